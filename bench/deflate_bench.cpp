@@ -0,0 +1,164 @@
+// compresses broadcast chunks with web_server::deflate_message, like each station does once per chunk with PERMESSAGE_DEFLATE,
+// and prints the compression ratio and the time per compressed chunk, for the audio and the metadata messages
+// the chunks are made from the Ogg/Opus files given, in the same JSON as audio_server::broadcast_chunk (nlohmann's dump, keys sorted)
+#include "../src/header/web_server/permessage_deflate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr int BROADCAST_INTERVAL_MS = 3000; // as in web_server.h
+constexpr int OPUS_SAMPLE_RATE_KHZ = 48;
+
+struct ogg_page {
+  std::string_view buff{};
+  uint64_t duration{}; // ms
+};
+
+auto read_pages(const std::string &file) -> std::vector<std::string> { // the whole pages, the first 2 are the headers and aren't broadcast
+  std::ifstream input(file, std::ios::binary);
+  const std::string data{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+  std::vector<std::string> pages{};
+  size_t offset = 0;
+  while (offset + 27 <= data.size() && data.compare(offset, 4, "OggS") == 0) {
+    const auto num_segments = static_cast<uint8_t>(data[offset + 26]);
+    size_t length = 27 + num_segments;
+    for (size_t i = 0; i < num_segments && offset + 27 + i < data.size(); i++) {
+      length += static_cast<uint8_t>(data[offset + 27 + i]);
+    }
+    if (offset + length > data.size()) {
+      break;
+    }
+    pages.push_back(data.substr(offset, length));
+    offset += length;
+  }
+  return pages;
+}
+
+auto granule_position(const std::string &page) -> uint64_t {
+  uint64_t position = 0;
+  for (int i = 7; i >= 0; i--) {
+    position = (position << 8) | static_cast<uint8_t>(page[6 + i]);
+  }
+  return position;
+}
+
+auto chunk_json(const std::vector<ogg_page> &pages, uint64_t duration, uint64_t start_offset, uint64_t sequence) -> std::string {
+  std::string json = "{\"duration\":" + std::to_string(duration) + ",\"pages\":[";
+  for (size_t i = 0; i < pages.size(); i++) {
+    json += i == 0 ? "{\"buff\":[" : ",{\"buff\":[";
+    for (size_t j = 0; j < pages[i].buff.size(); j++) {
+      json += (j == 0 ? "" : ",") + std::to_string(static_cast<int>(static_cast<signed char>(pages[i].buff[j]))); // a std::vector<char>
+    }
+    json += "],\"duration\":" + std::to_string(pages[i].duration) + "}";
+  }
+  return json + "],\"seq\":" + std::to_string(sequence) + ",\"start_offset\":" + std::to_string(start_offset) + "}";
+}
+
+auto metadata_json(uint64_t duration, uint64_t start_offset, uint64_t total_length, uint64_t sequence, const std::string &title) -> std::string {
+  return "{\"dropped_chunks\":0,\"duration\":" + std::to_string(duration) + ",\"num_listeners\":12,\"seq\":" + std::to_string(sequence) + ",\"skipped_track\":false,\"start_offset\":" +
+         std::to_string(start_offset) + ",\"title\":\"" + title + "\",\"total_length\":" + std::to_string(total_length) + "}";
+}
+
+struct result {
+  size_t messages{};
+  size_t bytes{};
+  size_t compressed_bytes{};
+  std::vector<double> times{}; // us per message
+};
+
+void compress_all(const std::vector<std::string> &messages, result &totals, int repeats) {
+  std::string compressed{};
+  std::vector<char> inflated{};
+  for (const auto &message : messages) {
+    double best = 1e18;
+    for (int i = 0; i < repeats; i++) { // the best of a few, so a preemption doesn't count
+      const auto start = std::chrono::steady_clock::now();
+      if (!web_server::deflate_message(message, compressed)) {
+        std::printf("deflate_message failed\n");
+        return;
+      }
+      const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    if (!web_server::inflate_message(compressed, inflated, message.size()) || std::string_view(inflated.data(), inflated.size()) != message) {
+      std::printf("the compressed message doesn't inflate back to the message\n");
+      return;
+    }
+    totals.messages++;
+    totals.bytes += message.size();
+    totals.compressed_bytes += compressed.size();
+    totals.times.push_back(best);
+  }
+}
+
+void print(const char *name, result &totals) {
+  if (totals.times.empty()) {
+    return;
+  }
+  std::sort(totals.times.begin(), totals.times.end());
+  double sum = 0;
+  for (const auto time : totals.times) {
+    sum += time;
+  }
+  std::printf("%-9s %6zu %12.1f KiB %9.1f%% %10.1f us %10.1f us %10.1f MB/s\n", name, totals.messages, totals.bytes / 1024.0 / totals.messages, 100.0 * totals.compressed_bytes / totals.bytes,
+              totals.times[totals.times.size() / 2], sum / totals.times.size(), totals.bytes / sum);
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <file.opus>...\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> audio_messages{}, metadata_messages{};
+  uint64_t sequence = 0;
+  for (int arg = 1; arg < argc; arg++) {
+    const auto pages = read_pages(argv[arg]);
+    if (pages.size() < 3) {
+      std::fprintf(stderr, "%s isn't an Ogg file\n", argv[arg]);
+      return 1;
+    }
+
+    uint64_t total_length = 0;
+    for (size_t i = 2; i < pages.size(); i++) {
+      total_length += (granule_position(pages[i]) - granule_position(pages[i - 1])) / OPUS_SAMPLE_RATE_KHZ;
+    }
+
+    std::string title = argv[arg];
+    title = title.substr(title.rfind('/') + 1);
+    title = title.substr(0, title.rfind('.'));
+
+    std::vector<ogg_page> chunk{};
+    uint64_t duration = 0, start_offset = 0;
+    for (size_t i = 2; i < pages.size(); i++) { // chunks of at least BROADCAST_INTERVAL_MS, like audio_server::read_and_process_file
+      const auto page_duration = (granule_position(pages[i]) - granule_position(pages[i - 1])) / OPUS_SAMPLE_RATE_KHZ;
+      chunk.push_back({pages[i], page_duration});
+      duration += page_duration;
+      if (duration >= BROADCAST_INTERVAL_MS || i + 1 == pages.size()) {
+        audio_messages.push_back(chunk_json(chunk, duration, start_offset, sequence));
+        metadata_messages.push_back(metadata_json(duration, start_offset, total_length, sequence, title));
+        sequence++;
+        start_offset += duration;
+        duration = 0;
+        chunk.clear();
+      }
+    }
+  }
+
+  result audio{}, metadata{};
+  compress_all(audio_messages, audio, 5);
+  compress_all(metadata_messages, metadata, 50);
+
+  std::printf("%-9s %6s %16s %10s %13s %13s %15s\n", "message", "count", "average size", "deflated", "p50 time", "mean time", "throughput");
+  print("audio", audio);
+  print("metadata", metadata);
+  return audio.messages == audio_messages.size() && metadata.messages == metadata_messages.size() ? 0 : 1;
+}
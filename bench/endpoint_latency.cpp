@@ -0,0 +1,119 @@
+// times /station_list, /audio_list/<station> and /audio_queue/<station> on a running server over loopback, and prints the
+// p50/p99 of each, each request is a new connection like the page's fetches, optionally while other clients keep the server busy
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+auto get(int port, const std::string &path) -> bool { // the whole response, the server closes the connection after it
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return false;
+  }
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  const std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+  bool ok = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 && send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size());
+
+  char buff[16384];
+  size_t received = 0;
+  ssize_t result = 0;
+  while (ok && (result = recv(fd, buff, sizeof(buff), 0)) > 0) {
+    if (received == 0 && (result < 12 || std::string(buff, 12) != "HTTP/1.0 200" && std::string(buff, 12) != "HTTP/1.1 200")) {
+      ok = false;
+    }
+    received += result;
+  }
+  close(fd);
+  return ok && result == 0 && received > 0;
+}
+
+auto percentile(std::vector<double> &samples, double p) -> double {
+  const size_t idx = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+  return samples[idx];
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: %s <port> <station> [requests per endpoint, 2000] [busy clients, 0]\n", argv[0]);
+    return 1;
+  }
+  const int port = std::atoi(argv[1]);
+  const std::string station = argv[2];
+  const int requests = argc > 3 ? std::atoi(argv[3]) : 2000;
+  const int busy_clients = argc > 4 ? std::atoi(argv[4]) : 0;
+  const std::vector<std::string> paths{"/station_list", "/audio_list/" + station, "/audio_queue/" + station};
+
+  std::atomic<bool> running{true};
+  std::atomic<size_t> busy_requests{0};
+  std::vector<std::thread> busy{};
+  for (int i = 0; i < busy_clients; i++) { // the same endpoints, as fast as they're answered
+    busy.emplace_back([&, i] {
+      for (size_t n = i; running.load(std::memory_order_relaxed); n++) {
+        get(port, paths[n % paths.size()]);
+        busy_requests.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  std::printf("%d requests each, %d busy clients\n", requests, busy_clients);
+  std::printf("%-28s %10s %10s %10s\n", "endpoint", "p50 us", "p99 us", "max us");
+  int failures = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto &path : paths) {
+    for (int i = 0; i < requests / 10; i++) { // warm up
+      get(port, path);
+    }
+
+    std::vector<double> samples{};
+    samples.reserve(requests);
+    for (int i = 0; i < requests; i++) {
+      const auto request_start = std::chrono::steady_clock::now();
+      if (!get(port, path)) {
+        failures++;
+        continue;
+      }
+      const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - request_start;
+      samples.push_back(elapsed.count());
+    }
+    if (samples.empty()) {
+      std::printf("%-28s all failed\n", path.c_str());
+      continue;
+    }
+    const auto max = *std::max_element(samples.begin(), samples.end());
+    const auto p50 = percentile(samples, 0.5);
+    const auto p99 = percentile(samples, 0.99);
+    std::printf("%-28s %10.1f %10.1f %10.1f\n", path.c_str(), p50, p99, max);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  running = false;
+  for (auto &thread : busy) {
+    thread.join();
+  }
+  if (busy_clients > 0) {
+    std::printf("busy clients: %.0f requests/s\n", busy_requests.load() / elapsed.count());
+  }
+  if (failures > 0) {
+    std::printf("%d requests failed\n", failures);
+  }
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+// listeners joining and leaving a station on a running server, like page loads: each client connects to the station's
+// WebSocket, reads the first message (the fast start) and closes, over and over, every join and leave is a message between a
+// server thread and the central thread, so run the server with MAILBOX_STATS: yes to see how they're batched
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+auto recv_at_least(int fd, std::string &buffer, size_t length) -> bool {
+  char buff[16384];
+  while (buffer.size() < length) {
+    const auto result = recv(fd, buff, sizeof(buff), 0);
+    if (result <= 0) {
+      return false;
+    }
+    buffer.append(buff, result);
+  }
+  return true;
+}
+
+auto join_and_leave(int port, const std::string &path) -> bool {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return false;
+  }
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  const timeval timeout{2, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  const std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+  std::string buffer{};
+  bool ok = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 && send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size());
+
+  size_t header_end = std::string::npos;
+  while (ok && (header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    ok = recv_at_least(fd, buffer, buffer.size() + 1);
+  }
+  ok = ok && buffer.compare(0, 12, "HTTP/1.1 101") == 0;
+
+  if (ok) { // the first frame's header, and then its payload
+    size_t offset = header_end + 4;
+    ok = recv_at_least(fd, buffer, offset + 2);
+    uint64_t length = ok ? static_cast<uint8_t>(buffer[offset + 1]) & 0x7F : 0;
+    size_t header_length = 2 + (length == 126 ? 2 : (length == 127 ? 8 : 0));
+    ok = ok && recv_at_least(fd, buffer, offset + header_length);
+    if (ok && header_length > 2) {
+      length = 0;
+      for (size_t i = 2; i < header_length; i++) {
+        length = (length << 8) | static_cast<uint8_t>(buffer[offset + i]);
+      }
+    }
+    ok = ok && recv_at_least(fd, buffer, offset + header_length + length);
+  }
+  close(fd);
+  return ok;
+}
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: %s <port> <station> [clients, 8] [seconds, 20]\n", argv[0]);
+    return 1;
+  }
+  const int port = std::atoi(argv[1]);
+  const std::string station = argv[2];
+  const int clients = argc > 3 ? std::atoi(argv[3]) : 8;
+  const int seconds = argc > 4 ? std::atoi(argv[4]) : 20;
+  const std::vector<std::string> paths{"/ws/radio/" + station + "/audio_broadcast", "/ws/radio/" + station + "/metadata_only"}; // what the page opens
+
+  std::atomic<size_t> joins{0}, failures{0};
+  const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  std::vector<std::thread> threads{};
+  for (int i = 0; i < clients; i++) {
+    threads.emplace_back([&, i] {
+      for (size_t n = i; std::chrono::steady_clock::now() < end; n++) {
+        if (join_and_leave(port, paths[n % paths.size()])) {
+          joins.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          failures.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::printf("%d clients: %.0f joins/s, %zu failed\n", clients, static_cast<double>(joins.load()) / seconds, failures.load());
+  return failures.load() > 0 ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+// ping-pongs between two threads, each waiting on its own io_uring like the server and central threads do, and prints the
+// latency per hop of waking the other thread with msg_ring::send (IORING_OP_MSG_RING) against writing to an eventfd which
+// the other thread keeps an io_uring read outstanding on
+#include "../src/header/msg_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+constexpr int ROUND_TRIPS = 100000;
+constexpr int WARM_UP = 1000;
+
+struct side {
+  io_uring ring{};
+  int efd = -1;
+  eventfd_t efd_value{};
+};
+
+void read_efd(side &self) { // what add_event_read_req does for the server's eventfds
+  auto *sqe = io_uring_get_sqe(&self.ring);
+  io_uring_prep_read(sqe, self.efd, &self.efd_value, sizeof(self.efd_value), 0);
+  io_uring_sqe_set_data64(sqe, 0);
+  io_uring_submit(&self.ring);
+}
+
+void wait_for_wake_up(side &self, bool use_msg_ring) {
+  while (true) {
+    io_uring_cqe *cqe = nullptr;
+    if (io_uring_wait_cqe(&self.ring, &cqe) != 0) {
+      continue;
+    }
+    const auto data = cqe->user_data;
+    io_uring_cqe_seen(&self.ring, cqe);
+    if (msg_ring::is_message(data) && msg_ring::kind_of(data) == msg_ring::kind::SEND_FAILED) {
+      msg_ring::send_failed(data);
+      continue;
+    }
+    if (!use_msg_ring) {
+      read_efd(self); // rearmed for the next one, like the server does
+    }
+    return;
+  }
+}
+
+void wake(side &other, bool use_msg_ring) {
+  if (use_msg_ring) {
+    msg_ring::send(other.ring.ring_fd, msg_ring::kind::NOTIFICATION, 0, 0, other.efd);
+  } else {
+    eventfd_write(other.efd, 1);
+  }
+}
+
+auto ping_pong(bool use_msg_ring, std::vector<double> &hops) -> bool { // hops in ns, half of each round trip
+  side ping{}, pong{};
+  for (auto *s : {&ping, &pong}) {
+    if (io_uring_queue_init(64, &s->ring, 0) != 0) {
+      return false;
+    }
+    s->efd = eventfd(0, EFD_CLOEXEC);
+  }
+
+  std::atomic<bool> ready{false};
+  std::thread other([&] {
+    msg_ring::set_thread_ring(&pong.ring);
+    read_efd(pong); // the eventfd read is always outstanding, msg_ring falls back to it
+    ready = true;
+    for (int i = 0; i < WARM_UP + ROUND_TRIPS; i++) {
+      wait_for_wake_up(pong, use_msg_ring);
+      wake(ping, use_msg_ring);
+    }
+  });
+
+  msg_ring::set_thread_ring(&ping.ring);
+  read_efd(ping);
+  while (!ready) {
+    std::this_thread::yield();
+  }
+
+  hops.clear();
+  hops.reserve(ROUND_TRIPS);
+  for (int i = 0; i < WARM_UP + ROUND_TRIPS; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    wake(pong, use_msg_ring);
+    wait_for_wake_up(ping, use_msg_ring);
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    if (i >= WARM_UP) {
+      hops.push_back(elapsed.count() / 2);
+    }
+  }
+  other.join();
+
+  for (auto *s : {&ping, &pong}) {
+    io_uring_queue_exit(&s->ring);
+    close(s->efd);
+  }
+  return true;
+}
+
+void print(const char *name, std::vector<double> &hops) {
+  std::sort(hops.begin(), hops.end());
+  double sum = 0;
+  for (const auto hop : hops) {
+    sum += hop;
+  }
+  std::printf("%-10s %10.2f us %10.2f us %10.2f us\n", name, hops[hops.size() / 2] / 1000, hops[hops.size() * 99 / 100] / 1000, sum / hops.size() / 1000);
+}
+} // namespace
+
+auto main() -> int {
+  std::vector<double> eventfd_hops{}, msg_ring_hops{};
+  if (!ping_pong(false, eventfd_hops)) {
+    std::printf("couldn't set up io_uring\n");
+    return 1;
+  }
+  std::printf("%-10s %13s %13s %13s\n", "per hop", "p50", "p99", "mean");
+  print("eventfd", eventfd_hops);
+
+  if (!msg_ring::enable()) {
+    std::printf("IORING_OP_MSG_RING isn't supported by this kernel\n");
+    return 1;
+  }
+  ping_pong(true, msg_ring_hops);
+  print("msg_ring", msg_ring_hops);
+  return 0;
+}
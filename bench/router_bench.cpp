@@ -0,0 +1,235 @@
+// times the compile-time router and MIME table against the strtok_r if-chains they replaced in get_process and
+// get_content_type, over the paths the page requests, and checks both pick the same route and content type for each
+#include "../src/header/web_server/mime_types.h"
+#include "../src/header/web_server/router.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+enum route_id { WEBSOCKET, SKIP_TRACK, AUDIO_LIST, AUDIO_REQ, BROADCAST_METADATA, STATION_LIST, AUDIO_QUEUE, LISTEN, STREAM, PUBLIC_FILE };
+
+// what get_process used to do, up to calling the handler, the handlers took std::strings, with /stream/ as it would have been added
+auto old_get_process(const std::string &path, bool websocket, std::vector<std::string> &subdirs) -> route_id {
+  char *path_temp = strdup(path.c_str());
+
+  char *saveptr = nullptr;
+  char *token = strtok_r(path_temp, "/", &saveptr);
+  std::string subdir = token != nullptr ? token : "";
+
+  if (subdir == "ws" && websocket) {
+    free(path_temp);
+    return WEBSOCKET;
+  }
+
+  subdirs.clear();
+  while ((token = strtok_r(nullptr, "/", &saveptr)) != nullptr) {
+    subdirs.emplace_back(token);
+  }
+  free(path_temp);
+
+  if (subdir == "skip_track" && subdirs.size() == 1) {
+    return SKIP_TRACK;
+  }
+  if (subdir == "audio_list" && subdirs.size() == 1) {
+    return AUDIO_LIST;
+  }
+  if (subdir == "audio_req" && subdirs.size() == 2) {
+    return AUDIO_REQ;
+  }
+  if (subdir == "broadcast_metadata" && subdirs.empty()) {
+    return BROADCAST_METADATA;
+  }
+  if (subdir == "station_list" && subdirs.empty()) {
+    return STATION_LIST;
+  }
+  if (subdir == "audio_queue" && subdirs.size() == 1) {
+    return AUDIO_QUEUE;
+  }
+  if (subdir == "stream" && subdirs.size() == 1) {
+    return STREAM;
+  }
+  if (subdir == "listen") {
+    return LISTEN;
+  }
+  return PUBLIC_FILE;
+}
+
+// what get_content_type used to do, including writing into the path through c_str()
+auto old_get_content_type(const std::string &filepath) -> std::string {
+  char *file_extension_data = (char *)filepath.c_str();
+  std::string file_extension;
+  char *saveptr = nullptr;
+  while ((file_extension_data = strtok_r(file_extension_data, ".", &saveptr)) != nullptr) {
+    file_extension = file_extension_data;
+    file_extension_data = nullptr;
+  }
+
+  if (file_extension == "html" || file_extension == "htm") {
+    return "Content-Type: text/html\r\n";
+  }
+  if (file_extension == "css") {
+    return "Content-Type: text/css\r\n";
+  }
+  if (file_extension == "js") {
+    return "Content-Type: text/javascript\r\n";
+  }
+  if (file_extension == "opus") {
+    return "Content-Type: audio/opus\r\n";
+  }
+  if (file_extension == "mp3") {
+    return "Content-Type: audio/mpeg\r\n";
+  }
+  if (file_extension == "mp4") {
+    return "Content-Type: video/mp4\r\n";
+  }
+  if (file_extension == "gif") {
+    return "Content-Type: image/gif\r\n";
+  }
+  if (file_extension == "png") {
+    return "Content-Type: image/png\r\n";
+  }
+  if (file_extension == "jpg" || file_extension == "jpeg") {
+    return "Content-Type: image/jpeg\r\n";
+  }
+  if (file_extension == "txt") {
+    return "Content-Type: text/plain\r\n";
+  }
+  if (file_extension == "wasm") {
+    return "Content-Type: application/wasm\r\n";
+  }
+  return "Content-Type: application/octet-stream\r\n";
+}
+
+using route_handler = route_id (*)(const web_server::path_params &params);
+
+// the same table as get_process, with handlers which only say which route they are
+constexpr auto routes = web_server::make_router<route_handler>({
+    {"ws/*", [](const web_server::path_params &) { return WEBSOCKET; }},
+    {"skip_track/{station}", [](const web_server::path_params &) { return SKIP_TRACK; }},
+    {"audio_list/{station}", [](const web_server::path_params &) { return AUDIO_LIST; }},
+    {"audio_req/{station}/{track}", [](const web_server::path_params &) { return AUDIO_REQ; }},
+    {"broadcast_metadata", [](const web_server::path_params &) { return BROADCAST_METADATA; }},
+    {"station_list", [](const web_server::path_params &) { return STATION_LIST; }},
+    {"audio_queue/{station}", [](const web_server::path_params &) { return AUDIO_QUEUE; }},
+    {"listen/*", [](const web_server::path_params &) { return LISTEN; }},
+    {"stream/{station}", [](const web_server::path_params &) { return STREAM; }},
+});
+
+auto new_get_process(std::string_view path, bool websocket, web_server::path_params &params) -> route_id {
+  const auto split = web_server::split_path(path);
+  params = split.params;
+  if (const auto *route = routes.find(split.first_segment, split.params.size())) {
+    const auto id = route->handler(split.params);
+    return id == WEBSOCKET && !websocket ? PUBLIC_FILE : id;
+  }
+  return PUBLIC_FILE;
+}
+
+struct request_path {
+  std::string path{};
+  bool websocket = false;
+};
+
+template <typename F>
+auto time_per_call(F &&call, size_t count) -> double { // in nanoseconds, per item
+  const size_t iterations = 2000000 / count + 1;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    call();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(iterations * count);
+}
+} // namespace
+
+auto main() -> int {
+  const std::vector<request_path> paths{
+      {"/"},
+      {"/listen/lofi"},
+      {"/station_list"},
+      {"/audio_list/lofi"},
+      {"/audio_queue/lofi"},
+      {"/skip_track/lofi"},
+      {"/audio_req/lofi/purrple-cat-midnight-snack"},
+      {"/broadcast_metadata"},
+      {"/stream/lofi.opus"},
+      {"/ws/radio/lofi/audio", true},
+      {"/ws/mux", true},
+      {"/assets/index.js"},
+      {"/assets/styles.css"},
+      {"/favicon-32x32.png"},
+      {"/site.webmanifest"},
+      {"/nothing/here/at/all"},
+  };
+
+  const std::vector<std::string> files{
+      "public/index.html", "public/assets/index.js", "public/assets/styles.css", "public/favicon-32x32.png", "public/assets/background.jpg", "public/assets/audio/aerohead-lost-memories.opus", "public/assets/silence.mp3", "public/wasm_audio/decoder.wasm", "public/site.webmanifest", "public/404.html",
+  };
+
+  int mismatches = 0;
+  std::vector<std::string> subdirs{};
+  web_server::path_params params{};
+  for (const auto &request : paths) {
+    if (old_get_process(request.path, request.websocket, subdirs) != new_get_process(request.path, request.websocket, params)) {
+      std::printf("route mismatch for %s\n", request.path.c_str());
+      mismatches++;
+    }
+  }
+  for (const auto &file : files) {
+    const std::string copy = file; // the old one writes into it
+    const auto old_type = old_get_content_type(copy);
+    const auto new_type = web_server::get_content_type(file);
+    // the old table had no webmanifest, so that one is expected to differ
+    if (old_type != new_type && file.find("webmanifest") == std::string::npos) {
+      std::printf("content type mismatch for %s\n", file.c_str());
+      mismatches++;
+    }
+  }
+
+  const auto old_routing = time_per_call(
+      [&] {
+        for (const auto &request : paths) {
+          auto id = old_get_process(request.path, request.websocket, subdirs);
+          asm volatile("" : : "r"(id), "r"(subdirs.data()) : "memory");
+        }
+      },
+      paths.size());
+  const auto new_routing = time_per_call(
+      [&] {
+        for (const auto &request : paths) {
+          auto id = new_get_process(request.path, request.websocket, params);
+          asm volatile("" : : "r"(id), "r"(&params) : "memory");
+        }
+      },
+      paths.size());
+
+  std::vector<std::string> file_copies = files;
+  const auto old_mime = time_per_call(
+      [&] {
+        for (size_t i = 0; i < files.size(); i++) {
+          file_copies[i] = files[i]; // strtok_r replaces the dots, so it's given a fresh copy each time
+          auto type = old_get_content_type(file_copies[i]);
+          asm volatile("" : : "r"(type.data()) : "memory");
+        }
+      },
+      files.size());
+  const auto new_mime = time_per_call(
+      [&] {
+        for (size_t i = 0; i < files.size(); i++) {
+          file_copies[i] = files[i]; // the same copy, so only the lookups differ
+          auto type = web_server::get_content_type(file_copies[i]);
+          asm volatile("" : : "r"(type.data()) : "memory");
+        }
+      },
+      files.size());
+
+  std::printf("%-22s %12s %12s\n", "", "if-chain", "table");
+  std::printf("%-22s %9.1f ns %9.1f ns\n", "route, per path", old_routing, new_routing);
+  std::printf("%-22s %9.1f ns %9.1f ns\n", "content type, per file", old_mime, new_mime);
+  return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+// times web_server::unmask_ws_payload against the byte at a time loop it replaced, and checks they give the same payload
+#include "../src/header/web_server/ws_unmask.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+void unmask_bytes(char *payload, size_t length, const char *masking_key) { // what decode_ws_frame used to do
+  for (size_t i = 0; i < length; i++) {
+    payload[i] ^= masking_key[i & 3];
+  }
+}
+
+template <typename F>
+auto time_per_call(F &&unmask, char *payload, size_t length, const char *masking_key) -> double { // in nanoseconds
+  const size_t iterations = std::max<size_t>(16, (256 * 1024 * 1024) / length); // about 256 MiB each
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    unmask(payload, length, masking_key);
+    asm volatile("" : : "r"(payload) : "memory"); // so the loop isn't optimised away
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+void print_time(double ns) {
+  if (ns < 1000) {
+    std::printf("%9.1f ns", ns);
+  } else if (ns < 1000 * 1000) {
+    std::printf("%9.2f us", ns / 1000);
+  } else {
+    std::printf("%9.2f ms", ns / (1000 * 1000));
+  }
+}
+} // namespace
+
+auto main() -> int {
+  std::mt19937 generator{42};
+  const char masking_key[4] = {'\x3a', '\x7f', '\x01', '\xc4'};
+
+  for (size_t length = 0; length <= 100; length++) { // every tail length, at each misalignment
+    for (size_t offset = 0; offset < 3; offset++) {
+      std::vector<char> expected(length + offset), actual{};
+      for (auto &byte : expected) {
+        byte = static_cast<char>(generator());
+      }
+      actual = expected;
+      unmask_bytes(expected.data() + offset, length, masking_key);
+      web_server::unmask_ws_payload(actual.data() + offset, length, masking_key);
+      if (expected != actual) {
+        std::printf("mismatch at %zu bytes, offset %zu\n", length, offset);
+        return 1;
+      }
+    }
+  }
+
+  std::printf("%10s %12s %12s %9s\n", "payload", "byte loop", "unmask", "speedup");
+  for (size_t length = 16; length <= 1024 * 1024; length *= 4) {
+    std::vector<char> payload(length + 1);
+    for (auto &byte : payload) {
+      byte = static_cast<char>(generator());
+    }
+    char *start = payload.data() + 1; // frames start after a 2-14 byte header, so it's never aligned
+
+    const auto bytes = time_per_call(unmask_bytes, start, length, masking_key);
+    const auto vector = time_per_call(web_server::unmask_ws_payload, start, length, masking_key);
+    std::printf("%8zu B ", length);
+    print_time(bytes);
+    std::printf(" ");
+    print_time(vector);
+    std::printf(" %8.1fx\n", bytes / vector);
+  }
+  return 0;
+}
@@ -1,5 +1,5 @@
 export CXX=/usr/bin/clang++
-SOURCE_FILES=$(find . -type d \( -path ./build -o -path ./src/vendor -o -path ./wasm_audio \) -prune -false -o \( -name *.cpp -o -name *.tcc -o -name *.h \) | sed -E 's:\.\/src\/(.*):\1:g' | tr '\r\n' ' ')
+SOURCE_FILES=$(find . -type d \( -path ./build -o -path ./bench -o -path ./src/vendor -o -path ./wasm_audio \) -prune -false -o \( -name *.cpp -o -name *.tcc -o -name *.h \) | sed -E 's:\.\/src\/(.*):\1:g' | tr '\r\n' ' ')
 # above will go through all of the directories, except those specified, and find all .cpp, .h and .tcc files,
 # and make the output into a space separated string of paths
 cd src
@@ -518,9 +518,42 @@ window.addEventListener("load", () => {
   requestAnimationFrame(animationLoop);
 })
 
+///// control messages, sent over the metadata websocket rather than as separate HTTP requests
+
+const control_requests = {
+  next_id: 0,
+  pending: {} // id to resolve function
+};
+
+// resolves with the result (or the error) of the request, uses the HTTP endpoint if the websocket isn't open
+function control_request(type, fallback_url, extra = {}) {
+  const ws = audio_metadata.metadata_ws;
+  if (!ws || ws.readyState != WebSocket.OPEN)
+    return fetch(fallback_url).then(res => res.text());
+
+  const id = control_requests.next_id++;
+  ws.send(JSON.stringify({ id, type, ...extra }));
+  return new Promise(resolve => control_requests.pending[id] = resolve);
+}
+
+function handle_control_message(message) {
+  if (message.type == "queue_update") {
+    refresh_voted_for_stuff(message.result);
+  } else if (message.type == "list_update") {
+    set_station_tracks(message.result);
+  } else if (message.id in control_requests.pending) {
+    control_requests.pending[message.id](message.result ?? message.error);
+    delete control_requests.pending[message.id];
+  }
+}
+
 function start_metadata_connection() {
   let just_started = true;
   audio_metadata.metadata_ws = new WebSocket(`wss://${window.location.host}/ws/radio/${current_station_data.name}/metadata_only`)
+  audio_metadata.metadata_ws.onopen = () => {
+    audio_metadata.metadata_ws.send(JSON.stringify({ type: "subscribe", topics: ["queue", "list"] })); // pushed whenever they change
+    control_request("list", `/audio_list/${current_station_data.name}`).then(set_station_tracks);
+  }
   audio_metadata.metadata_ws.onmessage = msg => {
     if (msg.data == "INVALID_ENDPOINT" || msg.data == "INVALID_STATION") {
       if (msg.data == "INVALID_STATION") {
@@ -533,6 +566,11 @@ function start_metadata_connection() {
 
     metadata = JSON.parse(msg.data)
 
+    if (metadata.type) { // a control message, rather than the metadata for a chunk
+      handle_control_message(metadata);
+      return;
+    }
+
     if (metadata.start_offset == 0) { // if the same shows up twice, time isn't reset
       update_playing(metadata.title, metadata.total_length);
       refresh_voted_for_stuff(); // if for example the voting box is still open
@@ -575,19 +613,15 @@ const current_station_data = {
   name: window.localStorage.getItem("station")
 };
 
-function set_station(name) {
-  fetch(`/audio_list/${name}`).then(data => data.text()).then(res => {
-    current_station_data.tracks = res != "" ? res.split("/") : []
-    update_vote_modal()
-  })
+function set_station_tracks(list) {
+  current_station_data.tracks = list != "" ? list.split("/") : []
+  update_vote_modal()
+}
 
+function set_station(name) {
   current_station_data.name = name
   window.localStorage.setItem("station", name)
-
-  fetch(`/audio_list/${name}`).then(data => data.text()).then(text => {
-    const list = text.split("/");
-    current_station_data.tracks = list;
-  })
+  // the track list is fetched once the metadata connection for this station is open
 
   // force pause
   toggleAudio(true)
@@ -625,12 +659,10 @@ function refresh_voted_for_stuff(data = undefined) {
     }
   }
 
-  if (typeof data == "string" && data != "") {
+  if (typeof data == "string") {
     func_body(data);
   } else {
-    fetch(`/audio_queue/${current_station_data.name}`).then(res => res.text()).then(data => {
-      func_body(data);
-    })
+    control_request("queue", `/audio_queue/${current_station_data.name}`).then(func_body)
   }
 }
 
@@ -639,7 +671,7 @@ function update_vote_modal() {
 }
 
 function vote_for(track_name) {
-  fetch(`/audio_req/${current_station_data.name}/${track_name}`).then(res => res.text()).then(data => {
+  control_request("request", `/audio_req/${current_station_data.name}/${track_name}`, { track: track_name }).then(data => {
     if (data != "FAILURE")
       refresh_voted_for_stuff(data)
   })
@@ -648,7 +680,7 @@ function vote_for(track_name) {
 const skip_button = document.getElementById("skip_button");
 let pre_skip_gain_value = -1;
 skip_button.addEventListener('click', () => [
-  fetch(`/skip_track/${current_station_data.name}`).then(res => res.text()).then(data => {
+  control_request("skip", `/skip_track/${current_station_data.name}`).then(data => {
     if (data.indexOf("FAILURE") == 0) {
       successful_action_popup(data.replace("FAILURE:", "Failure: "), true)
     } else {
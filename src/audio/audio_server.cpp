@@ -2,6 +2,9 @@
 #include "../header/web_server/web_server.h"
 #include <chrono>
 #include <algorithm>
+#include <cstring>
+#include <endian.h>
+#include <strings.h>
 #include <sys/eventfd.h>
 #include "../vendor/json/single_include/nlohmann/json.hpp"
 
@@ -11,6 +14,10 @@ using json = nlohmann::json;
 std::vector<audio_server*> audio_server::audio_servers{};
 int audio_server::max_id = 0;
 std::unordered_map<std::string, int> audio_server::server_id_map{};
+bool audio_server::deflate_broadcasts = false;
+int audio_server::program_ring_fd = -1;
+size_t audio_server::ws_fragment_size = 0;
+cpu_placement::cpu_set audio_server::cpus{};
 int audio_server::active_instances = 0;
 
 audio_server::audio_server(std::string name, std::string dir_path){ // not thread safe
@@ -21,6 +28,8 @@ audio_server::audio_server(std::string name, std::string dir_path){ // not threa
   id = max_id++; // (also acts as an index into the vector below)
   audio_servers.push_back(this); // push to static vector
   server_id_map[audio_server_name] = id;
+  stream_writer = ogg_stream::writer(audio_server_name);
+  main_thread_state.stream_header = ogg_stream::response_header(audio_server_name);
 
   active_instances++; // used for shutdown
 
@@ -65,11 +74,26 @@ audio_server::audio_server(std::string name, std::string dir_path){ // not threa
   });
 }
 
+audio_server::audio_server(std::string name){ // not thread safe
+  if(web_server::basic_web_server<server_type::TLS>::instance_exists || web_server::basic_web_server<server_type::NON_TLS>::instance_exists)
+    utility::fatal_error("Audio servers must be initialised before web servers");
+
+  audio_server_name = utility::to_web_name(name);
+  id = max_id++;
+  audio_servers.push_back(this);
+  server_id_map[audio_server_name] = id;
+  stream_writer = ogg_stream::writer(audio_server_name);
+  main_thread_state.stream_header = ogg_stream::response_header(audio_server_name);
+}
+
 void audio_server::run(){
+  cpu_placement::pin_this_thread(cpus);
+
   // io_uring
   io_uring_cqe *cqe;
   std::memset(&ring, 0, sizeof(io_uring));
   io_uring_queue_init(QUEUE_DEPTH, &ring, 0); //no flags, setup the queue
+  msg_ring::set_thread_ring(&ring); // broadcasts are sent to the central thread on this ring
   
   // making sure it exits cleanly
   fd_read_req(kill_efd, audio_events::KILL);
@@ -82,6 +106,7 @@ void audio_server::run(){
   fd_read_req(file_ready_fd, audio_events::FILE_READY);
 
   fd_read_req(request_skip_fd, audio_events::REQUEST_SKIP);
+  fd_read_req(ingest_fd, audio_events::INGEST);
 
   // time stuff
   utility::set_timerfd_interval(timerfd, BROADCAST_INTERVAL_MS);
@@ -103,6 +128,12 @@ void audio_server::run(){
     if(ret < 0)
       break;
     
+    if(msg_ring::is_message(cqe->user_data)){ // only a broadcast which couldn't be posted to the central thread's ring
+      msg_ring::send_failed(cqe->user_data);
+      io_uring_cqe_seen(&ring, cqe);
+      continue;
+    }
+
     auto *req = reinterpret_cast<audio_req*>(cqe->user_data);
     switch(req->event){
       case audio_events::FILE_READY: {
@@ -127,7 +158,9 @@ void audio_server::run(){
       case audio_events::REQUEST_SKIP: {
         auto data = get_request_to_skip_data();
 
-        if(request_skip_ips.count(data.ip)){
+        if(live.active){
+          respond_to_request_to_skip("FAILURE:The station is live", data.client_idx, data.thread_id);
+        }else if(request_skip_ips.count(data.ip)){
           respond_to_request_to_skip("FAILURE:Can't vote twice on the same track", data.client_idx, data.thread_id);
         }else{
           request_skip_ips.insert(data.ip);
@@ -145,6 +178,14 @@ void audio_server::run(){
 
         fd_read_req(request_skip_fd, audio_events::REQUEST_SKIP);
         break;
+      }
+      case audio_events::INGEST: {
+        ingest_data data{};
+        while(ingest_queue.try_dequeue(data)) // the eventfd's count is however many were queued, so take all of them
+          ingest(std::move(data));
+
+        fd_read_req(ingest_fd, audio_events::INGEST);
+        break;
       }
   		case audio_events::INOTIFY_DIR_CHANGED: {
 
@@ -220,6 +261,7 @@ void audio_server::run(){
   close(notify_audio_list_available);
   close(audio_list_update);
   close(timerfd);
+  close(ingest_fd);
   io_uring_queue_exit(&ring);
 }
 
@@ -230,6 +272,15 @@ combined_data_chunk audio_server::get_broadcast_data(){
 }
 
 void audio_server::broadcast_routine(){
+  if(live.active){ // the playlist is paused while a source is live
+    if(live.chunks.size()){
+      broadcast_chunk(live.chunks.front(), true);
+      live.chunks.pop_front();
+      live.last_broadcast = std::chrono::steady_clock::now();
+    }
+    return;
+  }
+
   if(currently_processing_audio == "" && (std::chrono::system_clock::now() >= current_audio_finish_time - std::chrono::milliseconds(BROADCAST_INTERVAL_MS) || skip_track)){ // natural way to skip
     // if there are less than BROADCAST_INTERVAL_MS long till the end of this file, and nothing is currently being
     currently_processing_audio = get_requested_audio();
@@ -270,37 +321,112 @@ void audio_server::broadcast_routine(){
   if(chunks_of_audio.size()){
     auto chunk = chunks_of_audio.front();
     chunks_of_audio.pop_front();
+    broadcast_chunk(chunk);
+  }
+}
 
-    json data_pages{};
-    for(const auto &page : chunk.pages){
-      json data_page{};
-      data_page["duration"] = page.duration;
-      data_page["buff"] = page.buff;
-      data_pages.push_back(data_page);
-    }
+void audio_server::broadcast_chunk(const audio_chunk &chunk, bool live_chunk){
+  const auto sequence = chunk_sequence++;
 
-    json data_chunk{};
-    data_chunk["duration"] = chunk.duration;
-    data_chunk["pages"] = data_pages;
-    data_chunk["start_offset"] = chunk.start_offset;
+  json data_pages{};
+  for(const auto &page : chunk.pages){
+    json data_page{};
+    data_page["duration"] = page.duration;
+    data_page["buff"] = page.buff;
+    data_pages.push_back(data_page);
+  }
 
-    current_playback_time += std::chrono::milliseconds(chunk.duration); // increase it with each broadcast
-    
-    json metadata_only_chunk{};
-    metadata_only_chunk["duration"] = chunk.duration;
-    metadata_only_chunk["title"] = chunk.title;
-    metadata_only_chunk["start_offset"] = chunk.start_offset;
-    metadata_only_chunk["total_length"] = chunk.total_length;
-    metadata_only_chunk["num_listeners"] = num_listeners.load();
-    metadata_only_chunk["skipped_track"] = skipped_track_metadata_info;
-    skipped_track_metadata_info = false; // reset this signal to the default value
-    broadcast_to_central_server(data_chunk.dump(), metadata_only_chunk.dump(), chunk.title);
+  json data_chunk{};
+  data_chunk["duration"] = chunk.duration;
+  data_chunk["pages"] = data_pages;
+  data_chunk["start_offset"] = chunk.start_offset;
+  data_chunk["seq"] = sequence;
+
+  current_playback_time += std::chrono::milliseconds(chunk.duration); // increase it with each broadcast
+  
+  json metadata_only_chunk{};
+  metadata_only_chunk["duration"] = chunk.duration;
+  metadata_only_chunk["title"] = chunk.title;
+  metadata_only_chunk["start_offset"] = chunk.start_offset;
+  metadata_only_chunk["total_length"] = chunk.total_length;
+  metadata_only_chunk["num_listeners"] = num_listeners.load();
+  metadata_only_chunk["dropped_chunks"] = num_dropped_chunks.load();
+  metadata_only_chunk["skipped_track"] = skipped_track_metadata_info;
+  metadata_only_chunk["seq"] = sequence; // the same as the audio's, so the two can be matched up
+  skipped_track_metadata_info = false; // reset this signal to the default value
+  if(live_chunk)
+    metadata_only_chunk["live"] = true; // there's no end to it, total_length is only how long it's been live
+
+  std::vector<std::string_view> stream_pages{};
+  for(const auto &page : chunk.pages)
+    stream_pages.emplace_back(page.buff.data(), page.buff.size());
+
+  broadcast_to_central_server(data_chunk.dump(), metadata_only_chunk.dump(), chunk.title, sequence, stream_writer.make_chunk(stream_pages));
+}
+
+void audio_server::broadcast_to_central_server(std::string &&audio_data, std::string &&metadata_only, std::string track_name, uint64_t sequence, tcp_tls_server::shared_buffer &&stream_frame){
+  // the frames are made here rather than on the central thread, after that they're never copied
+  combined_data_chunk chunk(
+    web_server::make_shared_ws_frame(audio_data, web_server::websocket_non_control_opcodes::text_frame, false, ws_fragment_size),
+    web_server::make_shared_ws_frame(metadata_only, web_server::websocket_non_control_opcodes::text_frame, false, ws_fragment_size),
+    std::move(track_name)
+  );
+  chunk.sequence = sequence;
+  chunk.stream_frame = std::move(stream_frame);
+  if(deflate_broadcasts){ // compressed once here, every listener with permessage-deflate gets the same frame
+    chunk.audio_deflated_frame = web_server::make_shared_deflated_ws_frame(audio_data, web_server::websocket_non_control_opcodes::text_frame, ws_fragment_size);
+    chunk.metadata_only_deflated_frame = web_server::make_shared_deflated_ws_frame(metadata_only, web_server::websocket_non_control_opcodes::text_frame, ws_fragment_size);
+  }
+
+  if(auto *ring = direct_ring.load(std::memory_order_acquire)){ // published from here, the central thread only needs the track name
+    publish_chunk(*ring, chunk);
+    ring->wake_readers();
+    chunk = combined_data_chunk({}, {}, std::move(chunk.track_name));
   }
+
+  broadcast_queue.emplace(std::move(chunk));
+  msg_ring::send(program_ring_fd, msg_ring::kind::AUDIO_SERVER, id, broadcast_fd, broadcast_fd); // with MSG_RING on, straight into the central thread's ring
 }
 
-void audio_server::broadcast_to_central_server(std::string &&audio_data, std::string &&metadata_only, std::string track_name){
-  broadcast_queue.emplace(std::move(audio_data), std::move(metadata_only), track_name);
-  eventfd_write(broadcast_fd, 1);
+void audio_server::publish_chunk(web_server::broadcast_ring &ring, const combined_data_chunk &chunk){
+  const auto publish = [&](web_server::channel_kind kind, const tcp_tls_server::shared_buffer &frame, const tcp_tls_server::shared_buffer &deflated_frame){
+    if(!ring.publish(web_server::broadcast_channel_id(id, kind), frame, deflated_frame, chunk.sequence)){
+      // a server thread is thousands of broadcasts behind, so this one is dropped for everyone rather than waiting on it
+      std::cerr << "Broadcast ring full, dropped a chunk on " << audio_server_name << std::endl;
+      num_dropped_chunks++;
+    }
+  };
+
+  std::lock_guard<std::mutex> lock(broadcast_state.lock);
+
+  // the frames were made on the audio thread, the backlogs and every thread's writes all share them
+  // with permessage-deflate there's a compressed frame as well, for websockets which negotiated it
+  if(chunk.audio_frame.length > 0){
+    broadcast_state.backlogs.push(web_server::channel_kind::audio_broadcast, chunk.audio_frame, chunk.audio_deflated_frame, chunk.sequence);
+
+    publish(web_server::channel_kind::audio_broadcast, chunk.audio_frame, chunk.audio_deflated_frame);
+
+    if(broadcast_state.num_tagged_audio_subscribers > 0){ // one tagged copy, for anything using /ws/mux
+      auto tagged_frame = web_server::make_tagged_ws_frame(audio_server_name, "audio", chunk.audio_frame, false, ws_fragment_size);
+      auto tagged_deflated_frame = deflate_broadcasts ? web_server::make_tagged_ws_frame(audio_server_name, "audio", chunk.audio_frame, true, ws_fragment_size) : tcp_tls_server::shared_buffer{};
+      publish(web_server::channel_kind::audio_tagged, tagged_frame, tagged_deflated_frame);
+    }
+  }
+
+  broadcast_state.backlogs.push(web_server::channel_kind::metadata_only, chunk.metadata_only_frame, chunk.metadata_only_deflated_frame, chunk.sequence);
+
+  publish(web_server::channel_kind::metadata_only, chunk.metadata_only_frame, chunk.metadata_only_deflated_frame);
+
+  if(broadcast_state.num_tagged_metadata_subscribers > 0){
+    auto tagged_frame = web_server::make_tagged_ws_frame(audio_server_name, "metadata", chunk.metadata_only_frame, false, ws_fragment_size);
+    auto tagged_deflated_frame = deflate_broadcasts ? web_server::make_tagged_ws_frame(audio_server_name, "metadata", chunk.metadata_only_frame, true, ws_fragment_size) : tcp_tls_server::shared_buffer{};
+    publish(web_server::channel_kind::metadata_tagged, tagged_frame, tagged_deflated_frame);
+  }
+
+  if(chunk.stream_frame.length > 0){ // the same HTTP chunk for every /stream/ listener
+    broadcast_state.backlogs.push(web_server::channel_kind::ogg_stream, chunk.stream_frame, {}, chunk.sequence);
+    publish(web_server::channel_kind::ogg_stream, chunk.stream_frame, {});
+  }
 }
 
 int audio_server::get_config_num(int num){
@@ -322,22 +448,28 @@ int audio_server::get_frame_duration_ms(int config) {
   }
 }
 
-audio_byte_length_duration audio_server::get_ogg_page_info(char *buff){ // gets the ogg page length and duration
-  uint8_t *segments_table = reinterpret_cast<uint8_t*>(&buff[27]);
+audio_byte_length_duration audio_server::get_ogg_page_info(const char *buff, size_t length){ // gets the ogg page length and duration
+  if(length < 27 || length < 27 + uint8_t(buff[26])) // cut off, so it's taken to be the rest of the buffer
+    return { 0, length };
+
+  const uint8_t *segments_table = reinterpret_cast<const uint8_t*>(&buff[27]);
   uint8_t segments_table_length = buff[26];
   uint32_t segments_total_length{};
-  uint8_t *segments = reinterpret_cast<uint8_t*>(&buff[27 + segments_table_length]);
+  const uint8_t *segments = reinterpret_cast<const uint8_t*>(&buff[27 + segments_table_length]);
+  const size_t segments_available = length - 27 - segments_table_length;
 
   time_t length_ms{};
   int16_t last_length_extended_page_segment = -1;
 
   for(int i = 0; i < segments_table_length; i++){
+    // live pages come from the network, so a packet's TOC byte is only read if it has one and it's in the page
+    const bool has_toc = segments_table[i] > 0 && segments_total_length < segments_available;
     if(segments_table[i] == 255){
-      last_length_extended_page_segment = get_frame_duration_ms(get_config_num(segments[segments_total_length]));
+      last_length_extended_page_segment = has_toc ? get_frame_duration_ms(get_config_num(segments[segments_total_length])) : 0;
     }else if(last_length_extended_page_segment != -1){
       length_ms += last_length_extended_page_segment;
       last_length_extended_page_segment = -1;
-    }else{
+    }else if(has_toc){
       length_ms += get_frame_duration_ms(get_config_num(segments[segments_total_length]));
     }
 
@@ -354,7 +486,7 @@ std::vector<audio_page_data> audio_server::get_audio_page_data(std::vector<char>
   int iter_num = 0;
   time_t duration = 0;
   while(read_head < buff.size()){
-    auto data = get_ogg_page_info(&buff[read_head]);
+    auto data = get_ogg_page_info(&buff[read_head], buff.size() - read_head);
 
     if(iter_num >= 2){
       page_vec.push_back({ std::vector<char>(&buff[read_head], &buff[read_head] + data.byte_length), data.duration });
@@ -379,6 +511,11 @@ void audio_server::process_audio(file_transfer_data &&data){
 
   // firstly get the most recent chunk from chunks_of_audio.pop_back(), get its length and see if you can append some on to the end of it to get a BROADCAST_INTERVAL_MS long chunk
   // then push that chunk, followed by the rest of the chunks
+  if(live.active){ // a live source took over while it was being read
+    currently_processing_audio = "";
+    return;
+  }
+
   auto audio_data = get_audio_page_data(std::move(data.data));
 
   int audio_data_idx = 0;
@@ -437,6 +574,116 @@ void audio_server::process_audio(file_transfer_data &&data){
   }
 }
 
+static std::string opus_tags_title(const char *payload, size_t length){ // TITLE= from an OpusTags packet's comments, empty if there isn't one
+  const auto read_length = [&](size_t offset, uint32_t &value){ // the lengths are little endian
+    if(offset + sizeof(value) > length)
+      return false;
+    std::memcpy(&value, payload + offset, sizeof(value));
+    value = le32toh(value);
+    return true;
+  };
+
+  uint32_t vendor_length{}, num_comments{};
+  if(!read_length(8, vendor_length) || !read_length(12 + size_t(vendor_length), num_comments))
+    return "";
+
+  size_t offset = 16 + size_t(vendor_length);
+  for(uint32_t i = 0; i < num_comments; i++){
+    uint32_t comment_length{};
+    if(!read_length(offset, comment_length) || offset + 4 + comment_length > length)
+      break;
+    const std::string_view comment(payload + offset + 4, comment_length);
+    offset += 4 + size_t(comment_length);
+    if(comment.size() > 6 && strncasecmp(comment.data(), "TITLE=", 6) == 0)
+      return std::string(comment.substr(6));
+  }
+  return "";
+}
+
+void audio_server::ingest(ingest_data &&data){
+  if(data.ended){
+    set_live(false);
+    broadcast_routine(); // asks for the next track straight away
+    return;
+  }
+  if(!live.active)
+    set_live(true);
+
+  auto &buffer = live.buffer;
+  buffer.insert(buffer.end(), data.data.begin(), data.data.end());
+
+  // the same pages as a file, but they can be split across messages, so a page is only used once all of it is here
+  size_t read_head = 0;
+  while(buffer.size() - read_head >= 27){ // the fixed part of a page header
+    if(std::memcmp(&buffer[read_head], "OggS", 4) != 0){ // not at a page (it started mid page, or some was dropped), so skip to the next one
+      constexpr std::string_view capture_pattern = "OggS";
+      const auto next = std::search(buffer.begin() + read_head + 1, buffer.end(), capture_pattern.begin(), capture_pattern.end());
+      read_head = next == buffer.end() ? buffer.size() - 3 : next - buffer.begin(); // the last 3 bytes could be the start of one
+      continue;
+    }
+
+    const size_t header_length = 27 + uint8_t(buffer[read_head + 26]);
+    if(buffer.size() - read_head < header_length)
+      break;
+    size_t page_length = header_length;
+    for(size_t i = read_head + 27; i < read_head + header_length; i++)
+      page_length += uint8_t(buffer[i]);
+    if(buffer.size() - read_head < page_length)
+      break; // the rest of it is in the next message
+
+    // the header pages aren't broadcast, like the first 2 pages of a file, but a new stream can bring a new title
+    const char *payload = &buffer[read_head + header_length];
+    const size_t payload_length = page_length - header_length;
+    if(payload_length >= 8 && std::memcmp(payload, "OpusHead", 8) == 0){
+      live.title = "Live";
+    }else if(payload_length >= 8 && std::memcmp(payload, "OpusTags", 8) == 0){
+      auto title = opus_tags_title(payload, payload_length);
+      if(!title.empty())
+        live.title = std::move(title);
+    }else{
+      const auto info = get_ogg_page_info(&buffer[read_head], page_length);
+      add_live_page({std::vector<char>(&buffer[read_head], &buffer[read_head] + page_length), info.duration});
+    }
+    read_head += page_length;
+  }
+  buffer.erase(buffer.begin(), buffer.begin() + read_head);
+}
+
+void audio_server::add_live_page(audio_page_data &&page){
+  live.chunk.insert_data(std::move(page));
+  if(live.chunk.duration < BROADCAST_INTERVAL_MS)
+    return;
+
+  live.chunk.title = live.title;
+  live.chunk.start_offset = live.elapsed;
+  live.elapsed += live.chunk.duration;
+  live.chunk.total_length = live.elapsed;
+  live.chunks.push_back(std::move(live.chunk));
+  live.chunk = {};
+
+  if(live.chunks.size() > MAX_LIVE_CHUNKS){ // it's sending faster than it plays, listeners would only fall further behind
+    live.chunks.pop_front();
+    std::cerr << "Live source on " << audio_server_name << " is ahead, dropped a chunk" << std::endl;
+  }
+
+  // sent straight away if it's keeping pace, so listeners are only as far behind as it takes to fill a chunk, otherwise the timer sends them
+  if(std::chrono::steady_clock::now() - live.last_broadcast >= std::chrono::milliseconds(BROADCAST_INTERVAL_MS / 2))
+    broadcast_routine();
+}
+
+void audio_server::set_live(bool active){
+  live.active = active;
+  live.buffer.clear();
+  live.chunk = {};
+  live.chunks.clear();
+  live.elapsed = 0;
+  live.title = "Live";
+
+  chunks_of_audio.clear();
+  current_audio_finish_time = std::chrono::system_clock::now(); // so the playlist starts on a new track when it's gone
+  std::cout << (active ? "Live source started on " : "Live source stopped on ") << audio_server_name << std::endl;
+}
+
 void audio_server::respond_with_file_list(){
   audio_file_list_data_queue.emplace(slash_separated_audio_list, true, audio_list); // we are updating with a new list and stuff
   eventfd_write(notify_audio_list_available, 1); // notify the main thread we've pushed something
@@ -547,6 +794,14 @@ request_skip_data audio_server::get_request_to_skip_data(){
   return data;
 }
 
+auto audio_server::submit_ingest(std::vector<char> &&data, bool ended) -> bool {
+  if(!ended && ingest_queue.size_approx() >= MAX_QUEUED_INGEST)
+    return false;
+  ingest_queue.emplace(ingest_data{std::move(data), ended});
+  eventfd_write(ingest_fd, 1);
+  return true;
+}
+
 request_skip_data audio_server::get_request_to_skip_response_data(){
   request_skip_data data{};
   request_to_skip_response_queue.try_dequeue(data);
@@ -10,9 +10,11 @@
 #include <sys/timerfd.h>
 
 #include <atomic>
+#include <mutex>
 
 #include "utility.h"
 #include "web_server/web_server.h"
+#include "web_server/ogg_stream.h"
 
 #include "../vendor/readerwriterqueue/atomicops.h"
 #include "../vendor/readerwriterqueue/readerwriterqueue.h"
@@ -42,9 +44,12 @@ struct audio_data {
 enum class audio_events {
 	AUDIO_BROADCAST_EVT, FILE_REQUEST, INOTIFY_DIR_CHANGED, AUDIO_LIST, AUDIO_LIST_UPDATE,
 	FILE_READY, AUDIO_REQUEST_FROM_PROGRAM, AUDIO_QUEUE, BROADCAST_TIMER, KILL,
-  REQUEST_SKIP
+  REQUEST_SKIP, INGEST
 };
 
+constexpr size_t MAX_LIVE_CHUNKS = 2; // a live source's chunks waiting to be broadcast, any more and the oldest is dropped
+constexpr size_t MAX_QUEUED_INGEST = 256; // messages from a live source waiting on the audio thread, any more are dropped
+
 static struct {
   std::array<float, 4> silkOnly{10, 20, 40, 60};
   std::array<float, 2> hybrid{10, 20};
@@ -99,14 +104,123 @@ struct audio_chunk {
   }
 };
 
-struct combined_data_chunk {
-  std::string audio_data{};
-  std::string metdata_only{};
+struct combined_data_chunk { // the websocket frames for the broadcast
+  tcp_tls_server::shared_buffer audio_frame{};
+  tcp_tls_server::shared_buffer metadata_only_frame{};
+  tcp_tls_server::shared_buffer audio_deflated_frame{}; // compressed versions for permessage-deflate, empty unless it's enabled
+  tcp_tls_server::shared_buffer metadata_only_deflated_frame{};
+  tcp_tls_server::shared_buffer stream_frame{}; // the pages as an HTTP chunk of the station's Ogg stream, for /stream/ listeners
   std::string track_name{};
-  combined_data_chunk(std::string &&audio_data, std::string &&metdata_only, std::string track_name) : audio_data{audio_data}, metdata_only{metdata_only}, track_name{track_name} {}
+  uint64_t sequence{}; // the chunk's place in the station's stream, so a relay can pick up where it left off
+  combined_data_chunk(tcp_tls_server::shared_buffer &&audio_frame, tcp_tls_server::shared_buffer &&metadata_only_frame, std::string track_name) : audio_frame{std::move(audio_frame)}, metadata_only_frame{std::move(metadata_only_frame)}, track_name{std::move(track_name)} {}
   combined_data_chunk() {}
 };
 
+class broadcast_backlog { // the last few broadcast frames of a channel, which new listeners are sent so they start with audio buffered
+  std::vector<tcp_tls_server::shared_buffer> frames = std::vector<tcp_tls_server::shared_buffer>(2);
+  std::vector<uint64_t> sequences = std::vector<uint64_t>(2); // each frame's chunk sequence number
+  size_t next{}; // where the next frame goes
+  size_t count{};
+public:
+  void set_capacity(size_t capacity){
+    frames.assign(std::max<size_t>(capacity, 1), {});
+    sequences.assign(frames.size(), 0);
+    next = 0;
+    count = 0;
+  }
+
+  void push(const tcp_tls_server::shared_buffer &frame, uint64_t sequence = 0){ // shares the frame with the broadcast, the oldest one is dropped once full
+    frames[next] = frame;
+    sequences[next] = sequence;
+    next = (next + 1) % frames.size();
+    count = std::min(count + 1, frames.size());
+  }
+
+  size_t size() const { return count; }
+  auto latest_sequence() const -> int64_t { return count == 0 ? -1 : static_cast<int64_t>(sequences[(next + frames.size() - 1) % frames.size()]); } // -1 if it's empty
+
+  template<typename F>
+  void for_each_recent(size_t num_frames, F &&callback) const { // the most recent num_frames frames, oldest first
+    num_frames = std::min(num_frames, count);
+    for(size_t i = num_frames; i > 0; i--)
+      callback(frames[(next + frames.size() - i) % frames.size()]);
+  }
+
+  template<typename F>
+  void for_each_after(uint64_t sequence, F &&callback) const { // every frame after the chunk sequence, oldest first
+    for(size_t i = count; i > 0; i--){
+      const auto idx = (next + frames.size() - i) % frames.size();
+      if(sequences[idx] > sequence)
+        callback(frames[idx]);
+    }
+  }
+};
+
+struct station_backlogs { // a backlog for each channel of a station that new listeners are sent one for
+  broadcast_backlog audio{}; // BACKLOG_CHUNKS long
+  broadcast_backlog metadata_only{};
+  broadcast_backlog audio_deflated{}; // the same chunks compressed, if deflate_broadcasts is set
+  broadcast_backlog metadata_only_deflated{};
+  broadcast_backlog stream{}; // the HTTP chunks, never compressed
+
+  void set_capacity(size_t capacity){
+    for(auto *backlog : {&audio, &metadata_only, &audio_deflated, &metadata_only_deflated, &stream})
+      backlog->set_capacity(capacity);
+  }
+
+  void push(web_server::channel_kind kind, const tcp_tls_server::shared_buffer &frame, const tcp_tls_server::shared_buffer &deflated_frame, uint64_t sequence){ // only the untagged chunks
+    if(kind == web_server::channel_kind::audio_broadcast){
+      audio.push(frame, sequence);
+      audio_deflated.push(deflated_frame, sequence);
+    }else if(kind == web_server::channel_kind::metadata_only){
+      metadata_only.push(frame, sequence);
+      metadata_only_deflated.push(deflated_frame, sequence);
+    }else if(kind == web_server::channel_kind::ogg_stream){
+      stream.push(frame, sequence);
+    }
+  }
+
+  // the most recent num_frames for the channel, oldest first, tagged frames are made from the uncompressed ones (and compressed after that if need be)
+  // with after_sequence it's every frame after that chunk instead, for a relay picking up where it left off
+  auto recent(web_server::channel_kind kind, bool deflate, size_t num_frames, int64_t after_sequence = -1) const -> std::vector<tcp_tls_server::shared_buffer> {
+    const broadcast_backlog *backlog = backlog_for(kind, deflate);
+
+    std::vector<tcp_tls_server::shared_buffer> frames{};
+    const auto add = [&](const tcp_tls_server::shared_buffer &frame){ frames.push_back(frame); };
+    if(backlog != nullptr && after_sequence >= 0)
+      backlog->for_each_after(after_sequence, add);
+    else if(backlog != nullptr)
+      backlog->for_each_recent(num_frames, add);
+    return frames;
+  }
+
+  auto latest_sequence(web_server::channel_kind kind) const -> int64_t { // the last chunk in the channel's backlog, -1 if there isn't one
+    const broadcast_backlog *backlog = backlog_for(kind, false);
+    return backlog != nullptr ? backlog->latest_sequence() : -1;
+  }
+
+private:
+  auto backlog_for(web_server::channel_kind kind, bool deflate) const -> const broadcast_backlog * {
+    const broadcast_backlog *backlog = nullptr;
+    if(kind == web_server::channel_kind::audio_broadcast)
+      backlog = deflate ? &audio_deflated : &audio;
+    else if(kind == web_server::channel_kind::metadata_only)
+      backlog = deflate ? &metadata_only_deflated : &metadata_only;
+    else if(kind == web_server::channel_kind::audio_tagged)
+      backlog = &audio;
+    else if(kind == web_server::channel_kind::metadata_tagged)
+      backlog = &metadata_only;
+    else if(kind == web_server::channel_kind::ogg_stream)
+      backlog = &stream;
+    return backlog;
+  }
+};
+
+struct ingest_data { // from the central thread, some of a live source's stream, or that it's gone
+  std::vector<char> data{};
+  bool ended = false;
+};
+
 struct audio_req_from_program {
 	int client_idx = -1;
 	std::string str_data{}; // either file name or response
@@ -163,16 +277,36 @@ class audio_server {
 
   moodycamel::ReaderWriterQueue<combined_data_chunk> broadcast_queue{}; // the audio data chunk and the metadata only chunk
 
+  moodycamel::ReaderWriterQueue<ingest_data> ingest_queue{};
+
+  // a live source on /ws/ingest takes over from the playlist until it disconnects, its pages are put into chunks as they come
+  struct {
+    bool active = false;
+    std::vector<char> buffer{}; // the start of a page, until the rest of it comes
+    audio_chunk chunk{}; // being filled
+    std::deque<audio_chunk> chunks{}; // filled, waiting to be broadcast
+    time_t elapsed{}; // since it went live, for the chunks' start_offset
+    std::string title{};
+    std::chrono::steady_clock::time_point last_broadcast{};
+  } live;
+
   std::string audio_server_name{};
   std::string dir_path = "";
 
   void broadcast_routine();
+  void broadcast_chunk(const audio_chunk &chunk, bool live_chunk = false);
   void process_audio(file_transfer_data &&data);
+
+  void ingest(ingest_data &&data); // parses whatever whole pages there are, resyncing on "OggS" if it has to
+  void add_live_page(audio_page_data &&page);
+  void set_live(bool active); // either way the playlist's chunks are dropped, so it starts on a new track afterwards
   
   std::string currently_processing_audio{}; // the name of the current file being processed - it is blank after processing
 
   std::chrono::system_clock::time_point current_audio_finish_time{};
   std::chrono::system_clock::time_point current_playback_time{}; // is relative to the actual system clock
+  // numbers each chunk broadcast, from the wall clock so it carries on increasing after a restart (for relays resuming with it)
+  uint64_t chunk_sequence = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() / BROADCAST_INTERVAL_MS;
 
   static std::vector<audio_server*> audio_servers;
 
@@ -182,7 +316,7 @@ class audio_server {
 
   int get_config_num(int num); // gets the config number from the number provided
   int get_frame_duration_ms(int config); // uses data in the first byte of each segment in a page to get the duration
-  audio_byte_length_duration get_ogg_page_info(char *buff); // gets the ogg page length and duration
+  audio_byte_length_duration get_ogg_page_info(const char *buff, size_t length); // gets the ogg page length and duration, reading nothing past length
   std::vector<audio_page_data> get_audio_page_data(std::vector<char> &&buff); // returns a vector of pointers for the pages along with their durations
 
   static int max_id;
@@ -194,12 +328,18 @@ class audio_server {
 public:
   audio_server(audio_server &&server) = delete;
   audio_server(std::string audio_server_name, std::string dir_path);
+  explicit audio_server(std::string audio_server_name); // a station relayed from an origin (RELAY in the config), with no audio thread, the central thread publishes its chunks
   int id = -1;
+  auto name() const -> const std::string & { return audio_server_name; }
 
   static std::unordered_map<std::string, int> server_id_map;
   static audio_server *instance(int id){ return audio_servers[id]; }
   static void audio_server_req_handler(int server_id, int event_fd);
   static std::vector<std::string> audio_server_names; // the names of the audio server are stored here
+  static bool deflate_broadcasts; // whether compressed frames are made for websockets with permessage-deflate, PERMESSAGE_DEFLATE in the config
+  static size_t ws_fragment_size; // broadcast frames larger than this are fragmented, WS_FRAGMENT_SIZE in the config, 0 to never fragment
+  static int program_ring_fd; // the central thread's ring, broadcasts are posted straight to it with MSG_RING in the config
+  static cpu_placement::cpu_set cpus; // what every audio thread is pinned to, from CPU_PLACEMENT/AUDIO_CPUS in the config
 
   void kill_server();
   int kill_efd = eventfd(0, 0);
@@ -234,8 +374,15 @@ public:
 	const int file_ready_fd = eventfd(0, 0);
   
   combined_data_chunk get_broadcast_data();
-  void broadcast_to_central_server(std::string &&audio_data, std::string &&metadata_only, std::string track_name);
+  void broadcast_to_central_server(std::string &&audio_data, std::string &&metadata_only, std::string track_name, uint64_t sequence, tcp_tls_server::shared_buffer &&stream_frame = {});
   const int broadcast_fd = eventfd(0, 0);
+  // adds the chunk to the backlogs and publishes it (and tagged copies if need be), on whichever thread the ring is published from
+  void publish_chunk(web_server::broadcast_ring &ring, const combined_data_chunk &chunk);
+  // with DIRECT_BROADCASTS, the central thread sets this to the station's ring once every server thread is reading it, after that
+  // the audio thread publishes the chunks itself, and only the track name goes to the central thread (for the queue)
+  std::atomic<web_server::broadcast_ring*> direct_ring{};
+  // rewrites each chunk's pages into the station's one Ogg stream, on the audio thread (or the central thread for a relayed station)
+  ogg_stream::writer stream_writer{};
 
   void send_request_to_skip_to_audio_server(const std::string &ip, int client_idx, int thread_id);
   void respond_to_request_to_skip(std::string resp_str, int client_idx, int thread_id);
@@ -243,11 +390,15 @@ public:
   request_skip_data get_request_to_skip_response_data(); 
 	const int request_skip_fd = eventfd(0, 0);
 	const int request_skip_response_fd = eventfd(0, 0);
+
+  auto submit_ingest(std::vector<char> &&data, bool ended = false) -> bool; // false if the audio thread is too far behind, so it's dropped
+  const int ingest_fd = eventfd(0, 0);
   int num_skip_votes = 0; // reset for every track
   bool skip_track = false; // reset for every track
   bool skipped_track_metadata_info = false; // reset once sent out in metadata
 
   std::atomic<uint32_t> num_listeners{}; // number of people listening on the station, atomic, can be read/written from central server and here at the same time
+  std::atomic<uint64_t> num_dropped_chunks{}; // chunks dropped for listeners which couldn't keep up, across both channels, added to by the central server
 
   // these are updated via the event loop on the main thread, rather than directly since could cause a data race
   struct {
@@ -255,16 +406,22 @@ public:
     
     std::unordered_map<int, std::string> fd_to_filepath{};
 
-    std::vector<char> last_broadcast_audio_data{};
-    std::vector<char> second_last_broadcast_audio_data{};
-
-    std::vector<char> last_broadcast_metadata_only{};
-    std::vector<char> second_last_broadcast_metadata_only{};
-
     std::deque<std::string> queued_audio{};
-    
+
+    tcp_tls_server::shared_buffer audio_list_response{}; // rebuilt whenever slash_separated_audio_list changes
+    tcp_tls_server::shared_buffer audio_queue_response{}; // rebuilt whenever queued_audio changes
+    tcp_tls_server::shared_buffer stream_header{}; // the start of every /stream/ response, which never changes
   } main_thread_state;
 
+  // used by whichever thread publishes the chunks, and by the central thread for new listeners
+  struct {
+    std::mutex lock{}; // held while adding to or reading the backlogs, along with publishing the chunk, so new listeners get each chunk once
+    station_backlogs backlogs{};
+
+    std::atomic<int> num_tagged_audio_subscribers{}; // tagged copies of the chunks are only made when something is subscribed to them, counted on the central thread
+    std::atomic<int> num_tagged_metadata_subscribers{};
+  } broadcast_state;
+
   ~audio_server(){ // this will be called as soon as it goes out of scope, unlike the web
     kill_server();
     if(audio_thread.joinable())
@@ -29,6 +29,9 @@ namespace tcp_callbacks {
 
   template<server_type T>
   void custom_read_cb(CUSTOM_READ_CB_PARAMS);
+
+  template<server_type T>
+  void timer_cb(TIMER_CB_PARAMS);
 }
 
 #endif
\ No newline at end of file
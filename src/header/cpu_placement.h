@@ -0,0 +1,33 @@
+#ifndef CPU_PLACEMENT
+#define CPU_PLACEMENT
+
+#include <string>
+#include <vector>
+
+// Which CPUs the central thread, the audio threads and each server thread run on, so the scheduler doesn't move them around
+// (and each server thread's clients and send queues stay in its core's cache). It's set with CPU_PLACEMENT in the config, auto
+// gives each server thread a physical core of its own, and keeps the central and audio threads on the first one. SERVER_CPUS,
+// AUDIO_CPUS and CENTRAL_CPUS (lists like 0-3,8) set those explicitly, with or without auto.
+
+namespace cpu_placement {
+using cpu_set = std::vector<int>; // empty for no pinning
+
+struct plan {
+  cpu_set central{};
+  cpu_set audio{};                      // shared by every audio thread
+  std::vector<cpu_set> server_threads{}; // one each
+
+  auto empty() const -> bool { return central.empty() && audio.empty() && server_threads.empty(); }
+};
+
+auto parse_cpu_list(const std::string &list) -> cpu_set; // like 0-3,8
+auto to_string(const cpu_set &cpus) -> std::string;
+
+// call this from the central thread before pinning anything, unset groups can run anywhere the process could to begin with
+auto make_plan(const std::string &mode, const std::string &server_cpus, const std::string &audio_cpus, const std::string &central_cpus, int num_server_threads) -> plan;
+void log_plan(const plan &placement);
+
+auto pin_this_thread(const cpu_set &cpus) -> bool; // true if it's empty as well
+} // namespace cpu_placement
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MSG_RING
+#define MSG_RING
+
+#include <liburing.h>
+#include <cstdint>
+
+// Waking another thread by posting a completion straight into its io_uring (IORING_OP_MSG_RING, Linux 5.18+) rather than by
+// writing to an eventfd which it keeps a read outstanding on. The completion's user_data has the low bit set, which a pointer
+// to a request never does, along with what kind of message it is and an index (the server thread or audio server it's from),
+// and res has a value. It's only used with MSG_RING in the config, and if it can't be used the eventfd is written to instead.
+
+namespace msg_ring {
+enum class kind : uint8_t {
+  SEND_FAILED,   // on the sender's own ring, the index is the eventfd to fall back to
+  NOTIFICATION,  // to a server thread, from the central thread, an audio thread publishing to its station's ring, or the server thread itself
+  SERVER_THREAD, // to the central thread, the index is the server thread's
+  AUDIO_SERVER   // to the central thread, the index is the audio server's id and the value is the eventfd it would have written to
+};
+
+constexpr uint64_t TAG_BIT = 1;
+constexpr auto user_data(kind type, uint32_t index) -> uint64_t { return (uint64_t(index) << 8) | (uint64_t(type) << 1) | TAG_BIT; }
+constexpr auto is_message(uint64_t user_data) -> bool { return (user_data & TAG_BIT) != 0; }
+constexpr auto kind_of(uint64_t user_data) -> kind { return static_cast<kind>((user_data >> 1) & 127); }
+constexpr auto index_of(uint64_t user_data) -> uint32_t { return user_data >> 8; }
+
+static_assert(kind_of(user_data(kind::AUDIO_SERVER, 1234)) == kind::AUDIO_SERVER && index_of(user_data(kind::AUDIO_SERVER, 1234)) == 1234);
+
+auto enable() -> bool; // call before any other threads start, false if the kernel doesn't support it
+auto enabled() -> bool;
+void set_thread_ring(io_uring *ring); // the ring this thread sends messages on, only from the thread which uses that ring
+
+// wakes the thread using the ring target_ring_fd, or writes to fallback_efd if this thread can't send messages
+void send(int target_ring_fd, kind type, uint32_t index, int32_t value, int fallback_efd);
+void send_failed(uint64_t user_data); // call this for SEND_FAILED completions, the eventfd is written to instead
+} // namespace msg_ring
+
+#endif
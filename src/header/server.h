@@ -3,15 +3,21 @@
 
 #include <liburing.h>    //for liburing
 #include <sys/eventfd.h> // for eventfd
+#include <sys/timerfd.h> // for timerfd
 #include <wolfssl/options.h>
 #include <wolfssl/ssl.h>
 
+#include <array>
+#include <memory>
 #include <mutex>
+#include <deque>
+#include <list>
 #include <queue>
 #include <set>
 #include <unordered_set>
 
 #include "server_metadata.h"
+#include "timer_wheel.h"
 #include "utility.h"
 
 namespace tcp_tls_server {
@@ -38,6 +44,9 @@ using event_callback = void (*)(EVENT_CB_PARAMS);
 template <server_type T>
 using custom_read_callback = void (*)(CUSTOM_READ_CB_PARAMS);
 
+template <server_type T>
+using timer_callback = void (*)(TIMER_CB_PARAMS);
+
 struct request {
   // fields used for any request
   event_type event;
@@ -64,7 +73,20 @@ struct multi_write {
   int uses{}; //this should be decremented each time you would normally delete this object, when it reaches 0, then delete
 };
 
-struct write_data { //this is closer to 3 objects in 1
+struct shared_buffer { // read only view into some buffer, the owner keeps the buffer alive for as long as this view exists
+  std::shared_ptr<const void> owner{};
+  const char *buff = nullptr;
+  size_t length{};
+};
+
+// where a write goes in a client's queue, writes which can't wait for everything before them (pongs, or small replies) jump ahead
+enum class write_priority {
+  NORMAL,       // at the back
+  NEXT_MESSAGE, // once the message being written is done, it may be split into several writes (fragments)
+  CONTROL       // straight after the write in progress, even between the fragments of a message
+};
+
+struct write_data { //this is closer to 4 objects in 1
   int last_written = -1;
 
   int64_t custom_info{};
@@ -80,6 +102,15 @@ struct write_data { //this is closer to 3 objects in 1
   write_data(multi_write *multi_write_data, uint64_t custom_info = 0) : multi_write_data(multi_write_data), custom_info(custom_info) {}
   multi_write *multi_write_data = nullptr; //if not null then buff should be empty, and data should be in the multi_write pointer
 
+  write_data(shared_buffer &&shared_buff, int64_t custom_info = 0) : shared_buff(std::move(shared_buff)), custom_info(custom_info) {}
+  shared_buffer shared_buff{}; // if the owner is set, then the data is in here, and is released once this is destroyed
+
+  bool droppable = false; // broadcast frames can be dropped if they haven't started being written, when the client falls behind
+  bool dropped = false;   // dropped frames are skipped over once they reach the front
+
+  write_priority priority = write_priority::NORMAL;
+  bool continuation = false; // a fragment after the first of a message, which goes (or is dropped) with the rest of it
+
   ~write_data() {
     if (multi_write_data != nullptr) {
       multi_write_data->uses--;
@@ -98,6 +129,8 @@ struct write_data { //this is closer to 3 objects in 1
   ptr_and_size get_ptr_and_size() {
     if (multi_write_data) {
       return {&(multi_write_data->buff[0]), multi_write_data->buff.size()};
+    } else if (shared_buff.owner) {
+      return {shared_buff.buff, shared_buff.length};
     } else if (ptr_buff) {
       return {ptr_buff, total_length};
     } else {
@@ -109,11 +142,64 @@ struct write_data { //this is closer to 3 objects in 1
 struct client_base {
   int id = 0; // id is only used to ensure the connection is unique
   int sockfd = -1;
-  std::queue<write_data> send_data{};
+  std::list<write_data> send_data{}; // the front is the one being written, a list since some writes are put in ahead of others
   bool closing_now = false; // marked as true when closing is initiated
 
   bool read_req_active = false;
   int num_write_reqs = 0; // if this is non zero, then do not proceed with the close callback, wait for other requests to finish
+
+  std::array<uint64_t, NUM_TIMER_TYPES> timer_deadlines{}; // the tick each timer expires on, 0 if it isn't set
+  std::array<uint64_t, NUM_TIMER_TYPES> timer_queued{};    // the deadline of this timer's entry in the timer wheel, 0 if there isn't one
+
+  void pop_write() { // removes the write which just finished, along with any dropped ones after it
+    send_data.pop_front();
+    while (!send_data.empty() && send_data.front().dropped) {
+      send_data.pop_front();
+    }
+  }
+
+  auto write_position(write_priority priority) -> std::list<write_data>::iterator { // where a write with this priority is put
+    if (priority == write_priority::NORMAL || send_data.empty()) {
+      return send_data.end();
+    }
+
+    auto position = std::next(send_data.begin()); // the front is being written
+    if (priority == write_priority::NEXT_MESSAGE) {
+      while (position != send_data.end() && (position->continuation || position->priority == write_priority::CONTROL)) {
+        position++; // the rest of the message being written, since other messages can't go between its fragments
+      }
+    }
+    while (position != send_data.end() && position->priority != write_priority::NORMAL) {
+      position++; // after anything else which jumped ahead, so they stay in order
+    }
+    return position;
+  }
+
+  auto drop_stale_writes(size_t max_queued) -> size_t { // drops the oldest droppable messages which haven't started until at most max_queued are left, returns how many were dropped
+    if (send_data.size() <= max_queued + 1) {
+      return 0; // can't be over, this is the usual case
+    }
+
+    size_t queued = 0;
+    for (auto item = std::next(send_data.begin()); item != send_data.end(); item++) {
+      queued += item->droppable && !item->dropped && !item->continuation ? 1 : 0;
+    }
+
+    size_t num_dropped = 0;
+    for (auto item = std::next(send_data.begin()); item != send_data.end() && queued > max_queued; item++) {
+      if (item->droppable && !item->dropped && !item->continuation) { // only whole messages, so never one which has started
+        item->dropped = true;
+        item->shared_buff = {}; // releases it now rather than when it gets to the front
+        for (auto fragment = std::next(item); fragment != send_data.end() && fragment->continuation; fragment++) {
+          fragment->dropped = true;
+          fragment->shared_buff = {};
+        }
+        queued--;
+        num_dropped++;
+      }
+    }
+    return num_dropped;
+  }
 };
 
 template <server_type T>
@@ -138,6 +224,7 @@ protected:
   write_callback<T> write_cb = nullptr;
   event_callback<T> event_cb = nullptr;
   custom_read_callback<T> custom_read_cb = nullptr;
+  timer_callback<T> timer_cb = nullptr;
 
   io_uring ring;
   void *custom_obj; //it can be anything
@@ -160,13 +247,21 @@ protected:
 
   void event_read(int event_fd, event_type event); //will set a read request for the eventfd
 
+  void clear_timers(int client_idx); // should be called once a connection is closed
+
   bool ran_server = false;
 
 private:
   int notification_efd = eventfd(0, 0); //used to awaken this thread for some event
   int kill_efd = eventfd(0, 0);         //used to awaken this thread to be killed
+  int timer_fd = timerfd_create(CLOCK_MONOTONIC, 0); //goes off every tick, to advance the timer wheel
+
+  timer_wheel timers{};
+  std::vector<timer_wheel::entry> due_timers{}; // reused for every tick
+  void timer_tick();
 
   int listener_fd = 0;
+  int listener_index = -1; // its place in the SO_REUSEPORT group
 
   auto add_accept_req(int listener_fd, sockaddr_storage *client_address, socklen_t *client_address_length) -> int; //adds an accept request to the io_uring ring
   //used in the req_event_handler functions for accept requests
@@ -178,6 +273,7 @@ private:
   //needed to synchronize the multiple server threads
   static std::mutex init_mutex;
   static int shared_ring_fd; //pointer to a single io_uring ring fd, who's async backend is shared
+  static std::vector<int> listener_fds; //in the order they joined the SO_REUSEPORT group, since listeners are set up one at a time, -1 once closed
 public:
   server_base(int listen_port);
   void start(); //function to start the server
@@ -190,9 +286,18 @@ public:
   void notify_event();
   void kill_server(); // will kill the server
 
+  // one timer of each type per connection, setting it again replaces the deadline, it's cleared once it expires or the connection closes
+  void set_timer(int client_idx, timer_type type, uint32_t ms);
+  void clear_timer(int client_idx, timer_type type);
+
   bool is_active = true; // is the server active (only false once it received an exit signal)
 
   auto get_ip_address(int client_idx) -> std::string;
+
+  auto reuseport_index() const -> int { return listener_index; }
+  // new connections go to each listener in proportion to its weight (indexed by reuseport_index) rather than by the kernel's hash
+  // of the address, with a classic BPF program attached to the SO_REUSEPORT group, this can be called from any thread
+  static auto steer_connections(const std::vector<uint32_t> &weights) -> bool;
 };
 
 template <>
@@ -217,7 +322,8 @@ public:
          read_callback<server_type::NON_TLS> r_cb = nullptr,
          write_callback<server_type::NON_TLS> w_cb = nullptr,
          event_callback<server_type::NON_TLS> e_cb = nullptr,
-         custom_read_callback<server_type::NON_TLS> cr_cb = nullptr);
+         custom_read_callback<server_type::NON_TLS> cr_cb = nullptr,
+         timer_callback<server_type::NON_TLS> t_cb = nullptr);
 
   template <typename U>
   void broadcast_message(U begin, U end, int num_clients, std::vector<char> &&buff) {
@@ -226,7 +332,7 @@ public:
 
       for (auto client_idx_ptr = begin; client_idx_ptr != end; client_idx_ptr++) {
         auto &client = clients[(int)*client_idx_ptr];
-        client.send_data.emplace(data);
+        client.send_data.emplace_back(data);
         if (client.send_data.size() == 1) { //only adds a write request in the case that the queue was empty before this
           add_write_req(*client_idx_ptr, event_type::WRITE, &(data->buff[0]), data->buff.size());
         }
@@ -239,7 +345,7 @@ public:
     if (num_clients > 0) {
       for (auto client_idx_ptr = begin; client_idx_ptr != end; client_idx_ptr++) {
         auto &client = clients[(int)*client_idx_ptr];
-        client.send_data.emplace(buff, length, true, custom_info);
+        client.send_data.emplace_back(buff, length, true, custom_info);
         if (client.send_data.size() == 1) { //only adds a write request in the case that the queue was empty before this
           add_write_req(*client_idx_ptr, event_type::WRITE, buff, length);
         }
@@ -247,10 +353,35 @@ public:
     }
   }
 
+  template <typename U>
+  auto broadcast_message(U begin, U end, int num_clients, const shared_buffer &buff, size_t max_queued = 0) -> size_t { //every client holds a reference to the buffer until its write is done
+    return broadcast_message(begin, end, num_clients, &buff, 1, max_queued);
+  }
+
+  template <typename U>
+  auto broadcast_message(U begin, U end, int num_clients, const shared_buffer *fragments, size_t num_fragments, size_t max_queued = 0) -> size_t { //a message in several writes, so writes can go in between them
+    size_t num_dropped = 0; // if max_queued isn't 0, clients with more than that many broadcasts queued have the oldest ones dropped
+    if (num_clients > 0) {
+      for (auto client_idx_ptr = begin; client_idx_ptr != end; client_idx_ptr++) {
+        auto &client = clients[(int)*client_idx_ptr];
+        for (size_t i = 0; i < num_fragments; i++) {
+          write_connection((int)*client_idx_ptr, shared_buffer{fragments[i]});
+          client.send_data.back().continuation = i > 0;
+          client.send_data.back().droppable = max_queued > 0;
+        }
+        if (max_queued > 0) {
+          num_dropped += client.drop_stale_writes(max_queued);
+        }
+      }
+    }
+    return num_dropped;
+  }
+
   static void kill_all_servers(); // will kill all non tls servers on any thread
 
-  void write_connection(int client_idx, std::vector<char> &&buff);  //writing depends on TLS or SSL, unlike read
-  void write_connection(int client_idx, char *buff, size_t length); //writing but using a char pointer, doesn't do anything to the data
+  void write_connection(int client_idx, std::vector<char> &&buff, write_priority priority = write_priority::NORMAL);  //writing depends on TLS or SSL, unlike read
+  void write_connection(int client_idx, char *buff, size_t length, write_priority priority = write_priority::NORMAL); //writing but using a char pointer, doesn't do anything to the data
+  void write_connection(int client_idx, shared_buffer &&buff, write_priority priority = write_priority::NORMAL);      //writing a shared buffer, it's kept alive until the write is done
 
   void start_closing_connection(int client_idx);  //closing depends on what resources need to be freed
   void finish_closing_connection(int client_idx); //closing depends on what resources need to be freed
@@ -289,7 +420,8 @@ public:
       read_callback<server_type::TLS> r_cb = nullptr,
       write_callback<server_type::TLS> w_cb = nullptr,
       event_callback<server_type::TLS> e_cb = nullptr,
-      custom_read_callback<server_type::TLS> cr_cb = nullptr);
+      custom_read_callback<server_type::TLS> cr_cb = nullptr,
+      timer_callback<server_type::TLS> t_cb = nullptr);
 
   template <typename U>
   void broadcast_message(U begin, U end, int num_clients, std::vector<char> &&buff) {
@@ -298,7 +430,7 @@ public:
 
       for (auto client_idx_ptr = begin; client_idx_ptr != end; client_idx_ptr++) {
         auto &client = clients[(int)*client_idx_ptr];
-        client.send_data.emplace(data);
+        client.send_data.emplace_back(data);
         if (client.send_data.size() == 1) { //only adds a write request in the case that the queue was empty before this
           wolfSSL_write(client.ssl, &(data->buff[0]), (int)data->buff.size());
         }
@@ -311,7 +443,7 @@ public:
     if (num_clients > 0) {
       for (auto client_idx_ptr = begin; client_idx_ptr != end; client_idx_ptr++) {
         auto &client = clients[(int)*client_idx_ptr];
-        client.send_data.emplace(buff, length, true, custom_info);
+        client.send_data.emplace_back(buff, length, true, custom_info);
         if (client.send_data.size() == 1) { //only adds a write request in the case that the queue was empty before this
           wolfSSL_write(client.ssl, buff, (int)length);
         }
@@ -319,10 +451,35 @@ public:
     }
   }
 
+  template <typename U>
+  auto broadcast_message(U begin, U end, int num_clients, const shared_buffer &buff, size_t max_queued = 0) -> size_t { //every client holds a reference to the buffer until its write is done
+    return broadcast_message(begin, end, num_clients, &buff, 1, max_queued);
+  }
+
+  template <typename U>
+  auto broadcast_message(U begin, U end, int num_clients, const shared_buffer *fragments, size_t num_fragments, size_t max_queued = 0) -> size_t { //a message in several writes, so writes can go in between them
+    size_t num_dropped = 0; // if max_queued isn't 0, clients with more than that many broadcasts queued have the oldest ones dropped
+    if (num_clients > 0) {
+      for (auto client_idx_ptr = begin; client_idx_ptr != end; client_idx_ptr++) {
+        auto &client = clients[(int)*client_idx_ptr];
+        for (size_t i = 0; i < num_fragments; i++) {
+          write_connection((int)*client_idx_ptr, shared_buffer{fragments[i]});
+          client.send_data.back().continuation = i > 0;
+          client.send_data.back().droppable = max_queued > 0;
+        }
+        if (max_queued > 0) {
+          num_dropped += client.drop_stale_writes(max_queued);
+        }
+      }
+    }
+    return num_dropped;
+  }
+
   static void kill_all_servers(); // will kill all tls servers on any thread
 
-  void write_connection(int client_idx, std::vector<char> &&buff);  //writing depends on TLS or SSL, unlike read
-  void write_connection(int client_idx, char *buff, size_t length); //writing but using a char pointer, doesn't do anything to the data
+  void write_connection(int client_idx, std::vector<char> &&buff, write_priority priority = write_priority::NORMAL);  //writing depends on TLS or SSL, unlike read
+  void write_connection(int client_idx, char *buff, size_t length, write_priority priority = write_priority::NORMAL); //writing but using a char pointer, doesn't do anything to the data
+  void write_connection(int client_idx, shared_buffer &&buff, write_priority priority = write_priority::NORMAL);      //writing a shared buffer, it's kept alive until the write is done
 
   void start_closing_connection(int client_idx);  //closing depends on what resources need to be freed
   void finish_closing_connection(int client_idx); //closing depends on what resources need to be freed
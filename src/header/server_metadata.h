@@ -1,6 +1,8 @@
 #ifndef SERVER_ENUMS
 #define SERVER_ENUMS
 
+#include <cstddef>
+#include <cstdint>
 #include <linux/limits.h>
 #include <vector> //for vectors
 
@@ -12,12 +14,22 @@ constexpr size_t inotify_read_size = 8192;  // to read many events, for large mo
 constexpr int QUEUE_DEPTH = 256; //the maximum number of events which can be submitted to the io_uring submission queue ring at once, you can have many more pending requests though
 
 namespace tcp_tls_server {
-  enum class event_type{ ACCEPT, ACCEPT_READ, ACCEPT_WRITE, READ, WRITE, NOTIFICATION, CUSTOM_READ, KILL };
+  enum class event_type{ ACCEPT, ACCEPT_READ, ACCEPT_WRITE, READ, WRITE, NOTIFICATION, CUSTOM_READ, KILL, TIMER };
+
+  // every connection can have one of each of these timers, the first three close the connection when they expire, anything else goes to the timer callback
+  enum class timer_type{ HANDSHAKE, HEADER, IDLE, PING };
+  constexpr int NUM_TIMER_TYPES = 4;
 
   constexpr int BACKLOG = 10; //max number of connections pending acceptance
   constexpr int READ_SIZE = 8192; //how much one read request should read
   constexpr int READ_BLOCK_SIZE = 8192; //how much to read from a file at once
 
+  constexpr int TIMER_TICK_MS = 100; //the resolution of connection timers
+  constexpr uint32_t HANDSHAKE_TIMEOUT_MS = 10000; //how long a TLS handshake can take
+  constexpr uint32_t HEADER_TIMEOUT_MS = 10000; //how long after connecting the request has to arrive, this is set by the layer above
+  constexpr uint32_t IDLE_TIMEOUT_MS = 90000; //how long a connection can go without a read or write completing
+  constexpr uint32_t CLOSE_TIMEOUT_MS = 5000; //how long to wait for the other end to finish closing the connection
+
   template<server_type T>
   class server_base; //forward declaration
 
@@ -32,5 +44,6 @@ namespace tcp_tls_server {
 #define       WRITE_CB_PARAMS int client_idx, int broadcast_additional_info, tcp_tls_server::server<T> *tcp_server, void *custom_obj
 #define       EVENT_CB_PARAMS tcp_tls_server::server<T> *tcp_server, void *custom_obj
 #define CUSTOM_READ_CB_PARAMS int client_idx, int fd, std::vector<char> &&buff, size_t read_bytes, tcp_tls_server::server<T> *tcp_server, void *custom_obj
+#define       TIMER_CB_PARAMS int client_idx, tcp_tls_server::timer_type type, tcp_tls_server::server<T> *tcp_server, void *custom_obj
 
 #endif
@@ -0,0 +1,45 @@
+#ifndef TIMER_WHEEL
+#define TIMER_WHEEL
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "server_metadata.h"
+
+// A hierarchical timer wheel, each server thread has one for the deadlines of all of its connections.
+// Level 0 has a slot for each of the next 64 ticks, and each level above that covers 64 times as much
+// time per slot, entries are moved down a level whenever the level below wraps around, so inserting
+// and expiring are both O(1) regardless of how many timers there are.
+// Entries are never removed, the server checks whether an entry is still the current one when it expires.
+
+namespace tcp_tls_server {
+class timer_wheel {
+public:
+  struct entry {
+    int client_idx = -1;
+    int id{}; // the id of the client when this was added, in case the slot has since been reused
+    timer_type type{};
+    uint64_t deadline{}; // the tick this expires on
+  };
+
+  auto now() const -> uint64_t { return current_tick; }
+
+  void insert(const entry &item);        // deadlines which have already passed expire on the next tick
+  void advance(std::vector<entry> &due); // moves on by one tick, adding anything which has expired to due
+
+private:
+  static constexpr int SLOT_BITS = 6;
+  static constexpr uint64_t NUM_SLOTS = 1 << SLOT_BITS;
+  static constexpr uint64_t SLOT_MASK = NUM_SLOTS - 1;
+  static constexpr int NUM_LEVELS = 4; // 64^4 ticks in total, much longer than any timeout
+
+  uint64_t current_tick{};
+  std::array<std::array<std::vector<entry>, NUM_SLOTS>, NUM_LEVELS> levels{};
+
+  void place(const entry &item, uint64_t deadline); // deadline should be at least the current tick
+  void cascade(int level); // moves the entries in the current slot of this level down to the levels below
+};
+} // namespace tcp_tls_server
+
+#endif
@@ -21,6 +21,7 @@ namespace utility {
   void fatal_error(std::string error_message); //fatal error helper function
   uint64_t get_file_size(int file_fd); //gets file size of the file descriptor passed in
   void sigint_handler(int sig_number); //handler used in main for handling SIGINT
+  void sighup_handler(int sig_number); //handler used in main for handling SIGHUP
 
   void log_helper_function(std::string msg, bool cerr_or_not);
   
@@ -40,16 +41,6 @@ namespace utility {
     std::memmove(&data[0], &data[num_elements_to_remove], new_size);
     data.resize(new_size);
   }
-
-  template <typename T>
-  void remove_first_n_elements(T *data, int length, T *&ret_buff, int num_elements_to_remove){ //deals correctly with overlaps
-    auto new_size = length - num_elements_to_remove;
-    std::memmove(data, &data[num_elements_to_remove], new_size);
-    char *temp_ptr = (T*)std::malloc(new_size);
-    free(ret_buff);
-    ret_buff = temp_ptr;
-    std::memcpy(ret_buff, data, new_size);
-  }
 }
 
 #endif
\ No newline at end of file
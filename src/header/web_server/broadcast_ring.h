@@ -0,0 +1,93 @@
+#ifndef BROADCAST_RING
+#define BROADCAST_RING
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "../server.h"
+
+// Broadcast frames go from the central thread to the server threads through a single producer, multiple consumer ring,
+// rather than a message per thread in each thread's queue. The central thread publishes each frame once and wakes every
+// thread once, and each server thread reads every frame published since it last looked, straight out of the ring.
+// Each thread keeps its own cursor (the epoch it's read up to), and the central thread releases its references to the frames
+// once every cursor has moved past them, so nothing is sent back to say a frame is done with.
+// With DIRECT_BROADCASTS each station has a ring of its own as well, which its audio thread publishes the chunks to, so the
+// central thread isn't in the way of any audio. Those wake the readers themselves, the central thread wakes each thread once
+// for everything it published instead.
+
+namespace web_server {
+struct broadcast_entry {
+  int channel_id = -1;
+  tcp_tls_server::shared_buffer frame{};
+  tcp_tls_server::shared_buffer deflated_frame{}; // for websockets with permessage-deflate, if there is one
+  uint64_t sequence{};                            // the chunk's sequence number for audio broadcasts, for the workers' backlogs
+};
+
+class broadcast_ring {
+public:
+  static constexpr size_t CAPACITY = 4096; // a power of 2, far more than is published in the time a thread takes to get to them
+  static constexpr size_t MAX_READERS = 256;
+
+private:
+  static constexpr size_t MASK = CAPACITY - 1;
+
+  struct alignas(64) reader_cursor { // on their own cache lines, each is written by a different thread
+    std::atomic<uint64_t> next{};
+  };
+
+  std::unique_ptr<broadcast_entry[]> slots = std::make_unique<broadcast_entry[]>(CAPACITY);
+  std::unique_ptr<reader_cursor[]> readers = std::make_unique<reader_cursor[]>(MAX_READERS);
+  alignas(64) std::atomic<uint64_t> head{}; // everything before this has been published
+
+  // only used by the producer, the central thread or a station's audio thread
+  uint64_t reclaimed{}; // the slots before this have been released
+  size_t num_readers{};
+  std::vector<std::function<void()>> wake_ups{}; // for each reader, for rings which aren't published to by the central thread
+
+  broadcast_ring() = default;
+
+  void reclaim(); // releases the slots which every reader has moved past
+
+  static auto stations() -> std::vector<std::unique_ptr<broadcast_ring>> &;
+
+public:
+  broadcast_ring(broadcast_ring const &) = delete;
+  void operator=(broadcast_ring const &) = delete;
+
+  static auto instance() -> broadcast_ring & {
+    static broadcast_ring inst;
+    return inst;
+  }
+
+  // each station's ring, with DIRECT_BROADCASTS, made on the central thread before the server threads are
+  static void make_station_rings(size_t num_stations);
+  static auto num_stations() -> size_t { return stations().size(); }
+  static auto station(int server_id) -> broadcast_ring & { return *stations()[server_id]; }
+
+  // readers are added on the central thread before their thread starts (and before anything else publishes to the ring), and read from whatever is published after that
+  auto add_reader(std::function<void()> wake_up = {}) -> int;
+  // only call these from the producer
+  auto publish(int channel_id, const tcp_tls_server::shared_buffer &frame, const tcp_tls_server::shared_buffer &deflated_frame = {}, uint64_t sequence = 0) -> bool; // false if a reader is so far behind that the ring is full
+  void wake_readers(); // once for everything just published
+
+  auto published() const -> uint64_t { return head.load(std::memory_order_acquire); } // the epoch, anything posted along with this is ordered after these
+  auto unread(int reader) const -> bool { return readers[reader].next.load(std::memory_order_relaxed) < published(); } // only from the reader's own thread
+
+  template <typename F>
+  void consume(int reader, uint64_t up_to, F &&callback) { // only from the reader's own thread, callback is given everything published since last time, up to the epoch up_to
+    auto &cursor = readers[reader].next;
+    auto next = cursor.load(std::memory_order_relaxed);
+    const auto end = std::min(up_to, head.load(std::memory_order_acquire));
+    for (; next < end; next++) {
+      callback(static_cast<const broadcast_entry &>(slots[next & MASK]));
+    }
+    cursor.store(next, std::memory_order_release); // the central thread can release these now
+  }
+};
+} // namespace web_server
+
+#endif
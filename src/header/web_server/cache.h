@@ -50,7 +50,7 @@ namespace web_cache {
     }
 
     cache_fetch_item fetch_item(const std::string &filepath, int client_idx, web_server::tcp_client &client){
-      if(client_idx < 0) // for the off chance that an invalid client ID is supplied
+      if(client_idx == -1) // for the off chance that an invalid client ID is supplied (other negative idxs are HTTP/2 streams)
         return { false, nullptr };
       
       if(filepath_to_cache_idx.count(filepath)) {
@@ -174,7 +174,7 @@ namespace web_cache {
     }
 
     void finished_with_item(int client_idx, web_server::tcp_client &client){ //requires a pointer to the client object, for the using_file stuff - to ensure it's not decremented too many times
-      if(client_idx < 0){ // for the off chance that an invalid client ID is supplied
+      if(client_idx == -1){ // for the off chance that an invalid client ID is supplied (other negative idxs are HTTP/2 streams)
         utility::log_helper_function(std::string(__func__) + " ## " + std::to_string(__LINE__) + " ## " + std::string(__FILE__) + " ## Client idx: " + std::to_string(client_idx) + " ## " + std::to_string(client.using_file), true);
         return;
       }
@@ -3,6 +3,7 @@
 
 #include "../server_metadata.h"
 #include <string>
+#include <vector>
 
 namespace web_server {
   template<server_type T>
@@ -21,28 +22,56 @@ namespace web_server {
     pong = 0xA
   };
 
-  enum class message_type {
-    websocket_broadcast,
-    broadcast_finished,
-    new_radio_client,
-    new_radio_client_response,
-    request_station_list,
-    request_station_list_response,
-    request_audio_list,
-    request_audio_list_response,
-    request_audio_track,
-    request_audio_track_response,
-    request_audio_queue,
-    request_audio_queue_response,
-    skip_request,
-    skip_request_response,
-    radio_client_left
+  // every station has a broadcast channel of each kind, websockets subscribe to channels to get what's broadcast on them
+  enum class channel_kind {
+    audio_broadcast,
+    metadata_only,
+    queue_updates, // the queue/list is pushed on these whenever it changes, for the control messages
+    list_updates,
+    audio_tagged, // the same chunks as the first two, wrapped with the channel they're from, for connections with several stations on them
+    metadata_tagged,
+    ogg_stream // the chunks' pages rewritten into one Ogg stream, as HTTP chunks for /stream/<station>.opus, see ogg_stream.h
   };
+  constexpr int NUM_CHANNEL_KINDS = 7;
+
+  constexpr auto broadcast_channel_id(int server_id, channel_kind kind) -> int { return server_id * NUM_CHANNEL_KINDS + (int)kind; }
+  constexpr auto channel_server_id(int broadcast_channel_id) -> int { return broadcast_channel_id / NUM_CHANNEL_KINDS; }
+  constexpr auto channel_kind_of(int broadcast_channel_id) -> channel_kind { return static_cast<channel_kind>(broadcast_channel_id % NUM_CHANNEL_KINDS); }
+
+  constexpr auto is_chunk_channel(channel_kind kind) -> bool { return kind != channel_kind::queue_updates && kind != channel_kind::list_updates; } // chunks can be dropped for slow listeners
+  constexpr auto is_listener_channel(channel_kind kind) -> bool { return kind == channel_kind::audio_broadcast || kind == channel_kind::audio_tagged || kind == channel_kind::ogg_stream; }
+  constexpr auto is_tagged_channel(channel_kind kind) -> bool { return kind == channel_kind::audio_tagged || kind == channel_kind::metadata_tagged; }
+
+  struct radio_channel { // what a websocket asked for with "station/connection_type"
+    std::string station{};
+    std::string connection_type{}; // audio_broadcast or metadata_only, or audio or metadata for tagged chunks
+    channel_kind kind{};
+    bool valid = false;
+  };
+  inline auto parse_radio_channel(const std::string &path) -> radio_channel {
+    const auto slash = path.find('/');
+    radio_channel channel{path.substr(0, slash), slash == std::string::npos ? "" : path.substr(slash + 1)};
+    channel.valid = true;
+    if (channel.connection_type == "audio_broadcast") {
+      channel.kind = channel_kind::audio_broadcast;
+    } else if (channel.connection_type == "metadata_only") {
+      channel.kind = channel_kind::metadata_only;
+    } else if (channel.connection_type == "audio") {
+      channel.kind = channel_kind::audio_tagged;
+    } else if (channel.connection_type == "metadata") {
+      channel.kind = channel_kind::metadata_tagged;
+    } else {
+      channel.valid = false;
+    }
+    return channel;
+  }
 
   struct tcp_client {
     std::string last_requested_read_filepath{}; //the last filepath it was asked to read
     int ws_client_idx = -1;
     bool using_file = false;
+    std::vector<int> channels{}; //the broadcast channels it's subscribed to, so they're found without going through every channel
+    int stream_listener_id = 0; // set for a /stream/ listener, so the central thread's response finds the same connection, and it isn't closed after writing
   };
 }
 
@@ -0,0 +1,176 @@
+#ifndef HTTP2
+#define HTTP2
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../server.h"
+#include "common_structs_enums.h"
+
+// HTTP/2 (RFC 9113) for the plain request/response side of the web server, negotiated through ALPN
+// over TLS (or with prior knowledge otherwise). Requests on every stream go through the same
+// get_process/send_file_request logic as HTTP/1, using a negative request handle in place of the
+// client idx, and the HTTP/1 response which is written to that handle is translated into a
+// HEADERS frame and DATA frames here. WebSockets still use their own HTTP/1.1 connections.
+
+namespace http2 {
+constexpr std::string_view connection_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+constexpr size_t FRAME_HEADER_SIZE = 9;
+constexpr uint32_t DEFAULT_WINDOW_SIZE = 65535;
+constexpr uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+constexpr uint32_t MAX_WINDOW_SIZE = 0x7fffffff;
+constexpr uint32_t HEADER_TABLE_SIZE = 4096;      // the size of our decoder's dynamic table, this is the default so isn't sent
+constexpr uint32_t MAX_CONCURRENT_STREAMS = 100;  // per connection
+constexpr size_t MAX_HEADER_BLOCK_SIZE = 65536;   // the most we'll buffer across HEADERS and CONTINUATION frames
+constexpr size_t MAX_DECODED_HEADERS_SIZE = 65536; // limits how much a compressed header block can expand to
+
+enum class frame_type : uint8_t {
+  DATA = 0x0,
+  HEADERS = 0x1,
+  PRIORITY = 0x2,
+  RST_STREAM = 0x3,
+  SETTINGS = 0x4,
+  PUSH_PROMISE = 0x5,
+  PING = 0x6,
+  GOAWAY = 0x7,
+  WINDOW_UPDATE = 0x8,
+  CONTINUATION = 0x9
+};
+
+namespace flags {
+constexpr uint8_t END_STREAM = 0x1;
+constexpr uint8_t ACK = 0x1;
+constexpr uint8_t END_HEADERS = 0x4;
+constexpr uint8_t PADDED = 0x8;
+constexpr uint8_t PRIORITY = 0x20;
+} // namespace flags
+
+enum class settings_id : uint16_t {
+  HEADER_TABLE_SIZE = 0x1,
+  ENABLE_PUSH = 0x2,
+  MAX_CONCURRENT_STREAMS = 0x3,
+  INITIAL_WINDOW_SIZE = 0x4,
+  MAX_FRAME_SIZE = 0x5,
+  MAX_HEADER_LIST_SIZE = 0x6
+};
+
+enum class error_code : uint32_t {
+  NO_ERROR = 0x0,
+  PROTOCOL_ERROR = 0x1,
+  INTERNAL_ERROR = 0x2,
+  FLOW_CONTROL_ERROR = 0x3,
+  STREAM_CLOSED = 0x5,
+  FRAME_SIZE_ERROR = 0x6,
+  REFUSED_STREAM = 0x7,
+  CANCEL = 0x8,
+  COMPRESSION_ERROR = 0x9,
+  ENHANCE_YOUR_CALM = 0xb,
+  HTTP_1_1_REQUIRED = 0xd
+};
+
+struct frame_header {
+  uint32_t length{};
+  frame_type type{};
+  uint8_t flags{};
+  uint32_t stream_id{};
+};
+
+auto read_frame_header(const char *buff) -> frame_header; // needs at least FRAME_HEADER_SIZE bytes
+void write_frame_header(std::vector<char> &out, uint32_t length, frame_type type, uint8_t flags, uint32_t stream_id);
+
+// appends whole frames to out
+void write_settings(std::vector<char> &out, const std::vector<std::pair<settings_id, uint32_t>> &settings);
+void write_settings_ack(std::vector<char> &out);
+void write_ping_ack(std::vector<char> &out, const char *opaque_data); // opaque data is 8 bytes
+void write_window_update(std::vector<char> &out, uint32_t stream_id, uint32_t increment);
+void write_rst_stream(std::vector<char> &out, uint32_t stream_id, error_code error);
+void write_goaway(std::vector<char> &out, uint32_t last_stream_id, error_code error);
+
+using header_list = std::vector<std::pair<std::string, std::string>>;
+
+// HPACK (RFC 7541)
+auto huffman_decode(std::string_view input, std::string &output) -> bool;
+
+class hpack_decoder {
+  std::deque<std::pair<std::string, std::string>> dynamic_table{}; // newest entry first
+  size_t dynamic_table_size{};
+  size_t max_dynamic_table_size = HEADER_TABLE_SIZE;
+
+  void add_entry(std::string name, std::string value);
+  void evict(size_t max_size);
+  auto get_entry(uint64_t idx, std::pair<std::string, std::string> &entry) const -> bool;
+
+public:
+  auto decode(const char *buff, size_t length, header_list &headers) -> bool; // false on a compression error, which is fatal for the connection
+};
+
+// encoding only uses literals which aren't indexed, so there's no encoder state to keep in sync with the peer
+void hpack_encode_header(std::vector<char> &out, std::string_view name, std::string_view value);
+void hpack_encode_status(std::vector<char> &out, std::string_view status);
+
+// turns the status line and headers of an HTTP/1 response into a header block, connection specific headers are dropped
+// the response should be whole, the body is everything after the headers
+auto translate_http1_response(std::string_view response, std::vector<char> &header_block, size_t &body_offset) -> bool;
+
+struct stream {
+  int client_idx = -1; // the connection this is on
+  uint32_t id{};
+  int generation{}; // incremented each time the slot is used
+  int64_t send_window{};
+
+  bool active = false;
+  bool responded = false;
+
+  tcp_tls_server::shared_buffer body{}; // the owner isn't set if it's from the cache, which is locked until the stream is closed
+  size_t body_sent{};
+
+  web_server::tcp_client client_data{}; // used in place of the tcp_clients entry for this request
+};
+
+struct session {
+  std::vector<char> recv_data{}; // partial frames
+  bool preface_received = false;
+  bool goaway = false; // once set, the connection is closed after the final write
+
+  hpack_decoder decoder{};
+
+  // the header block currently being received, over a HEADERS frame followed by CONTINUATION frames
+  uint32_t header_block_stream_id{};
+  std::vector<char> header_block{};
+
+  int64_t send_window = DEFAULT_WINDOW_SIZE;
+  uint32_t peer_initial_window_size = DEFAULT_WINDOW_SIZE;
+  uint32_t peer_max_frame_size = DEFAULT_MAX_FRAME_SIZE;
+
+  uint32_t last_stream_id{};
+  std::unordered_map<uint32_t, int> streams{}; // stream id to stream slot
+
+  std::vector<char> send_data{}; // frames waiting to be written, they're written together
+  bool batching = false;         // set while processing a read, so that everything it causes is written at once
+  int pending_writes{};          // writes which haven't completed yet
+};
+
+// request handles are client idxs for HTTP/1, or negative for HTTP/2 streams (-1 is left as invalid)
+// a stream handle also has the generation of its slot, so that a response for a stream which has since been closed can't go to whichever stream reused the slot
+constexpr int STREAM_SLOT_BITS = 20;
+constexpr int STREAM_GENERATION_MASK = 0x3ff;
+
+constexpr auto stream_handle(int slot, int generation) -> int { return -((((generation & STREAM_GENERATION_MASK) << STREAM_SLOT_BITS) | slot) + 2); }
+constexpr auto handle_to_stream_slot(int handle) -> int { return (-handle - 2) & ((1 << STREAM_SLOT_BITS) - 1); }
+constexpr auto handle_to_stream_generation(int handle) -> int { return (-handle - 2) >> STREAM_SLOT_BITS; }
+constexpr int STREAM_HANDLE_LIMIT = (1 << 30) + 2; // handles from -STREAM_HANDLE_LIMIT down are websocket control requests
+constexpr auto is_stream_handle(int handle) -> bool { return handle < -1 && handle > -STREAM_HANDLE_LIMIT; }
+
+static_assert(handle_to_stream_slot(stream_handle(12345, 678)) == 12345 && handle_to_stream_generation(stream_handle(12345, 678)) == 678);
+static_assert(is_stream_handle(stream_handle(0, 0)) && !is_stream_handle(-1));
+static_assert(is_stream_handle(stream_handle((1 << STREAM_SLOT_BITS) - 1, STREAM_GENERATION_MASK)) && !is_stream_handle(-STREAM_HANDLE_LIMIT));
+} // namespace http2
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef MAILBOX
+#define MAILBOX
+
+#include "../../vendor/readerwriterqueue/atomicops.h"
+#include "../../vendor/readerwriterqueue/readerwriterqueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Messages in one direction between two threads (so one sender and one receiver). The sender only needs to wake the receiver
+// when the mailbox goes from having been drained to having something in it, and the receiver drains everything each time it's
+// woken, so a burst of messages costs one wake up (an eventfd write, or a MSG_RING message) rather than one each.
+
+namespace web_server {
+struct mailbox_stats {
+  uint64_t messages{};
+  uint64_t wakeups{};
+  uint64_t wakeup_latency_ns{}; // the total time from signalling the receiver to it draining the mailbox
+  uint64_t wakeup_latency_samples{};
+};
+
+template <typename T>
+class mailbox {
+  moodycamel::ReaderWriterQueue<T> queue{};
+  std::atomic<bool> signalled{}; // whether the receiver has been woken and hasn't drained the mailbox since
+  std::atomic<int64_t> signalled_at{}; // when it was, for the latency of waking the receiver
+
+  static auto now_ns() -> int64_t { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+  // only written by the receiver, read by anything reporting them
+  std::atomic<uint64_t> num_messages{};
+  std::atomic<uint64_t> num_wakeups{};
+  std::atomic<uint64_t> latency_ns{};
+  std::atomic<uint64_t> latency_samples{};
+
+public:
+  mailbox() = default;
+  mailbox(mailbox &&other) noexcept : queue(std::move(other.queue)), signalled(other.signalled.load()) {} // only before either thread is using it
+
+  auto post(T &&message) -> bool { // returns whether the receiver needs waking
+    queue.enqueue(std::move(message));
+    return signal();
+  }
+
+  auto signal() -> bool { // for waking the receiver without a message, this is false if it's already been woken
+    if (signalled.exchange(true, std::memory_order_acq_rel)) {
+      return false;
+    }
+    signalled_at.store(now_ns(), std::memory_order_relaxed); // before the receiver is actually woken by the caller
+    return true;
+  }
+
+  template <typename F>
+  auto drain(F &&callback) -> size_t { // gives callback everything in the mailbox, call this each time the receiver is woken
+    signalled.exchange(false, std::memory_order_acq_rel); // anything posted before this is dequeued below, anything after wakes the receiver again
+    const auto woken_at = now_ns();
+    const auto sent_at = signalled_at.exchange(0, std::memory_order_relaxed);
+
+    T message{};
+    size_t count = 0;
+    while (queue.try_dequeue(message)) {
+      callback(message);
+      count++;
+    }
+
+    num_messages.store(num_messages.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    num_wakeups.store(num_wakeups.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (sent_at != 0 && woken_at > sent_at) {
+      latency_ns.store(latency_ns.load(std::memory_order_relaxed) + (woken_at - sent_at), std::memory_order_relaxed);
+      latency_samples.store(latency_samples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  auto stats() const -> mailbox_stats {
+    return {num_messages.load(std::memory_order_relaxed), num_wakeups.load(std::memory_order_relaxed), latency_ns.load(std::memory_order_relaxed), latency_samples.load(std::memory_order_relaxed)};
+  }
+};
+} // namespace web_server
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef MIME_TYPES
+#define MIME_TYPES
+
+#include <array>
+#include <string_view>
+
+namespace web_server {
+struct mime_type {
+  std::string_view extension{};
+  std::string_view content_type{}; // the full header line
+};
+
+constexpr std::array mime_types{
+    mime_type{"html", "Content-Type: text/html\r\n"},
+    mime_type{"htm", "Content-Type: text/html\r\n"},
+    mime_type{"css", "Content-Type: text/css\r\n"},
+    mime_type{"js", "Content-Type: text/javascript\r\n"},
+    mime_type{"json", "Content-Type: application/json\r\n"},
+    mime_type{"opus", "Content-Type: audio/opus\r\n"},
+    mime_type{"mp3", "Content-Type: audio/mpeg\r\n"},
+    mime_type{"mp4", "Content-Type: video/mp4\r\n"},
+    mime_type{"gif", "Content-Type: image/gif\r\n"},
+    mime_type{"png", "Content-Type: image/png\r\n"},
+    mime_type{"jpg", "Content-Type: image/jpeg\r\n"},
+    mime_type{"jpeg", "Content-Type: image/jpeg\r\n"},
+    mime_type{"svg", "Content-Type: image/svg+xml\r\n"},
+    mime_type{"ico", "Content-Type: image/x-icon\r\n"},
+    mime_type{"xml", "Content-Type: application/xml\r\n"},
+    mime_type{"webmanifest", "Content-Type: application/manifest+json\r\n"},
+    mime_type{"txt", "Content-Type: text/plain\r\n"},
+    mime_type{"wasm", "Content-Type: application/wasm\r\n"}};
+
+constexpr std::string_view default_content_type = "Content-Type: application/octet-stream\r\n";
+
+// gets the content type header for a file, based on its extension
+constexpr auto get_content_type(std::string_view filepath) -> std::string_view {
+  const auto dot = filepath.rfind('.');
+  const auto slash = filepath.rfind('/');
+  if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) {
+    return default_content_type;
+  }
+
+  const auto extension = filepath.substr(dot + 1);
+  for (const auto &type : mime_types) {
+    if (type.extension == extension) {
+      return type.content_type;
+    }
+  }
+  return default_content_type;
+}
+
+static_assert(get_content_type("public/index.html") == "Content-Type: text/html\r\n");
+static_assert(get_content_type("public/assets/audio/a.b.opus") == "Content-Type: audio/opus\r\n");
+static_assert(get_content_type("public/assets.d/noextension") == default_content_type);
+} // namespace web_server
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef OGG_STREAM
+#define OGG_STREAM
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "../server.h"
+
+// GET /stream/<station>.opus is the station as one continuous Ogg Opus stream, sent with chunked transfer encoding, for anything
+// which can play Ogg Opus itself (native players, <audio>, curl) rather than decoding the websocket chunks. Every file is its own
+// Ogg stream, with its own serial number, page numbers and granule positions, so each page a station broadcasts is rewritten into
+// the station's stream once, on whichever thread makes its chunks, and a chunk's pages are published as one HTTP chunk on the
+// station's ogg_stream channel, which every listener's write shares. A new listener is sent the response header with the stream's
+// OpusHead and OpusTags pages first (which never change), then the backlog, so it starts on a page like anything else.
+// It's HTTP/1.1 only, HTTP/2 responses are translated from a whole response, so over HTTP/2 the stream is reset with
+// HTTP_1_1_REQUIRED, and browsers ask again on an HTTP/1.1 connection.
+
+namespace ogg_stream {
+constexpr uint16_t PRE_SKIP = 312; // what opusenc uses, each file's own pre-skip isn't kept
+constexpr uint8_t CHANNELS = 2;    // mono packets decode as stereo just as well
+
+auto serial_number(std::string_view station) -> uint32_t; // from the name, so a worker's header is the same as the audio process's
+// the HTTP response header and a first chunk with the OpusHead and OpusTags pages, built once for each station
+auto response_header(std::string_view station) -> tcp_tls_server::shared_buffer;
+
+class writer { // used by one thread at a time, whichever makes the station's chunks
+  uint32_t serial{};
+  uint32_t page_sequence = 2; // after the header pages
+  uint64_t granule = PRE_SKIP; // 48kHz samples up to the end of the last whole packet, including the pre-skip
+  std::array<unsigned char, 2> packet_start{}; // the start of the packet being read, which may carry on onto the next page, for its duration
+  size_t packet_start_length{};
+  bool in_packet = false;
+
+public:
+  writer() = default;
+  explicit writer(std::string_view station) : serial(serial_number(station)) {}
+
+  // the pages rewritten into the station's stream as one HTTP chunk, empty if none of them are valid
+  auto make_chunk(const std::vector<std::string_view> &pages) -> tcp_tls_server::shared_buffer;
+};
+} // namespace ogg_stream
+
+#endif
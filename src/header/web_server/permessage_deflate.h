@@ -0,0 +1,22 @@
+#ifndef PERMESSAGE_DEFLATE
+#define PERMESSAGE_DEFLATE
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The permessage-deflate WebSocket extension (RFC 7692), always with no context takeover in both directions, so every
+// message is compressed on its own. That's what lets a broadcast chunk be compressed once and the same compressed
+// frame be sent to every listener which negotiated the extension.
+
+namespace web_server {
+const std::string permessage_deflate_response_header{"Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; client_no_context_takeover\r\n"};
+
+auto accepts_permessage_deflate(std::string_view offers) -> bool; // whether any of the offers in a Sec-WebSocket-Extensions header can be accepted
+
+// the zlib streams are kept per thread, and reset for each message
+auto deflate_message(std::string_view payload, std::string &compressed) -> bool;
+auto inflate_message(std::string_view compressed, std::vector<char> &payload, size_t max_size) -> bool; // false if it's invalid or larger than max_size
+} // namespace web_server
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef RELAY
+#define RELAY
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common_structs_enums.h"
+
+// With RELAY: <host:port> in the config this server is an edge, which has no audio of its own and rebroadcasts an origin's
+// stations instead. At startup it gets the origin's station list, and then keeps one /ws/mux connection to the origin, over
+// which it subscribes to every station's audio, metadata, queue and list. The chunks it gets are published to the server
+// threads just like a local station's, so listeners on the edge get the same frames, backlog and fast start. Every chunk has
+// a sequence number ("seq"), and when the connection drops the edge reconnects and resubscribes with the last one it got,
+// and the origin sends everything after that which is still in its backlog, so a short outage doesn't leave a gap. Track and
+// skip requests made on the edge are sent on to the origin, and the reply comes back the same way.
+// The startup fetch is tried once and is bounded by STATION_LIST_TIMEOUT_MS, an edge whose origin isn't up exits straight away.
+// The connection (resolving the origin, connecting and the handshake) is made on a thread of its own, which wakes the central
+// thread once it's done, so the central thread never waits on the origin. After that everything sent to the origin is sent without
+// blocking, and if it can't all go the connection is shut down and made again. Only plain TCP is supported to the origin.
+
+namespace relay {
+constexpr int CONNECT_TIMEOUT_MS = 1000;
+constexpr int HANDSHAKE_TIMEOUT_MS = 2000;
+constexpr int STATION_LIST_TIMEOUT_MS = 3000; // for all of the startup fetch, connecting included
+constexpr int64_t DUPLICATE_WINDOW = 1000; // chunks at most this far behind the last one are taken to be resent, rather than a restarted origin's
+
+struct origin_address {
+  std::string host{};
+  std::string port{};
+};
+
+auto parse_address(const std::string &address) -> origin_address; // "host:port"
+auto fetch_station_list(const origin_address &origin) -> std::vector<std::string>; // the station names from /station_list, empty if it couldn't in time
+// connects to /ws/mux, -1 if it couldn't, anything sent straight after the handshake is put in leftover, this blocks
+auto connect_to_origin(const origin_address &origin, std::string &leftover) -> int;
+
+// a masked text frame, like any client sends, without blocking, if it can't all be sent the connection is shut down (so its read fails)
+auto send_text(int fd, std::string_view payload) -> bool;
+auto subscribe_message(const std::string &station, int64_t after_sequence) -> std::string;
+auto request_message(int64_t id, std::string_view type, const std::string &station, const std::string &track = {}) -> std::string;
+
+class frame_reader { // the origin's frames aren't masked, and may be fragmented
+  std::string buffer{};
+  std::string message{};
+
+public:
+  template <typename F>
+  auto feed(int fd, const char *data, size_t length, F &&callback) -> bool { // callback gets each whole text message, false once the origin closes the connection
+    buffer.append(data, length);
+
+    size_t offset = 0;
+    while (buffer.size() - offset >= 2) {
+      const auto *frame = reinterpret_cast<const unsigned char *>(buffer.data() + offset);
+      const bool fin = (frame[0] & 0x80) != 0;
+      const int opcode = frame[0] & 0x0F;
+      uint64_t payload_length = frame[1] & 0x7F;
+      size_t header_length = 2;
+      if (payload_length == 126 || payload_length == 127) {
+        const size_t extended = payload_length == 126 ? 2 : 8;
+        if (buffer.size() - offset < 2 + extended) {
+          break;
+        }
+        payload_length = 0;
+        for (size_t i = 0; i < extended; i++) {
+          payload_length = (payload_length << 8) | frame[2 + i];
+        }
+        header_length += extended;
+      }
+      if (buffer.size() - offset - header_length < payload_length) {
+        break; // the rest of it is in the next read
+      }
+
+      const std::string_view payload(buffer.data() + offset + header_length, payload_length);
+      offset += header_length + payload_length;
+
+      if (opcode == web_server::websocket_non_control_opcodes::close_connection) {
+        return false;
+      }
+      if (opcode == web_server::websocket_non_control_opcodes::ping) {
+        send_control(fd, web_server::websocket_non_control_opcodes::pong, payload);
+        continue;
+      }
+      if (opcode == web_server::websocket_non_control_opcodes::pong) {
+        continue;
+      }
+
+      message.append(payload); // continuation frames have an opcode of 0
+      if (fin) {
+        callback(std::string_view(message));
+        message.clear();
+      }
+    }
+    buffer.erase(0, offset);
+    return true;
+  }
+
+  static void send_control(int fd, int opcode, std::string_view payload); // masked, for the pongs, sent like send_text
+};
+
+enum class message_kind {
+  AUDIO,    // a chunk, data is the chunk's JSON as the origin broadcast it
+  METADATA,
+  UPDATE,   // the queue or list changed, topic is "queue_update" or "list_update"
+  REPLY,    // to one of our requests
+  OTHER
+};
+
+struct message {
+  message_kind kind = message_kind::OTHER;
+  std::string station{};
+  std::string topic{};
+  std::string_view data{}; // for chunks, pointing into the message
+  std::string result{};    // for updates and replies
+  int64_t id = -1;
+  bool error = false;
+  int64_t sequence = -1; // for chunks
+};
+
+auto parse_message(std::string_view payload) -> message;
+auto chunk_pages(std::string_view audio) -> std::vector<std::string>; // the Ogg pages in a chunk's JSON, for the station's /stream/
+
+struct pending_request { // waiting on the origin's reply
+  std::string type{};      // "request" or "skip" from one of our server threads, or "queue" or "list" after connecting
+  int thread_id = -1;
+  int request_handle = -1;
+  int station_id = -1;
+};
+
+struct station_state {
+  int64_t last_sequence = -1;             // the last chunk published, resumed from after reconnecting
+  std::unordered_map<uint64_t, std::string> pending_audio{}; // by sequence, until the metadata for it comes
+};
+
+struct state {
+  origin_address origin{};
+  int fd = -1; // -1 while disconnected, it's retried with the 5 second timer
+  std::chrono::steady_clock::time_point connected{};
+  std::thread connecting{};  // joinable while it's connecting, it writes to connected_efd once it's done
+  int connected_efd = -1;
+  int connecting_fd = -1;    // what connect_to_origin gave, read once connecting has been joined
+  std::string connecting_leftover{};
+  frame_reader reader{};
+  std::vector<station_state> stations{}; // by station id
+  std::unordered_map<int64_t, pending_request> requests{}; // by id, failed if the connection drops
+  int64_t next_request_id = 1;
+};
+} // namespace relay
+
+#endif
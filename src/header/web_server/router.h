@@ -0,0 +1,132 @@
+#ifndef ROUTER
+#define ROUTER
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+// Declarative routing on the first path segment, the table is built at compile time.
+// A route is declared with a pattern, e.g "audio_req/{station}/{track}", where the first
+// segment is matched exactly, and the rest are parameters which are passed to the handler
+// as views into the path. A pattern ending in "*" takes any number of parameters.
+
+namespace web_server {
+constexpr int ROUTE_ANY_PARAMS = -1;
+
+struct path_params {
+  static constexpr size_t MAX_PARAMS = 8;
+
+  std::array<std::string_view, MAX_PARAMS> params{};
+  size_t count{}; // may be more than MAX_PARAMS, only the first MAX_PARAMS are kept
+
+  constexpr auto size() const -> size_t { return count; }
+  constexpr auto operator[](size_t idx) const -> std::string_view { return params[idx]; }
+};
+
+struct split_path_data {
+  std::string_view first_segment{};
+  path_params params{};
+};
+
+constexpr auto split_path(std::string_view path) -> split_path_data { // like strtok_r with "/", empty segments are skipped
+  split_path_data data{};
+  bool first = true;
+
+  while (!path.empty()) {
+    const auto slash = path.find('/');
+    const auto segment = path.substr(0, slash);
+    path = slash == std::string_view::npos ? std::string_view{} : path.substr(slash + 1);
+
+    if (segment.empty()) {
+      continue;
+    }
+
+    if (first) {
+      data.first_segment = segment;
+      first = false;
+    } else {
+      if (data.params.count < path_params::MAX_PARAMS) {
+        data.params.params[data.params.count] = segment;
+      }
+      data.params.count++;
+    }
+  }
+
+  return data;
+}
+
+constexpr auto route_hash(std::string_view name) -> uint32_t { // FNV-1a
+  uint32_t hash = 2166136261U;
+  for (const auto character : name) {
+    hash ^= static_cast<uint8_t>(character);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+template <typename Handler>
+struct route {
+  std::string_view name{};
+  int num_params{};
+  Handler handler{};
+
+  constexpr route() = default;
+  constexpr route(std::string_view pattern, Handler handler) : handler(handler) {
+    const auto data = split_path(pattern);
+    name = data.first_segment;
+    num_params = static_cast<int>(data.params.size());
+    if (num_params > 0 && data.params[data.params.size() - 1] == "*") {
+      num_params = ROUTE_ANY_PARAMS;
+    }
+  }
+};
+
+template <typename Handler, size_t N>
+class router {
+  static constexpr size_t TABLE_SIZE = std::bit_ceil(N * 2); // open addressing, at most half full
+
+  std::array<route<Handler>, N> routes{};
+  std::array<int, TABLE_SIZE> table{};
+
+public:
+  constexpr explicit router(const std::array<route<Handler>, N> &routes) : routes(routes) {
+    table.fill(-1);
+    for (size_t i = 0; i < N; i++) {
+      auto slot = route_hash(routes[i].name) & (TABLE_SIZE - 1);
+      while (table[slot] != -1) {
+        if (routes[table[slot]].name == routes[i].name) {
+          throw "duplicate route"; // fails to compile, since this is only evaluated at compile time
+        }
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+      }
+      table[slot] = static_cast<int>(i);
+    }
+  }
+
+  // the route with this first segment, if its number of parameters also matches
+  constexpr auto find(std::string_view name, size_t num_params) const -> const route<Handler> * {
+    auto slot = route_hash(name) & (TABLE_SIZE - 1);
+    while (table[slot] != -1) {
+      const auto &found = routes[table[slot]];
+      if (found.name == name) {
+        const bool params_match = found.num_params == ROUTE_ANY_PARAMS || static_cast<size_t>(found.num_params) == num_params;
+        return params_match ? &found : nullptr;
+      }
+      slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+    return nullptr;
+  }
+};
+
+template <typename Handler, size_t N>
+constexpr auto make_router(const route<Handler> (&routes)[N]) -> router<Handler, N> {
+  std::array<route<Handler>, N> route_array{};
+  for (size_t i = 0; i < N; i++) {
+    route_array[i] = routes[i];
+  }
+  return router<Handler, N>(route_array);
+}
+} // namespace web_server
+
+#endif
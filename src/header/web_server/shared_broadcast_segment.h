@@ -0,0 +1,86 @@
+#ifndef SHARED_BROADCAST_SEGMENT
+#define SHARED_BROADCAST_SEGMENT
+
+#include <atomic>
+#include <cstdint>
+
+#include "broadcast_ring.h"
+
+// With WORKERS in the config the server threads are in worker processes, and the broadcasts get to them through shared memory
+// (a memfd which each worker maps) rather than the broadcast ring. The audio process copies every frame in once and writes
+// each worker's eventfd, and each worker copies them out into its own broadcast ring, which its server threads read as usual.
+// The audio process never waits on a worker, anything a worker didn't get to before it was written over is skipped, the same
+// way the slowest listeners have chunks dropped. Each entry's slot and bytes are checked again after they're copied out, like
+// a seqlock, so a worker can tell if the audio process was writing over them in the meantime.
+
+namespace web_server {
+class shared_broadcast_segment {
+public:
+  static constexpr size_t NUM_SLOTS = 4096;                  // as many entries as the broadcast ring
+  static constexpr size_t DATA_CAPACITY = size_t(64) << 20; // for the frames, far more than the entries in the slots take up
+
+private:
+  struct alignas(64) segment_header {
+    std::atomic<uint64_t> head{};                 // everything before this has been published
+    alignas(64) std::atomic<uint64_t> written{}; // bytes of frames which have been (or are being) written, in total
+  };
+
+  struct slot {
+    std::atomic<uint64_t> epoch{}; // the entry's epoch + 1, 0 while it's being written
+    std::atomic<int32_t> channel_id{};
+    std::atomic<uint32_t> frame_length{};
+    std::atomic<uint32_t> deflated_length{}; // the compressed frame is straight after the frame
+    std::atomic<uint64_t> position{};        // where the frame starts, in bytes written in total
+    std::atomic<uint64_t> sequence{};
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "the atomics are shared between processes");
+  static constexpr size_t SIZE = sizeof(segment_header) + NUM_SLOTS * sizeof(slot) + DATA_CAPACITY;
+
+  int memfd = -1;
+  void *mapping = nullptr;
+  segment_header *header = nullptr;
+  slot *slots = nullptr;
+  char *data = nullptr;
+
+  void copy_in(uint64_t position, const char *buff, size_t length);
+  void copy_out(uint64_t position, char *buff, size_t length) const;
+
+public:
+  static auto create() -> int; // a new memfd for the segment, made by the audio process and passed to each worker
+  explicit shared_broadcast_segment(int memfd); // maps it, in either process
+  ~shared_broadcast_segment();
+  shared_broadcast_segment(shared_broadcast_segment const &) = delete;
+  void operator=(shared_broadcast_segment const &) = delete;
+
+  auto fd() const -> int { return memfd; }
+
+  // only from the audio process's central thread
+  void publish(const broadcast_entry &entry);
+
+  auto published() const -> uint64_t { return header->head.load(std::memory_order_acquire); }
+  auto read(uint64_t epoch, broadcast_entry &entry) const -> bool; // a copy of the entry, false if it's been written over since
+
+  template <typename F>
+  auto consume(uint64_t &cursor, F &&callback) const -> uint64_t { // everything published since the cursor, returns how many entries were skipped
+    const auto end = published();
+    uint64_t skipped = 0;
+    if (end - cursor > NUM_SLOTS) { // those slots have been reused already
+      skipped += end - NUM_SLOTS - cursor;
+      cursor = end - NUM_SLOTS;
+    }
+
+    broadcast_entry entry{};
+    for (; cursor < end; cursor++) {
+      if (read(cursor, entry)) {
+        callback(static_cast<const broadcast_entry &>(entry));
+      } else {
+        skipped++;
+      }
+    }
+    return skipped;
+  }
+};
+} // namespace web_server
+
+#endif
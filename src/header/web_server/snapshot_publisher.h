@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_PUBLISHER
+#define SNAPSHOT_PUBLISHER
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Hands immutable snapshots from the central thread to the server threads, RCU style. A new snapshot is swapped in
+// whole, and readers keep whichever one they loaded alive for as long as they hold it. The generation is bumped after
+// each swap, so a reader only has to load the pointer again once the generation changes, see basic_web_server::get_stations.
+
+namespace web_cache {
+template <typename T>
+class snapshot_publisher {
+  std::atomic<std::shared_ptr<const T>> current{};
+  std::atomic<uint64_t> generation{}; // 0 means nothing has been published
+
+public:
+  void publish(std::shared_ptr<const T> snapshot) { // only from one thread
+    current.store(std::move(snapshot), std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_release); // after the store, so a reader who sees it gets this snapshot or a later one
+  }
+
+  // safe to call from any thread
+  auto current_generation() const -> uint64_t { return generation.load(std::memory_order_acquire); }
+  auto snapshot() const -> std::shared_ptr<const T> { return current.load(std::memory_order_acquire); }
+};
+} // namespace web_cache
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef STATIC_ASSETS
+#define STATIC_ASSETS
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "snapshot_publisher.h"
+
+// An immutable snapshot of everything under public/, for fixed deployments.
+// Every file is loaded into a single mapping at startup along with its full pre-rendered
+// response (status line, headers and body), and looked up via a perfect hash on the filepath,
+// so serving one of these is just a write. Reloading builds a new snapshot and swaps it in,
+// anything still writing from the old snapshot keeps it alive until it's done.
+
+namespace web_cache {
+struct static_asset {
+  std::string filepath{}; // empty if this slot is unused
+  const char *response = nullptr;
+  size_t length{};
+};
+
+class asset_snapshot {
+  void *region = nullptr; // every response lives in here, read only once built
+  size_t region_size{};
+
+  // perfect hash (hash and displace), the bucket of a key gives the seed which places it in a unique slot
+  std::vector<uint32_t> displacements{};
+  std::vector<static_asset> slots{};
+
+  static_asset not_found{}; // the 404 page has a 404 status line rather than a 200 one
+
+  friend class static_asset_store;
+
+public:
+  asset_snapshot() = default;
+  asset_snapshot(const asset_snapshot &) = delete;
+  void operator=(const asset_snapshot &) = delete;
+
+  auto find(std::string_view filepath, bool not_found_response = false) const -> const static_asset *;
+  auto size() const -> size_t { return region_size; }
+
+  ~asset_snapshot();
+};
+
+class static_asset_store {
+  snapshot_publisher<asset_snapshot> published{}; // nothing published means the store is unused
+
+  std::string root{};
+  std::string not_found_filepath{};
+  bool huge_pages = false;
+  bool loaded = false;
+
+  static_asset_store() = default;
+
+  auto build() -> std::shared_ptr<const asset_snapshot>; // walks the root directory and builds a new snapshot
+
+public:
+  static_asset_store(static_asset_store const &) = delete;
+  void operator=(static_asset_store const &) = delete;
+
+  static auto instance() -> static_asset_store & {
+    static static_asset_store inst;
+    return inst;
+  }
+
+  // only call these from the central thread
+  void load(const std::string &root, const std::string &not_found_filepath, bool huge_pages);
+  auto reload() -> bool;
+
+  // safe to call from any thread, the generation is only checked so that the snapshot is only fetched when it changed
+  auto current_generation() const -> uint64_t { return published.current_generation(); }
+  auto snapshot() const -> std::shared_ptr<const asset_snapshot> { return published.snapshot(); }
+};
+} // namespace web_cache
+
+#endif
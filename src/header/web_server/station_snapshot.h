@@ -0,0 +1,56 @@
+#ifndef STATION_SNAPSHOT
+#define STATION_SNAPSHOT
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../server.h"
+#include "snapshot_publisher.h"
+
+// An immutable snapshot of the state of every station, published by the central thread whenever
+// something in it changes (the audio list or the queue of a station), so that the read only
+// station endpoints are answered on the server threads directly, without going through the
+// central thread. Each server thread holds onto the latest snapshot it has seen, and only
+// fetches a new one once the generation changes.
+
+namespace web_cache {
+struct station_state {
+  std::string name{};
+  int id = -1; // the audio server id, which the broadcast channels are worked out from
+  tcp_tls_server::shared_buffer audio_list_response{};
+  tcp_tls_server::shared_buffer audio_queue_response{};
+  tcp_tls_server::shared_buffer stream_header{}; // the response header and first pages for /stream/, see ogg_stream.h
+};
+
+struct station_snapshot {
+  std::vector<station_state> stations{}; // there are only a few stations, so these are just searched through
+  tcp_tls_server::shared_buffer station_list_response{};
+
+  auto find(std::string_view name) const -> const station_state *;
+};
+
+class station_snapshot_store {
+  snapshot_publisher<station_snapshot> published{};
+
+  station_snapshot_store() = default;
+
+public:
+  station_snapshot_store(station_snapshot_store const &) = delete;
+  void operator=(station_snapshot_store const &) = delete;
+
+  static auto instance() -> station_snapshot_store & {
+    static station_snapshot_store inst;
+    return inst;
+  }
+
+  void publish(std::shared_ptr<const station_snapshot> snapshot) { published.publish(std::move(snapshot)); } // only call this from the central thread
+
+  // safe to call from any thread, the generation is only checked so that the snapshot is only fetched when it changed
+  auto current_generation() const -> uint64_t { return published.current_generation(); }
+  auto snapshot() const -> std::shared_ptr<const station_snapshot> { return published.snapshot(); }
+};
+} // namespace web_cache
+
+#endif
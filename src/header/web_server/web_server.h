@@ -2,21 +2,29 @@
 #define BASIC_WEB_SERVER
 
 #include "../callbacks.h"
-#include "../data_store.h"
+#include "../cpu_placement.h"
+#include "../msg_ring.h"
 #include "../server.h"
 #include "../utility.h"
 
 #include "../utility.h"
 
+#include "broadcast_ring.h"
 #include "cache.h"
 #include "common_structs_enums.h"
-
-#include "../../vendor/readerwriterqueue/atomicops.h"
-#include "../../vendor/readerwriterqueue/readerwriterqueue.h"
-
+#include "http2.h"
+#include "mailbox.h"
+#include "mime_types.h"
+#include "permessage_deflate.h"
+#include "router.h"
+#include "static_assets.h"
+#include "station_snapshot.h"
+
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <utility>
+#include <variant>
 
 #include <openssl/evp.h>
 #include <openssl/sha.h>
@@ -27,6 +35,7 @@ using namespace web_cache;
 
 constexpr int BROADCAST_INTERVAL_MS = 3000; // used for audio broadcasts, and any other if necessary, high enough to allow for the system to queue new audio for audio broadcasts
 constexpr uint32_t WS_PING_INTERVAL = 30000;
+constexpr uint32_t WS_PING_SPREAD_STEP = WS_PING_INTERVAL * 0.618; // the golden ratio spaces out the first pings of consecutive websockets evenly over the interval
 constexpr uint32_t CACHE_SIZE = 5;
 
 extern std::chrono::system_clock::time_point time_start;
@@ -39,38 +48,158 @@ const std::string default_plain_text_http_header{"HTTP/1.0 200 OK\r\nContent-Typ
 const std::string default_plain_json_http_header{"HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nCache-Control: no-cache, no-store, must-revalidate\r\nConnection: close\r\nKeep-Alive: timeout=0, max=0\r\n\r\n"};
 
 namespace web_server {
-struct receiving_data_info {
-  receiving_data_info(int length = -1, std::vector<char> buffer = {}) : length(length), buffer(std::move(buffer)) {}
-  int length = -1;
-  std::vector<char> buffer{};
+constexpr size_t WS_MAX_HEADER_SIZE = 14;                 // 2 bytes, up to 8 for the extended length, and the 4 byte masking key
+constexpr size_t WS_DEFAULT_MAX_PAYLOAD_SIZE = 1 << 20;   // WS_MAX_PAYLOAD in the config overrides this
+constexpr size_t DEFAULT_MAX_QUEUED_CHUNKS = 4;           // MAX_QUEUED_CHUNKS in the config overrides this
+constexpr size_t WS_MAX_CONTROL_PAYLOAD_SIZE = 125;
+
+struct ws_frame { // a frame whose payload has been unmasked in place, so it's only valid until the buffer it came from is reused
+  bool fin = false;
+  bool compressed = false; // RSV1, set on the first frame of a message compressed with permessage-deflate
+  uint8_t opcode{};
+  char *payload = nullptr;
+  size_t length{};
+};
 
-  ~receiving_data_info(){};
+constexpr size_t WS_MAX_SERVER_HEADER_SIZE = 10; // frames we send aren't masked
+
+// makes a frame which can be shared between any number of writes, the header is written into headroom in front of the payload,
+// payloads larger than fragment_size (if it's set) are split into fragments instead, one after the other in the same buffer
+auto make_shared_ws_frame(std::string_view payload, websocket_non_control_opcodes opcode, bool compressed = false, size_t fragment_size = 0) -> tcp_tls_server::shared_buffer;
+// the same, but the payload is compressed first, for websockets with permessage-deflate, empty if compressing failed
+auto make_shared_deflated_ws_frame(std::string_view payload, websocket_non_control_opcodes opcode, size_t fragment_size = 0) -> tcp_tls_server::shared_buffer;
+// the fragments of a frame made above, as views into the same buffer, so each can be written separately with other writes in between
+void split_ws_fragments(const tcp_tls_server::shared_buffer &frame, std::vector<tcp_tls_server::shared_buffer> &fragments);
+
+// a copy of a broadcast frame (whose payload is JSON) as {"channel": "<station>/<topic>", "data": <payload>}, for connections which
+// are subscribed to several channels, made once per chunk and shared like the original
+auto make_tagged_ws_frame(std::string_view station, std::string_view topic, const tcp_tls_server::shared_buffer &frame, bool deflate = false, size_t fragment_size = 0) -> tcp_tls_server::shared_buffer;
+// a new listener's burst from the station's untagged backlog, tagged for the channel if it needs to be (so this can be slow, with deflate)
+auto make_burst_frames(const radio_channel &channel, const std::vector<tcp_tls_server::shared_buffer> &backlog, bool deflate, size_t fragment_size) -> std::vector<tcp_tls_server::shared_buffer>;
+
+struct ws_parse_state { // for frames split across reads, the buffers are kept for the next frame so they're allocated only once
+  std::vector<char> partial_frame{};   // the start of a frame, waiting for the rest of it
+  std::vector<char> completed_frame{}; // a frame which was completed in the last read, frames can point into this
+  int64_t frame_length{};              // the full length of the partial frame, 0 if not enough of the header has been received yet
 };
 
 struct ws_client {
   int currently_writing = 0; //items it is currently writing
   bool close = false;        //should this socket be closed
   std::vector<char> websocket_frames{};
-  receiving_data_info receiving_data{};
+  uint8_t message_opcode{}; // the opcode of the message websocket_frames is part of
+  bool message_compressed = false;
+  bool deflate = false; // negotiated permessage-deflate, so it's sent compressed broadcasts
+  ws_parse_state parse_state{};
   int id = 0;          //in case we use io_uring later
   int client_idx = -1; //for the TCP/TLS layer
+
+  std::string station{};              // the station in the path it connected on (none for /ws/mux), control messages are for this station unless they say otherwise
+  std::string ip{};                   // skip votes are counted per IP
+  int pending_control_requests = 0; // control requests waiting on the central thread
+  std::vector<int> pending_channels{}; // audio/metadata subscriptions waiting on the central thread, so they aren't asked for twice (-1 for a /radio/ path's station this thread doesn't know yet)
+  std::string ingest_station{};        // connected on /ws/ingest/<station>, so it's a live source rather than a listener
+  bool ingest_authorised = false;      // it's sent the key, after that its binary messages are the station's Ogg/Opus stream
 };
 
-struct message_post_data {
-  message_type msg_type{};
+// control messages which are answered by the central thread (skips and track requests) are given a request handle, like HTTP/2 streams,
+// so that the response finds its way back to the websocket, the slot's generation makes sure a reused slot doesn't get an old response
+constexpr int WS_CONTROL_SLOT_BITS = 16;
+constexpr int WS_CONTROL_GENERATION_MASK = 0x1fff;
+constexpr int WS_MAX_PENDING_CONTROL_REQUESTS = 8; // per websocket
+
+constexpr auto ws_control_handle(int slot, int generation) -> int { return -(http2::STREAM_HANDLE_LIMIT + (((generation & WS_CONTROL_GENERATION_MASK) << WS_CONTROL_SLOT_BITS) | slot)); }
+constexpr auto handle_to_ws_control_slot(int handle) -> int { return (-handle - http2::STREAM_HANDLE_LIMIT) & ((1 << WS_CONTROL_SLOT_BITS) - 1); }
+constexpr auto handle_to_ws_control_generation(int handle) -> int { return (-handle - http2::STREAM_HANDLE_LIMIT) >> WS_CONTROL_SLOT_BITS; }
+constexpr auto is_ws_control_handle(int handle) -> bool { return handle <= -http2::STREAM_HANDLE_LIMIT; }
+
+static_assert(handle_to_ws_control_slot(ws_control_handle(1234, 567)) == 1234 && handle_to_ws_control_generation(ws_control_handle(1234, 567)) == 567);
+static_assert(is_ws_control_handle(ws_control_handle(0, 0)) && !http2::is_stream_handle(ws_control_handle(0, 0)));
+static_assert(is_ws_control_handle(ws_control_handle((1 << WS_CONTROL_SLOT_BITS) - 1, WS_CONTROL_GENERATION_MASK)));
+
+struct ws_control_request {
+  int ws_client_idx = -1;
+  int ws_client_id{};
+  int64_t id = -1; // the id the client gave the request, it's sent back with the response
+  std::string type{};
+  int generation{};
+  bool active = false;
+};
 
-  const char *buff_ptr{};
-  int64_t length = -1;
+// a message pushed to the subscribers of a station's queue_updates or list_updates channel, made once by the central thread
+auto make_ws_control_update(std::string_view type, std::string_view station, std::string_view result) -> tcp_tls_server::shared_buffer;
 
-  std::vector<char> buff{};
-
-  int item_idx = -1;
+// messages between the server threads and the central thread, each is only as big as what it needs
+struct new_radio_client_msg {
+  std::string station{}; // "<station>/<connection type>"
+  int ws_client_idx = -1;
+  int ws_client_id{};
+  bool deflate = false; // the backlog it's sent is compressed if so
+  int64_t after_sequence = -1; // if set, the backlog is every chunk after this one, for a relay resuming
+};
+struct radio_client_left_msg {
+  int broadcast_channel_id = -1;
+};
+struct broadcast_chunks_dropped_msg {
+  int broadcast_channel_id = -1;
+  size_t num_dropped{};
+};
+struct skip_request_msg {
+  int request_handle = -1;
+  std::string station{};
+  std::string ip{};
+};
+struct audio_track_request_msg {
+  int request_handle = -1;
+  std::string station{};
+  std::string track{};
+};
+struct ingest_msg { // some of a live source's stream, or that it's gone
+  std::string station{};
+  int ws_client_idx = -1;
+  int ws_client_id{};
+  std::vector<char> data{};
+  bool ended = false;
+};
+struct new_stream_client_msg { // a /stream/ listener, which has been sent the header and wants the backlog
+  int server_id = -1;
+  int client_idx = -1;
+  int listener_id{};
+};
+using program_message = std::variant<new_radio_client_msg, radio_client_left_msg, broadcast_chunks_dropped_msg, skip_request_msg, audio_track_request_msg, ingest_msg, new_stream_client_msg>;
+
+struct new_radio_client_response_msg { // all in one, so a websocket which has gone (or unsubscribed) is only uncounted once
+  int ws_client_idx = -1;
+  int ws_client_id{};
+  int broadcast_channel_id = -1; // -1 if the connection should be closed
+  std::vector<tcp_tls_server::shared_buffer> backlog{}; // frames, shared rather than copied
+  uint64_t station_broadcasts_before{}; // the station's ring's epoch when the backlog was read, with DIRECT_BROADCASTS
+};
+struct new_stream_client_response_msg { // all in one, so a listener which has gone is only uncounted once
+  int client_idx = -1;
+  int listener_id{};
+  int broadcast_channel_id = -1;
+  std::vector<tcp_tls_server::shared_buffer> backlog{}; // HTTP chunks, shared rather than copied
+  uint64_t station_broadcasts_before{};
+};
+struct skip_request_response_msg {
+  int request_handle = -1;
+  std::vector<char> response{};
+};
+struct audio_track_response_msg {
+  int request_handle = -1;
+  tcp_tls_server::shared_buffer response{};
+};
+struct server_message {
+  std::variant<new_radio_client_response_msg, skip_request_response_msg, audio_track_response_msg, new_stream_client_response_msg> body{};
+  uint64_t broadcasts_before{}; // the broadcast ring's epoch when this was posted, those broadcasts are dealt with first
+};
 
-  int64_t additional_info = -1;
-  int64_t additional_info2 = -1;
-  // for any extra data
-  std::string additional_str{};
-  std::string additional_str2{};
+struct thread_load { // written by its server thread, read by the central thread to balance new connections between them
+  std::atomic<uint32_t> subscriptions{}; // websocket channel subscriptions, which is what each broadcast is written to
+  std::atomic<int> reuseport_index{-1};  // its listener's place in the SO_REUSEPORT group, once it's listening
+  thread_load() = default;
+  thread_load(thread_load &&other) noexcept {} // only before the thread starts
 };
 
 struct broadcast_set_data {
@@ -85,13 +214,6 @@ struct broadcast_set_data {
   broadcast_set_data() = default;
 };
 
-struct broadcast_data_items {
-  const char *buff_ptr{};
-  size_t data_len{};
-  size_t uses{};
-  broadcast_data_items(const char *buff_ptr = nullptr, int64_t data_len = -1, int64_t uses = -1) : buff_ptr(buff_ptr), data_len(data_len), uses(uses) {}
-};
-
 template <server_type T>
 class basic_web_server {
   //
@@ -99,16 +221,69 @@ class basic_web_server {
   //
   tcp_tls_server::server<T> *tcp_server = nullptr;
 
-  auto get_content_type(const std::string &filepath) -> std::string;
+  // this thread's reference to the preloaded public/ snapshot, only refetched when a new one is published
+  std::shared_ptr<const asset_snapshot> static_assets{};
+  uint64_t static_assets_generation{};
+  auto get_static_assets() -> const asset_snapshot *;
+
+  // likewise for the station state, which the station list, audio list and queue are answered from
+  std::shared_ptr<const station_snapshot> stations{};
+  uint64_t stations_generation{};
+  auto get_stations() -> const station_snapshot *;
+
+  //
+  ////http routing, the table of routes is in get_process
+  //
+  struct http_request {
+    std::string &path;
+    bool accept_bytes;
+    const std::string &sec_websocket_key;
+    int client_idx; // the request handle, so this can be an HTTP/2 stream
+    const std::string &ip;
+    const std::string &sec_websocket_extensions;
+  };
+  using route_handler = bool (basic_web_server::*)(http_request &request, const path_params &params);
+
+  auto route_websocket(http_request &request, const path_params &params) -> bool;
+  auto route_skip_track(http_request &request, const path_params &params) -> bool;
+  auto route_audio_list(http_request &request, const path_params &params) -> bool;
+  auto route_audio_req(http_request &request, const path_params &params) -> bool;
+  auto route_broadcast_metadata(http_request &request, const path_params &params) -> bool;
+  auto route_station_list(http_request &request, const path_params &params) -> bool;
+  auto route_audio_queue(http_request &request, const path_params &params) -> bool;
+  auto route_listen(http_request &request, const path_params &params) -> bool;
+  auto route_stream(http_request &request, const path_params &params) -> bool;
+  auto route_public_file(http_request &request) -> bool; // anything not routed is a file in public/
+
+  //
+  ////http2 stuff////
+  //
+  std::unordered_map<int, http2::session> http2_sessions{}; // client idx to the session on that connection
+  std::vector<http2::stream> http2_streams{};
+  std::set<int> http2_freed_streams{}; // set of free slots in http2_streams
+
+  auto http2_new_stream(int client_idx, uint32_t stream_id) -> int; // returns the stream slot
+  void http2_close_stream(int slot);
+  auto http2_process_frame(int client_idx, http2::session &session, const http2::frame_header &header, const char *payload) -> bool; // false if the connection should stop reading
+  auto http2_process_headers(int client_idx, http2::session &session) -> bool;                                                       // a full header block has been received
+  auto http2_stream_open(int request_handle) -> bool;                                                                                // false if the stream has been closed
+  void http2_respond(int request_handle, tcp_tls_server::shared_buffer &&response);                                                  // the HTTP/1 response for this stream
+  void http2_require_http1(int request_handle);                                                                                      // resets the stream, so the client asks again over HTTP/1.1
+  void http2_send_body(int slot);                                                                                                    // sends as much of the body as flow control allows
+  void http2_send_all_bodies(http2::session &session);
+  void http2_connection_error(http2::session &session, http2::error_code error);
+  void http2_flush(int client_idx, http2::session &session);
 
   //
   ////websocket stuff////
   //
 
   //reading data from connections
-  auto get_ws_frame_length(const char *buffer) -> ulong;                                                             //helper function which reads the websocket header to get the length of the message
-  auto decode_websocket_frame(std::vector<char> &&data) -> std::pair<int, std::vector<char>>;                        //decodes a single full websocket frame
-  auto get_ws_frames(char *buffer, int length, int ws_client_idx) -> std::pair<int, std::vector<std::vector<char>>>; //gets any full websocket frames possible
+  auto get_ws_frame_length(const char *buffer, size_t length) const -> int64_t;                     //the full length of the frame from its header, 0 if more data is needed, -1 if it's invalid
+  static auto decode_ws_frame(char *frame, size_t frame_length) -> ws_frame;                           //decodes a single full websocket frame in place
+  auto get_ws_frames(char *buffer, size_t length, int ws_client_idx, std::vector<ws_frame> &frames) -> bool; //gets any full websocket frames possible, false if the connection should be closed
+  std::vector<ws_frame> received_ws_frames{};                                                          //reused for every read
+  std::vector<char> inflated_message{};                                                                //likewise for compressed messages
 
   //related to opening/closing connections
   auto get_accept_header_value(std::string input) -> std::string;        //gets the appropriate header value from the websocket connection request
@@ -119,13 +294,36 @@ class basic_web_server {
   std::set<int> freed_indexes{}; //set of free indexes for websocket client stuff
   std::vector<ws_client> websocket_clients{};
 
+  //control messages, sent by the client as JSON text frames on the station websocket
+  void websocket_control_cb(int ws_client_idx, std::string_view message);
+  void ws_control_reply(int ws_client_idx, int64_t id, const std::string &type, std::string_view result, bool error = false);
+  auto new_ws_control_request(int ws_client_idx, int64_t id, std::string type) -> int; // the request handle, -1 if it has too many already
+  void ws_control_respond(int request_handle, std::string_view http_response);         // the response from the central thread is an HTTP response, the body is sent back
+  std::vector<ws_control_request> ws_control_requests{};
+  std::vector<int> free_ws_control_slots{};
+
+  //a live source's messages on /ws/ingest/<station>, the key and then the stream, see audio_server::ingest
+  auto websocket_ingest_cb(int ws_client_idx, std::string_view message, bool binary) -> bool; // false if it's being closed
+
   //
   ////communication between threads////
   //
 
-  //lock free queues used to transport data between threads
-  moodycamel::ReaderWriterQueue<message_post_data> to_server_queue{};
-  moodycamel::ReaderWriterQueue<message_post_data> to_program_queue{};
+  //lock free mailboxes used to transport data between threads, the receiver is only woken when one goes from empty to not
+  mailbox<server_message> to_server_mailbox{};
+  mailbox<program_message> to_program_mailbox{};
+
+  void post_to_program(program_message &&message) {
+    if (to_program_mailbox.post(std::move(message))) {
+      msg_ring::send(program_ring_fd, msg_ring::kind::SERVER_THREAD, thread_idx, 0, central_communication_fd); //notify the program thread, using our eventfd unless MSG_RING is on
+    }
+  }
+  void post_to_server(server_message &&message) {
+    message.broadcasts_before = broadcast_ring::instance().published();
+    if (to_server_mailbox.post(std::move(message))) {
+      tcp_server->notify_event();
+    }
+  }
 
 public:
   static bool instance_exists; // used by anything which needs to be initialised before server threads are made
@@ -144,254 +342,199 @@ public:
 
   //thread stuff
   const int central_communication_fd = eventfd(0, 0); // set in main thread
+  int thread_idx = -1;      // which server thread this is, and the central thread's ring, for MSG_RING
+  int program_ring_fd = -1; // both set before the thread starts
+  thread_load load{};
+
+  std::vector<std::unordered_set<int>> broadcast_ws_clients_tcp_client_idxs{}; // subscribed websocket client idxs are in here, each client has its channels as well
+  std::vector<std::unordered_set<int>> broadcast_deflate_ws_clients_tcp_client_idxs{}; // the same for websockets with permessage-deflate, which get the compressed frames
+  auto broadcast_set(int channel_id, int client_idx) -> std::unordered_set<int> & { // /stream/ listeners aren't websockets, and are never compressed
+    const int ws_client_idx = tcp_clients[client_idx].ws_client_idx;
+    auto &sets = ws_client_idx != -1 && websocket_clients[ws_client_idx].deflate ? broadcast_deflate_ws_clients_tcp_client_idxs : broadcast_ws_clients_tcp_client_idxs;
+    if (sets.size() <= size_t(channel_id)) {
+      sets.resize(channel_id + 1);
+    }
+    return sets[channel_id];
+  }
+  auto subscribe_client(int channel_id, int client_idx) -> bool { // false if it was already subscribed
+    if (!broadcast_set(channel_id, client_idx).insert(client_idx).second) {
+      return false;
+    }
+    tcp_clients[client_idx].channels.push_back(channel_id);
+    load.subscriptions.store(load.subscriptions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+  }
+  void unsubscribe_client(int channel_id, int client_idx);
 
-  std::vector<broadcast_data_items> broadcast_data{}; // data from any broadcasts sent from the program thread
+  auto is_subscribed(int channel_id, int client_idx) const -> bool {
+    const auto &channels = tcp_clients[client_idx].channels;
+    return std::find(channels.begin(), channels.end(), channel_id) != channels.end(); // only ever a few channels per client
+  }
 
-  std::vector<std::unordered_set<int>> broadcast_ws_clients_tcp_client_idxs{}; // subscribed websocket client idxs are in here
-  void subscribe_client(int channel_id, int client_idx) {
-    if (broadcast_ws_clients_tcp_client_idxs.size() <= channel_id) {
-      broadcast_ws_clients_tcp_client_idxs.resize(channel_id + 1);
+  auto take_pending_channel(int channel_id, int client_idx) -> bool { // once the central thread has answered, false if it's been unsubscribed from since
+    auto &pending = websocket_clients[tcp_clients[client_idx].ws_client_idx].pending_channels;
+    auto channel = std::find(pending.begin(), pending.end(), channel_id);
+    if (channel == pending.end()) {
+      channel = std::find(pending.begin(), pending.end(), -1);
     }
-    broadcast_ws_clients_tcp_client_idxs[channel_id].insert(client_idx);
+    if (channel == pending.end()) {
+      return false;
+    }
+    pending.erase(channel);
+    return true;
   }
 
-  auto get_broadcast_set_data(int channel_id) -> broadcast_set_data {
-    if (broadcast_ws_clients_tcp_client_idxs.size() <= channel_id) {
-      broadcast_ws_clients_tcp_client_idxs.resize(channel_id + 1);
+  auto get_broadcast_set_data(int channel_id, bool deflate = false) -> broadcast_set_data {
+    auto &sets = deflate ? broadcast_deflate_ws_clients_tcp_client_idxs : broadcast_ws_clients_tcp_client_idxs;
+    if (sets.size() <= size_t(channel_id)) {
+      sets.resize(channel_id + 1);
     }
 
     if (channel_id >= 0) {
-      return broadcast_set_data(broadcast_ws_clients_tcp_client_idxs[channel_id]);
+      return broadcast_set_data(sets[channel_id]);
     }
     return {};
   }
 
-  void post_server_list_request_to_program(int client_idx) {
+  //broadcasts are published to the broadcast ring by the program thread, which then calls this once for all of them
+  void notify_broadcasts() {
     if (!tcp_server) {
-      return; // need this set before posting any messages
+      return; // they're read on the next wake up anyway
     }
-    message_post_data data;
-    data.msg_type = message_type::request_station_list;
-    data.item_idx = client_idx;
-    to_program_queue.enqueue(std::move(data));
-    // std::cout << "\t\tsize to program: \e[34m" << to_program_queue.size_approx() << "\e[0m" << std::endl;
-
-    eventfd_write(central_communication_fd, 1); //notify the program thread using our eventfd
-  }
-
-  void post_server_list_response_to_server(int client_idx, std::vector<char> &&str_data) {
-    if (!tcp_server) {
-      return; // need this set before posting any messages
+    if (to_server_mailbox.signal()) {
+      tcp_server->notify_event();
     }
-    message_post_data data;
-    data.msg_type = message_type::request_station_list_response;
-    data.item_idx = client_idx;
-    data.buff = str_data;
-    to_server_queue.enqueue(std::move(data));
-    // std::cout << "size to server: \e[34m" << to_server_queue.size_approx() << "\e[0m" << std::endl;
-    tcp_server->notify_event();
   }
-
-  void post_message_to_server_thread(message_type msg_type, const char *buff_ptr, int64_t length, int item_idx, int64_t additional_info = -1) { //called from the program thread, to notify the server thread
-    if (!tcp_server) {
-      return; // need this set before posting any messages
+  void read_broadcasts(uint64_t up_to = UINT64_MAX); // writes what's been published since last time to the subscribers, up to the epoch up_to
+  // at the start of a wake up, before the mailbox is drained, anything published after this could be after a response which isn't
+  // in the mailbox yet, so it's left for the next wake up (when the listener is subscribed)
+  // the same goes for each station's ring, with DIRECT_BROADCASTS
+  void mark_broadcasts() {
+    marked_broadcasts = broadcast_ring::instance().published();
+    for (size_t id = 0; id < station_readers.size(); id++) {
+      marked_station_broadcasts[id] = broadcast_ring::station(id).published();
     }
-    message_post_data data;
-    data.msg_type = msg_type;
-    data.buff_ptr = buff_ptr;
-    data.length = length;
-    data.item_idx = item_idx;
-    data.additional_info = additional_info;
-    to_server_queue.enqueue(std::move(data));
-    // std::cout << "size to server: \e[34m" << to_server_queue.size_approx() << "\e[0m" << std::endl;
-    tcp_server->notify_event();
   }
-
-  void post_memory_release_message_to_program(message_type msg_type, const char *buff_ptr, int64_t length, int item_idx, int64_t additional_info = -1) {
-    if (!tcp_server) {
-      return; // need this stuff set before posting any messages
+  void read_marked_broadcasts(); // up to the marks, and this thread is woken again if there's more, since the drain may have taken its wake up
+  uint64_t marked_broadcasts{};
+  std::vector<uint64_t> marked_station_broadcasts{}; // by station id
+  void read_station_broadcasts(int server_id = -1, uint64_t up_to = UINT64_MAX); // the same for the stations' rings (or just server_id's), with DIRECT_BROADCASTS
+  void write_broadcast(const broadcast_entry &entry);
+  const int broadcast_reader = broadcast_ring::instance().add_reader(); // made on the program thread, before this thread starts
+  std::vector<int> station_readers{};                                  // this thread's reader on each station's ring
+  std::vector<tcp_tls_server::shared_buffer> broadcast_fragments{};    // reused for every broadcast
+  size_t num_stream_listeners = 0;                                     // /stream/ listeners, which are sent broadcasts without any websockets open
+  int next_stream_listener_id = 0;
+
+  void add_station_readers() { // on the program thread before this thread starts, each station's audio thread wakes this one itself
+    for (size_t server_id = 0; server_id < broadcast_ring::num_stations(); server_id++) {
+      station_readers.push_back(broadcast_ring::station(server_id).add_reader([this] { notify_broadcasts(); }));
     }
-    message_post_data data;
-    data.msg_type = msg_type;
-    data.buff_ptr = buff_ptr;
-    data.length = length;
-    data.item_idx = item_idx;
-    data.additional_info = additional_info;
-    to_program_queue.enqueue(std::move(data));
-    // std::cout << "\t\tsize to program: \e[34m" << to_program_queue.size_approx() << "\e[0m" << std::endl;
-
-    eventfd_write(central_communication_fd, 1); //notify the program thread using our eventfd
+    marked_station_broadcasts.resize(station_readers.size());
   }
 
-  void post_new_radio_client_to_program(std::string station, int ws_client_idx, int ws_client_id) {
+  void post_new_radio_client_to_program(std::string station, int ws_client_idx, int ws_client_id, int64_t after_sequence = -1) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::new_radio_client;
-    data.item_idx = ws_client_idx;
-    data.additional_info = ws_client_id;
-    data.additional_str = std::move(station);
-    to_program_queue.enqueue(std::move(data));
-    // std::cout << "\t\tsize to program: \e[34m" << to_program_queue.size_approx() << "\e[0m" << std::endl;
-
-    eventfd_write(central_communication_fd, 1); //notify the program thread using our eventfd
+    post_to_program(new_radio_client_msg{std::move(station), ws_client_idx, ws_client_id, websocket_clients[ws_client_idx].deflate, after_sequence});
   }
 
-  void post_radio_client_left_to_server(int broadcast_channel_id) { // only used to indicate number listening to station has decreased
+  void post_radio_client_left_to_server(int broadcast_channel_id) { // only used to indicate number listening to station (or wanting tagged chunks) has decreased
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::radio_client_left;
-    data.additional_info = broadcast_channel_id;
-    to_program_queue.enqueue(std::move(data));
-    eventfd_write(central_communication_fd, 1); //notify the program thread using our eventfd
+    post_to_program(radio_client_left_msg{broadcast_channel_id});
   }
 
-  void post_new_radio_client_response_to_server(int ws_client_idx, int ws_client_id, std::vector<char> &&buff, int broadcast_channel_id = -1) {
+  void post_broadcast_chunks_dropped_to_program(int broadcast_channel_id, size_t num_dropped) { // counted per station, for listeners which can't keep up
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::new_radio_client_response;
-    data.item_idx = ws_client_idx;
-    data.additional_info = ws_client_id;
-    data.additional_info2 = broadcast_channel_id;
-    // we are storing the broadcast_channel_id in the pointer place becasue we need to, think of it as 'pointing' to the correct broadcast channel
-    data.buff = std::move(buff);
-    to_server_queue.enqueue(std::move(data));
-    // std::cout << "size to server: \e[34m" << to_server_queue.size_approx() << "\e[0m" << std::endl;
-    tcp_server->notify_event();
+    post_to_program(broadcast_chunks_dropped_msg{broadcast_channel_id, num_dropped});
   }
 
-  void post_skip_request_to_program(int client_idx, std::string station, std::string ip) {
+  void post_ingest_to_program(int ws_client_idx, std::vector<char> &&data, bool ended = false) { // the central thread closes it if the station already has a source
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::skip_request;
-    data.item_idx = client_idx;
-    data.additional_str = std::move(station);
-    data.additional_str2 = std::move(ip);
-    to_program_queue.enqueue(std::move(data));
-    eventfd_write(central_communication_fd, 1);
+    const auto &client = websocket_clients[ws_client_idx];
+    post_to_program(ingest_msg{client.ingest_station, ws_client_idx, client.id, std::move(data), ended});
   }
 
-  void post_skip_request_response_to_server(int client_idx, std::vector<char> &&buff) {
+  void post_new_stream_client_to_program(int server_id, int client_idx) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::skip_request_response;
-    data.item_idx = client_idx;
-    data.buff = buff;
-    to_server_queue.enqueue(std::move(data));
-    tcp_server->notify_event();
+    post_to_program(new_stream_client_msg{server_id, client_idx, tcp_clients[client_idx].stream_listener_id});
   }
 
-  void post_audio_list_req_to_program(int client_idx, std::string station) {
+  void post_new_stream_client_response_to_server(int client_idx, int listener_id, int broadcast_channel_id, std::vector<tcp_tls_server::shared_buffer> &&backlog, uint64_t station_broadcasts_before = 0) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::request_audio_list;
-    data.item_idx = client_idx;
-    data.additional_str = std::move(station);
-    to_program_queue.enqueue(std::move(data));
-    // std::cout << "\t\tsize to program: \e[34m" << to_program_queue.size_approx() << "\e[0m" << std::endl;
-
-    eventfd_write(central_communication_fd, 1);
+    post_to_server({new_stream_client_response_msg{client_idx, listener_id, broadcast_channel_id, std::move(backlog), station_broadcasts_before}});
   }
 
-  void post_audio_list_req_response_to_server(int client_idx, std::vector<char> &&buff) {
+  void post_new_radio_client_response_to_server(int ws_client_idx, int ws_client_id, std::vector<tcp_tls_server::shared_buffer> &&backlog, int broadcast_channel_id = -1, uint64_t station_broadcasts_before = 0) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::request_audio_list_response;
-    data.item_idx = client_idx;
-    data.buff = std::move(buff);
-    to_server_queue.enqueue(std::move(data));
-    // std::cout << "size to server: \e[34m" << to_server_queue.size_approx() << "\e[0m" << std::endl;
-    tcp_server->notify_event();
+    post_to_server({new_radio_client_response_msg{ws_client_idx, ws_client_id, broadcast_channel_id, std::move(backlog), station_broadcasts_before}}); // the backlog has everything up to now, and the client gets what's after it
   }
 
-  void post_audio_track_req_to_program(int client_idx, std::string station, std::string track_name) {
+  void post_skip_request_to_program(int client_idx, std::string station, std::string ip) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::request_audio_track;
-    data.item_idx = client_idx;
-    data.additional_str = std::move(station);
-    data.additional_str2 = std::move(track_name);
-    to_program_queue.enqueue(std::move(data));
-    // std::cout << "\t\tsize to program: \e[34m" << to_program_queue.size_approx() << "\e[0m" << std::endl;
-
-    eventfd_write(central_communication_fd, 1);
+    post_to_program(skip_request_msg{client_idx, std::move(station), std::move(ip)});
   }
 
-  void post_audio_track_req_response_to_server(int client_idx, std::vector<char> &&buff) {
+  void post_skip_request_response_to_server(int client_idx, std::vector<char> &&buff) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::request_audio_track_response;
-    data.item_idx = client_idx;
-    data.buff = std::move(buff);
-    to_server_queue.enqueue(std::move(data));
-    // std::cout << "size to server: \e[34m" << to_server_queue.size_approx() << "\e[0m" << std::endl;
-    tcp_server->notify_event();
+    post_to_server({skip_request_response_msg{client_idx, std::move(buff)}});
   }
 
-  void post_audio_queue_req_to_program(int client_idx, std::string station) {
+  void post_audio_track_req_to_program(int client_idx, std::string station, std::string track_name) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::request_audio_queue;
-    data.item_idx = client_idx;
-    data.additional_str = std::move(station);
-    to_program_queue.enqueue(std::move(data));
-    // std::cout << "\t\tsize to program: \e[34m" << to_program_queue.size_approx() << "\e[0m" << std::endl;
-
-    eventfd_write(central_communication_fd, 1);
+    post_to_program(audio_track_request_msg{client_idx, std::move(station), std::move(track_name)});
   }
 
-  void post_audio_queue_req_response_to_server(int client_idx, std::vector<char> &&buff) {
+  void post_audio_track_req_response_to_server(int client_idx, tcp_tls_server::shared_buffer &&response) {
     if (!tcp_server) {
       return; // need this stuff set before posting any messages
     }
-    message_post_data data;
-    data.msg_type = message_type::request_audio_queue_response;
-    data.item_idx = client_idx;
-    data.buff = std::move(buff);
-    to_server_queue.enqueue(std::move(data));
-    // std::cout << "size to server: \e[34m" << to_server_queue.size_approx() << "\e[0m" << std::endl;
-    tcp_server->notify_event();
+    post_to_server({audio_track_response_msg{client_idx, std::move(response)}}); // after the queue update for it
   }
 
-  auto get_from_to_program_queue() -> message_post_data { // so called from main program thread
-    message_post_data data{};
-    to_program_queue.try_dequeue(data);
-    // std::cout << "\t\tsize to program: \e[34m" << to_program_queue.size_approx() << "\e[0m" << std::endl;
-    return data;
-  }
+  template <typename F>
+  auto drain_to_program_mailbox(F &&callback) -> size_t { return to_program_mailbox.drain(callback); } // so called from main program thread
+  template <typename F>
+  auto drain_to_server_mailbox(F &&callback) -> size_t { return to_server_mailbox.drain(callback); } // so called from associated server thread
 
-  auto get_from_to_server_queue() -> message_post_data { // so called from associated server thread
-    message_post_data data{};
-    to_server_queue.try_dequeue(data);
-    // std::cout << "size to server: \e[34m" << to_server_queue.size_approx() << "\e[0m" << std::endl;
-    return data;
-  }
+  auto to_program_stats() const -> mailbox_stats { return to_program_mailbox.stats(); }
+  auto to_server_stats() const -> mailbox_stats { return to_server_mailbox.stats(); }
 
   //
   ////http public methods
   //
 
+  //parses the path and responds to it, request_handle is either a client idx or an HTTP/2 stream handle
+  void respond_to_http_request(int request_handle, bool is_GET, std::string path, bool accept_bytes, const std::string &sec_websocket_key, const std::string &ip, const std::string &sec_websocket_extensions = {});
+  //writing responses to request handles, HTTP/2 streams get the response translated
+  void http_write(int request_handle, std::vector<char> &&buff);
+  void http_write(int request_handle, char *buff, size_t length);
+  void http_write(int request_handle, tcp_tls_server::shared_buffer &&buff);
+  //the per request data for a request handle
+  auto http_client(int request_handle) -> tcp_client &;
+  //whether something can still be written to this request handle
+  auto http_request_open(int request_handle) -> bool { return !http2::is_stream_handle(request_handle) || http2_stream_open(request_handle); }
   //responding to get requests
-  auto get_process(std::string &path, bool accept_bytes, const std::string &sec_websocket_key, int client_idx, std::string ip = {}) -> bool;
+  auto get_process(std::string &path, bool accept_bytes, const std::string &sec_websocket_key, int client_idx, std::string ip = {}, const std::string &sec_websocket_extensions = {}) -> bool;
   //sending files
   auto send_file_request(int client_idx, const std::string &filepath, bool accept_bytes, int response_code) -> bool;
   //checking if it's a valid HTTP request
@@ -399,6 +542,15 @@ public:
   //the cache
   cache<CACHE_SIZE> web_cache{}; //cache of 5 items
 
+  //
+  ////public http2 stuff
+  //
+  static auto is_http2_preface(const char *buff, size_t length) -> bool;
+  auto is_http2_connection(int client_idx) -> bool;
+  auto http2_process_read_cb(int client_idx, char *buffer, int length) -> bool; // returns whether to keep reading from the connection
+  void http2_process_write_cb(int client_idx);
+  void http2_kill_session(int client_idx);
+
   //
   ////public websocket stuff
   //
@@ -409,34 +561,32 @@ public:
   auto close_ws_connection_req(int ws_client_idx, bool client_already_closed = false) -> bool; //puts in a request to close this websocket connection
 
   void websocket_process_read_cb(int client_idx, char *buffer, int length);
+  size_t ws_max_payload_size = WS_DEFAULT_MAX_PAYLOAD_SIZE; // larger frames or messages close the connection
+  size_t max_queued_chunks = DEFAULT_MAX_QUEUED_CHUNKS;     // a listener with more broadcast chunks than this waiting has the oldest ones dropped, 0 to never drop
+  bool permessage_deflate = false;                           // whether permessage-deflate is negotiated, PERMESSAGE_DEFLATE in the config
+  std::string ingest_key{};                                  // INGEST_KEY in the config, what a live source sends first on /ws/ingest, ingest is off without it
   auto websocket_process_write_cb(int client_idx) -> bool;                                                      //returns whether or not this was used
-  void websocket_accept_read_cb(const std::string &sec_websocket_key, const std::string &path, int client_idx); //used in the read callback to accept web sockets
+  void websocket_accept_read_cb(const std::string &sec_websocket_key, const std::string &path, int client_idx, const std::string &ip, const std::string &sec_websocket_extensions); //used in the read callback to accept web sockets
 
   //writing data to connections
-  void websocket_write(int ws_client_idx, std::vector<char> &&buff);
+  void websocket_write(int ws_client_idx, std::vector<char> &&buff, tcp_tls_server::write_priority priority = tcp_tls_server::write_priority::NORMAL);
 
   auto get_ws_client_tcp_client_idx(int ws_client_idx, int ws_client_id) -> int {
     auto &ws_client = websocket_clients[ws_client_idx];
-    if (websocket_clients[ws_client_idx].id == ws_client_id) {
+    // the id only changes when the slot is reused, so a closed websocket still matches, its tcp slot may be someone else's by now
+    if (ws_client.id == ws_client_id && active_websocket_connections_client_idxs.count(ws_client.client_idx) != 0U && tcp_clients[ws_client.client_idx].ws_client_idx == ws_client_idx) {
       return ws_client.client_idx;
     }
     return -1;
   }
 
-  void ping_all_websockets() {
-    if (tcp_server && !websocket_clients.empty()) {
-      static std::vector<char> ping_data = make_ws_frame("", websocket_non_control_opcodes::ping);
+  void ping_websocket(int client_idx) { // pings this websocket, and sets the timer for the next ping
+    static std::vector<char> ping_data = make_ws_frame("", websocket_non_control_opcodes::ping);
 
-      tcp_server->broadcast_message(
-          active_websocket_connections_client_idxs.begin(),
-          active_websocket_connections_client_idxs.end(),
-          active_websocket_connections_client_idxs.size(),
-          ping_data.data(),
-          ping_data.size()); // send the ping message
-    }
+    tcp_server->write_connection(client_idx, ping_data.data(), ping_data.size(), tcp_tls_server::write_priority::CONTROL); // not stuck behind a large chunk
+    tcp_server->set_timer(client_idx, tcp_tls_server::timer_type::PING, WS_PING_INTERVAL);
   }
-
-  const int ws_ping_timerfd = timerfd_create(CLOCK_MONOTONIC, 0); // used for pinging ws connections
+  uint32_t next_ping_offset{}; // when the first ping for the next websocket is, so that pings are spread out rather than all at once
 
   //websocket data
   std::unordered_set<int> all_websocket_connections{};                //this is used for the duration of the connection (even after we've sent the close request)
@@ -453,6 +603,16 @@ struct server_data;
 
 class audio_server;
 
+namespace workers {
+struct audio_process_state;
+struct worker_state;
+struct message_header;
+} // namespace workers
+
+namespace relay {
+struct state;
+} // namespace relay
+
 // AUDIO_SERVER_COMMUNICATION is a helper enum to distinguish the events from that class, for any other classes, just add a similar enum
 enum class central_web_server_event {
   TIMERFD,
@@ -460,7 +620,12 @@ enum class central_web_server_event {
   WRITE,
   SERVER_THREAD_COMMUNICATION,
   AUDIO_SERVER_COMMUNICATION,
-  KILL_SERVER
+  RELOAD_STATIC_ASSETS,
+  KILL_SERVER,
+  WORKER_COMMUNICATION, // the Unix socket between the audio process and a worker, from either end
+  WORKER_BROADCASTS,    // in a worker, there are broadcasts in the shared memory
+  RELAY_COMMUNICATION,  // on an edge, the connection to the origin
+  RELAY_CONNECTED       // on an edge, the thread connecting to the origin is done
 };
 
 struct central_web_server_req {
@@ -486,8 +651,7 @@ private:
   template <server_type T>
   static void thread_server_runner(web_server::basic_web_server<T> &basic_web_server);
 
-  central_web_server() = default;
-  ;
+  central_web_server(); // in the .cpp, along with the destructor, where the worker state is a complete type
 
   void run();
 
@@ -495,16 +659,17 @@ private:
   void run();
 
   int num_threads = -1;
+  size_t fast_start_chunks = 2; // how many chunks of the backlog are sent to new listeners
 
   const int event_fd = eventfd(0, 0);
   const int kill_server_efd = eventfd(0, 0);
+  const int reload_static_assets_efd = eventfd(0, 0); // written to on SIGHUP, only read if public/ is preloaded
 
   io_uring ring;
 
-  data_store_namespace::data_store store{}; // the data store
-
   void add_timer_read_req(int timerfd);                          // adds io_uring read request for the timerfd
   void add_read_req(int fd, size_t size, int custom_info = -1);  // adds normal read request on io_uring
+  void add_socket_read_req(int fd, central_web_server_event event, uint64_t custom_info = -1); // adds a read for whatever's there on a worker's socket or the origin's
   void add_write_req(int fd, const char *buff_ptr, size_t size); // adds normal write request on io_uring
 
   // to finish off the requests
@@ -517,11 +682,116 @@ private:
   void audio_server_read_req_handler(int readfd, int server_id, std::vector<char> &&buff);
   void audio_server_initialise_reads(audio_server *server);
 
+  // a websocket wants to be subscribed to a channel, it's sent the backlog for it and then subscribed
+  template <server_type T>
+  void new_radio_client(web_server::basic_web_server<T> &server, const web_server::new_radio_client_msg &data);
+  template <server_type T>
+  void new_stream_client(web_server::basic_web_server<T> &server, const web_server::new_stream_client_msg &data); // the same for /stream/
+  void count_subscriber(int broadcast_channel_id, int change); // listeners, and whatever wants tagged chunks
+  auto read_broadcast_config() -> size_t;                      // the fast start and the broadcast frame settings, returns BACKLOG_CHUNKS
+
+  // responses to a server thread's requests, with WORKERS thread_id is worker_idx * num_threads + the thread in that worker
+  template <server_type T>
+  void post_audio_track_response(int thread_id, int request_handle, const tcp_tls_server::shared_buffer &response, std::vector<server_data<T>> &thread_data_container);
+  template <server_type T>
+  void post_skip_response(int thread_id, int request_handle, std::vector<char> &&response, std::vector<server_data<T>> &thread_data_container);
+  // the requests themselves, to the station's audio thread, or to the origin with RELAY
+  template <server_type T>
+  void submit_track_request(const std::string &station, const std::string &track, int request_handle, int thread_id, std::vector<server_data<T>> &thread_data_container);
+  template <server_type T>
+  void submit_skip_request(const std::string &station, const std::string &ip, int request_handle, int thread_id, std::vector<server_data<T>> &thread_data_container);
+
+  // INGEST_KEY in the config, a live source on /ws/ingest/<station> takes the station over until it disconnects, one at a time
+  struct ingest_source {
+    int thread_id = -1; // -1 unless the station is live
+    int ws_client_idx = -1;
+    int ws_client_id{};
+  };
+  std::vector<ingest_source> ingest_sources{}; // by station id
+  template <server_type T>
+  void ingest(int thread_id, web_server::ingest_msg &&data, std::vector<server_data<T>> &thread_data_container);
+
+  // RELAY in the config, this is an edge and its stations are relayed from the origin over one websocket, see relay.h
+  std::unique_ptr<relay::state> relay_origin{};
+  void relay_connect(); // starts connecting on relay::state::connecting, unless it already is
+  template <server_type T>
+  void relay_connected(std::vector<server_data<T>> &thread_data_container); // resubscribes from the last chunk each station got
+  template <server_type T>
+  void relay_disconnected(std::vector<server_data<T>> &thread_data_container); // fails whatever was waiting on the origin
+  template <server_type T>
+  void relay_message_handler(std::string_view payload, std::vector<server_data<T>> &thread_data_container);
+  template <server_type T>
+  void relay_publish_chunk(audio_server *server, int64_t sequence, std::string_view metadata, std::vector<server_data<T>> &thread_data_container);
+  auto relay_request(const std::string &type, const std::string &station, const std::string &argument, int request_handle, int thread_id) -> bool; // false if the origin isn't connected
+
+  // WORKERS in the config, the server threads are in worker processes and this is the audio process, see workers.h
+  int num_workers = 0;
+  std::unique_ptr<workers::audio_process_state> audio_process{}; // in the audio process
+  std::unique_ptr<workers::worker_state> worker{};               // in a worker
+  void start_worker(int worker_idx);
+  void worker_exited(int worker_idx);                            // its socket closed, it's started again unless it was shut down
+  void export_broadcasts();                                      // copies everything published to the broadcast ring into the shared memory, and wakes the workers
+  void send_station_snapshot(int worker_idx);
+  void send_to_worker(int worker_idx, const workers::message_header &header, std::string_view payload = {}); // kills the worker if it fails, see worker_link::stalled
+  template <server_type T>
+  void worker_message_handler(int worker_idx, const workers::message_header &header, std::string_view payload, std::vector<server_data<T>> &thread_data_container);
+
+  // the worker's side, its own copy of the central thread's loop for its server threads
+  template <server_type T>
+  void run_worker(int worker_idx);
+  template <server_type T>
+  void worker_drain_server_thread_mailbox(int thread_idx, std::vector<server_data<T>> &thread_data_container);
+  template <server_type T>
+  void worker_new_radio_client(web_server::basic_web_server<T> &server, const web_server::new_radio_client_msg &data);
+  template <server_type T>
+  void worker_new_stream_client(web_server::basic_web_server<T> &server, const web_server::new_stream_client_msg &data);
+  template <server_type T>
+  void worker_read_broadcasts(std::vector<server_data<T>> &thread_data_container);
+  template <server_type T>
+  void worker_socket_message_handler(const workers::message_header &header, std::string_view payload, std::vector<server_data<T>> &thread_data_container);
+  template <server_type T>
+  void worker_read_snapshot(std::vector<server_data<T>> &thread_data_container); // blocks until the first snapshot comes, before the server threads start
+
+  // MAILBOX_STATS in the config, how many messages each wake up deals with, and how often threads are woken, since the last report
+  template <server_type T>
+  void report_mailbox_stats(std::vector<server_data<T>> &thread_data_container);
+  template <server_type T>
+  void drain_server_thread_mailbox(int thread_idx, std::vector<server_data<T>> &thread_data_container); // after the thread's eventfd or a MSG_RING message
+  web_server::mailbox_stats last_to_program_stats{};
+  web_server::mailbox_stats last_to_server_stats{};
+  std::chrono::steady_clock::time_point last_mailbox_report = std::chrono::steady_clock::now();
+
+  // BALANCE_CONNECTIONS in the config, the kernel only spreads connections evenly, not the long lived websockets on them, so
+  // new connections go to each server thread in proportion to how far below the busiest one it is, rechecked with the timer
+  template <server_type T>
+  void balance_connections(std::vector<server_data<T>> &thread_data_container);
+  std::vector<uint32_t> last_connection_weights{};
+  // LOAD_STATS in the config, a histogram of how many subscriptions each server thread has
+  template <server_type T>
+  void report_thread_load(std::vector<server_data<T>> &thread_data_container);
+
   // helper function
   auto tokenize_radio_list(std::string input) -> std::vector<std::pair<std::string, std::string>>;
 
+  // the station list, audio list and queue responses are prebuilt whenever what they show changes, and every request is given a reference to them
+  static auto make_cached_response(const std::string &header, const std::string &body) -> tcp_tls_server::shared_buffer;
+  void rebuild_station_list_response();
+  static void rebuild_audio_list_response(audio_server *server);
+  static void rebuild_audio_queue_response(audio_server *server);
+  void publish_station_snapshot(); // publishes the above to the server threads, call this after rebuilding any of them
+  template <server_type T>
+  void push_station_update(audio_server *server, web_server::channel_kind kind, std::vector<server_data<T>> &thread_data_container); // the new queue or list to websockets subscribed to it
+
+  // broadcasts are published to the broadcast ring, then each server thread is woken once for however many were published
+  void publish_broadcast(int broadcast_channel_id, const tcp_tls_server::shared_buffer &frame, const tcp_tls_server::shared_buffer &deflated_frame = {});
+  template <server_type T>
+  void notify_broadcasts(std::vector<server_data<T>> &thread_data_container);
+
+  tcp_tls_server::shared_buffer station_list_response{};
+  const tcp_tls_server::shared_buffer failure_response = make_cached_response(default_plain_text_http_header, "FAILURE");
+
 public:
-  void start_server(const char *config_file_path);
+  void start_server(const char *config_file_path, int worker_idx = -1); // worker_idx is set in a worker process, see workers.h
   void add_event_read_req(int eventfd, central_web_server_event event, uint64_t custom_info = -1); // adds io_uring read request for the eventfd
 
   central_web_server(central_web_server const &) = delete;
@@ -531,16 +801,24 @@ public:
     static central_web_server inst;
     return inst;
   }
+  ~central_web_server();
 
   void kill_server();
+  void reload_static_assets(); // swaps in a new snapshot of public/, if it's preloaded
 };
 
 template <server_type T>
 struct server_data {
   std::thread thread{};
   web_server::basic_web_server<T> server{};
-  server_data() {
-    thread = std::thread(central_web_server::thread_server_runner<T>, std::ref(server));
+  server_data(int thread_idx, int program_ring_fd, cpu_placement::cpu_set cpus = {}) {
+    server.thread_idx = thread_idx;
+    server.program_ring_fd = program_ring_fd;
+    server.add_station_readers();
+    thread = std::thread([&server = server, cpus = std::move(cpus)] {
+      cpu_placement::pin_this_thread(cpus); // before its ring and clients are allocated
+      central_web_server::thread_server_runner<T>(server);
+    });
   }
   server_data(server_data &&data) noexcept = default;
   ~server_data() {
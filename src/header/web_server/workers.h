@@ -0,0 +1,112 @@
+#ifndef WORKERS
+#define WORKERS
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "../audio_server.h"
+#include "shared_broadcast_segment.h"
+#include "station_snapshot.h"
+
+// With WORKERS: N in the config, this process only runs the central thread and the audio threads (the audio process), and the
+// server threads are in N worker processes instead, which all listen on the same port with SO_REUSEPORT. They're this program
+// again, run with --worker <idx>, and the audio process starts a worker again whenever one exits, so a crash only takes down
+// that worker's connections. The broadcasts get to the workers through a shared_broadcast_segment, and everything else goes
+// over a Unix socket, as a header and a payload for each message: listeners joining and leaving, dropped chunks, track and skip
+// requests and their responses, live sources, and the station snapshot whenever it changes. Each worker runs its own copy of the central
+// thread's loop for its server threads, and answers new listeners itself from backlogs it keeps from the broadcasts.
+
+namespace workers {
+constexpr int SEGMENT_FD = 3; // where a worker finds what it's passed
+constexpr int BROADCAST_EFD = 4;
+constexpr int SOCKET_FD = 5;
+constexpr size_t WARM_UP_ENTRIES = 256; // a worker starts this far back in the segment, to fill its backlogs
+
+enum class message_type : uint32_t {
+  LISTENER_JOINED, // to the audio process, the channel has a subscriber more or less
+  LISTENER_LEFT,
+  CHUNKS_DROPPED,  // the value is how many
+  TRACK_REQUEST,   // the payload is the station and the track, with a null between them
+  SKIP_REQUEST,    // the same with the IP
+  INGEST,          // some of a live source's stream, the payload is the station and the data, the value is the websocket's id
+  INGEST_ENDED,    // the same without the data
+  TRACK_RESPONSE,  // to a worker, the payload is the HTTP response
+  SKIP_RESPONSE,
+  INGEST_REJECTED, // the station already has a live source, so the websocket is closed
+  STATIONS         // the station snapshot, see serialise_snapshot
+};
+
+struct message_header {
+  message_type type{};
+  int32_t channel_id = -1;
+  int32_t thread_idx = -1; // the worker's server thread a request is from or a response is for
+  int32_t request_handle = -1;
+  uint64_t value{};
+  uint64_t payload_length{};
+};
+
+// blocking, false if the other end has gone, or the send timed out (maybe partway through, after which the stream is misframed)
+auto send_message(int socket_fd, message_header header, std::string_view payload = {}) -> bool;
+
+class message_reader { // puts the messages back together from however they were read
+  std::vector<char> buffer{};
+
+public:
+  template <typename F>
+  void feed(const char *data, size_t length, F &&callback) { // callback gets each full message, with its payload
+    buffer.insert(buffer.end(), data, data + length);
+
+    size_t offset = 0;
+    message_header header{};
+    while (buffer.size() - offset >= sizeof(header)) {
+      std::memcpy(&header, &buffer[offset], sizeof(header));
+      if (buffer.size() - offset - sizeof(header) < header.payload_length) {
+        break; // the rest of it is in the next read
+      }
+      callback(static_cast<const message_header &>(header), std::string_view(&buffer[offset + sizeof(header)], header.payload_length));
+      offset += sizeof(header) + header.payload_length;
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + offset);
+  }
+};
+
+auto serialise_snapshot(const web_cache::station_snapshot &snapshot) -> std::string;
+auto parse_snapshot(std::string_view payload) -> std::shared_ptr<const web_cache::station_snapshot>; // nullptr if it's malformed
+
+// runs this program as worker worker_idx, with the fds where it expects them, -1 if it couldn't fork
+auto spawn(int worker_idx, int segment_fd, int broadcast_efd, int socket_fd) -> pid_t;
+
+struct worker_link { // the audio process's end of a worker
+  pid_t pid = -1;
+  int socket_fd = -1;
+  int broadcast_efd = -1; // written to after broadcasts are copied into the segment, kept when the worker is restarted
+  std::chrono::steady_clock::time_point started{};
+  message_reader reader{};
+  bool stalled = false; // a send to it failed, so it's been killed, nothing more is sent until it's restarted
+  std::unordered_map<int, int64_t> subscribers{}; // by channel, what it's reported joining, taken off the counts if it dies
+};
+
+struct audio_process_state {
+  std::unique_ptr<web_server::shared_broadcast_segment> segment{};
+  int segment_reader = -1; // on the broadcast ring, everything published to it is copied into the segment
+  std::vector<worker_link> links{};
+};
+
+struct worker_state {
+  int idx = -1;
+  web_server::shared_broadcast_segment segment{SEGMENT_FD};
+  uint64_t segment_cursor{};
+  size_t backlog_chunks{};
+  std::vector<station_backlogs> backlogs{}; // by station id, from the broadcasts
+  std::shared_ptr<const web_cache::station_snapshot> snapshot{}; // the latest from the audio process, for the station ids
+  message_reader reader{};
+};
+} // namespace workers
+
+#endif
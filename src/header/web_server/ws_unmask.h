@@ -0,0 +1,11 @@
+#ifndef WS_UNMASK
+#define WS_UNMASK
+
+#include <cstddef>
+
+namespace web_server {
+// XORs the payload with the 4 byte masking key in place, using the widest vectors the CPU supports (picked at runtime)
+void unmask_ws_payload(char *payload, size_t length, const char *masking_key);
+} // namespace web_server
+
+#endif
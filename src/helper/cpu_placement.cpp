@@ -0,0 +1,177 @@
+#include "../header/cpu_placement.h"
+#include "../header/utility.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+auto allowed_cpus() -> cpu_placement::cpu_set { // whatever this process is allowed to run on
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  cpu_placement::cpu_set cpus{};
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return cpus;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+auto read_topology_id(int cpu, const char *name) -> int { // -1 if it isn't there, then each CPU is treated as its own core
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name);
+  int id = -1;
+  file >> id;
+  return file ? id : -1;
+}
+
+auto physical_cores(const cpu_placement::cpu_set &cpus) -> std::vector<cpu_placement::cpu_set> { // hyperthreads of the same core together, in order of their first CPU
+  std::map<std::pair<int, int>, cpu_placement::cpu_set> cores{};
+  for (const auto cpu : cpus) {
+    const auto core_id = read_topology_id(cpu, "core_id");
+    const auto package_id = read_topology_id(cpu, "physical_package_id");
+    cores[core_id == -1 ? std::make_pair(-1, cpu) : std::make_pair(package_id, core_id)].push_back(cpu);
+  }
+
+  std::vector<cpu_placement::cpu_set> ordered{};
+  for (auto &pair : cores) {
+    ordered.push_back(std::move(pair.second));
+  }
+  std::sort(ordered.begin(), ordered.end(), [](const auto &a, const auto &b) { return a.front() < b.front(); });
+  return ordered;
+}
+} // namespace
+
+namespace cpu_placement {
+auto parse_cpu_list(const std::string &list) -> cpu_set {
+  cpu_set cpus{};
+  size_t start = 0;
+  while (start < list.size()) {
+    auto end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    const auto range = list.substr(start, end - start);
+    const auto dash = range.find('-');
+    try {
+      const int first = std::stoi(range.substr(0, dash));
+      const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; cpu++) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::exception &) {
+      utility::fatal_error("Invalid CPU list " + list);
+    }
+    start = end + 1;
+  }
+  return cpus;
+}
+
+auto to_string(const cpu_set &cpus) -> std::string {
+  if (cpus.empty()) {
+    return "any CPU";
+  }
+
+  std::string output{};
+  for (size_t i = 0; i < cpus.size(); i++) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) { // runs of CPUs are written as ranges
+      j++;
+    }
+    output += (output.empty() ? "" : ",") + std::to_string(cpus[i]) + (j > i ? "-" + std::to_string(cpus[j]) : "");
+    i = j;
+  }
+  return output;
+}
+
+auto make_plan(const std::string &mode, const std::string &server_cpus, const std::string &audio_cpus, const std::string &central_cpus, int num_server_threads) -> plan {
+  plan placement{};
+  const bool automatic = mode == "auto";
+  if (!automatic && server_cpus.empty() && audio_cpus.empty() && central_cpus.empty()) {
+    return placement; // left to the scheduler
+  }
+
+  const auto allowed = allowed_cpus();
+  placement.central = allowed; // anything not set still has to be pinned, since threads start with the affinity of whatever made them
+  placement.audio = allowed;
+
+  cpu_set server_order = allowed; // the server threads take one CPU each from this, in order
+  if (automatic) {
+    auto cores = physical_cores(allowed);
+    if (cores.size() > 1) { // the first core is kept for the central and audio threads, which are mostly idle
+      placement.central = placement.audio = cores.front();
+      cores.erase(cores.begin());
+    }
+
+    server_order.clear(); // a core each, and only after that the other hyperthreads of each core
+    for (size_t sibling = 0; server_order.size() < allowed.size(); sibling++) {
+      bool any = false;
+      for (const auto &core : cores) {
+        if (sibling < core.size()) {
+          server_order.push_back(core[sibling]);
+          any = true;
+        }
+      }
+      if (!any) {
+        break;
+      }
+    }
+  }
+
+  if (!server_cpus.empty()) {
+    server_order = parse_cpu_list(server_cpus);
+  }
+  if (!audio_cpus.empty()) {
+    placement.audio = parse_cpu_list(audio_cpus);
+  }
+  if (!central_cpus.empty()) {
+    placement.central = parse_cpu_list(central_cpus);
+  }
+
+  if (!automatic && server_cpus.empty()) { // only the central or audio threads were placed, the server threads can still go anywhere
+    placement.server_threads.assign(num_server_threads, allowed);
+    return placement;
+  }
+
+  for (int idx = 0; idx < num_server_threads && !server_order.empty(); idx++) {
+    placement.server_threads.push_back({server_order[idx % server_order.size()]}); // more threads than CPUs doubles them up
+  }
+  return placement;
+}
+
+void log_plan(const plan &placement) {
+  if (placement.empty()) {
+    std::cout << "CPU placement: left to the scheduler\n";
+    return;
+  }
+
+  std::cout << "CPU placement: central thread on " << to_string(placement.central) << ", audio threads on " << to_string(placement.audio) << "\n";
+  for (size_t idx = 0; idx < placement.server_threads.size(); idx++) {
+    std::cout << "  server thread " << idx << " on " << to_string(placement.server_threads[idx]) << "\n";
+  }
+}
+
+auto pin_this_thread(const cpu_set &cpus) -> bool {
+  if (cpus.empty()) {
+    return true;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const auto cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    std::cerr << "Couldn't pin a thread to CPUs " << to_string(cpus) << std::endl;
+    return false;
+  }
+  return true;
+}
+} // namespace cpu_placement
@@ -92,4 +92,8 @@ namespace utility{
 
     central_web_server::instance().kill_server(); // the program gracefully exits without needing to explicitly exit
   }
+
+  void sighup_handler(int sig_number){
+    central_web_server::instance().reload_static_assets(); // only does anything if public/ is preloaded
+  }
 }
\ No newline at end of file
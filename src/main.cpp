@@ -3,14 +3,16 @@
 
 #include <thread>
 
-int main(){
+int main(int argc, char **argv){
   signal(SIGINT, utility::sigint_handler); //signal handler for when Ctrl+C is pressed
   signal(SIGPIPE, SIG_IGN); //signal handler for when a connection is closed while writing
+  signal(SIGHUP, utility::sighup_handler); //signal handler for reloading the preloaded public/ directory
 
   std::cout.setf(std::ios::unitbuf);
 
   auto &webserver_instance = central_web_server::instance();
-  webserver_instance.start_server(".config");
+  const int worker_idx = argc == 3 && std::string(argv[1]) == "--worker" ? std::stoi(argv[2]) : -1; // started by the audio process, with WORKERS in the config
+  webserver_instance.start_server(".config", worker_idx);
 
   return 0;
 }
\ No newline at end of file
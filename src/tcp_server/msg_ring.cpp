@@ -0,0 +1,43 @@
+#include "../header/msg_ring.h"
+
+#include <sys/eventfd.h>
+
+namespace {
+bool is_enabled = false;
+thread_local io_uring *thread_ring = nullptr;
+} // namespace
+
+auto msg_ring::enable() -> bool {
+  auto *probe = io_uring_get_probe();
+  if (probe == nullptr) {
+    return false;
+  }
+  is_enabled = io_uring_opcode_supported(probe, IORING_OP_MSG_RING) != 0; // added after IOSQE_CQE_SKIP_SUCCESS, so that's there as well
+  io_uring_free_probe(probe);
+  return is_enabled;
+}
+
+auto msg_ring::enabled() -> bool {
+  return is_enabled;
+}
+
+void msg_ring::set_thread_ring(io_uring *ring) {
+  thread_ring = ring;
+}
+
+void msg_ring::send(int target_ring_fd, kind type, uint32_t index, int32_t value, int fallback_efd) {
+  io_uring_sqe *sqe = is_enabled && thread_ring != nullptr && target_ring_fd >= 0 ? io_uring_get_sqe(thread_ring) : nullptr;
+  if (sqe == nullptr) {
+    eventfd_write(fallback_efd, 1);
+    return;
+  }
+
+  io_uring_prep_msg_ring(sqe, target_ring_fd, static_cast<uint32_t>(value), user_data(type, index), 0); // the value ends up in res
+  sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;                                                                // the sender only hears about it if it failed
+  io_uring_sqe_set_data64(sqe, user_data(kind::SEND_FAILED, fallback_efd));
+  io_uring_submit(thread_ring);
+}
+
+void msg_ring::send_failed(uint64_t user_data) {
+  eventfd_write(static_cast<int>(index_of(user_data)), 1); // the target's CQ was full, or it's gone, the eventfd read is always outstanding
+}
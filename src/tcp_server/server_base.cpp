@@ -1,6 +1,9 @@
 #include "../header/server.h"
+#include "../header/msg_ring.h"
 
+#include <algorithm>
 #include <chrono>
+#include <linux/filter.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 
@@ -11,6 +14,8 @@ template <server_type T>
 std::mutex server_base<T>::init_mutex{};
 template <server_type T>
 int server_base<T>::shared_ring_fd = -1;
+template <server_type T>
+std::vector<int> server_base<T>::listener_fds{};
 
 template <server_type T>
 void server_base<T>::start() { //function to run the server
@@ -20,18 +25,31 @@ void server_base<T>::start() { //function to run the server
     io_uring_cqe *cqe;
 
     add_tcp_accept_req();
+    msg_ring::set_thread_ring(&ring); // messages from this thread are sent on this ring
 
     while (true) {
       char ret = io_uring_wait_cqe(&ring, &cqe);
       if (ret < 0) {
         utility::fatal_error("io_uring_wait_cqe");
       }
+
+      if (msg_ring::is_message(cqe->user_data)) { // posted straight into this ring by another thread, rather than a request of ours
+        if (msg_ring::kind_of(cqe->user_data) == msg_ring::kind::SEND_FAILED) {
+          msg_ring::send_failed(cqe->user_data);
+        } else if (event_cb != nullptr) { // a notification, the same as the eventfd going off once
+          event_cb(static_cast<server<T> *>(this), custom_obj);
+        }
+        io_uring_cqe_seen(&ring, cqe);
+        continue;
+      }
+
       auto *req = (request *)cqe->user_data;
 
       if (req->event != event_type::ACCEPT &&
           req->event != event_type::KILL &&
           req->event != event_type::NOTIFICATION &&
           req->event != event_type::CUSTOM_READ &&
+          req->event != event_type::TIMER &&
           (cqe->res <= 0 || (req->client_idx > 0 && clients[req->client_idx].id != req->ID))) {
         if (req->event == event_type::ACCEPT_WRITE || req->event == event_type::WRITE)
           req->buffer = nullptr;                                       //done with the request buffer
@@ -44,9 +62,14 @@ void server_base<T>::start() { //function to run the server
         }
       } else if (req->event == event_type::KILL) {
         io_uring_queue_exit(&ring);
+        {
+          std::unique_lock<std::mutex> init_lock(init_mutex);
+          listener_fds[listener_index] = -1; // the rest of the group moves up to fill the gap, so connections aren't steered after this
+        }
         close(listener_fd);
         close(kill_efd);
         close(notification_efd);
+        close(timer_fd);
 
         is_active = false; // received an exit signal, main server program will now exit, so it's now inactive
         break;
@@ -57,6 +80,12 @@ void server_base<T>::start() { //function to run the server
         while (efd_data--) // repeat this for the number of times the eventfd has gone off
           if (event_cb != nullptr)
             event_cb(static_cast<server<T> *>(this), custom_obj);
+      } else if (req->event == event_type::TIMER) {
+        event_read(timer_fd, event_type::TIMER);
+
+        auto ticks = *reinterpret_cast<uint64_t *>(&(req->read_data[0]));
+        while (ticks--) // if this thread was busy, the timer could've gone off multiple times
+          timer_tick();
       } else if (req->event == event_type::CUSTOM_READ) {
         if (req->read_data.size() == cqe->res + req->read_amount || !req->auto_retry) { // if we said we don't want to use custom_read_req_continued, then we just process the data now
           if (custom_read_cb != nullptr)
@@ -80,6 +109,9 @@ void server_base<T>::start() { //function to run the server
 
         // std::cout << std::endl << std::endl;
 
+        if ((req->event == event_type::READ || req->event == event_type::WRITE) && active_connections.count(req->client_idx) && !clients[req->client_idx].closing_now)
+          set_timer(req->client_idx, timer_type::IDLE, IDLE_TIMEOUT_MS); // the connection is still making progress
+
         static_cast<server<T> *>(this)->req_event_handler(req, cqe->res);
       }
 
@@ -101,7 +133,7 @@ void server_base<T>::clean_up_client_resources(int client_idx, bool trigger_call
       close_cb(client_idx, broadcast_additional_info, static_cast<server<T> *>(this), custom_obj); // might have had multiple broadcasts
 
     // std::cout << std::string(send_data.get_ptr_and_size().buff, send_data.get_ptr_and_size().length) << " was deleted msg\n";
-    client.send_data.pop();
+    client.send_data.pop_front();
   }
 
   if (client.send_data.size() == 0) // there was no send_data and no broadcast, so we close it once here
@@ -111,8 +143,7 @@ void server_base<T>::clean_up_client_resources(int client_idx, bool trigger_call
 
 template <server_type T>
 void server_base<T>::notify_event() {
-  uint64_t data = 1;
-  write(notification_efd, &data, sizeof(uint64_t));
+  msg_ring::send(ring.ring_fd, msg_ring::kind::NOTIFICATION, 0, 0, notification_efd); // the eventfd, unless MSG_RING is on
 }
 
 template <server_type T>
@@ -121,6 +152,64 @@ void server_base<T>::kill_server() {
   write(kill_efd, &data, sizeof(uint64_t));
 }
 
+template <server_type T>
+void server_base<T>::set_timer(int client_idx, timer_type type, uint32_t ms) {
+  auto &client = clients[client_idx];
+  const auto ticks = std::max<uint64_t>((ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS, 1);
+  const auto deadline = timers.now() + ticks;
+
+  auto &queued = client.timer_queued[(int)type];
+  client.timer_deadlines[(int)type] = deadline;
+  if (queued == 0 || deadline < queued) { // a later deadline is picked up when the entry which is already there expires, so resetting a timer is cheap
+    queued = deadline;
+    timers.insert({client_idx, client.id, type, deadline});
+  }
+}
+
+template <server_type T>
+void server_base<T>::clear_timer(int client_idx, timer_type type) {
+  clients[client_idx].timer_deadlines[(int)type] = 0; // the entry in the wheel is ignored once it expires
+}
+
+template <server_type T>
+void server_base<T>::clear_timers(int client_idx) {
+  auto &client = clients[client_idx];
+  client.timer_deadlines = {};
+  client.timer_queued = {};
+}
+
+template <server_type T>
+void server_base<T>::timer_tick() {
+  due_timers.clear();
+  timers.advance(due_timers);
+
+  for (const auto &item : due_timers) {
+    auto &client = clients[item.client_idx];
+    auto &queued = client.timer_queued[(int)item.type];
+    if (client.id != item.id || queued != item.deadline) {
+      continue; // the timer was replaced by an earlier one, or the connection has closed
+    }
+    queued = 0;
+
+    auto &deadline = client.timer_deadlines[(int)item.type];
+    if (deadline == 0) {
+      continue; // cleared
+    }
+    if (deadline > timers.now()) { // it was pushed back since this entry was added
+      queued = deadline;
+      timers.insert({item.client_idx, client.id, item.type, deadline});
+      continue;
+    }
+    deadline = 0;
+
+    if (item.type == timer_type::HANDSHAKE || item.type == timer_type::HEADER || item.type == timer_type::IDLE) {
+      static_cast<server<T> *>(this)->force_close_connection(item.client_idx);
+    } else if (timer_cb != nullptr) {
+      timer_cb(item.client_idx, item.type, static_cast<server<T> *>(this), custom_obj);
+    }
+  }
+}
+
 template <server_type T>
 void server_base<T>::event_read(int event_fd, event_type event) {
   io_uring_sqe *sqe = io_uring_get_sqe(&ring); //get a valid SQE (correct index and all)
@@ -152,7 +241,12 @@ server_base<T>::server_base(int listen_port) {
   event_read(kill_efd, event_type::KILL);                 //sets a read request for the signal eventfd
   event_read(notification_efd, event_type::NOTIFICATION); //sets a read request for the normal eventfd
 
+  utility::set_timerfd_interval(timer_fd, TIMER_TICK_MS);
+  event_read(timer_fd, event_type::TIMER); //the timer wheel for this thread is advanced by this
+
   listener_fd = setup_listener(listen_port); //setup the listener socket
+  listener_index = listener_fds.size();      //it's joined the end of the SO_REUSEPORT group
+  listener_fds.push_back(listener_fd);
 }
 
 template <server_type T>
@@ -241,6 +335,42 @@ int server_base<T>::setup_listener(int port) {
   return listener_fd;
 }
 
+template <server_type T>
+auto server_base<T>::steer_connections(const std::vector<uint32_t> &weights) -> bool {
+  std::unique_lock<std::mutex> init_lock(init_mutex);
+  if (weights.size() != listener_fds.size() || std::count(listener_fds.begin(), listener_fds.end(), -1) > 0) {
+    return false; // the group has changed
+  }
+
+  uint32_t total = 0;
+  for (const auto weight : weights) {
+    total += weight;
+  }
+  if (total == 0) {
+    return false;
+  }
+
+  // a random number below the total, and then the first listener whose share (cumulatively) is above it
+  std::vector<sock_filter> program{
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_RANDOM)),
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, total)
+  };
+  uint32_t cumulative = 0;
+  for (uint32_t idx = 0; idx < weights.size(); idx++) {
+    if (weights[idx] == 0) {
+      continue;
+    }
+    cumulative += weights[idx];
+    if (cumulative < total) {
+      program.push_back(BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, cumulative, 1, 0)); // skips the return if it's past this one's share
+    }
+    program.push_back(BPF_STMT(BPF_RET | BPF_K, idx));
+  }
+
+  sock_fprog fprog{static_cast<unsigned short>(program.size()), program.data()};
+  return setsockopt(listener_fds[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) == 0; // for the whole group
+}
+
 template <server_type T>
 std::string server_base<T>::get_ip_address(int client_idx) {
   int fd = clients[client_idx].sockfd;
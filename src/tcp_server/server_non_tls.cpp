@@ -23,7 +23,8 @@ server<server_type::NON_TLS>::server(
   read_callback<server_type::NON_TLS> r_cb,
   write_callback<server_type::NON_TLS> w_cb,
   event_callback<server_type::NON_TLS> e_cb,
-  custom_read_callback<server_type::NON_TLS> cr_cb
+  custom_read_callback<server_type::NON_TLS> cr_cb,
+  timer_callback<server_type::NON_TLS> t_cb
 ) : server_base<server_type::NON_TLS>(listen_port) { //call parent constructor with the port to listen on
   this->accept_cb = a_cb;
   this->close_cb = c_cb;
@@ -31,15 +32,16 @@ server<server_type::NON_TLS>::server(
   this->write_cb = w_cb;
   this->event_cb = e_cb;
   this->custom_read_cb = cr_cb;
+  this->timer_cb = t_cb;
   this->custom_obj = custom_obj;
 
   std::unique_lock<std::mutex> access_lock(non_tls_server_vector_access);
   non_tls_servers.push_back(this); // basically so that anything which wants to manage all of the server at once, can
 }
 
-void server<server_type::NON_TLS>::write_connection(int client_idx, std::vector<char> &&buff) {
+void server<server_type::NON_TLS>::write_connection(int client_idx, std::vector<char> &&buff, write_priority priority) {
   auto &client = clients[client_idx];
-  client.send_data.emplace(std::move(buff));
+  client.send_data.emplace(client.write_position(priority), std::move(buff))->priority = priority;
   // std::cout << "send data size: " << client.send_data.size() << "\n";
   if(client.send_data.size() == 1){ //only adds a write request in the case that the queue was empty before this
     auto &data_ref = client.send_data.front();
@@ -49,9 +51,9 @@ void server<server_type::NON_TLS>::write_connection(int client_idx, std::vector<
   }
 }
 
-void server<server_type::NON_TLS>::write_connection(int client_idx, char* buff, size_t length) {
+void server<server_type::NON_TLS>::write_connection(int client_idx, char* buff, size_t length, write_priority priority) {
   auto &client = clients[client_idx];
-  client.send_data.emplace(buff, length);
+  client.send_data.emplace(client.write_position(priority), buff, length)->priority = priority;
   if(client.send_data.size() == 1){ //only adds a write request in the case that the queue was empty before this
     auto &data_ref = client.send_data.front();
     auto &buff = data_ref.ptr_buff;
@@ -59,6 +61,15 @@ void server<server_type::NON_TLS>::write_connection(int client_idx, char* buff,
   }
 }
 
+void server<server_type::NON_TLS>::write_connection(int client_idx, shared_buffer &&buff, write_priority priority) {
+  auto &client = clients[client_idx];
+  client.send_data.emplace(client.write_position(priority), std::move(buff))->priority = priority;
+  if(client.send_data.size() == 1){ //only adds a write request in the case that the queue was empty before this
+    auto &data_ref = client.send_data.front().shared_buff;
+    add_write_req(client_idx, event_type::WRITE, data_ref.buff, data_ref.length);
+  }
+}
+
 void server<server_type::NON_TLS>::start_closing_connection(int client_idx){
   auto &client = clients[client_idx];
 
@@ -73,6 +84,8 @@ void server<server_type::NON_TLS>::start_closing_connection(int client_idx){
     // std::cout << "\t\t\terrno: " << errno << "\n";
 
     client.closing_now = true;
+    clear_timers(client_idx);
+    set_timer(client_idx, timer_type::IDLE, CLOSE_TIMEOUT_MS); // in case the other end never finishes closing
     add_read_req(client_idx, event_type::READ);
   }
 }
@@ -84,6 +97,7 @@ void server<server_type::NON_TLS>::finish_closing_connection(int client_idx) {
     int shutdwn = shutdown(client.sockfd, SHUT_RD);
     int clse = close(client.sockfd);
 
+    clear_timers(client_idx);
     active_connections.erase(client_idx);
     freed_indexes.insert(freed_indexes.end(), client_idx);
 
@@ -103,6 +117,7 @@ void server<server_type::NON_TLS>::force_close_connection(int client_idx) {
     int shutdwn = shutdown(client.sockfd, SHUT_RDWR);
     int clse = close(client.sockfd);
 
+    clear_timers(client_idx);
     active_connections.erase(client_idx);
     freed_indexes.insert(freed_indexes.end(), client_idx);
 
@@ -131,6 +146,7 @@ void server<server_type::NON_TLS>::req_event_handler(request *&req, int cqe_res)
       auto client_idx = setup_client(cqe_res);
 
       active_connections.insert(client_idx);
+      set_timer(client_idx, timer_type::IDLE, IDLE_TIMEOUT_MS);
       //above basically says this connection is now active, checking if this connection replaced an existing but broken one happens elsewhere
 
       if(accept_cb != nullptr) accept_cb(client_idx, this, custom_obj);
@@ -167,7 +183,7 @@ void server<server_type::NON_TLS>::req_event_handler(request *&req, int cqe_res)
         if(queue_ptr->front().broadcast) //if it's broadcast, then custom_info must be the item_idx
           broadcast_additional_info = queue_ptr->front().custom_info;
 
-        queue_ptr->pop(); //remove the last processed item
+        client.pop_write(); //remove the last processed item
         if(queue_ptr->size() > 0){ //if there's still some data in the queue, write it now
           auto &data_ref = queue_ptr->front();
           auto write_data_stuff = data_ref.get_ptr_and_size();
@@ -177,5 +193,12 @@ void server<server_type::NON_TLS>::req_event_handler(request *&req, int cqe_res)
       if(write_cb != nullptr) write_cb(req->client_idx, broadcast_additional_info, this, custom_obj); //call the write callback
       break;
     }
+    case event_type::ACCEPT_READ: // only for the TLS handshake
+    case event_type::ACCEPT_WRITE:
+    case event_type::KILL: // the rest are dealt with in server_base::start
+    case event_type::NOTIFICATION:
+    case event_type::CUSTOM_READ:
+    case event_type::TIMER:
+      break;
   }
 }
\ No newline at end of file
@@ -28,6 +28,8 @@ void server<server_type::TLS>::start_closing_connection(int client_idx) {
     // std::cout << "we've started closing the connection\n";
 
     client.closing_now = true;
+    clear_timers(client_idx);
+    set_timer(client_idx, timer_type::IDLE, CLOSE_TIMEOUT_MS); // in case the other end never finishes closing
     add_read_req(client_idx, event_type::READ);
   }
 }
@@ -44,6 +46,7 @@ void server<server_type::TLS>::finish_closing_connection(int client_idx) {
     int shutdwn = shutdown(client.sockfd, SHUT_RD);
     int clse = close(client.sockfd);
 
+    clear_timers(client_idx);
     uninitiated_connections.erase(client_idx);
     active_connections.erase(client_idx);
     freed_indexes.insert(freed_indexes.end(), client_idx);
@@ -59,7 +62,7 @@ void server<server_type::TLS>::force_close_connection(int client_idx) {
   // std::cout << "\t\t\t\tforce close";
 
   if (active_connections.count(client_idx) || uninitiated_connections.count(client_idx)) {
-    clean_up_client_resources(client_idx);
+    clean_up_client_resources(client_idx, active_connections.count(client_idx)); // connections still in the handshake were never passed to the accept callback
 
     client.send_data = {}; //free up all the data we might have wanted to send
 
@@ -71,15 +74,16 @@ void server<server_type::TLS>::force_close_connection(int client_idx) {
     int shutdwn = shutdown(client.sockfd, SHUT_RDWR);
     int clse = close(client.sockfd);
 
+    clear_timers(client_idx);
     uninitiated_connections.erase(client_idx);
     active_connections.erase(client_idx);
     freed_indexes.insert(freed_indexes.end(), client_idx);
   }
 }
 
-void server<server_type::TLS>::write_connection(int client_idx, std::vector<char> &&buff) {
+void server<server_type::TLS>::write_connection(int client_idx, std::vector<char> &&buff, write_priority priority) {
   auto &client = clients[client_idx];
-  client.send_data.emplace(std::move(buff));
+  client.send_data.emplace(client.write_position(priority), std::move(buff))->priority = priority;
   const auto &data_ref = client.send_data.front();
   auto &to_write_buff = data_ref.buff;
 
@@ -87,9 +91,9 @@ void server<server_type::TLS>::write_connection(int client_idx, std::vector<char
     wolfSSL_write(client.ssl, &to_write_buff[0], to_write_buff.size()); //writes the data using wolfSSL
 }
 
-void server<server_type::TLS>::write_connection(int client_idx, char *buff, size_t length) {
+void server<server_type::TLS>::write_connection(int client_idx, char *buff, size_t length, write_priority priority) {
   auto &client = clients[client_idx];
-  client.send_data.emplace(buff, length);
+  client.send_data.emplace(client.write_position(priority), buff, length)->priority = priority;
   const auto &data_ref = client.send_data.front();
   auto &to_write_buff = data_ref.ptr_buff;
 
@@ -97,6 +101,15 @@ void server<server_type::TLS>::write_connection(int client_idx, char *buff, size
     wolfSSL_write(client.ssl, to_write_buff, length); //writes the data using wolfSSL
 }
 
+void server<server_type::TLS>::write_connection(int client_idx, shared_buffer &&buff, write_priority priority) {
+  auto &client = clients[client_idx];
+  client.send_data.emplace(client.write_position(priority), std::move(buff))->priority = priority;
+  const auto &data_ref = client.send_data.front().shared_buff;
+
+  if (client.send_data.size() == 1)                               //only do wolfSSL_write() if this is the only thing to write
+    wolfSSL_write(client.ssl, data_ref.buff, data_ref.length); //writes the data using wolfSSL
+}
+
 server<server_type::TLS>::server(
     int listen_port,
     std::string fullchain_location,
@@ -107,13 +120,15 @@ server<server_type::TLS>::server(
     read_callback<server_type::TLS> r_cb,
     write_callback<server_type::TLS> w_cb,
     event_callback<server_type::TLS> e_cb,
-    custom_read_callback<server_type::TLS> cr_cb) : server_base<server_type::TLS>(listen_port) { //call parent constructor with the port to listen on
+    custom_read_callback<server_type::TLS> cr_cb,
+    timer_callback<server_type::TLS> t_cb) : server_base<server_type::TLS>(listen_port) { //call parent constructor with the port to listen on
   this->accept_cb = a_cb;
   this->close_cb = c_cb;
   this->read_cb = r_cb;
   this->write_cb = w_cb;
   this->event_cb = e_cb;
   this->custom_read_cb = cr_cb;
+  this->timer_cb = t_cb;
   this->custom_obj = custom_obj;
 
   //initialise wolfSSL
@@ -148,6 +163,11 @@ void server<server_type::TLS>::tls_accept(int client_idx) {
   wolfSSL_SetIOReadCtx(ssl, this);
   wolfSSL_SetIOWriteCtx(ssl, this);
 
+#ifdef HAVE_ALPN
+  static char alpn_protocols[] = "h2,http/1.1"; // clients without h2, or opening a websocket, get HTTP/1.1
+  wolfSSL_UseALPN(ssl, alpn_protocols, sizeof(alpn_protocols) - 1, WOLFSSL_ALPN_CONTINUE_ON_MISMATCH);
+#endif
+
   client->ssl = ssl; //sets the ssl connection
 
   wolfSSL_accept(ssl); //initialise the wolfSSL accept procedure
@@ -160,6 +180,8 @@ void server<server_type::TLS>::tls_accepted_routine(int client_idx) {
     accept_cb(client_idx, this, custom_obj);
   uninitiated_connections.erase(client_idx);
   active_connections.insert(client_idx);
+  clear_timer(client_idx, timer_type::HANDSHAKE);
+  set_timer(client_idx, timer_type::IDLE, IDLE_TIMEOUT_MS);
 
   auto &data = client.recv_data; //the data vector
   const auto recvd_amount = data.size();
@@ -181,6 +203,7 @@ void server<server_type::TLS>::req_event_handler(request *&req, int cqe_res) {
   case event_type::ACCEPT: {
     auto client_idx = setup_client(cqe_res);
     uninitiated_connections.insert(client_idx);
+    set_timer(client_idx, timer_type::HANDSHAKE, HANDSHAKE_TIMEOUT_MS);
 
     add_tcp_accept_req();
     tls_accept(client_idx);
@@ -223,7 +246,7 @@ void server<server_type::TLS>::req_event_handler(request *&req, int cqe_res) {
         if (client.send_data.front().broadcast) //if it's broadcast, then custom_info must be some data we want to pass to the read callback (such as in our case the item_idx)
           broadcast_additional_info = client.send_data.front().custom_info;
 
-        client.send_data.pop();
+        client.pop_write();
         if (write_cb != nullptr)
           write_cb(req->client_idx, broadcast_additional_info, this, custom_obj);
         if (client.send_data.size()) { //if the write queue isn't empty, then write that as well
@@ -275,5 +298,10 @@ void server<server_type::TLS>::req_event_handler(request *&req, int cqe_res) {
     }
     break;
   }
+  case event_type::KILL: // these are dealt with in server_base::start
+  case event_type::NOTIFICATION:
+  case event_type::CUSTOM_READ:
+  case event_type::TIMER:
+    break;
   }
 }
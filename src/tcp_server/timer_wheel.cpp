@@ -0,0 +1,50 @@
+#include "../header/timer_wheel.h"
+
+using namespace tcp_tls_server;
+
+void timer_wheel::insert(const entry &item) {
+  place(item, item.deadline > current_tick ? item.deadline : current_tick + 1);
+}
+
+void timer_wheel::place(const entry &item, uint64_t deadline) {
+  const auto delta = deadline - current_tick;
+
+  for (int level = 0; level < NUM_LEVELS; level++) {
+    if (delta < (uint64_t{1} << (SLOT_BITS * (level + 1))) || level == NUM_LEVELS - 1) {
+      // anything beyond the top level goes in its furthest slot, and is put back in further down once it gets there
+      const auto slot = level == NUM_LEVELS - 1 && (delta >> (SLOT_BITS * NUM_LEVELS)) != 0
+                            ? ((current_tick >> (SLOT_BITS * level)) - 1) & SLOT_MASK
+                            : (deadline >> (SLOT_BITS * level)) & SLOT_MASK;
+      levels[level][slot].push_back(item);
+      return;
+    }
+  }
+}
+
+void timer_wheel::cascade(int level) {
+  const auto slot = (current_tick >> (SLOT_BITS * level)) & SLOT_MASK;
+  if (slot == 0 && level + 1 < NUM_LEVELS) { // the level above wrapped around as well, so move its entries down first
+    cascade(level + 1);
+  }
+
+  auto entries = std::move(levels[level][slot]);
+  levels[level][slot] = {};
+  for (const auto &item : entries) {
+    place(item, item.deadline > current_tick ? item.deadline : current_tick); // this happens before the current slot of level 0 is expired, so those due now still are
+  }
+}
+
+void timer_wheel::advance(std::vector<entry> &due) {
+  current_tick++;
+
+  const auto slot = current_tick & SLOT_MASK;
+  if (slot == 0) {
+    cascade(1);
+  }
+
+  auto &entries = levels[0][slot];
+  for (const auto &item : entries) {
+    due.push_back(item);
+  }
+  entries.clear(); // keeps the capacity, since slots are reused every 64 ticks
+}
@@ -0,0 +1,56 @@
+#include "../header/web_server/broadcast_ring.h"
+#include "../header/utility.h"
+
+using namespace web_server;
+
+auto broadcast_ring::stations() -> std::vector<std::unique_ptr<broadcast_ring>> & {
+  static std::vector<std::unique_ptr<broadcast_ring>> rings;
+  return rings;
+}
+
+void broadcast_ring::make_station_rings(size_t num_stations) {
+  for (size_t i = 0; i < num_stations; i++) {
+    stations().emplace_back(new broadcast_ring());
+  }
+}
+
+auto broadcast_ring::add_reader(std::function<void()> wake_up) -> int {
+  if (num_readers == MAX_READERS) {
+    utility::fatal_error("Too many server threads for the broadcast ring");
+  }
+  readers[num_readers].next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed); // nothing is published in between, see the header
+  wake_ups.push_back(std::move(wake_up));
+  return num_readers++;
+}
+
+void broadcast_ring::wake_readers() {
+  for (const auto &wake_up : wake_ups) {
+    if (wake_up) {
+      wake_up();
+    }
+  }
+}
+
+void broadcast_ring::reclaim() {
+  auto oldest = head.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < num_readers; i++) {
+    oldest = std::min(oldest, readers[i].next.load(std::memory_order_acquire)); // no reader is still looking at anything before this
+  }
+
+  for (; reclaimed < oldest; reclaimed++) {
+    slots[reclaimed & MASK] = {}; // the frame is freed once any writes using it are done as well
+  }
+}
+
+auto broadcast_ring::publish(int channel_id, const tcp_tls_server::shared_buffer &frame, const tcp_tls_server::shared_buffer &deflated_frame, uint64_t sequence) -> bool {
+  reclaim();
+
+  const auto epoch = head.load(std::memory_order_relaxed);
+  if (epoch - reclaimed >= CAPACITY) {
+    return false;
+  }
+
+  slots[epoch & MASK] = {channel_id, frame, deflated_frame, sequence};
+  head.store(epoch + 1, std::memory_order_release);
+  return true;
+}
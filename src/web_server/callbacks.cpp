@@ -3,8 +3,6 @@
 
 #include "../header/web_server/web_server.h"
 
-#include <curl/curl.h>
-
 #include <string>
 
 template <server_type T>
@@ -22,97 +20,71 @@ void tcp_callbacks::close_cb(int client_idx, int broadcast_additional_info, tcp_
 
   // std::cout << "\t\t\t\t\t\t\t\e[92mkilled (client idx): " << client_idx << "\e[0m" << std::endl;
 
-  if (broadcast_additional_info != -1) { // only a broadcast if this is not -1
-    auto &item = web_server->broadcast_data[broadcast_additional_info];
-    auto &uses = item.uses;
-    if (--uses == 0) {
-      web_server->post_memory_release_message_to_program(web_server::message_type::broadcast_finished, item.buff_ptr, item.data_len, broadcast_additional_info);
-    }
-  }
-
   web_server->kill_client(client_idx);
 }
 
 template <server_type T>
 void tcp_callbacks::event_cb(tcp_tls_server::server<T> *tcp_server, void *custom_obj) { //the event callback
   const auto web_server = (simple_web_server<T> *)custom_obj;
-  const auto &client_idxs = web_server->active_websocket_connections_client_idxs;
 
   //std::cout << "got something from the central server" << std::endl;
 
-  auto data = web_server->get_from_to_server_queue();
-  switch (data.msg_type) {
-  case web_server::message_type::websocket_broadcast: {
-    if (client_idxs.size()) { // only even process this bit once someone has connected
-      auto &data_vec = web_server->broadcast_data;
-      if (data_vec.size() <= data.item_idx)
-        data_vec.resize(data.item_idx + 1); // item_idx corresponds directly to the index
-
-      int broadcast_channel_id = data.additional_info; // broadcast_channel_id is stored in additional_info
+  // everything posted since the last wake up is dealt with now, so a burst of messages only wakes this thread once
+  // broadcasts come through the broadcast ring, anything posted to this thread is dealt with after the broadcasts published before it
+  // (and with DIRECT_BROADCASTS, audio chunks come through each station's ring, new listeners are subscribed after what's in their backlog)
+  web_server->mark_broadcasts();
+  web_server->drain_to_server_mailbox([&](web_server::server_message &message) {
+    web_server->read_broadcasts(message.broadcasts_before);
+
+    if (auto *data = std::get_if<web_server::new_radio_client_response_msg>(&message.body)) {
+      // both the ws_client_idx and ws_client_id are needed to do a simple check to make sure it's the right connection
+      const int tcp_client_idx = web_server->get_ws_client_tcp_client_idx(data->ws_client_idx, data->ws_client_id);
+      if (tcp_client_idx == -1) {
+        if (data->broadcast_channel_id != -1) {
+          web_server->post_radio_client_left_to_server(data->broadcast_channel_id); // the websocket has already gone, so it's uncounted
+        }
+        return;
+      }
 
-      auto broadcast_clients_data = web_server->get_broadcast_set_data(broadcast_channel_id);
+      if (data->broadcast_channel_id != -1) { // in the case they subscribed to the correct channel
+        if (!web_server->take_pending_channel(data->broadcast_channel_id, tcp_client_idx)) {
+          web_server->post_radio_client_left_to_server(data->broadcast_channel_id); // it was unsubscribed from before this came back
+          return;
+        }
 
-      if (broadcast_clients_data.size > 0) {
-        // final item is the number of clients that will broadcast this
-        data_vec[data.item_idx] = {data.buff_ptr, data.length, int64_t(broadcast_clients_data.size)}; // casting this, since need -1 as a value, but this shouldn't be an issue since hopefully we don't get close to the limit of int64
-        tcp_server->broadcast_message(broadcast_clients_data.begin, broadcast_clients_data.end, broadcast_clients_data.size, data.buff_ptr, data.length, data.item_idx);
-        break;
-      }
-    }
+        web_server->read_station_broadcasts(web_server::channel_server_id(data->broadcast_channel_id), data->station_broadcasts_before); // the same goes for the station's own ring
 
-    web_server->post_memory_release_message_to_program(web_server::message_type::broadcast_finished, data.buff_ptr, data.length, data.item_idx);
-    break;
-  }
-  case web_server::message_type::new_radio_client_response: {
-    int tcp_client_idx = -1;
+        for (auto &frame : data->backlog) { // nothing to send if there hasn't been a broadcast yet
+          tcp_server->write_connection(tcp_client_idx, std::move(frame));
+        }
 
-    if ((tcp_client_idx = web_server->get_ws_client_tcp_client_idx(data.item_idx, data.additional_info)) != -1) { // ws_client_idx, ws_client_id respectively
-      // both are needed to do a simple check to make sure it's the right connection
-      auto broadcast_channel_id = reinterpret_cast<int64_t>(data.additional_info2);
+        web_server->subscribe_client(data->broadcast_channel_id, tcp_client_idx); // the client is now subscribed to this channel
+        return;
+      }
 
-      if (broadcast_channel_id != -1) { // in the case they subscribed to the correct channel
-        // send data to this client
-        tcp_server->write_connection(tcp_client_idx, std::move(data.buff));
+      // otherwise close the connection
+      auto ws_client_idx = web_server->tcp_clients[tcp_client_idx].ws_client_idx;
+      web_server->websocket_write(ws_client_idx, web_server->make_ws_frame("INVALID_STATION", web_server::websocket_non_control_opcodes::text_frame));
+      web_server->close_ws_connection_req(ws_client_idx);
+    } else if (auto *data = std::get_if<web_server::new_stream_client_response_msg>(&message.body)) {
+      if (static_cast<size_t>(data->client_idx) >= web_server->tcp_clients.size() || web_server->tcp_clients[data->client_idx].stream_listener_id != data->listener_id) {
+        web_server->post_radio_client_left_to_server(data->broadcast_channel_id); // it's gone, so it's uncounted
+        return;
+      }
 
-        web_server->subscribe_client(broadcast_channel_id, tcp_client_idx); // the client is now subscribed to this channel
-        break;
+      web_server->read_station_broadcasts(web_server::channel_server_id(data->broadcast_channel_id), data->station_broadcasts_before);
+      for (auto &frame : data->backlog) {
+        tcp_server->write_connection(data->client_idx, std::move(frame));
       }
+      web_server->subscribe_client(data->broadcast_channel_id, data->client_idx);
+    } else if (auto *data = std::get_if<web_server::skip_request_response_msg>(&message.body)) {
+      web_server->http_write(data->request_handle, std::move(data->response));
+    } else if (auto *data = std::get_if<web_server::audio_track_response_msg>(&message.body)) {
+      // std::cout << "Writing (track req): " << data->response.length << ", client idx: " << data->request_handle << std::endl;
+      web_server->http_write(data->request_handle, std::move(data->response));
     }
-    // otherwise close the connection
-    auto ws_client_idx = web_server->tcp_clients[tcp_client_idx].ws_client_idx;
-    web_server->websocket_write(ws_client_idx, web_server->make_ws_frame("INVALID_STATION", web_server::websocket_non_control_opcodes::text_frame));
-    web_server->close_ws_connection_req(ws_client_idx);
-    break;
-  }
-  case web_server::message_type::request_station_list_response: {
-    int client_idx = data.item_idx;
-    // std::cout << "Writing (track req): " << data.buff.size() << ", client idx: " << client_idx << std::endl;
-    tcp_server->write_connection(client_idx, std::move(data.buff));
-    break;
-  }
-  case web_server::message_type::request_audio_list_response: {
-    int client_idx = data.item_idx;
-    tcp_server->write_connection(client_idx, std::move(data.buff));
-    break;
-  }
-  case web_server::message_type::skip_request_response: {
-    int client_idx = data.item_idx;
-    tcp_server->write_connection(client_idx, std::move(data.buff));
-    break;
-  }
-  case web_server::message_type::request_audio_track_response: {
-    int client_idx = data.item_idx;
-    // std::cout << "Writing (track req): " << data.buff.size() << ", client idx: " << client_idx << std::endl;
-    tcp_server->write_connection(client_idx, std::move(data.buff));
-    break;
-  }
-  case web_server::message_type::request_audio_queue_response: {
-    int client_idx = data.item_idx;
-    // std::cout << "Writing (queue req): " << data.buff.size() << ", client idx: " << client_idx << std::endl;
-    tcp_server->write_connection(client_idx, std::move(data.buff));
-    break;
-  }
-  }
+  });
+  web_server->read_marked_broadcasts(); // whatever's been published after the last message, but not after the wake up started
 }
 
 template <server_type T>
@@ -127,36 +99,55 @@ void tcp_callbacks::custom_read_cb(int client_idx, int fd, std::vector<char> &&b
       web_server->web_cache.inotify_event_handler(event->wd); // pass on the watch descriptor
     }
     tcp_server->custom_read_req(fd, inotify_read_size, false); //always read from inotify_fd - we only read size of event, since we monitor files, and don't bother reading as much as you can
-  } else if (fd == web_server->ws_ping_timerfd) {
-    // ping the websockets to prevent their connections from being considered idle (since they respond with a pong packet)
-    web_server->ping_all_websockets(); // pings all the websockets
-
-    tcp_server->custom_read_req(fd, sizeof(uint64_t)); // rearms the timer
   } else {
     close(fd); //close the file fd finally, since we've read what we needed to
 
-    const auto &filepath = web_server->tcp_clients[client_idx].last_requested_read_filepath;
+    // client_idx is a request handle here, so it may be an HTTP/2 stream, which could have been reset since
+    if (!web_server->http_request_open(client_idx)) {
+      return;
+    }
+
+    const auto &filepath = web_server->http_client(client_idx).last_requested_read_filepath;
 
     if (web_server->web_cache.try_insert_item(filepath, std::move(buff))) { // try inserting the item
-      const auto ret_data = web_server->web_cache.fetch_item(filepath, client_idx, web_server->tcp_clients[client_idx]);
-      tcp_server->write_connection(client_idx, ret_data.buff, ret_data.size);
-    } else {                                                     // if insertion failed, it's not in the cache, so just send the original buffer
-      tcp_server->write_connection(client_idx, std::move(buff)); // this works because the rvalue reference of buff isn't assigned to anywhere in try_insert_item (since it failed), so buff still has its data
+      const auto ret_data = web_server->web_cache.fetch_item(filepath, client_idx, web_server->http_client(client_idx));
+      web_server->http_write(client_idx, ret_data.buff, ret_data.size);
+    } else {                                               // if insertion failed, it's not in the cache, so just send the original buffer
+      web_server->http_write(client_idx, std::move(buff)); // this works because the rvalue reference of buff isn't assigned to anywhere in try_insert_item (since it failed), so buff still has its data
     }
   }
 }
 
+template <server_type T>
+void tcp_callbacks::timer_cb(int client_idx, tcp_tls_server::timer_type type, tcp_tls_server::server<T> *tcp_server, void *custom_obj) {
+  const auto web_server = (simple_web_server<T> *)custom_obj;
+
+  if (type == tcp_tls_server::timer_type::PING && web_server->active_websocket_connections_client_idxs.count(client_idx)) {
+    // each websocket is pinged on its own schedule, so that they aren't all pinged at once, they respond with a pong which keeps the connection from being idle
+    web_server->ping_websocket(client_idx);
+  }
+}
+
 template <server_type T>
 void tcp_callbacks::read_cb(int client_idx, char *buffer, unsigned int length, tcp_tls_server::server<T> *tcp_server, void *custom_obj) {
   const auto web_server = (simple_web_server<T> *)custom_obj;
 
-  if (web_server->is_valid_http_req(buffer, length)) { //if not a valid HTTP req, then probably a websocket frame
+  if (web_server->is_http2_connection(client_idx) || web_server->is_http2_preface(buffer, length)) { // HTTP/2 connections stay open, and read frames continuously
+    tcp_server->clear_timer(client_idx, tcp_tls_server::timer_type::HEADER); // the idle timeout applies from now on
+    if (web_server->http2_process_read_cb(client_idx, buffer, length)) {
+      tcp_server->read_connection(client_idx);
+    }
+  } else if (web_server->is_valid_http_req(buffer, length)) { //if not a valid HTTP req, then probably a websocket frame
+    tcp_server->clear_timer(client_idx, tcp_tls_server::timer_type::HEADER);
+
     std::vector<std::string> headers;
 
     bool accept_bytes = false;
     std::string sec_websocket_key;
+    std::string sec_websocket_extensions;
 
     const auto *const websocket_key_token = "Sec-WebSocket-Key: ";
+    const auto *const websocket_extensions_token = "Sec-WebSocket-Extensions: ";
 
     char *str = nullptr;
     char *saveptr = nullptr;
@@ -171,6 +162,9 @@ void tcp_callbacks::read_cb(int client_idx, char *buffer, unsigned int length, t
       if (tempStr.find("Sec-WebSocket-Key") != std::string::npos) {
         sec_websocket_key = tempStr.substr(strlen(websocket_key_token));
       }
+      if (tempStr.find(websocket_extensions_token) == 0) {
+        sec_websocket_extensions = tempStr.substr(strlen(websocket_extensions_token));
+      }
       if (tempStr.find("X-Forwarded-For: ") != std::string::npos) {
         ip_str = tempStr.substr(strlen("X-Forwarded-For: "));
       }
@@ -189,17 +183,9 @@ void tcp_callbacks::read_cb(int client_idx, char *buffer, unsigned int length, t
     std::string path = &strtok_r(nullptr, " ", &saveptr)[1]; //if it's a valid request it should be a path
     free(temp_str);
 
-    static CURL *curl = curl_easy_init();
-    char *output = curl_easy_unescape(curl, path.c_str(), (int)path.size(), nullptr);
-    path = output;
-    curl_free(output);
-
-    //get callback, if unsuccesful then 404
-    if (!is_GET ||
-        !web_server->get_process(path, accept_bytes, sec_websocket_key, client_idx, ip_str)) {
-      web_server->send_file_request(client_idx, "public/404.html", false, HTTP_400_UNAUTHORISED); //sends 404 request, should be cached if possible
-    } else if (web_server->active_websocket_connections_client_idxs.count(client_idx)) {          // if it's a websocket
-      tcp_server->read_connection(client_idx);                                                    // read from the socket immediately
+    web_server->respond_to_http_request(client_idx, is_GET, std::move(path), accept_bytes, sec_websocket_key, ip_str, sec_websocket_extensions);
+    if (web_server->active_websocket_connections_client_idxs.count(client_idx)) { // if it's a websocket
+      tcp_server->read_connection(client_idx);                                    // read from the socket immediately
     }
   } else if (web_server->active_websocket_connections_client_idxs.count(client_idx)) { //this bit should be just websocket frames, and we only want to hear from active websockets, not closing ones
     web_server->websocket_process_read_cb(client_idx, buffer, length);                 //this is the main websocket callback, deals with receiving messages, and sending them too if it needs/wants to
@@ -213,15 +199,10 @@ template <server_type T>
 void tcp_callbacks::write_cb(int client_idx, int broadcast_additional_info, tcp_tls_server::server<T> *tcp_server, void *custom_obj) {
   const auto web_server = (simple_web_server<T> *)custom_obj;
 
-  if (broadcast_additional_info != -1) { // only a broadcast if this is not -1
-    auto &item = web_server->broadcast_data[broadcast_additional_info];
-    auto &uses = item.uses;
-    if (--uses == 0) {
-      web_server->post_memory_release_message_to_program(web_server::message_type::broadcast_finished, item.buff_ptr, item.data_len, broadcast_additional_info);
-    }
-  }
-
-  if (!web_server->websocket_process_write_cb(client_idx)) { //if this is a websocket that is in the process of closing, it will let it close and then exit the function, otherwise we read from the function
+  if (web_server->is_http2_connection(client_idx)) { // HTTP/2 connections are only closed once the session is done
+    web_server->http2_process_write_cb(client_idx);
+  } else if (web_server->tcp_clients[client_idx].stream_listener_id != 0) { // a /stream/ listener, which is only closed by the other end
+  } else if (!web_server->websocket_process_write_cb(client_idx)) { //if this is a websocket that is in the process of closing, it will let it close and then exit the function, otherwise we read from the function
     // std::cout << "closing client connection " << client_idx << std::endl;
     web_server->close_connection(client_idx); //for web requests you close the connection right after
   } else {
@@ -238,6 +219,9 @@ template void tcp_callbacks::read_cb(int client_idx, char *buffer, unsigned int
 template void tcp_callbacks::custom_read_cb(int client_idx, int fd, std::vector<char> &&buff, size_t read_bytes, tcp_tls_server::server<server_type::TLS> *tcp_server, void *custom_obj);
 template void tcp_callbacks::custom_read_cb(int client_idx, int fd, std::vector<char> &&buff, size_t read_bytes, tcp_tls_server::server<server_type::NON_TLS> *tcp_server, void *custom_obj);
 
+template void tcp_callbacks::timer_cb(int client_idx, tcp_tls_server::timer_type type, tcp_tls_server::server<server_type::TLS> *tcp_server, void *custom_obj);
+template void tcp_callbacks::timer_cb(int client_idx, tcp_tls_server::timer_type type, tcp_tls_server::server<server_type::NON_TLS> *tcp_server, void *custom_obj);
+
 template void tcp_callbacks::event_cb(tcp_tls_server::server<server_type::TLS> *tcp_server, void *custom_obj);
 template void tcp_callbacks::event_cb(tcp_tls_server::server<server_type::NON_TLS> *tcp_server, void *custom_obj);
 
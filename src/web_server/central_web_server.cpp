@@ -1,15 +1,23 @@
 #include "../header/web_server/web_server.h"
 #include "../header/audio_server.h"
+#include "../header/web_server/workers.h"
+#include "../header/web_server/relay.h"
 
 #include <regex>
 #include <thread>
 #include <algorithm>
 
+#include <signal.h>
+#include <sys/socket.h>
 #include <sys/timerfd.h>
+#include <sys/wait.h>
 
 std::unordered_map<std::string, std::string> central_web_server::config_data_map{}; // config options
 std::chrono::system_clock::time_point time_start = std::chrono::system_clock::now(); // global start time
 
+central_web_server::central_web_server() = default;
+central_web_server::~central_web_server() = default;
+
 template<>
 void central_web_server::thread_server_runner(web_server::tls_web_server &basic_web_server){
   web_server::tls_server tcp_server(
@@ -22,11 +30,17 @@ void central_web_server::thread_server_runner(web_server::tls_web_server &basic_
     tcp_callbacks::read_cb<server_type::TLS>,
     tcp_callbacks::write_cb<server_type::TLS>,
     tcp_callbacks::event_cb<server_type::TLS>,
-    tcp_callbacks::custom_read_cb<server_type::TLS>
+    tcp_callbacks::custom_read_cb<server_type::TLS>,
+    tcp_callbacks::timer_cb<server_type::TLS>
   ); //pass function pointers and a custom object
 
   basic_web_server.set_tcp_server(&tcp_server); //required to be called, to give it a pointer to the server
-  tcp_server.custom_read_req(basic_web_server.ws_ping_timerfd, sizeof(uint64_t)); // start reading on the ping timerfd
+  if(config_data_map.count("WS_MAX_PAYLOAD"))
+    basic_web_server.ws_max_payload_size = std::stoull(config_data_map["WS_MAX_PAYLOAD"]);
+  if(config_data_map.count("MAX_QUEUED_CHUNKS"))
+    basic_web_server.max_queued_chunks = std::stoull(config_data_map["MAX_QUEUED_CHUNKS"]);
+  basic_web_server.permessage_deflate = config_data_map["PERMESSAGE_DEFLATE"] == "yes";
+  basic_web_server.ingest_key = config_data_map["INGEST_KEY"];
   
   tcp_server.start();
 }
@@ -41,16 +55,22 @@ void central_web_server::thread_server_runner(web_server::plain_web_server &basi
     tcp_callbacks::read_cb<server_type::NON_TLS>,
     tcp_callbacks::write_cb<server_type::NON_TLS>,
     tcp_callbacks::event_cb<server_type::NON_TLS>,
-    tcp_callbacks::custom_read_cb<server_type::NON_TLS>
+    tcp_callbacks::custom_read_cb<server_type::NON_TLS>,
+    tcp_callbacks::timer_cb<server_type::NON_TLS>
   ); //pass function pointers and a custom object
   
   basic_web_server.set_tcp_server(&tcp_server); //required to be called, to give it a pointer to the server
-  tcp_server.custom_read_req(basic_web_server.ws_ping_timerfd, sizeof(uint64_t)); // start reading on the ping timerfd
+  if(config_data_map.count("WS_MAX_PAYLOAD"))
+    basic_web_server.ws_max_payload_size = std::stoull(config_data_map["WS_MAX_PAYLOAD"]);
+  if(config_data_map.count("MAX_QUEUED_CHUNKS"))
+    basic_web_server.max_queued_chunks = std::stoull(config_data_map["MAX_QUEUED_CHUNKS"]);
+  basic_web_server.permessage_deflate = config_data_map["PERMESSAGE_DEFLATE"] == "yes";
+  basic_web_server.ingest_key = config_data_map["INGEST_KEY"];
   
   tcp_server.start();
 }
 
-void central_web_server::start_server(const char *config_file_path){
+void central_web_server::start_server(const char *config_file_path, int worker_idx){
   auto file_fd = open(config_file_path, O_RDONLY);
   if(file_fd == -1)
     utility::fatal_error("Ensure the .config file is in this directory");
@@ -94,8 +114,8 @@ void central_web_server::start_server(const char *config_file_path){
 
     char *saveptr = nullptr;
     std::string key = strtok_r(&line[0], ":", &saveptr);
-    std::string value = strtok_r(nullptr, ":", &saveptr);
-    config_data_map[key] = value;    
+    const char *value = strtok_r(nullptr, "", &saveptr); // the rest of the line, since some values (like RELAY's host:port) have colons in them
+    config_data_map[key] = value != nullptr ? value : "";
   }
 
   if(config_data_map.count("TLS") && config_data_map["TLS"] == "yes"){
@@ -110,6 +130,15 @@ void central_web_server::start_server(const char *config_file_path){
   //done reading config
   const auto num_threads = config_data_map.count("SERVER_THREADS") ? std::stoi(config_data_map["SERVER_THREADS"]) : 3; //by default uses 3 threads
   this->num_threads = num_threads;
+  num_workers = config_data_map.count("WORKERS") ? std::stoi(config_data_map["WORKERS"]) : 0; // worker processes, each with SERVER_THREADS server threads
+
+  if(worker_idx != -1){ // this is one of those, started by the audio process
+    if(config_data_map["TLS"] == "yes")
+      run_worker<server_type::TLS>(worker_idx);
+    else
+      run_worker<server_type::NON_TLS>(worker_idx);
+    return;
+  }
 
   std::cout << "Running server\n";
 
@@ -147,6 +176,19 @@ void central_web_server::add_read_req(int fd, size_t size, int custom_info){
   io_uring_submit(&ring); //submits the event
 }
 
+void central_web_server::add_socket_read_req(int fd, central_web_server_event event, uint64_t custom_info){
+  io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+  auto *req = new central_web_server_req();
+  req->buff.resize(64 * 1024); // messages split between reads are put back together by the reader
+  req->event = event;
+  req->fd = fd;
+  req->custom_info = custom_info;
+
+  io_uring_prep_read(sqe, fd, &(req->buff[0]), req->buff.size(), 0); // a socket, so there is no offset
+  io_uring_sqe_set_data(sqe, req);
+  io_uring_submit(&ring);
+}
+
 void central_web_server::add_timer_read_req(int timer_fd){
   io_uring_sqe *sqe = io_uring_get_sqe(&ring); //get a valid SQE (correct index and all)
   auto *req = new central_web_server_req(); //enough space for the request struct
@@ -231,13 +273,29 @@ std::vector<std::pair<std::string, std::string>> central_web_server::tokenize_ra
 
 template<server_type T>
 void central_web_server::run(){
-  std::cout << "Using " << num_threads << " threads\n";
+  if(num_workers > 0)
+    std::cout << "Using " << num_workers << " worker processes with " << num_threads << " threads each\n";
+  else
+    std::cout << "Using " << num_threads << " threads\n";
+  const int num_local_threads = num_workers > 0 ? 0 : num_threads; // with workers, this process only has the central and audio threads
+
+  // pinned before anything else is made, every thread is pinned to its own CPUs as soon as it starts
+  const auto placement = cpu_placement::make_plan(config_data_map["CPU_PLACEMENT"], config_data_map["SERVER_CPUS"], config_data_map["AUDIO_CPUS"], config_data_map["CENTRAL_CPUS"], num_local_threads);
+  cpu_placement::log_plan(placement);
+  cpu_placement::pin_this_thread(placement.central);
+  audio_server::cpus = placement.audio; // before the audio threads start
 
   // io_uring stuff
   std::memset(&ring, 0, sizeof(io_uring));
   io_uring_queue_init(QUEUE_DEPTH, &ring, 0); //no flags, setup the queue
   io_uring_cqe *cqe;
 
+  // threads can wake each other by posting to each other's rings rather than with eventfds, before any of them start
+  msg_ring::set_thread_ring(&ring);
+  if(config_data_map["MSG_RING"] == "yes" && !msg_ring::enable())
+    std::cerr << "IORING_OP_MSG_RING isn't supported, using eventfds" << std::endl;
+  audio_server::program_ring_fd = ring.ring_fd;
+
 
   // need to read on the kill efd, and make the server exit cleanly
   add_event_read_req(kill_server_efd, central_web_server_event::KILL_SERVER);
@@ -248,20 +306,77 @@ void central_web_server::run(){
   auto radio_data = tokenize_radio_list(config_data_map["RADIO"]);
 
   std::vector<std::unique_ptr<audio_server>> audio_servers{};
-  
-  for(auto radio_data_pair : radio_data){
-    audio_servers.push_back(std::unique_ptr<audio_server>(new audio_server(radio_data_pair.first, radio_data_pair.second)));
-    audio_server_initialise_reads(audio_servers.back().get());
+
+  const size_t backlog_chunks = read_broadcast_config(); // before the audio threads start
+
+  if(config_data_map.count("RELAY")){ // an edge, the stations are the origin's rather than the ones in RADIO
+    relay_origin = std::make_unique<relay::state>();
+    relay_origin->origin = relay::parse_address(config_data_map["RELAY"]);
+    const auto stations = relay::fetch_station_list(relay_origin->origin); // tried once, and bounded, so a missing origin doesn't hold up startup
+    if(stations.empty())
+      utility::fatal_error("Couldn't get the station list from the origin at " + config_data_map["RELAY"] + ", is it running?");
+
+    std::cout << "Relaying " << stations.size() << " stations from " << config_data_map["RELAY"] << "\n";
+    for(const auto &station : stations){
+      audio_servers.push_back(std::unique_ptr<audio_server>(new audio_server(station)));
+      audio_servers.back()->broadcast_state.backlogs.set_capacity(backlog_chunks);
+      rebuild_audio_list_response(audio_servers.back().get());
+      rebuild_audio_queue_response(audio_servers.back().get());
+    }
+    relay_origin->stations.resize(audio_servers.size());
+  }else{
+    for(auto radio_data_pair : radio_data){
+      audio_servers.push_back(std::unique_ptr<audio_server>(new audio_server(radio_data_pair.first, radio_data_pair.second)));
+      audio_servers.back()->broadcast_state.backlogs.set_capacity(backlog_chunks);
+      rebuild_audio_list_response(audio_servers.back().get());
+      rebuild_audio_queue_response(audio_servers.back().get());
+      audio_server_initialise_reads(audio_servers.back().get());
+    }
+  }
+  rebuild_station_list_response(); // the stations are all set up now
+
+  // the audio threads can publish the chunks straight to the server threads, each station with its own ring, rather than through this thread
+  // they all go through here with workers, and are copied into the shared memory
+  const bool direct_broadcasts = config_data_map["DIRECT_BROADCASTS"] == "yes" && num_workers == 0 && !relay_origin;
+  if(direct_broadcasts)
+    web_server::broadcast_ring::make_station_rings(audio_servers.size()); // the server threads add themselves as readers
+  if(num_workers > 0){
+    audio_process = std::make_unique<workers::audio_process_state>();
+    audio_process->segment = std::make_unique<web_server::shared_broadcast_segment>(web_server::shared_broadcast_segment::create());
+    audio_process->segment_reader = web_server::broadcast_ring::instance().add_reader(); // before anything's published
+  }
+  publish_station_snapshot(); // before the server threads start, so they always have a snapshot
+
+  // fixed deployments can have all of public/ preloaded and pre-rendered, SIGHUP reloads it
+  if(config_data_map["PRELOAD_PUBLIC"] == "yes"){
+    web_cache::static_asset_store::instance().load("public", "public/404.html", config_data_map["HUGE_PAGES"] == "yes");
+    add_event_read_req(reload_static_assets_efd, central_web_server_event::RELOAD_STATIC_ASSETS);
   }
 
   // server threads
   std::vector<server_data<T>> thread_data_container{};
-  thread_data_container.resize(num_threads);
-  int idx = 0;
-  for(auto &thread_data : thread_data_container){
-    // custom info is the idx of the server in the vector
-    add_event_read_req(thread_data.server.central_communication_fd, central_web_server_event::SERVER_THREAD_COMMUNICATION, idx); // add read for all thread events
-    idx++;
+  thread_data_container.reserve(num_local_threads); // never reallocated, each thread has a reference to its server
+  for(int idx = 0; idx < num_local_threads; idx++){
+    thread_data_container.emplace_back(idx, ring.ring_fd, size_t(idx) < placement.server_threads.size() ? placement.server_threads[idx] : cpu_placement::cpu_set{});
+    // custom info is the idx of the server in the vector, the eventfd is still read with MSG_RING in case it can't be used
+    add_event_read_req(thread_data_container.back().server.central_communication_fd, central_web_server_event::SERVER_THREAD_COMMUNICATION, idx); // add read for all thread events
+  }
+  if(direct_broadcasts){ // every server thread is reading them now, so the audio threads can take over, anything before this came through here
+    for(auto &server : audio_servers)
+      server->direct_ring.store(&web_server::broadcast_ring::station(server->id), std::memory_order_release);
+  }
+
+  // each worker is sent the snapshot as soon as it's started, and reads the shared memory from then on
+  for(int worker_idx = 0; worker_idx < num_workers; worker_idx++){
+    audio_process->links.push_back({});
+    audio_process->links.back().broadcast_efd = eventfd(0, EFD_CLOEXEC);
+    start_worker(worker_idx);
+  }
+
+  if(relay_origin){ // the server threads are all reading the broadcasts now
+    relay_origin->connected_efd = eventfd(0, EFD_CLOEXEC);
+    add_event_read_req(relay_origin->connected_efd, central_web_server_event::RELAY_CONNECTED);
+    relay_connect();
   }
 
 
@@ -280,9 +395,28 @@ void central_web_server::run(){
       break;
     }
 
+    if(msg_ring::is_message(cqe->user_data)){ // posted straight into this ring, in place of an eventfd
+      const auto index = msg_ring::index_of(cqe->user_data);
+      switch(msg_ring::kind_of(cqe->user_data)){
+        case msg_ring::kind::SEND_FAILED:
+          msg_ring::send_failed(cqe->user_data);
+          break;
+        case msg_ring::kind::SERVER_THREAD:
+          drain_server_thread_mailbox(index, thread_data_container);
+          break;
+        case msg_ring::kind::AUDIO_SERVER:
+          audio_server_event_req_handler<T>(cqe->res, index, thread_data_container); // res is the eventfd it stands in for
+          break;
+        default:
+          break;
+      }
+      io_uring_cqe_seen(&ring, cqe);
+      continue;
+    }
+
     auto *req = reinterpret_cast<central_web_server_req*>(cqe->user_data);
 
-    if(cqe->res < 0){
+    if(cqe->res < 0 && req->event != central_web_server_event::WORKER_COMMUNICATION && req->event != central_web_server_event::RELAY_COMMUNICATION){ // a worker's or the origin's socket failing means it's gone
       std::cerr << "CQE RES CENTRAL: " << cqe->res << std::endl;
       std::cerr << "ERRNO: " << errno << std::endl;
       std::cerr << "io_uring_wait_cqe ret: " << int(ret) << std::endl;
@@ -299,150 +433,57 @@ void central_web_server::run(){
       }
       case central_web_server_event::TIMERFD: {
         add_timer_read_req(timer_fd); // rearm the timer
+        if(config_data_map["MAILBOX_STATS"] == "yes")
+          report_mailbox_stats(thread_data_container);
+        if(config_data_map["BALANCE_CONNECTIONS"] == "yes" && num_workers == 0) // the workers' listeners aren't in this process
+          balance_connections(thread_data_container);
+        if(config_data_map["LOAD_STATS"] == "yes")
+          report_thread_load(thread_data_container);
+        if(relay_origin && relay_origin->fd == -1)
+          relay_connect();
+        break;
+      }
+      case central_web_server_event::WORKER_BROADCASTS: // only read in a worker, see run_worker
+        break;
+      case central_web_server_event::RELAY_CONNECTED:
+        add_event_read_req(req->fd, central_web_server_event::RELAY_CONNECTED); // rearm the eventfd
+        relay_connected(thread_data_container);
+        break;
+      case central_web_server_event::RELAY_COMMUNICATION: {
+        const auto handler = [&](std::string_view message){ relay_message_handler(message, thread_data_container); };
+        if(cqe->res <= 0 || !relay_origin->reader.feed(req->fd, req->buff.data(), cqe->res, handler)){ // the origin has gone, or closed the websocket
+          relay_disconnected(thread_data_container);
+          break;
+        }
+        add_socket_read_req(req->fd, central_web_server_event::RELAY_COMMUNICATION);
+        break;
+      }
+      case central_web_server_event::WORKER_COMMUNICATION: {
+        const int worker_idx = req->custom_info;
+        auto &link = audio_process->links[worker_idx];
+        if(cqe->res <= 0){ // the worker has exited
+          worker_exited(worker_idx);
+          break;
+        }
+
+        link.reader.feed(req->buff.data(), cqe->res, [&](const workers::message_header &header, std::string_view payload){
+          worker_message_handler(worker_idx, header, payload, thread_data_container);
+        });
+        add_socket_read_req(link.socket_fd, central_web_server_event::WORKER_COMMUNICATION, worker_idx);
+        break;
+      }
+      case central_web_server_event::RELOAD_STATIC_ASSETS: {
+        add_event_read_req(reload_static_assets_efd, central_web_server_event::RELOAD_STATIC_ASSETS); // rearm the eventfd
+
+        if(!web_cache::static_asset_store::instance().reload())
+          std::cerr << "Failed to reload public/, still using the old snapshot" << std::endl;
         break;
       }
       case central_web_server_event::SERVER_THREAD_COMMUNICATION: {
         add_event_read_req(req->fd, central_web_server_event::SERVER_THREAD_COMMUNICATION, req->custom_info); // rearm the eventfd
 
-        if(req->custom_info != -1){ // then the idx is set as custom_info in the add_event_read_req call above
-          auto efd_count = *reinterpret_cast<uint64_t*>(req->buff.data()); // we only write a value of 1 to the efd, so if greater than 1, multiple items in queue
-          
-          while(efd_count--){ // possibly deal with multiple items in the queue
-            web_server::basic_web_server<T> &server = thread_data_container[req->custom_info].server;
-            web_server::message_post_data data = server.get_from_to_program_queue();
-
-            switch(data.msg_type){
-              case web_server::message_type::request_station_list: {
-                std::string response_str = default_plain_json_http_header + "{\"stations\": [";
-
-                for(auto &pair : audio_server::server_id_map)
-                  response_str += "\"" + pair.first + "\",";
-                response_str = response_str.substr(0, response_str.size() - 1); // gets rid of the trailing comma
-                response_str += "]}";
-
-                std::vector<char> response{response_str.begin(), response_str.end()};
-
-                server.post_server_list_response_to_server(data.item_idx, std::move(response));
-                break;
-              }
-              case web_server::message_type::broadcast_finished:
-                store.free_item(data.item_idx);
-                break;
-              case web_server::message_type::radio_client_left: {
-                int server_id = data.additional_info/2;
-                if((double)server_id == (double)data.additional_info/2){ // since the audio end point is broadcast_channel_id/2, and metadata is broadcast_channel_id/2 + 1
-                  audio_server *inst = audio_server::instance(server_id);
-                  inst->num_listeners--;
-                }
-                break;
-              }
-              case web_server::message_type::new_radio_client: {
-                std::vector<char> response_data_first{};
-                std::vector<char> response_data_second{};
-
-                char *saveptr{};
-                char *temp_str = strdup(data.additional_str.c_str()); // expecting something like "test_server/endpoint"
-                std::string station_name = strtok_r(temp_str, "/", &saveptr);
-                std::string connection_type = strtok_r(nullptr, "", &saveptr); // so either audio_broadcast or metadata_only in this case
-                free(temp_str);
-
-                // broadcast_channel_id = server_id*2 for connection_type == "audio_broadcast"
-                // broadcast_channel_id = server_id*2 + 1 for connection_type == "metadata_only"
-                int broadcast_channel_id = -1; // the default, used to indicate the connectio should be closed
-
-                if(audio_server::server_id_map.count(station_name) && ( connection_type == "audio_broadcast" || connection_type == "metadata_only" )){ // so must be a valid station and connection_type
-                  // send the latest cached data for this specific server to this user, data.item_idx is the ws_client_idx and data.additional_info is the ws_client_id
-                  auto server_id = audio_server::server_id_map[station_name];
-                  
-                  broadcast_channel_id = server_id * 2; // the server ID
-
-                  audio_server *inst = audio_server::instance(server_id);
-
-                  if(connection_type == "audio_broadcast"){
-                    response_data_first = inst->main_thread_state.second_last_broadcast_audio_data; // since this would be the 2nd last item, so send it first
-                    response_data_second = inst->main_thread_state.last_broadcast_audio_data; // and this would be the last item, so send it after that
-                    inst->num_listeners++;
-                  }else if(connection_type == "metadata_only"){
-                    response_data_first = inst->main_thread_state.second_last_broadcast_metadata_only; // since this would be the 2nd last item, so send it first
-                    response_data_second = inst->main_thread_state.last_broadcast_metadata_only; // and this would be the last item, so send it after that
-                    broadcast_channel_id += 1; // since broadcast channel is server_id*2 + 1
-                  }
-                }
-
-                server.post_new_radio_client_response_to_server(data.item_idx, data.additional_info, std::move(response_data_first), broadcast_channel_id);
-
-                if(broadcast_channel_id != -1)
-                  server.post_new_radio_client_response_to_server(data.item_idx, data.additional_info, std::move(response_data_second), broadcast_channel_id);
-                break;
-              }
-              case web_server::message_type::request_audio_track: {
-                if(audio_server::server_id_map.count(data.additional_str)){
-                  audio_server *audio_broadcast_server = audio_server::instance(audio_server::server_id_map[data.additional_str]);
-                  // std::cout << "clientidx: " << data.item_idx << ", threadid: " << req->custom_info << std::endl;
-									audio_broadcast_server->submit_audio_req(data.additional_str2, data.item_idx, req->custom_info); // custom info is the thread_id
-									// above submits a request for a track in the addditional_str2 string
-									break;
-								}
-
-								std::string response = default_plain_text_http_header + "FAILURE";
-
-                std::vector<char> buff{response.begin(), response.end()};
-                server.post_audio_track_req_response_to_server(data.item_idx, std::move(buff));
-                break;
-              }
-              case web_server::message_type::skip_request: {
-                if(audio_server::server_id_map.count(data.additional_str)){
-                  audio_server* audio_server_inst = audio_server::instance(audio_server::server_id_map[data.additional_str]);
-                  audio_server_inst->send_request_to_skip_to_audio_server(data.additional_str2, data.item_idx, req->custom_info); // custom info is the thread_id
-                }else{
-                  std::string response = default_plain_text_http_header + "FAILURE";
-                  std::vector<char> buff{response.begin(), response.end()};
-                  server.post_skip_request_response_to_server(data.item_idx, std::move(buff));
-                }
-                break;
-              }
-              case web_server::message_type::request_audio_list: {
-                std::string response = default_plain_text_http_header;
-                  
-                if(audio_server::server_id_map.count(data.additional_str)){
-                  response += audio_server::instance(
-                      audio_server::server_id_map[data.additional_str]
-                    )->main_thread_state.slash_separated_audio_list;
-                  
-                  std::vector<char> buff{response.begin(), response.end()};
-                  
-                  server.post_audio_list_req_response_to_server(data.item_idx, std::move(buff));
-                }else{
-                  response += "NOT_FOUND";
-                  
-                  std::vector<char> buff{response.begin(), response.end()};
-                  
-                  server.post_audio_list_req_response_to_server(data.item_idx, std::move(buff));
-                }
-                break;
-              }
-              case web_server::message_type::request_audio_queue:
-								std::string response = default_plain_text_http_header;
-
-                if(audio_server::server_id_map.count(data.additional_str)){
-                  audio_server *audio_broadcast_server = audio_server::instance(audio_server::server_id_map[data.additional_str]);
-
-                  std::string queue{};
-                  for(const auto &item : audio_broadcast_server->main_thread_state.queued_audio)
-                    queue += item + "/";
-
-                  response += queue;
-
-                  // std::cout << "q: " << queue << std::endl;
-								}else{
-                  response += "FAILURE";
-                }
-
-                std::vector<char> buff{response.begin(), response.end()};
-                server.post_audio_queue_req_response_to_server(data.item_idx, std::move(buff));
-						}
-          }
-        }
+        if(req->custom_info != -1) // then the idx is set as custom_info in the add_event_read_req call above
+          drain_server_thread_mailbox(req->custom_info, thread_data_container);
         break;
       }
       case central_web_server_event::READ:
@@ -478,6 +519,9 @@ void central_web_server::run(){
   
   // make sure to close sockets
   close(timer_fd);
+
+  if(relay_origin && relay_origin->connecting.joinable()) // it gives up after the connect and handshake timeouts
+    relay_origin->connecting.join();
 }
 
 void central_web_server::audio_server_initialise_reads(audio_server *server){
@@ -506,8 +550,6 @@ void central_web_server::audio_server_read_req_handler(int readfd, int server_id
 
 template<server_type T>
 void central_web_server::audio_server_event_req_handler(int eventfd, int server_id, std::vector<server_data<T>> &thread_data_container){
-  // shortcut for make_ws_frame
-  const auto make_ws_frame = web_server::basic_web_server<T>::make_ws_frame;
   // the audio server
   auto server = audio_server::instance(server_id);
 
@@ -515,6 +557,9 @@ void central_web_server::audio_server_event_req_handler(int eventfd, int server_
     auto data = server->get_from_audio_file_list_data_queue();
 
     server->main_thread_state.slash_separated_audio_list = data.appropriate_str;
+    rebuild_audio_list_response(server);
+    publish_station_snapshot();
+    push_station_update(server, web_server::channel_kind::list_updates, thread_data_container);
   }else if(eventfd == server->audio_list_update){ // updates the initial data
     auto data = server->get_from_audio_file_list_data_queue();
 
@@ -526,6 +571,10 @@ void central_web_server::audio_server_event_req_handler(int eventfd, int server_
       }
     }else
       server->main_thread_state.slash_separated_audio_list = utility::remove_from_slash_string(server->main_thread_state.slash_separated_audio_list, data.appropriate_str);
+
+    rebuild_audio_list_response(server);
+    publish_station_snapshot();
+    push_station_update(server, web_server::channel_kind::list_updates, thread_data_container);
   }else if(eventfd == server->file_request_fd){
     auto data = server->get_from_file_req_transfer_queue();
 
@@ -537,21 +586,16 @@ void central_web_server::audio_server_event_req_handler(int eventfd, int server_
   }else if(eventfd == server->audio_req_response_fd){
     auto data = server->get_from_audio_req_response_queue();
 
-    if(data.str_data != "//FAILURE"){ // this audio is now queued
+    if(data.str_data != "//FAILURE"){ // this audio is now queued, so respond with the new queue
       server->main_thread_state.queued_audio.push_front(data.str_data);
+      rebuild_audio_queue_response(server);
+      publish_station_snapshot();
+      push_station_update(server, web_server::channel_kind::queue_updates, thread_data_container);
 
-      data.str_data = "";
-      for(const auto &item : server->main_thread_state.queued_audio)
-        data.str_data += item + "/";
+      post_audio_track_response(data.thread_id, data.client_idx, server->main_thread_state.audio_queue_response, thread_data_container);
     }else{
-      data.str_data = "FAILURE";
+      post_audio_track_response(data.thread_id, data.client_idx, failure_response, thread_data_container);
     }
-    
-    std::string response_str = default_plain_text_http_header + data.str_data;
-
-    std::vector<char> buff{response_str.begin(), response_str.end()};
-
-    thread_data_container[data.thread_id].server.post_audio_track_req_response_to_server(data.client_idx, std::move(buff));
   }else if(eventfd == server->broadcast_fd){
     //
     // audio data broadcast
@@ -559,51 +603,871 @@ void central_web_server::audio_server_event_req_handler(int eventfd, int server_
     auto data = server->get_broadcast_data();
     auto &main_thread_state = server->main_thread_state;
 
-    if(main_thread_state.queued_audio.size() && main_thread_state.queued_audio.back() == data.track_name) // if it's in the queue, remove it, since it is now being played
+    if(main_thread_state.queued_audio.size() && main_thread_state.queued_audio.back() == data.track_name){ // if it's in the queue, remove it, since it is now being played
       main_thread_state.queued_audio.pop_back();
+      rebuild_audio_queue_response(server);
+      publish_station_snapshot();
+      push_station_update(server, web_server::channel_kind::queue_updates, thread_data_container);
+    }
 
-    if(data.audio_data.size() > 0){
-      auto ws_audio_data = make_ws_frame(data.audio_data, web_server::websocket_non_control_opcodes::text_frame);
-      main_thread_state.second_last_broadcast_audio_data = main_thread_state.last_broadcast_audio_data;
-      main_thread_state.last_broadcast_audio_data = ws_audio_data;
-
-      auto item_audio_data = store.insert_item(std::move(ws_audio_data), num_threads);
-
-      // as mentioned above, broadcast_channel_id == server_id*2 when the subscribed endpoint is audio_broadcast, so we just send the server_id
-      for(server_data<T> &thread_data : thread_data_container)
-        thread_data.server.post_message_to_server_thread(
-          web_server::message_type::websocket_broadcast, 
-          reinterpret_cast<const char*>(item_audio_data.buffer.ptr),
-          item_audio_data.buffer.size,
-          item_audio_data.idx,
-          server_id*2
-        );
+    if(data.metadata_only_frame.length > 0){ // otherwise the audio thread published it itself, with DIRECT_BROADCASTS
+      server->publish_chunk(web_server::broadcast_ring::instance(), data);
+      notify_broadcasts(thread_data_container); // one wake up per thread for all of it
     }
-    
-    //
-    // metadata only broadcast
-    //
-    auto ws_metadata_only = make_ws_frame(data.metdata_only, web_server::websocket_non_control_opcodes::text_frame);
-    main_thread_state.second_last_broadcast_metadata_only = main_thread_state.last_broadcast_metadata_only;
-    main_thread_state.last_broadcast_metadata_only = ws_metadata_only;
-
-    auto item_metadata_only = store.insert_item(std::move(ws_metadata_only), num_threads);
-
-    // as mentioned above, broadcast_channel_id == server_id*2+1 when the subscribed endpoint is metadata_only, so we just send the server_id
-    for(server_data<T> &thread_data : thread_data_container)
-      thread_data.server.post_message_to_server_thread(
-        web_server::message_type::websocket_broadcast, 
-        reinterpret_cast<const char*>(item_metadata_only.buffer.ptr),
-        item_metadata_only.buffer.size,
-        item_metadata_only.idx,
-        server_id*2+1
-      );
   }else if(eventfd == server->request_skip_response_fd){
     auto data = server->get_request_to_skip_response_data();
     std::string response = default_plain_text_http_header + data.resp_str;
     std::vector<char> buff{response.begin(), response.end()};
-    thread_data_container[data.thread_id].server.post_skip_request_response_to_server(data.client_idx, std::move(buff));
+    post_skip_response(data.thread_id, data.client_idx, std::move(buff), thread_data_container);
+  }
+}
+
+template<server_type T>
+void central_web_server::post_audio_track_response(int thread_id, int request_handle, const tcp_tls_server::shared_buffer &response, std::vector<server_data<T>> &thread_data_container){
+  if(!audio_process){
+    thread_data_container[thread_id].server.post_audio_track_req_response_to_server(request_handle, tcp_tls_server::shared_buffer{response});
+    return;
+  }
+
+  send_to_worker(thread_id / num_threads, {workers::message_type::TRACK_RESPONSE, -1, thread_id % num_threads, request_handle}, std::string_view(response.buff, response.length));
+}
+
+template<server_type T>
+void central_web_server::post_skip_response(int thread_id, int request_handle, std::vector<char> &&response, std::vector<server_data<T>> &thread_data_container){
+  if(!audio_process){
+    thread_data_container[thread_id].server.post_skip_request_response_to_server(request_handle, std::move(response));
+    return;
+  }
+
+  send_to_worker(thread_id / num_threads, {workers::message_type::SKIP_RESPONSE, -1, thread_id % num_threads, request_handle}, std::string_view(response.data(), response.size()));
+}
+
+template<server_type T>
+void central_web_server::submit_track_request(const std::string &station, const std::string &track, int request_handle, int thread_id, std::vector<server_data<T>> &thread_data_container){
+  if(!audio_server::server_id_map.count(station) || (relay_origin && !relay_request("request", station, track, request_handle, thread_id)))
+    post_audio_track_response(thread_id, request_handle, failure_response, thread_data_container);
+  else if(!relay_origin)
+    audio_server::instance(audio_server::server_id_map[station])->submit_audio_req(track, request_handle, thread_id);
+}
+
+template<server_type T>
+void central_web_server::submit_skip_request(const std::string &station, const std::string &ip, int request_handle, int thread_id, std::vector<server_data<T>> &thread_data_container){
+  if(!audio_server::server_id_map.count(station) || (relay_origin && !relay_request("skip", station, ip, request_handle, thread_id))){
+    std::string response = default_plain_text_http_header + "FAILURE";
+    post_skip_response(thread_id, request_handle, std::vector<char>{response.begin(), response.end()}, thread_data_container);
+  }else if(!relay_origin){
+    audio_server::instance(audio_server::server_id_map[station])->send_request_to_skip_to_audio_server(ip, request_handle, thread_id);
+  }
+}
+
+template<server_type T>
+void central_web_server::ingest(int thread_id, web_server::ingest_msg &&data, std::vector<server_data<T>> &thread_data_container){
+  const auto station = audio_server::server_id_map.find(data.station);
+  const int server_id = station != audio_server::server_id_map.end() && !relay_origin ? station->second : -1; // an edge's stations are only the origin's
+  if(server_id != -1 && ingest_sources.size() <= size_t(server_id))
+    ingest_sources.resize(audio_server::server_id_map.size());
+  auto *source = server_id != -1 ? &ingest_sources[server_id] : nullptr;
+  const bool is_source = source != nullptr && source->thread_id == thread_id && source->ws_client_idx == data.ws_client_idx && source->ws_client_id == data.ws_client_id;
+
+  if(data.ended){
+    if(is_source){
+      *source = {};
+      audio_server::instance(server_id)->submit_ingest({}, true);
+    }
+    return;
+  }
+
+  if(!is_source && (source == nullptr || source->thread_id != -1)){ // no such station, or it already has a source, so the websocket is closed
+    if(!audio_process)
+      thread_data_container[thread_id].server.post_new_radio_client_response_to_server(data.ws_client_idx, data.ws_client_id, {});
+    else
+      send_to_worker(thread_id / num_threads, {workers::message_type::INGEST_REJECTED, -1, thread_id % num_threads, data.ws_client_idx, uint64_t(data.ws_client_id)});
+    return;
+  }
+  if(!is_source)
+    *source = {thread_id, data.ws_client_idx, data.ws_client_id};
+
+  if(!audio_server::instance(server_id)->submit_ingest(std::move(data.data)))
+    std::cerr << "The audio thread for " << data.station << " is behind, dropped some of its live source" << std::endl;
+}
+
+template<server_type T>
+void central_web_server::drain_server_thread_mailbox(int thread_idx, std::vector<server_data<T>> &thread_data_container){
+  web_server::basic_web_server<T> &server = thread_data_container[thread_idx].server;
+
+  // this thread is only woken when the mailbox goes from empty to not, so everything in it is dealt with now
+  server.drain_to_program_mailbox([&](web_server::program_message &message){
+    if(auto *data = std::get_if<web_server::radio_client_left_msg>(&message)){
+      count_subscriber(data->broadcast_channel_id, -1);
+    }else if(auto *data = std::get_if<web_server::broadcast_chunks_dropped_msg>(&message)){
+      audio_server *inst = audio_server::instance(web_server::channel_server_id(data->broadcast_channel_id)); // same station for either channel
+      inst->num_dropped_chunks += data->num_dropped;
+    }else if(auto *data = std::get_if<web_server::new_radio_client_msg>(&message)){
+      new_radio_client(server, *data);
+    }else if(auto *data = std::get_if<web_server::audio_track_request_msg>(&message)){
+      submit_track_request(data->station, data->track, data->request_handle, thread_idx, thread_data_container); // so the response goes back to this thread
+    }else if(auto *data = std::get_if<web_server::skip_request_msg>(&message)){
+      submit_skip_request(data->station, data->ip, data->request_handle, thread_idx, thread_data_container);
+    }else if(auto *data = std::get_if<web_server::ingest_msg>(&message)){
+      ingest(thread_idx, std::move(*data), thread_data_container);
+    }else if(auto *data = std::get_if<web_server::new_stream_client_msg>(&message)){
+      new_stream_client(server, *data);
+    }
+  });
+}
+
+template<server_type T>
+void central_web_server::new_radio_client(web_server::basic_web_server<T> &server, const web_server::new_radio_client_msg &data){
+  const bool deflate = data.deflate && audio_server::deflate_broadcasts; // whether the websocket can be sent compressed frames
+  const auto channel = web_server::parse_radio_channel(data.station); // expecting something like "test_server/audio_broadcast"
+
+  if(!channel.valid || !audio_server::server_id_map.count(channel.station)){ // it's invalid, so the connection is closed
+    server.post_new_radio_client_response_to_server(data.ws_client_idx, data.ws_client_id, {});
+    return;
+  }
+
+  // each station has a channel for each connection type, see web_server::broadcast_channel_id
+  const auto server_id = audio_server::server_id_map[channel.station];
+  const int broadcast_channel_id = web_server::broadcast_channel_id(server_id, channel.kind);
+  count_subscriber(broadcast_channel_id, 1);
+
+  // the most recent chunks, so the client starts with fast_start_chunks chunks buffered
+  // the audio thread might be adding to the backlog with DIRECT_BROADCASTS, the client gets whatever it publishes after it's been read
+  audio_server *inst = audio_server::instance(server_id);
+  auto &backlogs = inst->broadcast_state.backlogs;
+  std::vector<tcp_tls_server::shared_buffer> burst{};
+  int64_t after_sequence = data.after_sequence;
+  if(web_server::is_tagged_channel(channel.kind)){ // tagging (and deflating) a copy of the backlog is slow, so the audio thread isn't kept waiting on it
+    std::vector<tcp_tls_server::shared_buffer> backlog{};
+    {
+      std::lock_guard<std::mutex> lock(inst->broadcast_state.lock);
+      backlog = backlogs.recent(channel.kind, deflate, fast_start_chunks, after_sequence);
+      after_sequence = std::max(after_sequence, backlogs.latest_sequence(channel.kind));
+    }
+    burst = web_server::make_burst_frames(channel, backlog, deflate, audio_server::ws_fragment_size);
+  }
+
+  // it's posted with the lock held, so the server thread has the response before anything published after the backlog
+  // anything published while the tagged frames were being made is added on here, which is almost always nothing
+  std::lock_guard<std::mutex> lock(inst->broadcast_state.lock);
+  const auto rest = web_server::make_burst_frames(channel, backlogs.recent(channel.kind, deflate, fast_start_chunks, after_sequence), deflate, audio_server::ws_fragment_size);
+  burst.insert(burst.end(), rest.begin(), rest.end());
+  uint64_t station_broadcasts_before = 0;
+  if(auto *ring = inst->direct_ring.load(std::memory_order_relaxed)) // only set on this thread
+    station_broadcasts_before = ring->published();
+
+  server.post_new_radio_client_response_to_server(data.ws_client_idx, data.ws_client_id, std::move(burst), broadcast_channel_id, station_broadcasts_before);
+}
+
+template<server_type T>
+void central_web_server::new_stream_client(web_server::basic_web_server<T> &server, const web_server::new_stream_client_msg &data){
+  // the server thread found the station in its snapshot, so it exists, and it's already been sent the header
+  const int broadcast_channel_id = web_server::broadcast_channel_id(data.server_id, web_server::channel_kind::ogg_stream);
+  count_subscriber(broadcast_channel_id, 1);
+
+  audio_server *inst = audio_server::instance(data.server_id);
+  std::lock_guard<std::mutex> lock(inst->broadcast_state.lock); // posted with it held, like new_radio_client
+  auto backlog = inst->broadcast_state.backlogs.recent(web_server::channel_kind::ogg_stream, false, fast_start_chunks);
+  uint64_t station_broadcasts_before = 0;
+  if(auto *ring = inst->direct_ring.load(std::memory_order_relaxed))
+    station_broadcasts_before = ring->published();
+
+  server.post_new_stream_client_response_to_server(data.client_idx, data.listener_id, broadcast_channel_id, std::move(backlog), station_broadcasts_before);
+}
+
+void central_web_server::count_subscriber(int broadcast_channel_id, int change){
+  const auto kind = web_server::channel_kind_of(broadcast_channel_id);
+  audio_server *inst = audio_server::instance(web_server::channel_server_id(broadcast_channel_id));
+  if(web_server::is_listener_channel(kind)) // only audio listeners are counted
+    inst->num_listeners += change;
+  if(kind == web_server::channel_kind::audio_tagged) // tagged copies of the chunks are only made while something wants them
+    inst->broadcast_state.num_tagged_audio_subscribers += change;
+  else if(kind == web_server::channel_kind::metadata_tagged)
+    inst->broadcast_state.num_tagged_metadata_subscribers += change;
+}
+
+auto central_web_server::read_broadcast_config() -> size_t {
+  // new listeners are sent enough of the backlog to have FAST_START_MS of audio buffered, by default the last 2 chunks
+  const size_t backlog_chunks = config_data_map.count("BACKLOG_CHUNKS") ? std::stoul(config_data_map["BACKLOG_CHUNKS"]) : 2;
+  const size_t fast_start_ms = config_data_map.count("FAST_START_MS") ? std::stoul(config_data_map["FAST_START_MS"]) : 2*BROADCAST_INTERVAL_MS;
+  fast_start_chunks = std::max<size_t>((fast_start_ms + BROADCAST_INTERVAL_MS - 1) / BROADCAST_INTERVAL_MS, 1); // whole chunks only
+
+  audio_server::deflate_broadcasts = config_data_map["PERMESSAGE_DEFLATE"] == "yes";
+  if(config_data_map.count("WS_FRAGMENT_SIZE"))
+    audio_server::ws_fragment_size = std::stoull(config_data_map["WS_FRAGMENT_SIZE"]);
+  return backlog_chunks;
+}
+
+template<server_type T>
+void central_web_server::report_mailbox_stats(std::vector<server_data<T>> &thread_data_container){
+  web_server::mailbox_stats to_program{}, to_server{};
+  for(const server_data<T> &thread_data : thread_data_container){
+    const auto program_stats = thread_data.server.to_program_stats();
+    const auto server_stats = thread_data.server.to_server_stats();
+    to_program.messages += program_stats.messages;
+    to_program.wakeups += program_stats.wakeups;
+    to_server.messages += server_stats.messages;
+    to_server.wakeups += server_stats.wakeups;
+    to_program.wakeup_latency_ns += program_stats.wakeup_latency_ns;
+    to_program.wakeup_latency_samples += program_stats.wakeup_latency_samples;
+    to_server.wakeup_latency_ns += server_stats.wakeup_latency_ns;
+    to_server.wakeup_latency_samples += server_stats.wakeup_latency_samples;
   }
+
+  const auto now = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(now - last_mailbox_report).count();
+  const auto report = [&](const char *direction, const web_server::mailbox_stats &current, const web_server::mailbox_stats &last){
+    const auto messages = current.messages - last.messages;
+    const auto wakeups = current.wakeups - last.wakeups;
+    const auto samples = current.wakeup_latency_samples - last.wakeup_latency_samples;
+    const auto latency_us = samples ? double(current.wakeup_latency_ns - last.wakeup_latency_ns) / samples / 1000 : 0.0;
+    std::cout << direction << ": " << (wakeups ? double(messages) / wakeups : 0.0) << " messages per wake up, " << wakeups / seconds << " wake ups/s, "
+              << latency_us << "us to wake up (" << (msg_ring::enabled() ? "MSG_RING" : "eventfd") << ")\n";
+  };
+  report("to the central thread", to_program, last_to_program_stats);
+  report("to the server threads", to_server, last_to_server_stats);
+
+  last_to_program_stats = to_program;
+  last_to_server_stats = to_server;
+  last_mailbox_report = now;
+}
+
+template<server_type T>
+void central_web_server::balance_connections(std::vector<server_data<T>> &thread_data_container){
+  std::vector<uint32_t> loads(thread_data_container.size());
+  uint32_t max_load = 0;
+  for(const server_data<T> &thread_data : thread_data_container){
+    const int idx = thread_data.server.load.reuseport_index.load(std::memory_order_acquire);
+    if(idx < 0 || size_t(idx) >= loads.size())
+      return; // not every thread is listening yet
+    loads[idx] = thread_data.server.load.subscriptions.load(std::memory_order_relaxed);
+    max_load = std::max(max_load, loads[idx]);
+  }
+
+  std::vector<uint32_t> weights(loads.size());
+  for(size_t idx = 0; idx < loads.size(); idx++)
+    weights[idx] = max_load - loads[idx] + 1; // evenly loaded threads get an even share, same as without this
+
+  if(weights == last_connection_weights)
+    return;
+  if(!tcp_tls_server::server<T>::steer_connections(weights))
+    std::cerr << "Couldn't steer new connections between the server threads" << std::endl;
+  last_connection_weights = std::move(weights);
+}
+
+template<server_type T>
+void central_web_server::report_thread_load(std::vector<server_data<T>> &thread_data_container){
+  if(thread_data_container.empty())
+    return; // they're in the workers
+  std::vector<uint32_t> loads{};
+  for(const server_data<T> &thread_data : thread_data_container)
+    loads.push_back(thread_data.server.load.subscriptions.load(std::memory_order_relaxed));
+
+  const uint32_t max_load = *std::max_element(loads.begin(), loads.end());
+  const uint32_t min_load = *std::min_element(loads.begin(), loads.end());
+  uint64_t total = 0;
+  for(const auto load : loads)
+    total += load;
+
+  constexpr int bar_width = 40;
+  std::cout << "subscriptions per server thread: min " << min_load << ", max " << max_load << ", mean " << double(total) / loads.size() << "\n";
+  for(size_t idx = 0; idx < loads.size(); idx++){
+    const int bar = max_load ? int(uint64_t(loads[idx]) * bar_width / max_load) : 0;
+    std::cout << "  thread " << idx << " |" << std::string(bar, '#') << std::string(bar_width - bar, ' ') << "| " << loads[idx] << "\n";
+  }
+}
+
+auto central_web_server::make_cached_response(const std::string &header, const std::string &body) -> tcp_tls_server::shared_buffer {
+  auto response = std::make_shared<const std::string>(header + body);
+  return tcp_tls_server::shared_buffer{response, response->data(), response->size()};
+}
+
+void central_web_server::rebuild_station_list_response(){
+  std::string body = "{\"stations\": [";
+
+  for(auto &pair : audio_server::server_id_map)
+    body += "\"" + pair.first + "\",";
+  if(body.back() == ',')
+    body.pop_back(); // gets rid of the trailing comma
+  body += "]}";
+
+  station_list_response = make_cached_response(default_plain_json_http_header, body);
+}
+
+void central_web_server::rebuild_audio_list_response(audio_server *server){
+  auto &main_thread_state = server->main_thread_state;
+  main_thread_state.audio_list_response = make_cached_response(default_plain_text_http_header, main_thread_state.slash_separated_audio_list);
+}
+
+void central_web_server::rebuild_audio_queue_response(audio_server *server){
+  auto &main_thread_state = server->main_thread_state;
+
+  std::string queue{};
+  for(const auto &item : main_thread_state.queued_audio)
+    queue += item + "/";
+
+  main_thread_state.audio_queue_response = make_cached_response(default_plain_text_http_header, queue);
+}
+
+template<server_type T>
+void central_web_server::push_station_update(audio_server *server, web_server::channel_kind kind, std::vector<server_data<T>> &thread_data_container){
+  const bool queue = kind == web_server::channel_kind::queue_updates;
+  const auto &response = queue ? server->main_thread_state.audio_queue_response : server->main_thread_state.audio_list_response;
+  const auto body = std::string_view(response.buff, response.length).substr(default_plain_text_http_header.size());
+
+  // made once, every thread's writes share it
+  auto update = web_server::make_ws_control_update(queue ? "queue_update" : "list_update", server->name(), body);
+  publish_broadcast(web_server::broadcast_channel_id(server->id, kind), update);
+  notify_broadcasts(thread_data_container);
+}
+
+void central_web_server::publish_broadcast(int broadcast_channel_id, const tcp_tls_server::shared_buffer &frame, const tcp_tls_server::shared_buffer &deflated_frame){
+  if(!web_server::broadcast_ring::instance().publish(broadcast_channel_id, frame, deflated_frame)){
+    // a server thread is thousands of broadcasts behind, so this one is dropped for everyone rather than waiting on it
+    std::cerr << "Broadcast ring full, dropped a broadcast on channel " << broadcast_channel_id << std::endl; // chunks are counted in audio_server::publish_chunk
+  }
+}
+
+template<server_type T>
+void central_web_server::notify_broadcasts(std::vector<server_data<T>> &thread_data_container){
+  if(audio_process)
+    export_broadcasts();
+  for(server_data<T> &thread_data : thread_data_container)
+    thread_data.server.notify_broadcasts();
+}
+
+void central_web_server::publish_station_snapshot(){
+  auto snapshot = std::make_shared<web_cache::station_snapshot>();
+  snapshot->station_list_response = station_list_response;
+
+  for(const auto &pair : audio_server::server_id_map){
+    const auto &main_thread_state = audio_server::instance(pair.second)->main_thread_state;
+    snapshot->stations.push_back({pair.first, pair.second, main_thread_state.audio_list_response, main_thread_state.audio_queue_response, main_thread_state.stream_header});
+  }
+
+  web_cache::station_snapshot_store::instance().publish(std::move(snapshot));
+
+  if(audio_process){
+    for(size_t worker_idx = 0; worker_idx < audio_process->links.size(); worker_idx++)
+      send_station_snapshot(worker_idx);
+  }
+}
+
+void central_web_server::start_worker(int worker_idx){
+  auto &link = audio_process->links[worker_idx];
+  int sockets[2];
+  if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+    utility::fatal_error("Couldn't make the socket for a worker");
+  const timeval send_timeout{1, 0}; // a stuck worker only holds up this thread for so long, it's restarted once it's gone
+  setsockopt(sockets[0], SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+  link.pid = workers::spawn(worker_idx, audio_process->segment->fd(), link.broadcast_efd, sockets[1]);
+  close(sockets[1]);
+  if(link.pid == -1)
+    utility::fatal_error("Couldn't start worker " + std::to_string(worker_idx));
+
+  link.socket_fd = sockets[0];
+  link.started = std::chrono::steady_clock::now();
+  link.reader = {};
+  link.stalled = false;
+  send_station_snapshot(worker_idx); // the first thing it reads, before its server threads start
+  add_socket_read_req(link.socket_fd, central_web_server_event::WORKER_COMMUNICATION, worker_idx);
+}
+
+void central_web_server::worker_exited(int worker_idx){
+  auto &link = audio_process->links[worker_idx];
+  int status = 0;
+  waitpid(link.pid, &status, 0); // its socket is only closed as it exits
+  close(link.socket_fd);
+  link.socket_fd = -1; // anything else for it is dropped
+
+  for(const auto &[channel_id, count] : link.subscribers) // its listeners went with it
+    count_subscriber(channel_id, -count);
+  link.subscribers.clear();
+
+  for(size_t server_id = 0; server_id < ingest_sources.size(); server_id++){ // its live sources went with it
+    auto &source = ingest_sources[server_id];
+    if(source.thread_id != -1 && source.thread_id / num_threads == worker_idx){
+      source = {};
+      audio_server::instance(server_id)->submit_ingest({}, true);
+    }
+  }
+
+  if(WIFEXITED(status) && WEXITSTATUS(status) == 0){ // shut down with SIGINT, the same as this process
+    std::cout << "Worker " << worker_idx << " shut down\n";
+    return;
+  }
+  if(!link.stalled && std::chrono::steady_clock::now() - link.started < std::chrono::seconds(5)) // it would only keep doing that
+    utility::fatal_error("Worker " + std::to_string(worker_idx) + " exited straight after starting");
+
+  if(!link.stalled)
+    std::cerr << "Worker " << worker_idx << " crashed, starting it again" << std::endl;
+  start_worker(worker_idx);
+}
+
+void central_web_server::send_station_snapshot(int worker_idx){
+  const auto snapshot = web_cache::station_snapshot_store::instance().snapshot();
+  send_to_worker(worker_idx, {workers::message_type::STATIONS}, workers::serialise_snapshot(*snapshot));
+}
+
+void central_web_server::send_to_worker(int worker_idx, const workers::message_header &header, std::string_view payload){
+  auto &link = audio_process->links[worker_idx];
+  if(link.socket_fd == -1 || link.stalled)
+    return;
+  if(!workers::send_message(link.socket_fd, header, payload)){
+    // it's gone, or stuck for the whole send timeout, and whatever part of the message went would misframe the rest of its stream,
+    // so it's killed, and restarted once its socket closes, this thread is only held up once for it
+    std::cerr << "Worker " << worker_idx << " isn't reading its messages, restarting it" << std::endl;
+    link.stalled = true;
+    kill(link.pid, SIGKILL);
+  }
+}
+
+void central_web_server::export_broadcasts(){
+  auto &segment = *audio_process->segment;
+  web_server::broadcast_ring::instance().consume(audio_process->segment_reader, UINT64_MAX, [&](const web_server::broadcast_entry &entry){
+    segment.publish(entry); // copied once for every worker
+  });
+
+  for(const auto &link : audio_process->links)
+    eventfd_write(link.broadcast_efd, 1);
+}
+
+template<server_type T>
+void central_web_server::worker_message_handler(int worker_idx, const workers::message_header &header, std::string_view payload, std::vector<server_data<T>> &thread_data_container){
+  const bool valid_channel = header.channel_id >= 0 && size_t(web_server::channel_server_id(header.channel_id)) < audio_server::server_id_map.size();
+  const int thread_id = worker_idx * num_threads + header.thread_idx; // the response finds its way back to the worker's thread from this
+
+  // the requests are the station and whatever goes with it
+  const auto separator = payload.find('\0');
+  const std::string station{payload.substr(0, separator)};
+  const std::string argument{separator == std::string_view::npos ? std::string_view{} : payload.substr(separator + 1)};
+
+  switch(header.type){
+    case workers::message_type::LISTENER_JOINED:
+    case workers::message_type::LISTENER_LEFT: {
+      if(!valid_channel)
+        break;
+      const int change = header.type == workers::message_type::LISTENER_JOINED ? 1 : -1;
+      count_subscriber(header.channel_id, change);
+      auto &count = audio_process->links[worker_idx].subscribers[header.channel_id];
+      if((count += change) == 0)
+        audio_process->links[worker_idx].subscribers.erase(header.channel_id);
+      break;
+    }
+    case workers::message_type::CHUNKS_DROPPED:
+      if(valid_channel)
+        audio_server::instance(web_server::channel_server_id(header.channel_id))->num_dropped_chunks += header.value;
+      break;
+    case workers::message_type::TRACK_REQUEST:
+      submit_track_request(station, argument, header.request_handle, thread_id, thread_data_container);
+      break;
+    case workers::message_type::SKIP_REQUEST:
+      submit_skip_request(station, argument, header.request_handle, thread_id, thread_data_container);
+      break;
+    case workers::message_type::INGEST:
+    case workers::message_type::INGEST_ENDED:
+      ingest(thread_id, {station, header.request_handle, int(header.value), std::vector<char>(argument.begin(), argument.end()), header.type == workers::message_type::INGEST_ENDED}, thread_data_container);
+      break;
+    default:
+      break;
+  }
+}
+
+template<server_type T>
+void central_web_server::run_worker(int worker_idx){
+  std::cout << "Worker " << worker_idx << " using " << num_threads << " threads\n";
+
+  worker = std::make_unique<workers::worker_state>();
+  worker->idx = worker_idx;
+
+  // the same plan as for one process with every worker's threads, this worker's threads are its share of that
+  const auto placement = cpu_placement::make_plan(config_data_map["CPU_PLACEMENT"], config_data_map["SERVER_CPUS"], config_data_map["AUDIO_CPUS"], config_data_map["CENTRAL_CPUS"], num_workers * num_threads);
+  cpu_placement::pin_this_thread(placement.central);
+
+  std::memset(&ring, 0, sizeof(io_uring));
+  io_uring_queue_init(QUEUE_DEPTH, &ring, 0);
+  io_uring_cqe *cqe;
+
+  msg_ring::set_thread_ring(&ring);
+  if(config_data_map["MSG_RING"] == "yes")
+    msg_ring::enable();
+
+  worker->backlog_chunks = read_broadcast_config();
+  std::vector<server_data<T>> thread_data_container{};
+  worker_read_snapshot(thread_data_container); // the server threads answer the station endpoints from it straight away
+
+  // it starts a little way back in the shared memory, so new listeners get a backlog from the start (the server threads aren't reading yet)
+  const auto published = worker->segment.published();
+  worker->segment_cursor = published - std::min<uint64_t>(published, workers::WARM_UP_ENTRIES);
+  worker_read_broadcasts(thread_data_container);
+
+  if(config_data_map["PRELOAD_PUBLIC"] == "yes"){
+    web_cache::static_asset_store::instance().load("public", "public/404.html", config_data_map["HUGE_PAGES"] == "yes");
+    add_event_read_req(reload_static_assets_efd, central_web_server_event::RELOAD_STATIC_ASSETS);
+  }
+
+  thread_data_container.reserve(num_threads); // never reallocated, each thread has a reference to its server
+  for(int idx = 0; idx < num_threads; idx++){
+    const auto cpu_idx = worker_idx * num_threads + idx;
+    thread_data_container.emplace_back(idx, ring.ring_fd, size_t(cpu_idx) < placement.server_threads.size() ? placement.server_threads[cpu_idx] : cpu_placement::cpu_set{});
+    add_event_read_req(thread_data_container.back().server.central_communication_fd, central_web_server_event::SERVER_THREAD_COMMUNICATION, idx);
+  }
+
+  add_event_read_req(workers::BROADCAST_EFD, central_web_server_event::WORKER_BROADCASTS);
+  add_socket_read_req(workers::SOCKET_FD, central_web_server_event::WORKER_COMMUNICATION, worker_idx);
+
+  const int timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+  utility::set_timerfd_interval(timer_fd, 5000);
+  add_timer_read_req(timer_fd);
+
+  bool run_server = true;
+  while(run_server){
+    char ret = io_uring_wait_cqe(&ring, &cqe);
+    if(ret < 0){ // interrupted by SIGINT, which has killed the server threads
+      io_uring_queue_exit(&ring);
+      break;
+    }
+
+    if(msg_ring::is_message(cqe->user_data)){
+      if(msg_ring::kind_of(cqe->user_data) == msg_ring::kind::SEND_FAILED)
+        msg_ring::send_failed(cqe->user_data);
+      else if(msg_ring::kind_of(cqe->user_data) == msg_ring::kind::SERVER_THREAD)
+        worker_drain_server_thread_mailbox(msg_ring::index_of(cqe->user_data), thread_data_container);
+      io_uring_cqe_seen(&ring, cqe);
+      continue;
+    }
+
+    auto *req = reinterpret_cast<central_web_server_req*>(cqe->user_data);
+    switch(req->event){
+      case central_web_server_event::TIMERFD:
+        add_timer_read_req(timer_fd);
+        if(config_data_map["MAILBOX_STATS"] == "yes")
+          report_mailbox_stats(thread_data_container);
+        if(config_data_map["LOAD_STATS"] == "yes")
+          report_thread_load(thread_data_container);
+        break;
+      case central_web_server_event::RELOAD_STATIC_ASSETS:
+        add_event_read_req(reload_static_assets_efd, central_web_server_event::RELOAD_STATIC_ASSETS);
+        if(!web_cache::static_asset_store::instance().reload())
+          std::cerr << "Failed to reload public/, still using the old snapshot" << std::endl;
+        break;
+      case central_web_server_event::SERVER_THREAD_COMMUNICATION:
+        add_event_read_req(req->fd, central_web_server_event::SERVER_THREAD_COMMUNICATION, req->custom_info);
+        worker_drain_server_thread_mailbox(req->custom_info, thread_data_container);
+        break;
+      case central_web_server_event::WORKER_BROADCASTS:
+        add_event_read_req(req->fd, central_web_server_event::WORKER_BROADCASTS);
+        worker_read_broadcasts(thread_data_container);
+        break;
+      case central_web_server_event::WORKER_COMMUNICATION:
+        if(cqe->res <= 0){ // the audio process has gone, so this worker goes as well
+          std::cerr << "Worker " << worker_idx << " lost the audio process, shutting down" << std::endl;
+          kill_server();
+          run_server = false;
+          break;
+        }
+        worker->reader.feed(req->buff.data(), cqe->res, [&](const workers::message_header &header, std::string_view payload){
+          worker_socket_message_handler(header, payload, thread_data_container);
+        });
+        add_socket_read_req(workers::SOCKET_FD, central_web_server_event::WORKER_COMMUNICATION, worker_idx);
+        break;
+      default:
+        break;
+    }
+
+    delete req;
+    io_uring_cqe_seen(&ring, cqe);
+  }
+
+  close(timer_fd);
+}
+
+template<server_type T>
+void central_web_server::worker_read_snapshot(std::vector<server_data<T>> &thread_data_container){
+  std::vector<char> buff(64 * 1024);
+  while(!worker->snapshot){
+    const auto length = read(workers::SOCKET_FD, buff.data(), buff.size());
+    if(length <= 0)
+      utility::fatal_error("Worker " + std::to_string(worker->idx) + " lost the audio process before it started");
+    worker->reader.feed(buff.data(), length, [&](const workers::message_header &header, std::string_view payload){
+      worker_socket_message_handler(header, payload, thread_data_container);
+    });
+  }
+}
+
+template<server_type T>
+void central_web_server::worker_drain_server_thread_mailbox(int thread_idx, std::vector<server_data<T>> &thread_data_container){
+  web_server::basic_web_server<T> &server = thread_data_container[thread_idx].server;
+
+  // everything but new listeners is passed on to the audio process, responses come back on the socket
+  server.drain_to_program_mailbox([&](web_server::program_message &message){
+    if(auto *data = std::get_if<web_server::radio_client_left_msg>(&message)){
+      workers::send_message(workers::SOCKET_FD, {workers::message_type::LISTENER_LEFT, data->broadcast_channel_id});
+    }else if(auto *data = std::get_if<web_server::broadcast_chunks_dropped_msg>(&message)){
+      workers::send_message(workers::SOCKET_FD, {workers::message_type::CHUNKS_DROPPED, data->broadcast_channel_id, -1, -1, data->num_dropped});
+    }else if(auto *data = std::get_if<web_server::new_radio_client_msg>(&message)){
+      worker_new_radio_client(server, *data);
+    }else if(auto *data = std::get_if<web_server::audio_track_request_msg>(&message)){
+      workers::send_message(workers::SOCKET_FD, {workers::message_type::TRACK_REQUEST, -1, thread_idx, data->request_handle}, data->station + '\0' + data->track);
+    }else if(auto *data = std::get_if<web_server::skip_request_msg>(&message)){
+      workers::send_message(workers::SOCKET_FD, {workers::message_type::SKIP_REQUEST, -1, thread_idx, data->request_handle}, data->station + '\0' + data->ip);
+    }else if(auto *data = std::get_if<web_server::ingest_msg>(&message)){
+      auto payload = data->station + '\0';
+      payload.append(data->data.data(), data->data.size());
+      workers::send_message(workers::SOCKET_FD, {data->ended ? workers::message_type::INGEST_ENDED : workers::message_type::INGEST, -1, thread_idx, data->ws_client_idx, uint64_t(data->ws_client_id)}, payload);
+    }else if(auto *data = std::get_if<web_server::new_stream_client_msg>(&message)){
+      worker_new_stream_client(server, *data);
+    }
+  });
+}
+
+template<server_type T>
+void central_web_server::worker_new_radio_client(web_server::basic_web_server<T> &server, const web_server::new_radio_client_msg &data){
+  const bool deflate = data.deflate && audio_server::deflate_broadcasts;
+  const auto channel = web_server::parse_radio_channel(data.station);
+  const auto *station = channel.valid ? worker->snapshot->find(channel.station) : nullptr;
+
+  if(station == nullptr || station->id < 0 || size_t(station->id) >= worker->backlogs.size()){ // it's invalid, so the connection is closed
+    server.post_new_radio_client_response_to_server(data.ws_client_idx, data.ws_client_id, {});
+    return;
+  }
+
+  // counted by the audio process, the backlog is this worker's copy of the broadcasts, read on this thread
+  const int broadcast_channel_id = web_server::broadcast_channel_id(station->id, channel.kind);
+  workers::send_message(workers::SOCKET_FD, {workers::message_type::LISTENER_JOINED, broadcast_channel_id});
+  const auto backlog = worker->backlogs[station->id].recent(channel.kind, deflate, fast_start_chunks, data.after_sequence);
+  server.post_new_radio_client_response_to_server(data.ws_client_idx, data.ws_client_id, web_server::make_burst_frames(channel, backlog, deflate, audio_server::ws_fragment_size), broadcast_channel_id);
+}
+
+template<server_type T>
+void central_web_server::worker_new_stream_client(web_server::basic_web_server<T> &server, const web_server::new_stream_client_msg &data){
+  const int broadcast_channel_id = web_server::broadcast_channel_id(data.server_id, web_server::channel_kind::ogg_stream);
+  workers::send_message(workers::SOCKET_FD, {workers::message_type::LISTENER_JOINED, broadcast_channel_id});
+  auto backlog = data.server_id >= 0 && size_t(data.server_id) < worker->backlogs.size() ? worker->backlogs[data.server_id].recent(web_server::channel_kind::ogg_stream, false, fast_start_chunks) : std::vector<tcp_tls_server::shared_buffer>{};
+  server.post_new_stream_client_response_to_server(data.client_idx, data.listener_id, broadcast_channel_id, std::move(backlog));
+}
+
+template<server_type T>
+void central_web_server::worker_read_broadcasts(std::vector<server_data<T>> &thread_data_container){
+  const auto skipped = worker->segment.consume(worker->segment_cursor, [&](const web_server::broadcast_entry &entry){
+    const auto server_id = web_server::channel_server_id(entry.channel_id);
+    if(server_id >= 0 && size_t(server_id) < worker->backlogs.size())
+      worker->backlogs[server_id].push(web_server::channel_kind_of(entry.channel_id), entry.frame, entry.deflated_frame, entry.sequence);
+    publish_broadcast(entry.channel_id, entry.frame, entry.deflated_frame); // the server threads read them like they would from the central thread
+  });
+  if(skipped > 0)
+    std::cerr << "Worker " << worker->idx << " fell behind the audio process, skipped " << skipped << " broadcasts" << std::endl;
+
+  for(server_data<T> &thread_data : thread_data_container)
+    thread_data.server.notify_broadcasts();
+}
+
+template<server_type T>
+void central_web_server::worker_socket_message_handler(const workers::message_header &header, std::string_view payload, std::vector<server_data<T>> &thread_data_container){
+  const bool valid_thread = header.thread_idx >= 0 && size_t(header.thread_idx) < thread_data_container.size();
+
+  switch(header.type){
+    case workers::message_type::STATIONS:
+      if(auto snapshot = workers::parse_snapshot(payload)){
+        worker->snapshot = snapshot;
+        web_cache::station_snapshot_store::instance().publish(std::move(snapshot));
+        while(worker->backlogs.size() < worker->snapshot->stations.size()){ // only the first snapshot adds any, the stations don't change
+          worker->backlogs.emplace_back();
+          worker->backlogs.back().set_capacity(worker->backlog_chunks);
+        }
+      }
+      break;
+    case workers::message_type::TRACK_RESPONSE:
+      if(valid_thread)
+        thread_data_container[header.thread_idx].server.post_audio_track_req_response_to_server(header.request_handle, make_cached_response({}, std::string(payload)));
+      break;
+    case workers::message_type::SKIP_RESPONSE:
+      if(valid_thread)
+        thread_data_container[header.thread_idx].server.post_skip_request_response_to_server(header.request_handle, std::vector<char>(payload.begin(), payload.end()));
+      break;
+    case workers::message_type::INGEST_REJECTED:
+      if(valid_thread)
+        thread_data_container[header.thread_idx].server.post_new_radio_client_response_to_server(header.request_handle, int(header.value), {});
+      break;
+    default:
+      break;
+  }
+}
+
+void central_web_server::relay_connect(){
+  if(relay_origin->connecting.joinable()) // already on its way
+    return;
+
+  relay_origin->connecting = std::thread([state = relay_origin.get()]{ // resolving and connecting block, so they're kept off this thread
+    state->connecting_fd = relay::connect_to_origin(state->origin, state->connecting_leftover);
+    eventfd_write(state->connected_efd, 1);
+  });
+}
+
+template<server_type T>
+void central_web_server::relay_connected(std::vector<server_data<T>> &thread_data_container){
+  relay_origin->connecting.join();
+  const int fd = relay_origin->connecting_fd;
+  const std::string leftover = std::move(relay_origin->connecting_leftover);
+  relay_origin->connecting_leftover.clear();
+  if(fd == -1){
+    std::cerr << "Couldn't connect to the origin at " << config_data_map["RELAY"] << ", retrying in 5 seconds" << std::endl;
+    return;
+  }
+
+  std::cout << "Connected to the origin at " << config_data_map["RELAY"] << "\n";
+  relay_origin->fd = fd;
+  relay_origin->connected = std::chrono::steady_clock::now();
+  relay_origin->reader = {};
+
+  // the queue and list are only pushed when they change, so they're asked for as well
+  // if a send fails the connection is shut down, and the read added below fails straight away
+  for(const auto &pair : audio_server::server_id_map){
+    auto &station = relay_origin->stations[pair.second];
+    station.pending_audio.clear();
+    relay::send_text(fd, relay::subscribe_message(pair.first, station.last_sequence)); // from the chunk after the last one it got, if it got any
+    for(const char *type : {"queue", "list"}){
+      const auto id = relay_origin->next_request_id++;
+      relay_origin->requests[id] = {type, -1, -1, pair.second};
+      relay::send_text(fd, relay::request_message(id, type, pair.first));
+    }
+  }
+
+  if(!relay_origin->reader.feed(fd, leftover.data(), leftover.size(), [&](std::string_view message){ relay_message_handler(message, thread_data_container); })){
+    relay_disconnected(thread_data_container);
+    return;
+  }
+  add_socket_read_req(fd, central_web_server_event::RELAY_COMMUNICATION);
+}
+
+template<server_type T>
+void central_web_server::relay_disconnected(std::vector<server_data<T>> &thread_data_container){
+  close(relay_origin->fd);
+  relay_origin->fd = -1;
+
+  for(const auto &pair : relay_origin->requests){ // no reply is coming for these
+    const auto &request = pair.second;
+    if(request.type == "request"){
+      post_audio_track_response(request.thread_id, request.request_handle, failure_response, thread_data_container);
+    }else if(request.type == "skip"){
+      std::string response = default_plain_text_http_header + "FAILURE";
+      post_skip_response(request.thread_id, request.request_handle, std::vector<char>{response.begin(), response.end()}, thread_data_container);
+    }
+  }
+  relay_origin->requests.clear();
+
+  // straight away if the connection had been up for a while, so a restarted origin is picked up within the backlog, otherwise with the timer
+  std::cerr << "Lost the connection to the origin at " << config_data_map["RELAY"] << std::endl;
+  if(std::chrono::steady_clock::now() - relay_origin->connected > std::chrono::seconds(5))
+    relay_connect();
+}
+
+template<server_type T>
+void central_web_server::relay_message_handler(std::string_view payload, std::vector<server_data<T>> &thread_data_container){
+  auto message = relay::parse_message(payload);
+
+  if(message.kind == relay::message_kind::REPLY){
+    const auto request = relay_origin->requests.find(message.id);
+    if(request == relay_origin->requests.end())
+      return;
+    const auto pending = request->second;
+    relay_origin->requests.erase(request);
+
+    // the result is the body of the origin's HTTP response, so the same response is made here
+    const std::string response = default_plain_text_http_header + (message.error ? "FAILURE" : message.result);
+    if(pending.type == "request"){
+      post_audio_track_response(pending.thread_id, pending.request_handle, make_cached_response(default_plain_text_http_header, message.error ? "FAILURE" : message.result), thread_data_container);
+      return;
+    }else if(pending.type == "skip"){
+      post_skip_response(pending.thread_id, pending.request_handle, std::vector<char>{response.begin(), response.end()}, thread_data_container);
+      return;
+    }else if(message.error){
+      return;
+    }
+    message.topic = pending.type + "_update"; // the queue or list asked for after connecting, the same as an update from here
+    message.station = audio_server::instance(pending.station_id)->name();
+    message.kind = relay::message_kind::UPDATE;
+  }
+
+  if(!audio_server::server_id_map.count(message.station))
+    return;
+  audio_server *server = audio_server::instance(audio_server::server_id_map[message.station]);
+  auto &station = relay_origin->stations[server->id];
+
+  if(message.kind == relay::message_kind::AUDIO && message.sequence >= 0){
+    station.pending_audio[message.sequence] = std::string(message.data); // published along with its metadata, which comes after it
+  }else if(message.kind == relay::message_kind::METADATA && message.sequence >= 0){
+    relay_publish_chunk(server, message.sequence, message.data, thread_data_container);
+  }else if(message.kind == relay::message_kind::UPDATE && message.topic == "queue_update"){
+    auto &queued_audio = server->main_thread_state.queued_audio;
+    queued_audio.clear();
+    size_t start = 0, end = 0;
+    while((end = message.result.find('/', start)) != std::string::npos){ // the same "a/b/" it's rebuilt as
+      if(end > start)
+        queued_audio.push_back(message.result.substr(start, end - start));
+      start = end + 1;
+    }
+    rebuild_audio_queue_response(server);
+    publish_station_snapshot();
+    push_station_update(server, web_server::channel_kind::queue_updates, thread_data_container);
+  }else if(message.kind == relay::message_kind::UPDATE && message.topic == "list_update"){
+    server->main_thread_state.slash_separated_audio_list = message.result;
+    rebuild_audio_list_response(server);
+    publish_station_snapshot();
+    push_station_update(server, web_server::channel_kind::list_updates, thread_data_container);
+  }
+}
+
+template<server_type T>
+void central_web_server::relay_publish_chunk(audio_server *server, int64_t sequence, std::string_view metadata, std::vector<server_data<T>> &thread_data_container){
+  auto &station = relay_origin->stations[server->id];
+  if(sequence <= station.last_sequence && station.last_sequence - sequence < relay::DUPLICATE_WINDOW)
+    return; // already published, a sequence far behind the last one means the origin was restarted with its clock behind
+  if(station.last_sequence != -1 && sequence > station.last_sequence + 1)
+    std::cerr << "Missed " << sequence - station.last_sequence - 1 << " chunks from the origin on " << server->name() << std::endl;
+
+  std::string audio{};
+  const auto audio_data = station.pending_audio.find(sequence);
+  if(audio_data != station.pending_audio.end()) // otherwise the origin dropped it, it only sends the metadata if it's behind
+    audio = std::move(audio_data->second);
+  std::erase_if(station.pending_audio, [&](const auto &pair){ return pair.first <= uint64_t(sequence); }); // anything older won't get its metadata now
+
+  // the frames are made once here, just like an audio thread would, and published the same way
+  combined_data_chunk chunk(
+    audio.empty() ? tcp_tls_server::shared_buffer{} : web_server::make_shared_ws_frame(audio, web_server::websocket_non_control_opcodes::text_frame, false, audio_server::ws_fragment_size),
+    web_server::make_shared_ws_frame(metadata, web_server::websocket_non_control_opcodes::text_frame, false, audio_server::ws_fragment_size),
+    {}
+  );
+  chunk.sequence = sequence;
+  if(!audio.empty()){ // the edge's /stream/ is its own, rewritten from the pages like the origin's
+    const auto pages = relay::chunk_pages(audio);
+    chunk.stream_frame = server->stream_writer.make_chunk(std::vector<std::string_view>(pages.begin(), pages.end()));
+  }
+  if(audio_server::deflate_broadcasts){
+    if(!audio.empty())
+      chunk.audio_deflated_frame = web_server::make_shared_deflated_ws_frame(audio, web_server::websocket_non_control_opcodes::text_frame, audio_server::ws_fragment_size);
+    chunk.metadata_only_deflated_frame = web_server::make_shared_deflated_ws_frame(metadata, web_server::websocket_non_control_opcodes::text_frame, audio_server::ws_fragment_size);
+  }
+
+  server->publish_chunk(web_server::broadcast_ring::instance(), chunk);
+  notify_broadcasts(thread_data_container);
+  station.last_sequence = sequence;
+}
+
+auto central_web_server::relay_request(const std::string &type, const std::string &station, const std::string &argument, int request_handle, int thread_id) -> bool {
+  if(relay_origin->fd == -1)
+    return false;
+
+  // skips are counted by the origin, as the edge's votes rather than each listener's
+  const auto id = relay_origin->next_request_id++;
+  relay_origin->requests[id] = {type, thread_id, request_handle, audio_server::server_id_map[station]};
+  relay::send_text(relay_origin->fd, relay::request_message(id, type, station, type == "request" ? argument : std::string{}));
+  return true; // if the send failed, the connection has been shut down, so its read fails and this is failed along with anything else waiting
+}
+
+void central_web_server::reload_static_assets(){
+  eventfd_write(reload_static_assets_efd, 1); // picked up by the central thread, which rebuilds and swaps in the snapshot
 }
 
 void central_web_server::kill_server(){
@@ -0,0 +1,984 @@
+#include "../header/web_server/http2.h"
+#include "../header/web_server/web_server.h"
+
+#include <algorithm>
+
+using namespace web_server;
+
+//
+////frames
+//
+
+namespace {
+void write_uint32(std::vector<char> &out, uint32_t value) {
+  out.push_back(static_cast<char>((value >> 24) & 0xff));
+  out.push_back(static_cast<char>((value >> 16) & 0xff));
+  out.push_back(static_cast<char>((value >> 8) & 0xff));
+  out.push_back(static_cast<char>(value & 0xff));
+}
+
+auto read_uint32(const char *buff) -> uint32_t {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(buff);
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+} // namespace
+
+auto http2::read_frame_header(const char *buff) -> frame_header {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(buff);
+  frame_header header{};
+  header.length = (uint32_t(bytes[0]) << 16) | (uint32_t(bytes[1]) << 8) | uint32_t(bytes[2]);
+  header.type = static_cast<frame_type>(bytes[3]);
+  header.flags = bytes[4];
+  header.stream_id = read_uint32(buff + 5) & MAX_WINDOW_SIZE; // the top bit is reserved
+  return header;
+}
+
+void http2::write_frame_header(std::vector<char> &out, uint32_t length, frame_type type, uint8_t flags, uint32_t stream_id) {
+  out.push_back(static_cast<char>((length >> 16) & 0xff));
+  out.push_back(static_cast<char>((length >> 8) & 0xff));
+  out.push_back(static_cast<char>(length & 0xff));
+  out.push_back(static_cast<char>(type));
+  out.push_back(static_cast<char>(flags));
+  write_uint32(out, stream_id & MAX_WINDOW_SIZE);
+}
+
+void http2::write_settings(std::vector<char> &out, const std::vector<std::pair<settings_id, uint32_t>> &settings) {
+  write_frame_header(out, settings.size() * 6, frame_type::SETTINGS, 0, 0);
+  for (const auto &[id, value] : settings) {
+    out.push_back(static_cast<char>((static_cast<uint16_t>(id) >> 8) & 0xff));
+    out.push_back(static_cast<char>(static_cast<uint16_t>(id) & 0xff));
+    write_uint32(out, value);
+  }
+}
+
+void http2::write_settings_ack(std::vector<char> &out) {
+  write_frame_header(out, 0, frame_type::SETTINGS, flags::ACK, 0);
+}
+
+void http2::write_ping_ack(std::vector<char> &out, const char *opaque_data) {
+  write_frame_header(out, 8, frame_type::PING, flags::ACK, 0);
+  out.insert(out.end(), opaque_data, opaque_data + 8);
+}
+
+void http2::write_window_update(std::vector<char> &out, uint32_t stream_id, uint32_t increment) {
+  write_frame_header(out, 4, frame_type::WINDOW_UPDATE, 0, stream_id);
+  write_uint32(out, increment & MAX_WINDOW_SIZE);
+}
+
+void http2::write_rst_stream(std::vector<char> &out, uint32_t stream_id, error_code error) {
+  write_frame_header(out, 4, frame_type::RST_STREAM, 0, stream_id);
+  write_uint32(out, static_cast<uint32_t>(error));
+}
+
+void http2::write_goaway(std::vector<char> &out, uint32_t last_stream_id, error_code error) {
+  write_frame_header(out, 8, frame_type::GOAWAY, 0, 0);
+  write_uint32(out, last_stream_id & MAX_WINDOW_SIZE);
+  write_uint32(out, static_cast<uint32_t>(error));
+}
+
+//
+////HPACK
+//
+
+namespace {
+constexpr std::array<std::pair<std::string_view, std::string_view>, 61> static_table{{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}}};
+
+// the code length of every symbol (256 is EOS), the code is canonical so the codes themselves follow from these
+constexpr std::array<uint8_t, 257> huffman_code_lengths{
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30};
+
+constexpr int HUFFMAN_MAX_CODE_LENGTH = 30;
+constexpr uint16_t HUFFMAN_EOS = 256;
+
+struct huffman_table {
+  std::array<uint32_t, HUFFMAN_MAX_CODE_LENGTH + 1> first_code{}; // the first code of each length
+  std::array<uint32_t, HUFFMAN_MAX_CODE_LENGTH + 1> count{};      // number of codes of each length
+  std::array<uint16_t, HUFFMAN_MAX_CODE_LENGTH + 1> offset{};     // where the symbols of each length start
+  std::array<uint16_t, 257> symbols{};                            // ordered by code
+};
+
+constexpr auto build_huffman_table() -> huffman_table {
+  huffman_table table{};
+  for (const auto length : huffman_code_lengths) {
+    table.count[length]++;
+  }
+
+  uint32_t code = 0;
+  uint16_t offset = 0;
+  for (int length = 1; length <= HUFFMAN_MAX_CODE_LENGTH; length++) {
+    table.first_code[length] = code;
+    table.offset[length] = offset;
+    code = (code + table.count[length]) << 1;
+    offset += table.count[length];
+  }
+
+  std::array<uint16_t, HUFFMAN_MAX_CODE_LENGTH + 1> filled{};
+  for (uint16_t symbol = 0; symbol < huffman_code_lengths.size(); symbol++) {
+    const auto length = huffman_code_lengths[symbol];
+    table.symbols[table.offset[length] + filled[length]++] = symbol;
+  }
+  return table;
+}
+
+constexpr huffman_table huffman = build_huffman_table();
+
+constexpr auto huffman_kraft_sum_is_one() -> bool { // every code must be used, so this is a complete prefix code
+  uint64_t sum = 0;
+  for (const auto length : huffman_code_lengths) {
+    sum += uint64_t(1) << (HUFFMAN_MAX_CODE_LENGTH - length);
+  }
+  return sum == uint64_t(1) << HUFFMAN_MAX_CODE_LENGTH;
+}
+
+static_assert(huffman_kraft_sum_is_one());
+static_assert(huffman.first_code[5] == 0x0 && huffman.symbols[huffman.offset[5]] == '0'); // '0' is 00000
+static_assert(huffman.first_code[13] == 0x1ff8 && huffman.symbols[huffman.offset[13]] == 0);
+static_assert(huffman.first_code[30] + 3 == 0x3fffffff && huffman.symbols[huffman.offset[30] + 3] == HUFFMAN_EOS);
+
+auto decode_integer(const uint8_t *&pos, const uint8_t *end, int prefix_bits, uint64_t &value) -> bool {
+  if (pos >= end) {
+    return false;
+  }
+
+  const uint64_t max_prefix = (1U << prefix_bits) - 1;
+  value = *pos++ & max_prefix;
+  if (value < max_prefix) {
+    return true;
+  }
+
+  for (int shift = 0; pos < end && shift <= 56; shift += 7) {
+    const auto byte = *pos++;
+    value += uint64_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto decode_string(const uint8_t *&pos, const uint8_t *end, std::string &output) -> bool {
+  if (pos >= end) {
+    return false;
+  }
+
+  const bool huffman_encoded = (*pos & 0x80) != 0;
+  uint64_t length = 0;
+  if (!decode_integer(pos, end, 7, length) || length > static_cast<uint64_t>(end - pos)) {
+    return false;
+  }
+
+  const std::string_view data(reinterpret_cast<const char *>(pos), length);
+  pos += length;
+
+  if (huffman_encoded) {
+    return http2::huffman_decode(data, output);
+  }
+  output = data;
+  return true;
+}
+
+void encode_integer(std::vector<char> &out, uint8_t first_byte, int prefix_bits, uint64_t value) {
+  const uint64_t max_prefix = (1U << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out.push_back(static_cast<char>(first_byte | value));
+    return;
+  }
+
+  out.push_back(static_cast<char>(first_byte | max_prefix));
+  value -= max_prefix;
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void encode_string(std::vector<char> &out, std::string_view str) { // never uses Huffman, responses are mostly values it wouldn't shrink much
+  encode_integer(out, 0x00, 7, str.size());
+  out.insert(out.end(), str.begin(), str.end());
+}
+} // namespace
+
+auto http2::huffman_decode(std::string_view input, std::string &output) -> bool {
+  output.clear();
+  output.reserve(input.size() * 8 / 5);
+
+  uint32_t code = 0;
+  int length = 0;
+  for (const auto character : input) {
+    const auto byte = static_cast<uint8_t>(character);
+    for (int bit = 7; bit >= 0; bit--) {
+      code = (code << 1) | ((byte >> bit) & 0x1);
+      length++;
+
+      if (code - huffman.first_code[length] < huffman.count[length]) { // unsigned, so this also fails if code < first_code
+        const auto symbol = huffman.symbols[huffman.offset[length] + code - huffman.first_code[length]];
+        if (symbol == HUFFMAN_EOS) {
+          return false;
+        }
+        output.push_back(static_cast<char>(symbol));
+        code = 0;
+        length = 0;
+      } else if (length == HUFFMAN_MAX_CODE_LENGTH) {
+        return false;
+      }
+    }
+  }
+
+  // the padding is the most significant bits of EOS, so it must be all 1s and shorter than a byte
+  return length < 8 && code == (1U << length) - 1;
+}
+
+void http2::hpack_decoder::evict(size_t max_size) {
+  while (dynamic_table_size > max_size && !dynamic_table.empty()) {
+    const auto &entry = dynamic_table.back();
+    dynamic_table_size -= entry.first.size() + entry.second.size() + 32;
+    dynamic_table.pop_back();
+  }
+}
+
+void http2::hpack_decoder::add_entry(std::string name, std::string value) {
+  const auto entry_size = name.size() + value.size() + 32;
+  if (entry_size > max_dynamic_table_size) { // too big to fit, which just empties the table
+    evict(0);
+    return;
+  }
+
+  evict(max_dynamic_table_size - entry_size);
+  dynamic_table.emplace_front(std::move(name), std::move(value));
+  dynamic_table_size += entry_size;
+}
+
+auto http2::hpack_decoder::get_entry(uint64_t idx, std::pair<std::string, std::string> &entry) const -> bool {
+  if (idx == 0) {
+    return false;
+  }
+  if (idx <= static_table.size()) {
+    entry = {std::string(static_table[idx - 1].first), std::string(static_table[idx - 1].second)};
+    return true;
+  }
+
+  idx -= static_table.size() + 1;
+  if (idx >= dynamic_table.size()) {
+    return false;
+  }
+  entry = dynamic_table[idx];
+  return true;
+}
+
+auto http2::hpack_decoder::decode(const char *buff, size_t length, header_list &headers) -> bool {
+  const auto *pos = reinterpret_cast<const uint8_t *>(buff);
+  const auto *end = pos + length;
+
+  size_t decoded_size = 0;
+  bool headers_started = false; // table size updates have to come first
+
+  while (pos < end) {
+    const auto first_byte = *pos;
+
+    if ((first_byte & 0x80) != 0) { // indexed header field
+      uint64_t idx = 0;
+      std::pair<std::string, std::string> entry{};
+      if (!decode_integer(pos, end, 7, idx) || !get_entry(idx, entry)) {
+        return false;
+      }
+      headers.push_back(std::move(entry));
+    } else if ((first_byte & 0xe0) == 0x20) { // dynamic table size update
+      uint64_t new_size = 0;
+      if (headers_started || !decode_integer(pos, end, 5, new_size) || new_size > HEADER_TABLE_SIZE) {
+        return false;
+      }
+      max_dynamic_table_size = new_size;
+      evict(max_dynamic_table_size);
+      continue;
+    } else { // literal header field, with incremental indexing, without indexing, or never indexed
+      const bool incremental_indexing = (first_byte & 0xc0) == 0x40;
+      uint64_t name_idx = 0;
+      if (!decode_integer(pos, end, incremental_indexing ? 6 : 4, name_idx)) {
+        return false;
+      }
+
+      std::pair<std::string, std::string> entry{};
+      if (name_idx == 0) {
+        if (!decode_string(pos, end, entry.first)) {
+          return false;
+        }
+      } else if (!get_entry(name_idx, entry)) {
+        return false;
+      }
+
+      if (!decode_string(pos, end, entry.second)) {
+        return false;
+      }
+
+      if (incremental_indexing) {
+        add_entry(entry.first, entry.second);
+      }
+      headers.push_back(std::move(entry));
+    }
+
+    headers_started = true;
+    decoded_size += headers.back().first.size() + headers.back().second.size() + 32;
+    if (decoded_size > MAX_DECODED_HEADERS_SIZE) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void http2::hpack_encode_header(std::vector<char> &out, std::string_view name, std::string_view value) {
+  uint64_t name_idx = 0;
+  for (size_t i = 0; i < static_table.size(); i++) {
+    if (static_table[i].first == name) {
+      name_idx = i + 1;
+      break;
+    }
+  }
+
+  encode_integer(out, 0x00, 4, name_idx); // literal header field without indexing
+  if (name_idx == 0) {
+    encode_string(out, name);
+  }
+  encode_string(out, value);
+}
+
+void http2::hpack_encode_status(std::vector<char> &out, std::string_view status) {
+  constexpr uint64_t STATUS_IDX = 8; // the first :status entry
+  for (size_t i = STATUS_IDX - 1; i < static_table.size() && static_table[i].first == ":status"; i++) {
+    if (static_table[i].second == status) {
+      encode_integer(out, 0x80, 7, i + 1); // indexed header field
+      return;
+    }
+  }
+
+  encode_integer(out, 0x00, 4, STATUS_IDX);
+  encode_string(out, status);
+}
+
+auto http2::translate_http1_response(std::string_view response, std::vector<char> &header_block, size_t &body_offset) -> bool {
+  const auto headers_end = response.find("\r\n\r\n");
+  if (headers_end == std::string_view::npos) {
+    return false;
+  }
+  body_offset = headers_end + 4;
+
+  auto head = response.substr(0, headers_end);
+  const auto status_line_end = head.find("\r\n");
+  const auto status_line = head.substr(0, status_line_end); // i.e "HTTP/1.0 200 OK"
+  head = status_line_end == std::string_view::npos ? std::string_view{} : head.substr(status_line_end + 2);
+
+  const auto status_start = status_line.find(' ');
+  if (status_start == std::string_view::npos || status_line.size() < status_start + 4) {
+    return false;
+  }
+  hpack_encode_status(header_block, status_line.substr(status_start + 1, 3));
+
+  std::string name{};
+  while (!head.empty()) {
+    const auto line_end = head.find("\r\n");
+    const auto line = head.substr(0, line_end);
+    head = line_end == std::string_view::npos ? std::string_view{} : head.substr(line_end + 2);
+
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+
+    name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char character) { return std::tolower(character); });
+
+    if (name == "connection" || name == "keep-alive" || name == "transfer-encoding" || name == "upgrade" || name == "proxy-connection") {
+      continue; // connection specific, so not allowed in HTTP/2
+    }
+
+    auto value = line.substr(colon + 1);
+    while (!value.empty() && value.front() == ' ') {
+      value.remove_prefix(1);
+    }
+    hpack_encode_header(header_block, name, value);
+  }
+
+  return true;
+}
+
+//
+////the web server side
+//
+
+template <server_type T>
+auto basic_web_server<T>::is_http2_preface(const char *buff, size_t length) -> bool {
+  return length >= http2::connection_preface.size() && std::memcmp(buff, http2::connection_preface.data(), http2::connection_preface.size()) == 0;
+}
+
+template <server_type T>
+auto basic_web_server<T>::is_http2_connection(int client_idx) -> bool {
+  return http2_sessions.count(client_idx) != 0U;
+}
+
+template <server_type T>
+auto basic_web_server<T>::http2_new_stream(int client_idx, uint32_t stream_id) -> int {
+  auto slot = 0;
+
+  if (!http2_freed_streams.empty()) { // if there's a free slot, give that
+    slot = *http2_freed_streams.begin();
+    http2_freed_streams.erase(slot);
+  } else {
+    http2_streams.emplace_back(); // otherwise give a new one
+    slot = http2_streams.size() - 1;
+  }
+
+  auto &stream = http2_streams[slot];
+  stream = http2::stream{.generation = (stream.generation + 1) & http2::STREAM_GENERATION_MASK};
+  stream.client_idx = client_idx;
+  stream.id = stream_id;
+  stream.active = true;
+  return slot;
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_close_stream(int slot) {
+  auto &stream = http2_streams[slot];
+  web_cache.finished_with_item(http2::stream_handle(slot, stream.generation), stream.client_data);
+
+  auto session_it = http2_sessions.find(stream.client_idx);
+  if (session_it != http2_sessions.end()) {
+    session_it->second.streams.erase(stream.id);
+  }
+
+  stream = http2::stream{.generation = stream.generation};
+  http2_freed_streams.insert(http2_freed_streams.end(), slot);
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_kill_session(int client_idx) {
+  auto session_it = http2_sessions.find(client_idx);
+  if (session_it == http2_sessions.end()) {
+    return;
+  }
+
+  std::vector<int> slots{};
+  for (const auto &[stream_id, slot] : session_it->second.streams) {
+    slots.push_back(slot);
+  }
+  for (const auto slot : slots) {
+    http2_close_stream(slot);
+  }
+
+  http2_sessions.erase(session_it);
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_flush(int client_idx, http2::session &session) {
+  if (session.batching || session.send_data.empty()) {
+    return;
+  }
+
+  session.pending_writes++;
+  tcp_server->write_connection(client_idx, std::move(session.send_data));
+  session.send_data = {};
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_connection_error(http2::session &session, http2::error_code error) {
+  http2::write_goaway(session.send_data, session.last_stream_id, error);
+  session.goaway = true;
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_send_body(int slot) {
+  auto &stream = http2_streams[slot];
+  auto &session = http2_sessions[stream.client_idx];
+  auto &out = session.send_data;
+  const auto &body = stream.body;
+
+  while (stream.body_sent < body.length && session.send_window > 0 && stream.send_window > 0) {
+    const auto chunk = std::min<int64_t>({static_cast<int64_t>(body.length - stream.body_sent), session.send_window, stream.send_window, session.peer_max_frame_size});
+    const bool last = stream.body_sent + chunk == body.length;
+
+    http2::write_frame_header(out, chunk, http2::frame_type::DATA, last ? http2::flags::END_STREAM : 0, stream.id);
+    out.insert(out.end(), body.buff + stream.body_sent, body.buff + stream.body_sent + chunk);
+
+    stream.body_sent += chunk;
+    stream.send_window -= chunk;
+    session.send_window -= chunk;
+  }
+
+  if (stream.body_sent == body.length) {
+    http2_close_stream(slot);
+  }
+}
+
+template <server_type T>
+auto basic_web_server<T>::http2_stream_open(int request_handle) -> bool {
+  const auto slot = http2::handle_to_stream_slot(request_handle);
+  if (slot < 0 || size_t(slot) >= http2_streams.size()) {
+    return false;
+  }
+
+  const auto &stream = http2_streams[slot];
+  return stream.active && stream.generation == http2::handle_to_stream_generation(request_handle);
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_respond(int request_handle, tcp_tls_server::shared_buffer &&response) {
+  if (!http2_stream_open(request_handle)) { // the stream was reset or the connection closed in the meantime
+    return;
+  }
+
+  const auto slot = http2::handle_to_stream_slot(request_handle);
+  auto &stream = http2_streams[slot];
+  if (stream.responded) {
+    return;
+  }
+
+  const auto client_idx = stream.client_idx;
+  auto &session = http2_sessions[client_idx];
+
+  std::vector<char> header_block{};
+  size_t body_offset = 0;
+  if (!http2::translate_http1_response(std::string_view(response.buff, response.length), header_block, body_offset)) {
+    http2::write_rst_stream(session.send_data, stream.id, http2::error_code::INTERNAL_ERROR);
+    http2_close_stream(slot);
+    http2_flush(client_idx, session);
+    return;
+  }
+
+  stream.responded = true;
+  const bool has_body = body_offset < response.length;
+
+  // the header block only goes over several frames if it's bigger than the max frame size
+  size_t written = 0;
+  do {
+    const auto chunk = std::min<size_t>(header_block.size() - written, session.peer_max_frame_size);
+    const bool first = written == 0;
+    const bool last = written + chunk == header_block.size();
+
+    uint8_t frame_flags = last ? http2::flags::END_HEADERS : 0;
+    if (first && !has_body) {
+      frame_flags |= http2::flags::END_STREAM;
+    }
+
+    http2::write_frame_header(session.send_data, chunk, first ? http2::frame_type::HEADERS : http2::frame_type::CONTINUATION, frame_flags, stream.id);
+    session.send_data.insert(session.send_data.end(), header_block.begin() + written, header_block.begin() + written + chunk);
+    written += chunk;
+  } while (written < header_block.size());
+
+  if (has_body) {
+    stream.body = {std::move(response.owner), response.buff + body_offset, response.length - body_offset};
+    http2_send_body(slot);
+  } else {
+    http2_close_stream(slot);
+  }
+
+  http2_flush(client_idx, session);
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_require_http1(int request_handle) {
+  if (!http2_stream_open(request_handle)) {
+    return;
+  }
+
+  const auto slot = http2::handle_to_stream_slot(request_handle);
+  const auto client_idx = http2_streams[slot].client_idx;
+  auto &session = http2_sessions[client_idx];
+  http2::write_rst_stream(session.send_data, http2_streams[slot].id, http2::error_code::HTTP_1_1_REQUIRED);
+  http2_close_stream(slot);
+  http2_flush(client_idx, session);
+}
+
+template <server_type T>
+auto basic_web_server<T>::http2_process_headers(int client_idx, http2::session &session) -> bool {
+  const auto stream_id = session.header_block_stream_id;
+  session.header_block_stream_id = 0;
+
+  http2::header_list headers{};
+  const bool decoded = session.decoder.decode(session.header_block.data(), session.header_block.size(), headers);
+  session.header_block.clear();
+  if (!decoded) {
+    http2_connection_error(session, http2::error_code::COMPRESSION_ERROR);
+    return false;
+  }
+
+  if (stream_id <= session.last_stream_id) { // trailers, requests here don't have bodies so they're ignored
+    return true;
+  }
+  session.last_stream_id = stream_id;
+
+  if (session.streams.size() >= http2::MAX_CONCURRENT_STREAMS) {
+    http2::write_rst_stream(session.send_data, stream_id, http2::error_code::REFUSED_STREAM);
+    return true;
+  }
+
+  std::string method{};
+  std::string path{};
+  std::string ip{};
+  bool accept_bytes = false;
+  for (auto &[name, value] : headers) {
+    if (name == ":method") {
+      method = std::move(value);
+    } else if (name == ":path") {
+      path = std::move(value);
+    } else if (name == "range" && value.find("bytes=") != std::string::npos) {
+      accept_bytes = true;
+    } else if (name == "x-forwarded-for") {
+      ip = std::move(value);
+    }
+  }
+
+  if (path.empty() || path[0] != '/') {
+    http2::write_rst_stream(session.send_data, stream_id, http2::error_code::PROTOCOL_ERROR);
+    return true;
+  }
+
+  // ip is only set when using nginx (the x-forwarded-for header is set)
+  if (ip.empty()) {
+    ip = tcp_server->get_ip_address(client_idx);
+  }
+
+  const auto slot = http2_new_stream(client_idx, stream_id);
+  http2_streams[slot].send_window = session.peer_initial_window_size;
+  session.streams[stream_id] = slot;
+
+  respond_to_http_request(http2::stream_handle(slot, http2_streams[slot].generation), method == "GET", path.substr(1), accept_bytes, {}, ip);
+  return true;
+}
+
+template <server_type T>
+auto basic_web_server<T>::http2_process_frame(int client_idx, http2::session &session, const http2::frame_header &header, const char *payload) -> bool {
+  using http2::error_code;
+  using http2::frame_type;
+
+  if (session.header_block_stream_id != 0 && header.type != frame_type::CONTINUATION) { // header blocks can't be interleaved with anything
+    http2_connection_error(session, error_code::PROTOCOL_ERROR);
+    return false;
+  }
+
+  switch (header.type) {
+  case frame_type::SETTINGS: {
+    if (header.stream_id != 0) {
+      http2_connection_error(session, error_code::PROTOCOL_ERROR);
+      return false;
+    }
+    if ((header.flags & http2::flags::ACK) != 0) {
+      break;
+    }
+    if (header.length % 6 != 0) {
+      http2_connection_error(session, error_code::FRAME_SIZE_ERROR);
+      return false;
+    }
+
+    for (uint32_t i = 0; i < header.length; i += 6) {
+      const auto id = static_cast<http2::settings_id>((uint16_t(uint8_t(payload[i])) << 8) | uint8_t(payload[i + 1]));
+      const auto value = read_uint32(payload + i + 2);
+
+      if (id == http2::settings_id::INITIAL_WINDOW_SIZE) {
+        if (value > http2::MAX_WINDOW_SIZE) {
+          http2_connection_error(session, error_code::FLOW_CONTROL_ERROR);
+          return false;
+        }
+
+        const auto delta = static_cast<int64_t>(value) - session.peer_initial_window_size;
+        for (const auto &[stream_id, slot] : session.streams) {
+          http2_streams[slot].send_window += delta;
+        }
+        session.peer_initial_window_size = value;
+      } else if (id == http2::settings_id::MAX_FRAME_SIZE) {
+        if (value < http2::DEFAULT_MAX_FRAME_SIZE || value > 0xffffff) {
+          http2_connection_error(session, error_code::PROTOCOL_ERROR);
+          return false;
+        }
+        session.peer_max_frame_size = value;
+      }
+    }
+
+    http2::write_settings_ack(session.send_data);
+    http2_send_all_bodies(session); // the stream windows may have grown
+    break;
+  }
+  case frame_type::PING: {
+    if (header.stream_id != 0 || header.length != 8) {
+      http2_connection_error(session, header.stream_id != 0 ? error_code::PROTOCOL_ERROR : error_code::FRAME_SIZE_ERROR);
+      return false;
+    }
+    if ((header.flags & http2::flags::ACK) == 0) {
+      http2::write_ping_ack(session.send_data, payload);
+    }
+    break;
+  }
+  case frame_type::WINDOW_UPDATE: {
+    if (header.length != 4) {
+      http2_connection_error(session, error_code::FRAME_SIZE_ERROR);
+      return false;
+    }
+
+    const auto increment = read_uint32(payload) & http2::MAX_WINDOW_SIZE;
+    if (header.stream_id == 0) {
+      session.send_window += increment;
+      if (increment == 0 || session.send_window > http2::MAX_WINDOW_SIZE) {
+        http2_connection_error(session, increment == 0 ? error_code::PROTOCOL_ERROR : error_code::FLOW_CONTROL_ERROR);
+        return false;
+      }
+      http2_send_all_bodies(session);
+    } else if (session.streams.count(header.stream_id) != 0U) {
+      const auto slot = session.streams[header.stream_id];
+      auto &stream = http2_streams[slot];
+      stream.send_window += increment;
+      if (increment == 0 || stream.send_window > http2::MAX_WINDOW_SIZE) {
+        http2::write_rst_stream(session.send_data, stream.id, increment == 0 ? error_code::PROTOCOL_ERROR : error_code::FLOW_CONTROL_ERROR);
+        http2_close_stream(slot);
+      } else if (stream.responded) {
+        http2_send_body(slot);
+      }
+    }
+    break;
+  }
+  case frame_type::HEADERS: {
+    if (header.stream_id == 0 || header.stream_id % 2 == 0) { // clients only use odd stream ids
+      http2_connection_error(session, error_code::PROTOCOL_ERROR);
+      return false;
+    }
+
+    // skip the padding and the priority fields, if there are any
+    size_t offset = 0;
+    size_t padding = 0;
+    if ((header.flags & http2::flags::PADDED) != 0) {
+      padding = header.length > 0 ? uint8_t(payload[0]) : 0;
+      offset = 1;
+    }
+    if ((header.flags & http2::flags::PRIORITY) != 0) {
+      offset += 5;
+    }
+    if (offset + padding > header.length) {
+      http2_connection_error(session, error_code::PROTOCOL_ERROR);
+      return false;
+    }
+
+    session.header_block.assign(payload + offset, payload + header.length - padding);
+    session.header_block_stream_id = header.stream_id;
+
+    if ((header.flags & http2::flags::END_HEADERS) != 0) {
+      return http2_process_headers(client_idx, session);
+    }
+    break;
+  }
+  case frame_type::CONTINUATION: {
+    if (session.header_block_stream_id == 0 || header.stream_id != session.header_block_stream_id) {
+      http2_connection_error(session, error_code::PROTOCOL_ERROR);
+      return false;
+    }
+    if (session.header_block.size() + header.length > http2::MAX_HEADER_BLOCK_SIZE) {
+      http2_connection_error(session, error_code::ENHANCE_YOUR_CALM);
+      return false;
+    }
+
+    session.header_block.insert(session.header_block.end(), payload, payload + header.length);
+    if ((header.flags & http2::flags::END_HEADERS) != 0) {
+      return http2_process_headers(client_idx, session);
+    }
+    break;
+  }
+  case frame_type::DATA: {
+    if (header.stream_id == 0) {
+      http2_connection_error(session, error_code::PROTOCOL_ERROR);
+      return false;
+    }
+
+    // request bodies aren't used, but the flow control windows have to be given back so that the connection doesn't stall
+    if (header.length > 0) {
+      http2::write_window_update(session.send_data, 0, header.length);
+      if (session.streams.count(header.stream_id) != 0U && (header.flags & http2::flags::END_STREAM) == 0) {
+        http2::write_window_update(session.send_data, header.stream_id, header.length);
+      }
+    }
+    break;
+  }
+  case frame_type::RST_STREAM: {
+    if (header.length != 4) {
+      http2_connection_error(session, error_code::FRAME_SIZE_ERROR);
+      return false;
+    }
+    if (session.streams.count(header.stream_id) != 0U) {
+      http2_close_stream(session.streams[header.stream_id]);
+    }
+    break;
+  }
+  case frame_type::GOAWAY: {
+    session.goaway = true; // the client is done with this connection
+    return false;
+  }
+  case frame_type::PUSH_PROMISE: { // only servers can push
+    http2_connection_error(session, error_code::PROTOCOL_ERROR);
+    return false;
+  }
+  default: // PRIORITY, and unknown frame types, are ignored
+    break;
+  }
+
+  return true;
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_send_all_bodies(http2::session &session) {
+  std::vector<int> slots{}; // sending the final part of a body closes the stream, which would invalidate the iterator
+  for (const auto &[stream_id, slot] : session.streams) {
+    if (http2_streams[slot].responded) {
+      slots.push_back(slot);
+    }
+  }
+  for (const auto slot : slots) {
+    http2_send_body(slot);
+  }
+}
+
+template <server_type T>
+auto basic_web_server<T>::http2_process_read_cb(int client_idx, char *buffer, int length) -> bool {
+  auto [session_it, new_session] = http2_sessions.try_emplace(client_idx);
+  auto &session = session_it->second;
+
+  if (new_session) { // the server connection preface is just our settings
+    http2::write_settings(session.send_data, {{http2::settings_id::MAX_CONCURRENT_STREAMS, http2::MAX_CONCURRENT_STREAMS}});
+  }
+
+  // only copy into the buffer if there's a partial frame from before
+  const char *data = buffer;
+  size_t size = length;
+  if (!session.recv_data.empty()) {
+    session.recv_data.insert(session.recv_data.end(), buffer, buffer + length);
+    data = session.recv_data.data();
+    size = session.recv_data.size();
+  }
+
+  session.batching = true; // responses which are written straight away are sent together
+  size_t pos = 0;
+  bool keep_reading = true;
+
+  if (!session.preface_received && size >= http2::connection_preface.size()) {
+    if (!is_http2_preface(data, size)) {
+      http2_connection_error(session, http2::error_code::PROTOCOL_ERROR);
+      keep_reading = false;
+    }
+    pos = http2::connection_preface.size();
+    session.preface_received = true;
+  }
+
+  while (keep_reading && session.preface_received && size - pos >= http2::FRAME_HEADER_SIZE) {
+    const auto header = http2::read_frame_header(data + pos);
+    if (header.length > http2::DEFAULT_MAX_FRAME_SIZE) { // we never raise SETTINGS_MAX_FRAME_SIZE
+      http2_connection_error(session, http2::error_code::FRAME_SIZE_ERROR);
+      keep_reading = false;
+      break;
+    }
+    if (size - pos - http2::FRAME_HEADER_SIZE < header.length) {
+      break; // wait for the rest of the frame
+    }
+
+    keep_reading = http2_process_frame(client_idx, session, header, data + pos + http2::FRAME_HEADER_SIZE);
+    pos += http2::FRAME_HEADER_SIZE + header.length;
+  }
+
+  if (session.recv_data.empty()) {
+    session.recv_data.assign(data + pos, data + size);
+  } else {
+    session.recv_data.erase(session.recv_data.begin(), session.recv_data.begin() + pos);
+  }
+
+  session.batching = false;
+  http2_flush(client_idx, session);
+
+  if (session.goaway && session.pending_writes == 0) { // nothing left to write, so close now
+    close_connection(client_idx);
+    return false;
+  }
+  return keep_reading && !session.goaway;
+}
+
+template <server_type T>
+void basic_web_server<T>::http2_process_write_cb(int client_idx) {
+  auto &session = http2_sessions[client_idx];
+  session.pending_writes--;
+  if (session.goaway && session.pending_writes == 0) {
+    close_connection(client_idx);
+  }
+}
+
+template class web_server::basic_web_server<server_type::TLS>;
+template class web_server::basic_web_server<server_type::NON_TLS>;
@@ -0,0 +1,176 @@
+#include "../header/web_server/ogg_stream.h"
+#include "../header/web_server/router.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace {
+constexpr auto make_crc_table() -> std::array<uint32_t, 256> { // Ogg's CRC32, the polynomial is 0x04c11db7 and nothing is reflected
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < table.size(); i++) {
+    uint32_t crc = i << 24;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80000000U) != 0 ? (crc << 1) ^ 0x04c11db7U : crc << 1;
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+constexpr auto crc_table = make_crc_table();
+
+auto page_crc(const char *page, size_t length) -> uint32_t { // with the checksum field zeroed
+  uint32_t crc = 0;
+  for (size_t i = 0; i < length; i++) {
+    crc = (crc << 8) ^ crc_table[((crc >> 24) & 0xFF) ^ static_cast<uint8_t>(page[i])];
+  }
+  return crc;
+}
+
+void write_le(char *position, uint64_t value, size_t bytes) { // everything in an Ogg page header is little endian
+  for (size_t i = 0; i < bytes; i++) {
+    position[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
+}
+
+auto packet_samples(const unsigned char *packet, size_t length) -> uint64_t { // from the TOC byte (RFC 6716 section 3.1), in 48kHz samples
+  if (length == 0) {
+    return 0;
+  }
+  constexpr std::array<uint64_t, 4> silk{480, 960, 1920, 2880};
+  constexpr std::array<uint64_t, 2> hybrid{480, 960};
+  constexpr std::array<uint64_t, 4> celt{120, 240, 480, 960};
+  const int config = packet[0] >> 3;
+  const auto frame_samples = config < 12 ? silk[config % 4] : (config < 16 ? hybrid[config % 2] : celt[config % 4]);
+
+  switch (packet[0] & 3) {
+  case 0:
+    return frame_samples;
+  case 1:
+  case 2:
+    return 2 * frame_samples;
+  default: // the frame count is in the next byte
+    return length < 2 ? 0 : frame_samples * (packet[1] & 0x3F);
+  }
+}
+
+auto make_page(uint32_t serial, uint32_t sequence, uint8_t flags, std::string_view packet) -> std::string { // a page with one packet, for the headers
+  std::string page(27, '\0');
+  page.replace(0, 4, "OggS");
+  page[5] = static_cast<char>(flags); // the granule position is 0 for both header pages
+  write_le(&page[14], serial, 4);
+  write_le(&page[18], sequence, 4);
+
+  size_t remaining = packet.size();
+  for (; remaining >= 255; remaining -= 255) {
+    page += static_cast<char>(255);
+  }
+  page += static_cast<char>(remaining);
+  page[26] = static_cast<char>(page.size() - 27);
+  page += packet;
+
+  write_le(&page[22], page_crc(page.data(), page.size()), 4);
+  return page;
+}
+
+auto chunk_size_line(size_t length) -> std::string {
+  char line[24]{};
+  const int line_length = snprintf(line, sizeof(line), "%zx\r\n", length);
+  return {line, static_cast<size_t>(line_length)};
+}
+} // namespace
+
+auto ogg_stream::serial_number(std::string_view station) -> uint32_t {
+  return web_server::route_hash(station); // FNV-1a
+}
+
+auto ogg_stream::response_header(std::string_view station) -> tcp_tls_server::shared_buffer {
+  std::string opus_head("OpusHead\x01", 9);
+  opus_head += static_cast<char>(CHANNELS);
+  opus_head.resize(opus_head.size() + 9);
+  write_le(&opus_head[10], PRE_SKIP, 2);
+  write_le(&opus_head[12], 48000, 4); // the input sample rate, only informational, the output gain and the mapping family are 0
+
+  constexpr std::string_view vendor = "radio";
+  const std::string title = "TITLE=" + std::string(station);
+  std::string opus_tags("OpusTags");
+  opus_tags.resize(opus_tags.size() + 4);
+  write_le(&opus_tags[8], vendor.size(), 4);
+  opus_tags += vendor;
+  opus_tags.resize(opus_tags.size() + 8);
+  write_le(&opus_tags[opus_tags.size() - 8], 1, 4); // one comment
+  write_le(&opus_tags[opus_tags.size() - 4], title.size(), 4);
+  opus_tags += title;
+
+  const auto serial = serial_number(station);
+  const auto pages = make_page(serial, 0, 0x02, opus_head) + make_page(serial, 1, 0, opus_tags); // the first is the beginning of the stream
+
+  auto response = std::make_shared<std::string>("HTTP/1.1 200 OK\r\nContent-Type: audio/ogg\r\nTransfer-Encoding: chunked\r\nCache-Control: no-cache, no-store\r\n"
+                                                "Connection: close\r\n\r\n");
+  *response += chunk_size_line(pages.size()) + pages + "\r\n";
+  return tcp_tls_server::shared_buffer{response, response->data(), response->size()};
+}
+
+auto ogg_stream::writer::make_chunk(const std::vector<std::string_view> &pages) -> tcp_tls_server::shared_buffer {
+  auto chunk = std::make_shared<std::vector<char>>();
+
+  for (const auto &page : pages) {
+    if (page.size() < 27 || page.substr(0, 4) != "OggS" || page.size() < 27 + static_cast<size_t>(static_cast<uint8_t>(page[26]))) {
+      continue;
+    }
+    const auto num_segments = static_cast<uint8_t>(page[26]);
+    const auto *segments = reinterpret_cast<const unsigned char *>(page.data() + 27);
+    size_t page_length = 27 + num_segments;
+    for (size_t i = 0; i < num_segments; i++) {
+      page_length += segments[i];
+    }
+    if (page_length != page.size()) {
+      continue;
+    }
+
+    const bool continued = (page[5] & 0x01) != 0;
+    if (!continued) {
+      in_packet = false; // whatever was carrying on from the last page was cut off, by a skip or a new track
+    }
+
+    // the granule position is where the last packet finishing on this page ends, or -1 if none do
+    const auto *data = segments + num_segments;
+    bool finished_packet = false;
+    for (size_t i = 0; i < num_segments; i++) {
+      if (!in_packet) {
+        packet_start_length = 0;
+        in_packet = true;
+      }
+      for (size_t byte = 0; byte < segments[i] && packet_start_length < packet_start.size(); byte++) {
+        packet_start[packet_start_length++] = data[byte];
+      }
+      data += segments[i];
+
+      if (segments[i] < 255) { // the end of the packet
+        granule += packet_samples(packet_start.data(), packet_start_length);
+        in_packet = false;
+        finished_packet = true;
+      }
+    }
+
+    const auto start = chunk->size();
+    chunk->insert(chunk->end(), page.begin(), page.end());
+    char *header = chunk->data() + start;
+    header[5] = static_cast<char>(continued ? 0x01 : 0); // never the first or last page of this stream, whatever it was in its file
+    write_le(header + 6, finished_packet ? granule : ~uint64_t{}, 8);
+    write_le(header + 14, serial, 4);
+    write_le(header + 18, page_sequence++, 4);
+    write_le(header + 22, 0, 4);
+    write_le(header + 22, page_crc(header, page.size()), 4);
+  }
+
+  if (chunk->empty()) {
+    return {};
+  }
+
+  const auto size_line = chunk_size_line(chunk->size());
+  chunk->insert(chunk->begin(), size_line.begin(), size_line.end());
+  chunk->push_back('\r');
+  chunk->push_back('\n');
+  return tcp_tls_server::shared_buffer{chunk, chunk->data(), chunk->size()};
+}
@@ -0,0 +1,136 @@
+#include "../header/web_server/permessage_deflate.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+
+using namespace web_server;
+
+namespace {
+constexpr int WINDOW_BITS = 15;                              // negative in the init calls for raw deflate, with no zlib header
+constexpr std::array<char, 4> EMPTY_BLOCK_TAIL{0, 0, -1, -1}; // 00 00 ff ff, which ends a sync flush and is left off the wire
+
+auto trim(std::string_view str) -> std::string_view {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+struct deflate_stream {
+  z_stream stream{};
+  bool ready = false;
+  deflate_stream() { ready = deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, -WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) == Z_OK; } // a chunk takes a few ms and is still well under half the size
+  ~deflate_stream() { deflateEnd(&stream); }
+};
+
+struct inflate_stream {
+  z_stream stream{};
+  bool ready = false;
+  inflate_stream() { ready = inflateInit2(&stream, -WINDOW_BITS) == Z_OK; }
+  ~inflate_stream() { inflateEnd(&stream); }
+};
+} // namespace
+
+auto web_server::accepts_permessage_deflate(std::string_view offers) -> bool {
+  while (!offers.empty()) {
+    const auto offer_end = offers.find(',');
+    auto offer = offers.substr(0, offer_end);
+    offers = offer_end == std::string_view::npos ? std::string_view{} : offers.substr(offer_end + 1);
+
+    auto param_end = offer.find(';');
+    if (trim(offer.substr(0, param_end)) != "permessage-deflate") {
+      continue;
+    }
+
+    bool acceptable = true;
+    while (param_end != std::string_view::npos) {
+      offer = offer.substr(param_end + 1);
+      param_end = offer.find(';');
+      const auto param = trim(offer.substr(0, param_end));
+
+      // our frames are compressed once for everyone with the full window, so a client wanting a smaller one is declined
+      if (param.substr(0, param.find('=')) == "server_max_window_bits" && trim(param.substr(param.find('=') + 1)) != "15") {
+        acceptable = false;
+      }
+    }
+
+    if (acceptable) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto web_server::deflate_message(std::string_view payload, std::string &compressed) -> bool {
+  thread_local deflate_stream deflater{};
+  if (!deflater.ready) {
+    return false;
+  }
+  auto &stream = deflater.stream;
+
+  compressed.resize(deflateBound(&stream, payload.size()) + 16); // the bound doesn't include the sync flush
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(payload.data()));
+  stream.avail_in = payload.size();
+  stream.next_out = reinterpret_cast<Bytef *>(compressed.data());
+  stream.avail_out = compressed.size();
+
+  const auto result = deflate(&stream, Z_SYNC_FLUSH);
+  const auto length = compressed.size() - stream.avail_out;
+  deflateReset(&stream); // no context takeover
+
+  if (result != Z_OK || stream.avail_in != 0 || length < EMPTY_BLOCK_TAIL.size()) {
+    return false;
+  }
+  compressed.resize(length - EMPTY_BLOCK_TAIL.size());
+  return true;
+}
+
+auto web_server::inflate_message(std::string_view compressed, std::vector<char> &payload, size_t max_size) -> bool {
+  thread_local inflate_stream inflater{};
+  if (!inflater.ready) {
+    return false;
+  }
+  auto &stream = inflater.stream;
+
+  payload.clear();
+  bool finished = false;
+  bool valid = true;
+
+  // the message, and then the tail which was taken off by the client
+  for (const auto input : {compressed, std::string_view(EMPTY_BLOCK_TAIL.data(), EMPTY_BLOCK_TAIL.size())}) {
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    stream.avail_in = input.size();
+
+    while (valid) {
+      const auto previous_size = payload.size();
+      payload.resize(previous_size + std::max<size_t>(input.size() * 2, 4096));
+      stream.next_out = reinterpret_cast<Bytef *>(payload.data() + previous_size);
+      stream.avail_out = payload.size() - previous_size;
+
+      const auto result = inflate(&stream, Z_SYNC_FLUSH);
+      const bool output_left = stream.avail_out != 0;
+      payload.resize(payload.size() - stream.avail_out);
+
+      if (result == Z_STREAM_END) { // a final block, nothing after it counts
+        finished = true;
+        break;
+      }
+      if ((result != Z_OK && result != Z_BUF_ERROR) || payload.size() > max_size) {
+        valid = false;
+      } else if (output_left && (stream.avail_in == 0 || result == Z_BUF_ERROR)) { // all of this input has been used, or what's left can't be yet
+        break;
+      }
+    }
+    if (finished || !valid) {
+      break;
+    }
+  }
+
+  inflateReset(&stream); // no context takeover
+  return valid;
+}
@@ -0,0 +1,334 @@
+#include "../header/web_server/relay.h"
+#include "../vendor/json/single_include/nlohmann/json.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <random>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <openssl/evp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+namespace {
+auto random_bytes() -> std::array<unsigned char, 16> {
+  static std::mt19937 generator{std::random_device{}()};
+  std::array<unsigned char, 16> bytes{};
+  for (auto &byte : bytes) {
+    byte = generator() & 0xFF;
+  }
+  return bytes;
+}
+
+auto make_masked_frame(int opcode, std::string_view payload) -> std::string {
+  std::string frame{};
+  frame += static_cast<char>(0x80 | opcode); // never fragmented, these are all small
+  if (payload.size() < 126) {
+    frame += static_cast<char>(0x80 | payload.size());
+  } else if (payload.size() <= 0xFFFF) {
+    frame += static_cast<char>(0x80 | 126);
+    frame += static_cast<char>(payload.size() >> 8);
+    frame += static_cast<char>(payload.size() & 0xFF);
+  } else {
+    frame += static_cast<char>(0x80 | 127);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      frame += static_cast<char>((payload.size() >> shift) & 0xFF);
+    }
+  }
+
+  const auto mask = random_bytes();
+  frame.append(reinterpret_cast<const char *>(mask.data()), 4);
+  for (size_t i = 0; i < payload.size(); i++) {
+    frame += static_cast<char>(payload[i] ^ mask[i % 4]);
+  }
+  return frame;
+}
+
+auto send_all(int fd, std::string_view data) -> bool {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    const auto result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (result <= 0) {
+      if (result == -1 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    sent += result;
+  }
+  return true;
+}
+
+auto send_now(int fd, std::string_view data) -> bool { // never blocks, a short send would leave half a frame, so the connection is shut down
+  ssize_t result = -1;
+  do {
+    result = send(fd, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+  } while (result == -1 && errno == EINTR);
+
+  if (result != static_cast<ssize_t>(data.size())) {
+    shutdown(fd, SHUT_RDWR);
+    return false;
+  }
+  return true;
+}
+
+auto connect_socket(const relay::origin_address &origin) -> int { // a blocking socket, with timeouts for everything sent and received
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  if (getaddrinfo(origin.host.c_str(), origin.port.c_str(), &hints, &addresses) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (auto *address = addresses; address != nullptr && fd == -1; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, address->ai_protocol);
+    if (fd == -1) {
+      continue;
+    }
+
+    // nonblocking while connecting, so an origin which doesn't answer only holds things up for so long
+    if (connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+      pollfd poll_fd{fd, POLLOUT, 0};
+      int error = 0;
+      socklen_t error_length = sizeof(error);
+      if (errno != EINPROGRESS || poll(&poll_fd, 1, relay::CONNECT_TIMEOUT_MS) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) != 0 || error != 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd == -1) {
+    return -1;
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  const timeval timeout{relay::HANDSHAKE_TIMEOUT_MS / 1000, (relay::HANDSHAKE_TIMEOUT_MS % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+auto wait_readable(int fd, std::chrono::steady_clock::time_point deadline) -> bool { // false once the deadline has passed, however slowly the origin trickles data in
+  while (true) {
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+      return false;
+    }
+    pollfd poll_fd{fd, POLLIN, 0};
+    const auto result = poll(&poll_fd, 1, static_cast<int>(remaining));
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    return result == 1;
+  }
+}
+
+auto read_response(int fd, std::string &response, std::chrono::steady_clock::time_point deadline) -> size_t { // until the end of the headers, returns where the body starts, 0 if it didn't get that far
+  std::array<char, 4096> buff{};
+  while (true) {
+    const auto end = response.find("\r\n\r\n");
+    if (end != std::string::npos) {
+      return end + 4;
+    }
+    if (!wait_readable(fd, deadline)) {
+      return 0;
+    }
+    const auto result = recv(fd, buff.data(), buff.size(), 0);
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return 0;
+    }
+    response.append(buff.data(), result);
+  }
+}
+} // namespace
+
+auto relay::parse_address(const std::string &address) -> origin_address {
+  const auto colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    return {address, "80"};
+  }
+  return {address.substr(0, colon), address.substr(colon + 1)};
+}
+
+auto relay::fetch_station_list(const origin_address &origin) -> std::vector<std::string> {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(STATION_LIST_TIMEOUT_MS);
+  const int fd = connect_socket(origin);
+  if (fd == -1) {
+    return {};
+  }
+
+  std::string response{};
+  const std::string request = "GET /station_list HTTP/1.1\r\nHost: " + origin.host + "\r\nConnection: close\r\n\r\n";
+  size_t body_start = 0;
+  if (send_all(fd, request) && (body_start = read_response(fd, response, deadline)) != 0) {
+    std::array<char, 4096> buff{};
+    while (wait_readable(fd, deadline)) { // it closes the connection after the response, a body cut short by the deadline won't parse
+      const auto result = recv(fd, buff.data(), buff.size(), 0);
+      if (result == -1 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        break;
+      }
+      response.append(buff.data(), result);
+    }
+  }
+  close(fd);
+  if (body_start == 0) {
+    return {};
+  }
+
+  const auto body = json::parse(response.begin() + body_start, response.end(), nullptr, false);
+  std::vector<std::string> stations{};
+  const auto list = body.is_object() ? body.find("stations") : body.end();
+  if (list != body.end() && list->is_array()) {
+    for (const auto &station : *list) {
+      if (station.is_string()) {
+        stations.push_back(station.get<std::string>());
+      }
+    }
+  }
+  return stations;
+}
+
+auto relay::connect_to_origin(const origin_address &origin, std::string &leftover) -> int {
+  const int fd = connect_socket(origin);
+  if (fd == -1) {
+    return -1;
+  }
+
+  const auto key = random_bytes();
+  std::string encoded_key(24, '\0'); // 16 bytes is 24 characters of base64
+  EVP_EncodeBlock(reinterpret_cast<unsigned char *>(encoded_key.data()), key.data(), key.size());
+
+  // no permessage-deflate, the chunks are rebroadcast as they are
+  const std::string request = "GET /ws/mux HTTP/1.1\r\nHost: " + origin.host + "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " + encoded_key +
+                              "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+  std::string response{};
+  size_t body_start = 0;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS);
+  if (!send_all(fd, request) || (body_start = read_response(fd, response, deadline)) == 0 || response.compare(0, 12, "HTTP/1.1 101") != 0) {
+    close(fd);
+    return -1;
+  }
+
+  const timeval no_timeout{};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &no_timeout, sizeof(no_timeout)); // read with io_uring from now on, and sent to with send_now
+  leftover = response.substr(body_start);
+  return fd;
+}
+
+void relay::frame_reader::send_control(int fd, int opcode, std::string_view payload) {
+  send_now(fd, make_masked_frame(opcode, payload));
+}
+
+auto relay::send_text(int fd, std::string_view payload) -> bool {
+  return send_now(fd, make_masked_frame(web_server::websocket_non_control_opcodes::text_frame, payload));
+}
+
+auto relay::subscribe_message(const std::string &station, int64_t after_sequence) -> std::string {
+  json request{};
+  request["type"] = "subscribe";
+  request["station"] = station;
+  request["topics"] = std::vector<std::string>{"audio", "metadata", "queue", "list"};
+  if (after_sequence >= 0) {
+    request["after"] = after_sequence;
+  }
+  return request.dump();
+}
+
+auto relay::request_message(int64_t id, std::string_view type, const std::string &station, const std::string &track) -> std::string {
+  json request{};
+  request["id"] = id;
+  request["type"] = std::string(type);
+  request["station"] = station;
+  if (!track.empty()) {
+    request["track"] = track;
+  }
+  return request.dump();
+}
+
+auto relay::parse_message(std::string_view payload) -> message {
+  message parsed{};
+
+  // chunks are the bulk of it, so they're picked apart by hand rather than parsed, see web_server::make_tagged_ws_frame
+  constexpr std::string_view channel_prefix = "{\"channel\":";
+  constexpr std::string_view data_key = ",\"data\":";
+  if (payload.substr(0, channel_prefix.size()) == channel_prefix) {
+    const auto data_start = payload.find(data_key);
+    if (data_start == std::string_view::npos || payload.back() != '}') {
+      return parsed;
+    }
+
+    const auto channel_name = payload.substr(channel_prefix.size(), data_start - channel_prefix.size());
+    const auto channel = json::parse(channel_name.begin(), channel_name.end(), nullptr, false);
+    if (!channel.is_string()) {
+      return parsed;
+    }
+    const auto name = channel.get<std::string>();
+    const auto slash = name.rfind('/');
+    parsed.station = name.substr(0, slash);
+    parsed.topic = slash == std::string::npos ? std::string{} : name.substr(slash + 1);
+    parsed.kind = parsed.topic == "audio" ? message_kind::AUDIO : (parsed.topic == "metadata" ? message_kind::METADATA : message_kind::OTHER);
+    parsed.data = payload.substr(data_start + data_key.size(), payload.size() - data_start - data_key.size() - 1);
+
+    // "seq" can only appear as a key, inside a string the quotes would be escaped
+    const auto sequence = parsed.data.find("\"seq\":");
+    if (sequence != std::string_view::npos) {
+      parsed.sequence = std::strtoll(std::string(parsed.data.substr(sequence + 6, 20)).c_str(), nullptr, 10);
+    }
+    return parsed;
+  }
+
+  const auto object = json::parse(payload.begin(), payload.end(), nullptr, false);
+  if (!object.is_object()) {
+    return parsed;
+  }
+
+  const auto get_string = [&](const char *key) { // a string or nothing
+    const auto item = object.find(key);
+    return item != object.end() && item->is_string() ? item->get<std::string>() : std::string{};
+  };
+  parsed.topic = get_string("type");
+  parsed.station = get_string("station");
+  const auto id = object.find("id");
+  if (id != object.end() && id->is_number_integer()) {
+    parsed.kind = message_kind::REPLY;
+    parsed.id = id->get<int64_t>();
+    parsed.error = object.contains("error");
+    parsed.result = get_string(parsed.error ? "error" : "result");
+  } else if (parsed.topic == "queue_update" || parsed.topic == "list_update") {
+    parsed.kind = message_kind::UPDATE;
+    parsed.result = get_string("result");
+  }
+  return parsed;
+}
+
+auto relay::chunk_pages(std::string_view audio) -> std::vector<std::string> {
+  const auto chunk = json::parse(audio.begin(), audio.end(), nullptr, false);
+  const auto pages = chunk.is_object() ? chunk.find("pages") : chunk.end();
+  std::vector<std::string> buffs{};
+  if (pages == chunk.end() || !pages->is_array()) {
+    return buffs;
+  }
+
+  for (const auto &page : *pages) { // each is {"duration": ..., "buff": [the bytes, as numbers]}, see audio_server::broadcast_chunk
+    const auto buff = page.is_object() ? page.find("buff") : page.end();
+    if (buff != page.end() && buff->is_array()) {
+      const auto bytes = buff->get<std::vector<char>>();
+      buffs.emplace_back(bytes.begin(), bytes.end());
+    }
+  }
+  return buffs;
+}
@@ -0,0 +1,104 @@
+#include "../header/web_server/shared_broadcast_segment.h"
+#include "../header/utility.h"
+
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace web_server;
+
+auto shared_broadcast_segment::create() -> int {
+  const int fd = memfd_create("radio_broadcasts", MFD_CLOEXEC); // the workers are given it explicitly
+  if (fd == -1 || ftruncate(fd, SIZE) != 0) {
+    utility::fatal_error("Couldn't make the shared memory for the worker processes");
+  }
+  return fd;
+}
+
+shared_broadcast_segment::shared_broadcast_segment(int memfd) : memfd(memfd) {
+  mapping = mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (mapping == MAP_FAILED) {
+    utility::fatal_error("Couldn't map the shared memory for the worker processes");
+  }
+  // a new memfd is all zeroes, which is what every atomic starts as
+  header = static_cast<segment_header *>(mapping);
+  slots = reinterpret_cast<slot *>(static_cast<char *>(mapping) + sizeof(segment_header));
+  data = reinterpret_cast<char *>(slots + NUM_SLOTS);
+}
+
+shared_broadcast_segment::~shared_broadcast_segment() {
+  munmap(mapping, SIZE);
+  close(memfd);
+}
+
+void shared_broadcast_segment::copy_in(uint64_t position, const char *buff, size_t length) {
+  const auto offset = position % DATA_CAPACITY;
+  const auto first = std::min(length, DATA_CAPACITY - offset); // the rest wraps around to the start
+  std::memcpy(data + offset, buff, first);
+  std::memcpy(data, buff + first, length - first);
+}
+
+void shared_broadcast_segment::copy_out(uint64_t position, char *buff, size_t length) const {
+  const auto offset = position % DATA_CAPACITY;
+  const auto first = std::min(length, DATA_CAPACITY - offset);
+  std::memcpy(buff, data + offset, first);
+  std::memcpy(buff + first, data, length - first);
+}
+
+void shared_broadcast_segment::publish(const broadcast_entry &entry) {
+  const auto epoch = header->head.load(std::memory_order_relaxed);
+  auto &slot = slots[epoch % NUM_SLOTS];
+  const auto length = entry.frame.length + entry.deflated_frame.length;
+  if (length > DATA_CAPACITY / 2) {
+    return; // never a real broadcast, and readers couldn't tell it apart from one which had been written over
+  }
+
+  // readers check the slot and the bytes written after they've copied an entry out, so both are marked before writing over anything
+  slot.epoch.store(0, std::memory_order_relaxed);
+  const auto position = header->written.load(std::memory_order_relaxed);
+  header->written.store(position + length, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  copy_in(position, entry.frame.buff, entry.frame.length);
+  copy_in(position + entry.frame.length, entry.deflated_frame.buff, entry.deflated_frame.length);
+
+  slot.channel_id.store(entry.channel_id, std::memory_order_relaxed);
+  slot.frame_length.store(entry.frame.length, std::memory_order_relaxed);
+  slot.deflated_length.store(entry.deflated_frame.length, std::memory_order_relaxed);
+  slot.position.store(position, std::memory_order_relaxed);
+  slot.sequence.store(entry.sequence, std::memory_order_relaxed);
+  slot.epoch.store(epoch + 1, std::memory_order_release);
+  header->head.store(epoch + 1, std::memory_order_release);
+}
+
+auto shared_broadcast_segment::read(uint64_t epoch, broadcast_entry &entry) const -> bool {
+  const auto &slot = slots[epoch % NUM_SLOTS];
+  if (slot.epoch.load(std::memory_order_acquire) != epoch + 1) {
+    return false;
+  }
+
+  const auto channel_id = slot.channel_id.load(std::memory_order_relaxed);
+  const auto frame_length = slot.frame_length.load(std::memory_order_relaxed);
+  const auto deflated_length = slot.deflated_length.load(std::memory_order_relaxed);
+  const auto position = slot.position.load(std::memory_order_relaxed);
+  const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+  if (size_t(frame_length) + deflated_length > DATA_CAPACITY / 2) {
+    return false; // the slot was being written over
+  }
+
+  // both frames in one allocation, which the server threads' writes share like any other broadcast
+  std::shared_ptr<char[]> buff(new char[size_t(frame_length) + deflated_length]);
+  copy_out(position, buff.get(), size_t(frame_length) + deflated_length);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.epoch.load(std::memory_order_relaxed) != epoch + 1 || header->written.load(std::memory_order_relaxed) - position > DATA_CAPACITY) {
+    return false; // something was written over it while it was copied
+  }
+
+  entry.channel_id = channel_id;
+  entry.sequence = sequence;
+  entry.frame = {buff, buff.get(), frame_length};
+  entry.deflated_frame = deflated_length ? tcp_tls_server::shared_buffer{buff, buff.get() + frame_length, deflated_length} : tcp_tls_server::shared_buffer{};
+  return true;
+}
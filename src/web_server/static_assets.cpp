@@ -0,0 +1,302 @@
+#include "../header/web_server/static_assets.h"
+#include "../header/utility.h"
+#include "../header/web_server/mime_types.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <dirent.h>
+#include <sys/mman.h>
+
+using namespace web_cache;
+
+namespace {
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr uint32_t MAX_DISPLACEMENT_SEED = 1 << 16; // if no seed below this works for a bucket, the table is grown
+constexpr size_t KEYS_PER_BUCKET = 4;
+
+auto asset_hash(std::string_view key, uint32_t seed) -> uint32_t { // seeded FNV-1a, with a final mix so that different seeds spread well
+  uint32_t hash = 2166136261U ^ (seed * 16777619U);
+  for (const auto character : key) {
+    hash ^= static_cast<uint8_t>(character);
+    hash *= 16777619U;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35U;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+void collect_files(const std::string &dir_path, std::vector<std::string> &filepaths) {
+  DIR *dir_ptr = opendir(dir_path.c_str());
+  if (dir_ptr == nullptr) {
+    return;
+  }
+
+  dirent *entry{};
+  while ((entry = readdir(dir_ptr)) != nullptr) {
+    const std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+
+    const auto path = dir_path + "/" + name;
+    stat_struct file_stat{};
+    if (stat(path.c_str(), &file_stat) != 0) {
+      continue;
+    }
+
+    if (S_ISDIR(file_stat.st_mode)) {
+      collect_files(path, filepaths);
+    } else if (S_ISREG(file_stat.st_mode)) {
+      filepaths.push_back(path);
+    }
+  }
+
+  closedir(dir_ptr);
+}
+
+auto make_headers(bool found, size_t content_length, std::string_view content_type) -> std::string { // same headers as send_file_request
+  std::string headers = found ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n";
+  headers += content_type;
+  headers += "Content-Length: ";
+  headers += std::to_string(content_length) + "\r\n";
+  headers += "Connection: close\r\nKeep-Alive: timeout=0, ";
+  headers += "max=0\r\nCache-Control: no-cache, no-store, ";
+  headers += "must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n";
+  headers += "\r\n";
+  return headers;
+}
+
+auto copy_file(const std::string &filepath, char *dest, size_t size) -> bool { // false if the file isn't the size its headers were made for
+  const auto file_fd = open(filepath.c_str(), O_RDONLY);
+  if (file_fd < 0) {
+    return false;
+  }
+
+  // it could have changed since the directory was walked, and a mapping of a file which is truncated while it's copied is a SIGBUS,
+  // so it's checked against the Content-Length and read rather than mapped, a truncation part way through is then just a short read
+  stat_struct file_stat{};
+  if (fstat(file_fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) != size) {
+    close(file_fd);
+    return false;
+  }
+
+  size_t copied = 0;
+  while (copied < size) {
+    const auto result = pread(file_fd, dest + copied, size - copied, static_cast<off_t>(copied));
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      break;
+    }
+    copied += result;
+  }
+  close(file_fd);
+  return copied == size;
+}
+} // namespace
+
+auto asset_snapshot::find(std::string_view filepath, bool not_found_response) const -> const static_asset * {
+  if (not_found_response) {
+    return not_found.response != nullptr && not_found.filepath == filepath ? &not_found : nullptr;
+  }
+
+  if (slots.empty()) {
+    return nullptr;
+  }
+
+  const auto bucket = asset_hash(filepath, 0) % displacements.size();
+  const auto &slot = slots[asset_hash(filepath, displacements[bucket]) % slots.size()];
+  return slot.filepath == filepath ? &slot : nullptr;
+}
+
+asset_snapshot::~asset_snapshot() {
+  if (region != nullptr) {
+    munmap(region, region_size);
+  }
+}
+
+auto static_asset_store::build() -> std::shared_ptr<const asset_snapshot> {
+  std::vector<std::string> filepaths{};
+  collect_files(root, filepaths);
+
+  struct pending_asset {
+    std::string filepath{};
+    std::string headers{};
+    size_t file_size{};
+  };
+
+  std::vector<pending_asset> pending{};
+  size_t total_size = 0;
+  for (auto &filepath : filepaths) {
+    stat_struct file_stat{};
+    if (stat(filepath.c_str(), &file_stat) != 0) {
+      continue;
+    }
+
+    const auto file_size = static_cast<size_t>(file_stat.st_size);
+    auto headers = make_headers(true, file_size, web_server::get_content_type(filepath));
+    total_size += headers.size() + file_size;
+    pending.push_back({std::move(filepath), std::move(headers), file_size});
+  }
+
+  // the 404 page is pre-rendered a second time with a 404 status line
+  pending_asset not_found_asset{};
+  for (const auto &asset : pending) {
+    if (asset.filepath == not_found_filepath) {
+      not_found_asset = {asset.filepath, make_headers(false, asset.file_size, web_server::get_content_type(asset.filepath)), asset.file_size};
+      total_size += not_found_asset.headers.size() + not_found_asset.file_size;
+      break;
+    }
+  }
+
+  auto snapshot = std::make_shared<asset_snapshot>();
+
+  size_t region_size = std::max<size_t>(total_size, 1);
+  void *region = MAP_FAILED;
+  if (huge_pages) { // needs huge pages reserved, so fall back to transparent huge pages if this fails
+    const auto rounded_size = (region_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    region = mmap(nullptr, rounded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED) {
+      region_size = rounded_size;
+    }
+  }
+  if (region == MAP_FAILED) {
+    region = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+      utility::log_helper_function(std::string(__func__) + " ## " + std::to_string(__LINE__) + " ## " + std::string(__FILE__) + " ## Couldn't map " + std::to_string(region_size) + " bytes for " + root, true);
+      return nullptr;
+    }
+    if (huge_pages) {
+      madvise(region, region_size, MADV_HUGEPAGE);
+    }
+  }
+
+  snapshot->region = region;
+  snapshot->region_size = region_size;
+
+  std::vector<static_asset> assets{};
+  auto *write_head = static_cast<char *>(region);
+  const auto write_asset = [&write_head](const pending_asset &asset) -> static_asset {
+    std::memcpy(write_head, asset.headers.c_str(), asset.headers.size());
+    if (!copy_file(asset.filepath, write_head + asset.headers.size(), asset.file_size)) {
+      return {};
+    }
+
+    static_asset written{asset.filepath, write_head, asset.headers.size() + asset.file_size};
+    write_head += written.length;
+    return written;
+  };
+
+  for (const auto &asset : pending) {
+    auto written = write_asset(asset);
+    if (written.response != nullptr) {
+      assets.push_back(std::move(written));
+    }
+  }
+  if (!not_found_asset.filepath.empty()) {
+    snapshot->not_found = write_asset(not_found_asset);
+  }
+
+  mprotect(region, region_size, PROT_READ); // immutable from here on
+
+  // build the perfect hash, if some bucket can't be placed then grow the table and try again
+  const auto num_buckets = std::max<size_t>(assets.size() / KEYS_PER_BUCKET, 1);
+  auto num_slots = std::max<size_t>(assets.size() + assets.size() / 4, 1);
+
+  std::vector<std::vector<size_t>> buckets(num_buckets);
+  for (size_t i = 0; i < assets.size(); i++) {
+    buckets[asset_hash(assets[i].filepath, 0) % num_buckets].push_back(i);
+  }
+
+  std::vector<size_t> bucket_order(num_buckets);
+  for (size_t i = 0; i < num_buckets; i++) {
+    bucket_order[i] = i;
+  }
+  std::sort(bucket_order.begin(), bucket_order.end(), [&buckets](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); }); // biggest buckets are placed first
+
+  std::vector<uint32_t> displacements{};
+  std::vector<int64_t> slot_to_asset{};
+  bool placed_all = false;
+  while (!placed_all) {
+    displacements.assign(num_buckets, 0);
+    slot_to_asset.assign(num_slots, -1);
+    placed_all = true;
+
+    std::vector<size_t> positions{};
+    for (const auto bucket_idx : bucket_order) {
+      const auto &bucket = buckets[bucket_idx];
+      if (bucket.empty()) {
+        break; // sorted by size, so the rest are empty too
+      }
+
+      bool placed = false;
+      for (uint32_t seed = 1; seed < MAX_DISPLACEMENT_SEED && !placed; seed++) {
+        positions.clear();
+        placed = true;
+        for (const auto asset_idx : bucket) {
+          const auto position = asset_hash(assets[asset_idx].filepath, seed) % num_slots;
+          if (slot_to_asset[position] != -1 || std::find(positions.begin(), positions.end(), position) != positions.end()) {
+            placed = false;
+            break;
+          }
+          positions.push_back(position);
+        }
+
+        if (placed) {
+          displacements[bucket_idx] = seed;
+          for (size_t i = 0; i < bucket.size(); i++) {
+            slot_to_asset[positions[i]] = static_cast<int64_t>(bucket[i]);
+          }
+        }
+      }
+
+      if (!placed) {
+        placed_all = false;
+        num_slots *= 2;
+        break;
+      }
+    }
+  }
+
+  snapshot->displacements = std::move(displacements);
+  snapshot->slots.resize(num_slots);
+  for (size_t i = 0; i < num_slots; i++) {
+    if (slot_to_asset[i] != -1) {
+      snapshot->slots[i] = std::move(assets[slot_to_asset[i]]);
+    }
+  }
+
+  std::cout << "Preloaded " << assets.size() << " files from " << root << " (" << total_size << " bytes" << (huge_pages ? ", huge pages" : "") << ")\n";
+
+  return snapshot;
+}
+
+void static_asset_store::load(const std::string &root, const std::string &not_found_filepath, bool huge_pages) {
+  this->root = root;
+  this->not_found_filepath = not_found_filepath;
+  this->huge_pages = huge_pages;
+  loaded = true;
+
+  if (!reload()) {
+    utility::fatal_error("Couldn't preload the files in " + root);
+  }
+}
+
+auto static_asset_store::reload() -> bool {
+  if (!loaded) {
+    return false; // never loaded
+  }
+
+  auto new_snapshot = build();
+  if (!new_snapshot) {
+    return false; // keep serving the old snapshot
+  }
+
+  published.publish(std::move(new_snapshot));
+  return true;
+}
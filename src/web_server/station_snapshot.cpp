@@ -0,0 +1,12 @@
+#include "../header/web_server/station_snapshot.h"
+
+using namespace web_cache;
+
+auto station_snapshot::find(std::string_view name) const -> const station_state * {
+  for (const auto &station : stations) {
+    if (station.name == name) {
+      return &station;
+    }
+  }
+  return nullptr;
+}
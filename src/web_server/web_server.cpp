@@ -1,6 +1,8 @@
 #include "../header/web_server/web_server.h"
 #include <chrono>
 
+#include <curl/curl.h>
+
 using namespace web_server;
 
 template <server_type T>
@@ -9,76 +11,188 @@ bool basic_web_server<T>::instance_exists = false;
 template <server_type T>
 basic_web_server<T>::basic_web_server() {
   instance_exists = true;
-  utility::set_timerfd_interval(ws_ping_timerfd, WS_PING_INTERVAL); // the ping timer should go off every 30 seconds
 };
 
 template <server_type T>
-auto basic_web_server<T>::get_process(std::string &path, bool accept_bytes, const std::string &sec_websocket_key, int client_idx, std::string ip) -> bool {
-  char *path_temp = strdup(path.c_str());
-
-  char *saveptr = nullptr;
-  char *token = strtok_r(path_temp, "/", &saveptr);
-  std::string subdir = token != nullptr ? token : "";
-
-  if (subdir == "ws" && !sec_websocket_key.empty()) {
-    websocket_accept_read_cb(sec_websocket_key, path.substr(2), client_idx);
-    free(path_temp);
-    return true;
+void basic_web_server<T>::respond_to_http_request(int request_handle, bool is_GET, std::string path, bool accept_bytes, const std::string &sec_websocket_key, const std::string &ip, const std::string &sec_websocket_extensions) {
+  static CURL *curl = curl_easy_init();
+  char *output = curl_easy_unescape(curl, path.c_str(), (int)path.size(), nullptr);
+  path = output;
+  curl_free(output);
+
+  //get callback, if unsuccesful then 404
+  if (!is_GET || !get_process(path, accept_bytes, sec_websocket_key, request_handle, ip, sec_websocket_extensions)) {
+    send_file_request(request_handle, "public/404.html", false, HTTP_400_UNAUTHORISED); //sends 404 request, should be cached if possible
   }
+}
 
-  // not a websocket, so we deal with the path here
+template <server_type T>
+void basic_web_server<T>::http_write(int request_handle, std::vector<char> &&buff) {
+  if (is_ws_control_handle(request_handle)) {
+    ws_control_respond(request_handle, std::string_view(buff.data(), buff.size()));
+  } else if (http2::is_stream_handle(request_handle)) {
+    auto owner = std::make_shared<std::vector<char>>(std::move(buff));
+    http2_respond(request_handle, {owner, owner->data(), owner->size()});
+  } else {
+    tcp_server->write_connection(request_handle, std::move(buff));
+  }
+}
 
-  std::vector<std::string> subdirs{};
+template <server_type T>
+void basic_web_server<T>::http_write(int request_handle, char *buff, size_t length) {
+  if (http2::is_stream_handle(request_handle)) {
+    http2_respond(request_handle, {nullptr, buff, length}); // the buffer is locked in the cache until the stream is closed
+  } else {
+    tcp_server->write_connection(request_handle, buff, length);
+  }
+}
 
-  while ((token = strtok_r(nullptr, "/", &saveptr)) != nullptr) {
-    subdirs.emplace_back(token);
+template <server_type T>
+void basic_web_server<T>::http_write(int request_handle, tcp_tls_server::shared_buffer &&buff) {
+  if (is_ws_control_handle(request_handle)) {
+    ws_control_respond(request_handle, std::string_view(buff.buff, buff.length));
+  } else if (http2::is_stream_handle(request_handle)) {
+    http2_respond(request_handle, std::move(buff));
+  } else {
+    tcp_server->write_connection(request_handle, std::move(buff));
   }
-  free(path_temp);
+}
 
-  if (subdir == "skip_track" && subdirs.size() == 1) {
-    post_skip_request_to_program(client_idx, subdirs[0], ip); // so we expect the server to respond with true or false
-    return true;
+template <server_type T>
+auto basic_web_server<T>::http_client(int request_handle) -> tcp_client & {
+  if (http2::is_stream_handle(request_handle)) {
+    return http2_streams[http2::handle_to_stream_slot(request_handle)].client_data;
   }
+  return tcp_clients[request_handle];
+}
 
-  if (subdir == "audio_list" && subdirs.size() == 1) {
-    post_audio_list_req_to_program(client_idx, subdirs[0]); // so we expect the server to respond with the list for this station
-    return true;
+template <server_type T>
+auto basic_web_server<T>::get_process(std::string &path, bool accept_bytes, const std::string &sec_websocket_key, int client_idx, std::string ip, const std::string &sec_websocket_extensions) -> bool {
+  // to add an endpoint, add a handler and a route for it here
+  static constexpr auto routes = make_router<route_handler>({
+      {"ws/*", &basic_web_server::route_websocket},
+      {"skip_track/{station}", &basic_web_server::route_skip_track},
+      {"audio_list/{station}", &basic_web_server::route_audio_list},
+      {"audio_req/{station}/{track}", &basic_web_server::route_audio_req},
+      {"broadcast_metadata", &basic_web_server::route_broadcast_metadata},
+      {"station_list", &basic_web_server::route_station_list},
+      {"audio_queue/{station}", &basic_web_server::route_audio_queue},
+      {"listen/*", &basic_web_server::route_listen}, // the page can be listen/*, the JS side will negotiate what station to connect to
+      {"stream/{station}", &basic_web_server::route_stream},
+  });
+
+  http_request request{path, accept_bytes, sec_websocket_key, client_idx, ip, sec_websocket_extensions};
+  const auto split = split_path(path);
+
+  if (const auto *route = routes.find(split.first_segment, split.params.size())) {
+    return (this->*(route->handler))(request, split.params);
   }
 
-  if (subdir == "audio_req" && subdirs.size() == 2) {
-    post_audio_track_req_to_program(client_idx, subdirs[0], subdirs[1]); // { station, track name } request
-    return true;
+  return route_public_file(request);
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_websocket(http_request &request, const path_params & /*params*/) -> bool {
+  if (request.sec_websocket_key.empty()) { // not a websocket request, so it's just a path
+    return route_public_file(request);
   }
 
-  if (subdir == "broadcast_metadata" && subdirs.empty()) {
-    std::string metadata_str = default_plain_text_http_header;
-    metadata_str += "BROADCAST_INTERVAL_MS: ";
-    metadata_str += std::to_string(BROADCAST_INTERVAL_MS);
-    metadata_str += "\nSTART_TIME_S: ";
-    metadata_str += std::to_string(std::chrono::time_point_cast<std::chrono::seconds>(time_start).time_since_epoch().count());
+  websocket_accept_read_cb(request.sec_websocket_key, request.path.substr(2), request.client_idx, request.ip, request.sec_websocket_extensions);
+  return true;
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_skip_track(http_request &request, const path_params &params) -> bool {
+  post_skip_request_to_program(request.client_idx, std::string(params[0]), request.ip); // so we expect the server to respond with true or false
+  return true;
+}
 
-    std::vector<char> metadta{metadata_str.begin(), metadata_str.end()};
-    tcp_server->write_connection(client_idx, std::move(metadta));
+template <server_type T>
+auto basic_web_server<T>::route_audio_list(http_request &request, const path_params &params) -> bool {
+  const auto *station = get_stations()->find(params[0]);
+  if (station == nullptr) {
+    std::string response = default_plain_text_http_header + "NOT_FOUND";
+    http_write(request.client_idx, std::vector<char>{response.begin(), response.end()});
     return true;
   }
 
-  if (subdir == "station_list" && subdirs.empty()) {
-    post_server_list_request_to_program(client_idx);
+  http_write(request.client_idx, tcp_tls_server::shared_buffer{station->audio_list_response});
+  return true;
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_audio_req(http_request &request, const path_params &params) -> bool {
+  post_audio_track_req_to_program(request.client_idx, std::string(params[0]), std::string(params[1])); // { station, track name } request
+  return true;
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_broadcast_metadata(http_request &request, const path_params & /*params*/) -> bool {
+  std::string metadata_str = default_plain_text_http_header;
+  metadata_str += "BROADCAST_INTERVAL_MS: ";
+  metadata_str += std::to_string(BROADCAST_INTERVAL_MS);
+  metadata_str += "\nSTART_TIME_S: ";
+  metadata_str += std::to_string(std::chrono::time_point_cast<std::chrono::seconds>(time_start).time_since_epoch().count());
+
+  std::vector<char> metadta{metadata_str.begin(), metadata_str.end()};
+  http_write(request.client_idx, std::move(metadta));
+  return true;
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_station_list(http_request &request, const path_params & /*params*/) -> bool {
+  http_write(request.client_idx, tcp_tls_server::shared_buffer{get_stations()->station_list_response});
+  return true;
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_audio_queue(http_request &request, const path_params &params) -> bool {
+  const auto *station = get_stations()->find(params[0]);
+  if (station == nullptr) {
+    std::string response = default_plain_text_http_header + "FAILURE";
+    http_write(request.client_idx, std::vector<char>{response.begin(), response.end()});
     return true;
   }
 
-  if (subdir == "audio_queue" && subdirs.size() == 1) {
-    post_audio_queue_req_to_program(client_idx, subdirs[0]);
-    return true;
+  http_write(request.client_idx, tcp_tls_server::shared_buffer{station->audio_queue_response});
+  return true;
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_listen(http_request &request, const path_params & /*params*/) -> bool {
+  request.path = "";
+  return route_public_file(request);
+}
+
+template <server_type T>
+auto basic_web_server<T>::route_stream(http_request &request, const path_params &params) -> bool {
+  constexpr std::string_view extension = ".opus";
+  const auto name = params[0];
+  if (name.size() <= extension.size() || name.substr(name.size() - extension.size()) != extension) {
+    return false;
   }
 
-  if (subdir == "listen") { // the page can be listen/*, the JS side will negotiate what station to connect to
-    path = "";
+  const auto *station = get_stations()->find(name.substr(0, name.size() - extension.size()));
+  if (station == nullptr) {
+    return false;
+  }
+  if (http2::is_stream_handle(request.client_idx)) { // HTTP/2 responses are sent whole, and this never ends, see ogg_stream.h
+    http2_require_http1(request.client_idx);
+    return true;
   }
 
-  path = path.empty() ? "public/index.html" : "public/" + path;
+  // the header and first pages now, then the backlog from the central thread, and it's subscribed after that
+  tcp_clients[request.client_idx].stream_listener_id = ++next_stream_listener_id;
+  num_stream_listeners++;
+  http_write(request.client_idx, tcp_tls_server::shared_buffer{station->stream_header});
+  post_new_stream_client_to_program(station->id, request.client_idx);
+  return true;
+}
 
-  return static_cast<bool>(send_file_request(client_idx, path, accept_bytes, HTTP_200_OK));
+template <server_type T>
+auto basic_web_server<T>::route_public_file(http_request &request) -> bool {
+  request.path = request.path.empty() ? "public/index.html" : "public/" + request.path;
+  return static_cast<bool>(send_file_request(request.client_idx, request.path, request.accept_bytes, HTTP_200_OK));
 }
 
 template <server_type T>
@@ -103,53 +217,38 @@ auto basic_web_server<T>::is_valid_http_req(const char *buff, int length) -> boo
 }
 
 template <server_type T>
-auto basic_web_server<T>::get_content_type(const std::string &filepath) -> std::string {
-  char *file_extension_data = (char *)filepath.c_str();
-  std::string file_extension;
-  char *saveptr = nullptr;
-  while ((file_extension_data = strtok_r(file_extension_data, ".", &saveptr)) != nullptr) {
-    file_extension = file_extension_data;
-    file_extension_data = nullptr;
+auto basic_web_server<T>::get_static_assets() -> const asset_snapshot * {
+  auto &store = static_asset_store::instance();
+  const auto generation = store.current_generation();
+  if (generation != static_assets_generation) { // only load it again when a new snapshot has been published
+    static_assets = store.snapshot();
+    static_assets_generation = generation;
   }
+  return static_assets.get();
+}
 
-  if (file_extension == "html" || file_extension == "htm") {
-    return "Content-Type: text/html\r\n";
-  }
-  if (file_extension == "css") {
-    return "Content-Type: text/css\r\n";
-  }
-  if (file_extension == "js") {
-    return "Content-Type: text/javascript\r\n";
-  }
-  if (file_extension == "opus") {
-    return "Content-Type: audio/opus\r\n";
-  }
-  if (file_extension == "mp3") {
-    return "Content-Type: audio/mpeg\r\n";
-  }
-  if (file_extension == "mp4") {
-    return "Content-Type: video/mp4\r\n";
-  }
-  if (file_extension == "gif") {
-    return "Content-Type: image/gif\r\n";
-  }
-  if (file_extension == "png") {
-    return "Content-Type: image/png\r\n";
-  }
-  if (file_extension == "jpg" || file_extension == "jpeg") {
-    return "Content-Type: image/jpeg\r\n";
-  }
-  if (file_extension == "txt") {
-    return "Content-Type: text/plain\r\n";
-  }
-  if (file_extension == "wasm") {
-    return "Content-Type: application/wasm\r\n";
+template <server_type T>
+auto basic_web_server<T>::get_stations() -> const station_snapshot * {
+  auto &store = station_snapshot_store::instance();
+  const auto generation = store.current_generation();
+  if (generation != stations_generation) { // the central thread publishes the first snapshot before any server threads start
+    stations = store.snapshot();
+    stations_generation = generation;
   }
-  return "Content-Type: application/octet-stream\r\n";
+  return stations.get();
 }
 
 template <server_type T>
 auto basic_web_server<T>::send_file_request(int client_idx, const std::string &filepath, bool accept_bytes, int response_code) -> bool {
+  if (!accept_bytes) { // ranged requests have different headers, so they go the normal route
+    const auto *assets = get_static_assets();
+    const auto *asset = assets != nullptr ? assets->find(filepath, response_code != HTTP_200_OK) : nullptr;
+    if (asset != nullptr) { // pre-rendered response, the snapshot is kept alive until the write is done
+      http_write(client_idx, tcp_tls_server::shared_buffer{static_assets, asset->response, asset->length});
+      return true;
+    }
+  }
+
   const auto file_fd = open(filepath.c_str(), O_RDONLY);
 
   std::string header_first_line{};
@@ -171,7 +270,7 @@ auto basic_web_server<T>::send_file_request(int client_idx, const std::string &f
   const auto content_type = get_content_type(filepath);
 
   const auto cache_data =
-      web_cache.fetch_item(filepath, client_idx, tcp_clients[client_idx]);
+      web_cache.fetch_item(filepath, client_idx, http_client(client_idx));
 
   std::string headers;
   if (accept_bytes) {
@@ -198,9 +297,9 @@ auto basic_web_server<T>::send_file_request(int client_idx, const std::string &f
   std::memcpy(&send_buffer[0], headers.c_str(), headers.size());
 
   if (cache_data.found) {
-    tcp_server->write_connection(client_idx, cache_data.buff, cache_data.size);
+    http_write(client_idx, cache_data.buff, cache_data.size);
   } else {
-    tcp_clients[client_idx].last_requested_read_filepath = filepath;
+    http_client(client_idx).last_requested_read_filepath = filepath;
     // so that when the file is read, it will be stored with the correct file path
     tcp_server->custom_read_req(file_fd, file_size, true, client_idx, std::move(send_buffer), headers.size()); // true is for using custom_read_req_continued
   }
@@ -211,6 +310,7 @@ auto basic_web_server<T>::send_file_request(int client_idx, const std::string &f
 template <server_type T>
 void basic_web_server<T>::set_tcp_server(tcp_tls_server::server<T> *server) {
   tcp_server = server;
+  load.reuseport_index.store(tcp_server->reuseport_index(), std::memory_order_release);
   tcp_server->custom_read_req(web_cache.inotify_fd, inotify_read_size);
   // always read from inotify_fd - we only read size of event, since we monitor files
 }
@@ -221,24 +321,31 @@ void basic_web_server<T>::new_tcp_client(int client_idx) {
     tcp_clients.resize(client_idx + 1);
   }
   tcp_clients[client_idx] = tcp_client();
+  tcp_server->set_timer(client_idx, tcp_tls_server::timer_type::HEADER, tcp_tls_server::HEADER_TIMEOUT_MS); // slow or empty requests are closed
 }
 
 template <server_type T>
 void basic_web_server<T>::kill_client(int client_idx) {
   // be wary of this, I don't think this will cause issues, but maybe it's possible that a new websocket client is at that index already and could be an issue?
   web_cache.finished_with_item(client_idx, tcp_clients[client_idx]);
+  http2_kill_session(client_idx);
 
   int ws_client_idx = tcp_clients[client_idx].ws_client_idx;
   all_websocket_connections.erase(ws_client_idx); // connection definitely closed now
 
-  tcp_clients[client_idx] = tcp_client(); // reset any info about the client
+  if (ws_client_idx != -1 && websocket_clients[ws_client_idx].ingest_authorised) { // a live source, so the station goes back to its playlist
+    post_ingest_to_program(ws_client_idx, {}, true);
+    websocket_clients[ws_client_idx].ingest_authorised = false;
+  }
 
-  for (int i = 0; i < broadcast_ws_clients_tcp_client_idxs.size(); i++) {
-    if (broadcast_ws_clients_tcp_client_idxs[i].count(client_idx) != 0U) {
-      post_radio_client_left_to_server(i); // client has left this channel
-      broadcast_ws_clients_tcp_client_idxs[i].erase(client_idx);
-    }
+  while (!tcp_clients[client_idx].channels.empty()) { // only the channels it's subscribed to
+    unsubscribe_client(tcp_clients[client_idx].channels.back(), client_idx);
   }
+  if (tcp_clients[client_idx].stream_listener_id != 0) {
+    num_stream_listeners--;
+  }
+
+  tcp_clients[client_idx] = tcp_client(); // reset any info about the client
 
   if (active_websocket_connections_client_idxs.count(ws_client_idx) != 0U) {
     active_websocket_connections_client_idxs.erase(client_idx);
@@ -246,6 +353,80 @@ void basic_web_server<T>::kill_client(int client_idx) {
   }
 }
 
+template <server_type T>
+void basic_web_server<T>::unsubscribe_client(int channel_id, int client_idx) {
+  auto &channels = tcp_clients[client_idx].channels;
+  const auto channel = std::find(channels.begin(), channels.end(), channel_id);
+  if (channel == channels.end()) {
+    return;
+  }
+  *channel = channels.back();
+  channels.pop_back();
+  broadcast_set(channel_id, client_idx).erase(client_idx);
+  load.subscriptions.store(load.subscriptions.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+  const auto kind = channel_kind_of(channel_id);
+  if (is_listener_channel(kind) || is_tagged_channel(kind)) {
+    post_radio_client_left_to_server(channel_id); // the listener count (or the number wanting tagged chunks) is decremented
+  }
+}
+
+template <server_type T>
+void basic_web_server<T>::read_broadcasts(uint64_t up_to) {
+  broadcast_ring::instance().consume(broadcast_reader, up_to, [&](const broadcast_entry &entry) { write_broadcast(entry); });
+}
+
+template <server_type T>
+void basic_web_server<T>::read_marked_broadcasts() {
+  read_broadcasts(marked_broadcasts);
+  bool unread = broadcast_ring::instance().unread(broadcast_reader);
+  for (int id = 0; size_t(id) < station_readers.size(); id++) {
+    read_station_broadcasts(id, marked_station_broadcasts[id]);
+    unread = unread || broadcast_ring::station(id).unread(station_readers[id]);
+  }
+  if (unread) {
+    notify_broadcasts();
+  }
+}
+
+template <server_type T>
+void basic_web_server<T>::read_station_broadcasts(int server_id, uint64_t up_to) {
+  for (int id = 0; size_t(id) < station_readers.size(); id++) { // there are none without DIRECT_BROADCASTS
+    if (server_id == -1 || server_id == id) {
+      broadcast_ring::station(id).consume(station_readers[id], up_to, [&](const broadcast_entry &entry) { write_broadcast(entry); });
+    }
+  }
+}
+
+template <server_type T>
+void basic_web_server<T>::write_broadcast(const broadcast_entry &entry) {
+  if (active_websocket_connections_client_idxs.empty() && num_stream_listeners == 0) { // only even process this bit once someone has connected
+    return;
+  }
+
+  auto broadcast_clients_data = get_broadcast_set_data(entry.channel_id);
+  auto deflate_clients_data = get_broadcast_set_data(entry.channel_id, true);
+
+  // each write holds a reference to the frame, it's freed once the last one is done (and the ring has let go of it)
+  // listeners which have fallen too far behind have their oldest unsent chunks dropped, rather than queueing up without limit
+  // queue/list updates are never dropped though
+  const auto max_queued = is_chunk_channel(channel_kind_of(entry.channel_id)) ? max_queued_chunks : 0;
+  // fragmented frames are written a fragment at a time, so pongs and pings can go in between
+  if (channel_kind_of(entry.channel_id) == channel_kind::ogg_stream) { // an HTTP chunk, not a websocket frame
+    broadcast_fragments.assign(1, entry.frame);
+  } else {
+    split_ws_fragments(entry.frame, broadcast_fragments);
+  }
+  auto num_dropped = tcp_server->broadcast_message(broadcast_clients_data.begin, broadcast_clients_data.end, broadcast_clients_data.size, broadcast_fragments.data(), broadcast_fragments.size(), max_queued);
+  if (deflate_clients_data.size > 0) { // uncompressed frames are still valid for these, for anything which isn't compressed
+    split_ws_fragments(entry.deflated_frame.length > 0 ? entry.deflated_frame : entry.frame, broadcast_fragments);
+    num_dropped += tcp_server->broadcast_message(deflate_clients_data.begin, deflate_clients_data.end, deflate_clients_data.size, broadcast_fragments.data(), broadcast_fragments.size(), max_queued);
+  }
+  if (num_dropped > 0) {
+    post_broadcast_chunks_dropped_to_program(entry.channel_id, num_dropped);
+  }
+}
+
 template <server_type T>
 void basic_web_server<T>::close_connection(int client_idx) {
   kill_client(client_idx); // destroy any data related to this request
@@ -1,20 +1,29 @@
 #include "../header/web_server/web_server.h"
+#include "../header/web_server/ws_unmask.h"
+#include <openssl/crypto.h>
 #include <openssl/sha.h>
 
 using namespace web_server;
 
 template <server_type T>
-void basic_web_server<T>::websocket_accept_read_cb(const std::string &sec_websocket_key, const std::string &path, int client_idx) {
+void basic_web_server<T>::websocket_accept_read_cb(const std::string &sec_websocket_key, const std::string &path, int client_idx, const std::string &ip, const std::string &sec_websocket_extensions) {
   const std::string accept_header_value = get_accept_header_value(sec_websocket_key);
-  const auto resp = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + accept_header_value + "\r\n\r\n";
+  const bool deflate = permessage_deflate && accepts_permessage_deflate(sec_websocket_extensions);
+  const auto resp = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + accept_header_value + "\r\n" +
+                    (deflate ? permessage_deflate_response_header : "") + "\r\n";
 
   std::vector<char> send_buffer(resp.size());
   std::memcpy(&send_buffer[0], resp.c_str(), resp.size());
   tcp_server->write_connection(client_idx, std::move(send_buffer));
 
+  next_ping_offset = (next_ping_offset + WS_PING_SPREAD_STEP) % WS_PING_INTERVAL;
+  tcp_server->set_timer(client_idx, tcp_tls_server::timer_type::PING, next_ping_offset + tcp_tls_server::TIMER_TICK_MS);
+
   int ws_client_idx = new_ws_client(client_idx); //sets this index up as a new client
   tcp_clients[client_idx].ws_client_idx = ws_client_idx;
   auto ws_client_id = websocket_clients[ws_client_idx].id;
+  websocket_clients[ws_client_idx].ip = ip;
+  websocket_clients[ws_client_idx].deflate = deflate; // before it's subscribed to anything, since that decides which frames it gets
 
   std::vector<std::string> subdirs{};
 
@@ -30,7 +39,15 @@ void basic_web_server<T>::websocket_accept_read_cb(const std::string &sec_websoc
 
   // we only accept radio connections via websocket in this case
   if (subdirs.size() == 3 && subdirs[0] == "radio") { // we don't keep a record of valid stations on this thread, ask the central thread
+    websocket_clients[ws_client_idx].station = subdirs[1];
+    const auto channel = parse_radio_channel(subdirs[1] + "/" + subdirs[2]);
+    const auto *station = get_stations()->find(subdirs[1]);
+    websocket_clients[ws_client_idx].pending_channels.push_back(channel.valid && station != nullptr ? broadcast_channel_id(station->id, channel.kind) : -1);
     post_new_radio_client_to_program(subdirs[1] + "/" + subdirs[2], ws_client_idx, ws_client_id);
+  } else if (subdirs.size() == 1 && subdirs[0] == "mux") { // subscribes to channels with control messages, see ws_control.cpp
+    return;
+  } else if (subdirs.size() == 2 && subdirs[0] == "ingest" && !ingest_key.empty()) { // a live source, it has to send the key before anything else
+    websocket_clients[ws_client_idx].ingest_station = subdirs[1];
   } else {
     websocket_write(ws_client_idx, make_ws_frame("INVALID_ENDPOINT", websocket_non_control_opcodes::text_frame));
     close_ws_connection_req(ws_client_idx);
@@ -40,64 +57,108 @@ void basic_web_server<T>::websocket_accept_read_cb(const std::string &sec_websoc
 template <server_type T>
 void basic_web_server<T>::websocket_process_read_cb(int client_idx, char *buffer, int length) { //we assume that the tcp server has been set by this point
   auto ws_client_idx = tcp_clients[client_idx].ws_client_idx;
-  std::vector<std::vector<char>> frames{};
-  auto frame_pair = get_ws_frames(buffer, length, ws_client_idx);
-
   auto &client_data = websocket_clients[ws_client_idx];
 
-  bool closed = false;
-  if (frame_pair.first == 1) { //if frame_pair.first == -1, then we're trying to immediately close
-    frames = std::move(frame_pair.second);
-    //by this point the frame has definitely been fully received
-
-    std::vector<char> frame_contents{};
-
-    for (auto &frame : frames) {
-      if (!frame.empty()) {
-        auto processed_data = decode_websocket_frame(std::move(frame)); //the frame is decoded then returned
-
-        frame_contents.clear();
-        //for now finishes and prints last 200 bytes
-        if (processed_data.first == 1) { // 1 is to indicate that it's done
-          if (!client_data.websocket_frames.empty()) {
-            auto *vec_member = &client_data.websocket_frames;
-            vec_member->insert(vec_member->end(), processed_data.second.begin(), processed_data.second.end());
-            frame_contents = std::move(*vec_member);
-            client_data.websocket_frames = {};
-          } else {
-            frame_contents = std::move(processed_data.second);
-          }
-        } else if (processed_data.first == -2) {
-          auto *vec_member = &client_data.websocket_frames;
-          vec_member->insert(vec_member->begin(), processed_data.second.begin(), processed_data.second.end());
-        } else if (processed_data.first == -3) { //close opcode
-          client_data.currently_writing++;
-          //we're going to close immediately after, so make sure the program knows there is this write op happening
-          closed = close_ws_connection_req(ws_client_idx);
-        } else if (processed_data.first == 2) { //ping opcode
-          std::string body_data((const char *)&processed_data.second[0], processed_data.second.size());
-          auto data = make_ws_frame(body_data, websocket_non_control_opcodes::pong);
-          websocket_write(ws_client_idx, std::move(data));
-        }
+  if (!get_ws_frames(buffer, length, ws_client_idx, received_ws_frames)) { // invalid or too large
+    close_ws_connection_req(ws_client_idx);
+    return;
+  }
+
+  for (const auto &frame : received_ws_frames) {
+    std::string_view frame_contents{};
+
+    if (frame.opcode == websocket_non_control_opcodes::close_connection) {
+      client_data.currently_writing++;
+      //we're going to close immediately after, so make sure the program knows there is this write op happening
+      close_ws_connection_req(ws_client_idx);
+      return;
+    }
+    if (frame.opcode == websocket_non_control_opcodes::ping) {
+      websocket_write(ws_client_idx, make_ws_frame(std::string(frame.payload, frame.length), websocket_non_control_opcodes::pong), tcp_tls_server::write_priority::CONTROL);
+      continue;
+    }
+    if (frame.opcode == websocket_non_control_opcodes::pong) {
+      continue;
+    }
+
+    auto &message = client_data.websocket_frames;
+    if (message.size() + frame.length > ws_max_payload_size) { // the message as a whole is limited too
+      close_ws_connection_req(ws_client_idx);
+      return;
+    }
+
+    if (frame.opcode != 0) { // continuation frames have an opcode of 0, the message has the opcode of its first frame
+      client_data.message_opcode = frame.opcode;
+      client_data.message_compressed = frame.compressed;
+      if (frame.compressed && !client_data.deflate) { // it's only allowed if permessage-deflate was negotiated
+        close_ws_connection_req(ws_client_idx);
+        return;
       }
+    }
 
-      if (!frame_contents.empty()) {
-        /******************************************/
-        // WEBSOCKET APPLICATION CODE //
-        /*****************************************/
+    if (!frame.fin) { // put this in a pending larger buffer of decoded data
+      message.insert(message.end(), frame.payload, frame.payload + frame.length);
+      continue;
+    }
 
-        // put the code for interacting with websockets here
+    if (!message.empty()) { // this is the final frame of a fragmented message
+      message.insert(message.end(), frame.payload, frame.payload + frame.length);
+      frame_contents = std::string_view(message.data(), message.size());
+    } else {
+      frame_contents = std::string_view(frame.payload, frame.length);
+    }
 
-        /****************************************/
+    if (client_data.message_compressed) { // each message is compressed on its own, since there's no context takeover
+      if (!inflate_message(frame_contents, inflated_message, ws_max_payload_size)) {
+        close_ws_connection_req(ws_client_idx);
+        return;
       }
+      frame_contents = std::string_view(inflated_message.data(), inflated_message.size());
+    }
+
+    if (!frame_contents.empty()) {
+      /******************************************/
+      // WEBSOCKET APPLICATION CODE //
+      /*****************************************/
 
-      if (closed) {
-        break;
+      if (!client_data.ingest_station.empty()) {
+        if (!websocket_ingest_cb(ws_client_idx, frame_contents, client_data.message_opcode == websocket_non_control_opcodes::binary_frame)) {
+          return; // the wrong key, it's being closed
+        }
+      } else if (client_data.message_opcode == websocket_non_control_opcodes::text_frame) {
+        // text frames are control messages for the station (skips, track requests, the queue and the list), see ws_control.cpp
+        websocket_control_cb(ws_client_idx, frame_contents);
       }
+
+      /****************************************/
     }
+
+    message.clear();
   }
 }
 
+template <server_type T>
+auto basic_web_server<T>::websocket_ingest_cb(int ws_client_idx, std::string_view message, bool binary) -> bool {
+  auto &client_data = websocket_clients[ws_client_idx];
+  if (active_websocket_connections_client_idxs.count(client_data.client_idx) == 0U) {
+    return false; // already being closed, the central thread turned it away
+  }
+
+  if (!client_data.ingest_authorised) { // the first message is the key, as text, anything else and it's closed
+    client_data.ingest_authorised = !binary && message.size() == ingest_key.size() && CRYPTO_memcmp(message.data(), ingest_key.data(), message.size()) == 0;
+    if (!client_data.ingest_authorised) {
+      websocket_write(ws_client_idx, make_ws_frame("INVALID_KEY", websocket_non_control_opcodes::text_frame));
+      close_ws_connection_req(ws_client_idx);
+    }
+    return client_data.ingest_authorised;
+  }
+
+  if (binary) { // whatever size the source sends it in, pages can be split across messages
+    post_ingest_to_program(ws_client_idx, std::vector<char>(message.begin(), message.end()));
+  }
+  return true;
+}
+
 template <server_type T>
 auto basic_web_server<T>::websocket_process_write_cb(int client_idx) -> bool {
   auto ws_client_idx = tcp_clients[client_idx].ws_client_idx;
@@ -109,10 +170,10 @@ auto basic_web_server<T>::websocket_process_write_cb(int client_idx) -> bool {
 }
 
 template <server_type T>
-void basic_web_server<T>::websocket_write(int ws_client_idx, std::vector<char> &&buff) {
+void basic_web_server<T>::websocket_write(int ws_client_idx, std::vector<char> &&buff, tcp_tls_server::write_priority priority) {
   auto &client_data = websocket_clients[ws_client_idx];
   client_data.currently_writing++;
-  tcp_server->write_connection(client_data.client_idx, std::move(buff));
+  tcp_server->write_connection(client_data.client_idx, std::move(buff), priority);
 }
 
 template <server_type T>
@@ -133,6 +194,17 @@ auto basic_web_server<T>::new_ws_client(int client_idx) -> int {
   }
 
   websocket_clients[index].client_idx = client_idx; // for the tcp layer sockets
+  websocket_clients[index].station.clear();
+  websocket_clients[index].pending_control_requests = 0;
+  websocket_clients[index].pending_channels.clear();
+  websocket_clients[index].ingest_station.clear();
+  websocket_clients[index].ingest_authorised = false;
+  websocket_clients[index].deflate = false;
+  websocket_clients[index].message_compressed = false;
+
+  auto &parse_state = websocket_clients[index].parse_state; // the buffers are kept from the last client in this slot
+  parse_state.partial_frame.clear();
+  parse_state.frame_length = 0;
 
   all_websocket_connections.insert(index); // stores ws_client_idx
   active_websocket_connections_client_idxs.insert(client_idx);
@@ -155,16 +227,49 @@ auto basic_web_server<T>::get_accept_header_value(std::string input) -> std::str
 }
 
 template <server_type T>
-auto basic_web_server<T>::get_ws_frame_length(const char *buffer) -> ulong {
-  constexpr uint32_t MAX_SMALL_PACKET = 127;
-
-  ulong packet_length = buffer[1] & 0x7f;
-  if (packet_length == MAX_SMALL_PACKET) {
-    packet_length = ntohs(*((u_short *)&((uchar *)buffer)[2])) + 2; //the 2 bytes extra needed to store the length are added
-  } else if (packet_length == 127) {
-    packet_length = be64toh(*((u_long *)&((uchar *)buffer)[2])) + 8; //the 8 bytes extra needed to store the length are added, be64toh used because ntohl is 32 bit
+auto basic_web_server<T>::get_ws_frame_length(const char *buffer, size_t length) const -> int64_t {
+  if (length < 2) {
+    return 0;
+  }
+
+  const auto *data = reinterpret_cast<const uchar *>(buffer);
+  const uint opcode = data[0] & 0xf;
+  const bool mask = (data[1] & 0x80) == 0x80;
+  if (!mask) {
+    return -1; //mask must be set
+  }
+  if ((data[0] & 0x30) != 0 || ((data[0] & 0x40) != 0 && ((opcode & 0x8) != 0 || opcode == 0))) {
+    return -1; //RSV2 and RSV3 aren't used, RSV1 (compressed) is only allowed on the first frame of a data message
+  }
+
+  size_t header_length = 2;
+  uint64_t payload_length = data[1] & 0x7f;
+  if (payload_length == 126) {
+    header_length += 2;
+    if (length < header_length) {
+      return 0;
+    }
+    uint16_t extended_length{};
+    std::memcpy(&extended_length, &data[2], sizeof(extended_length));
+    payload_length = ntohs(extended_length);
+  } else if (payload_length == 127) {
+    header_length += 8;
+    if (length < header_length) {
+      return 0;
+    }
+    uint64_t extended_length{};
+    std::memcpy(&extended_length, &data[2], sizeof(extended_length));
+    payload_length = be64toh(extended_length); //be64toh used because ntohl is 32 bit
+  }
+
+  if ((opcode & 0x8) != 0 && payload_length > WS_MAX_CONTROL_PAYLOAD_SIZE) {
+    return -1; //control frames can't be longer than this
   }
-  return packet_length + 6; // +6 bytes for the header data
+  if (payload_length > ws_max_payload_size) {
+    return -1; //also rejects lengths with the most significant bit set, which aren't allowed
+  }
+
+  return static_cast<int64_t>(header_length + 4 + payload_length); // +4 bytes for the masking key
 }
 
 template <server_type T>
@@ -209,6 +314,98 @@ auto basic_web_server<T>::make_ws_frame(const std::string &packet_msg, websocket
   return data;
 }
 
+namespace {
+auto ws_header_size(size_t payload_length) -> size_t {
+  if (payload_length >= 65536) {
+    return 10;
+  }
+  return payload_length >= 126 ? 4 : 2;
+}
+
+void write_ws_header(uchar *header, uchar first_byte, size_t payload_length) { // header has room for ws_header_size(payload_length)
+  header[0] = first_byte;
+  const auto header_size = ws_header_size(payload_length);
+  if (header_size == 2) {
+    header[1] = payload_length;
+  } else if (header_size == 4) {
+    header[1] = 126;
+    const uint16_t length = htons(payload_length);
+    std::memcpy(&header[2], &length, sizeof(length));
+  } else {
+    header[1] = 127;
+    const uint64_t length = htobe64(payload_length);
+    std::memcpy(&header[2], &length, sizeof(length));
+  }
+}
+} // namespace
+
+auto web_server::make_shared_ws_frame(std::string_view payload, websocket_non_control_opcodes opcode, bool compressed, size_t fragment_size) -> tcp_tls_server::shared_buffer {
+  if (fragment_size > 0 && payload.size() > fragment_size) { // the fragments go one after the other, it's still a valid stream of frames written as a whole
+    const auto num_fragments = (payload.size() + fragment_size - 1) / fragment_size;
+    const auto last_fragment_size = payload.size() - (num_fragments - 1) * fragment_size;
+
+    auto frame = std::make_shared<std::vector<char>>((num_fragments - 1) * (ws_header_size(fragment_size) + fragment_size) + ws_header_size(last_fragment_size) + last_fragment_size);
+    auto *position = reinterpret_cast<uchar *>(frame->data());
+    for (size_t i = 0; i < num_fragments; i++) {
+      const bool last = i == num_fragments - 1;
+      const auto length = last ? last_fragment_size : fragment_size;
+      const uchar first_byte = (last ? 128 : 0) | (i == 0 ? (compressed ? 64 : 0) | opcode : 0); // continuation frames have an opcode of 0, RSV1 is only on the first
+      write_ws_header(position, first_byte, length);
+      position += ws_header_size(length);
+      std::memcpy(position, payload.data() + i * fragment_size, length);
+      position += length;
+    }
+    return tcp_tls_server::shared_buffer{frame, frame->data(), frame->size()};
+  }
+
+  const auto header_size = ws_header_size(payload.size());
+
+  auto frame = std::make_shared<std::vector<char>>(WS_MAX_SERVER_HEADER_SIZE + payload.size());
+  std::memcpy(frame->data() + WS_MAX_SERVER_HEADER_SIZE, payload.data(), payload.size());
+
+  auto *header = reinterpret_cast<uchar *>(frame->data() + WS_MAX_SERVER_HEADER_SIZE - header_size); //right up against the payload
+  write_ws_header(header, 128 | (compressed ? 64 : 0) | opcode, payload.size()); //a single frame, so set the fin bit, and the opcode, and RSV1 if it's compressed
+
+  return tcp_tls_server::shared_buffer{frame, reinterpret_cast<const char *>(header), header_size + payload.size()};
+}
+
+auto web_server::make_shared_deflated_ws_frame(std::string_view payload, websocket_non_control_opcodes opcode, size_t fragment_size) -> tcp_tls_server::shared_buffer {
+  thread_local std::string compressed{}; // reused, the frame has its own copy
+  if (!deflate_message(payload, compressed)) {
+    return {};
+  }
+  return make_shared_ws_frame(compressed, opcode, true, fragment_size);
+}
+
+void web_server::split_ws_fragments(const tcp_tls_server::shared_buffer &frame, std::vector<tcp_tls_server::shared_buffer> &fragments) {
+  fragments.clear();
+  if (frame.length == 0 || (static_cast<uchar>(frame.buff[0]) & 128) != 0) { // a single frame, the usual case
+    fragments.push_back(frame);
+    return;
+  }
+
+  size_t offset = 0;
+  while (offset + 2 <= frame.length) {
+    const auto *header = reinterpret_cast<const uchar *>(frame.buff + offset);
+    uint64_t length = header[1] & 127;
+    size_t header_size = 2;
+    if (length == 126) {
+      uint16_t extended_length{};
+      std::memcpy(&extended_length, &header[2], sizeof(extended_length));
+      length = ntohs(extended_length);
+      header_size = 4;
+    } else if (length == 127) {
+      uint64_t extended_length{};
+      std::memcpy(&extended_length, &header[2], sizeof(extended_length));
+      length = be64toh(extended_length);
+      header_size = 10;
+    }
+
+    fragments.push_back({frame.owner, frame.buff + offset, header_size + length}); // each one shares the same buffer
+    offset += header_size + length;
+  }
+}
+
 template <server_type T>
 bool basic_web_server<T>::close_ws_connection_req(int ws_client_idx, bool client_already_closed) {
   auto &client_data = websocket_clients[ws_client_idx];
@@ -238,120 +435,98 @@ auto basic_web_server<T>::close_ws_connection_potential_confirm(int ws_client_id
 }
 
 template <server_type T>
-std::pair<int, std::vector<char>> basic_web_server<T>::decode_websocket_frame(std::vector<char> &&data) {
-  const auto *data_ptr = reinterpret_cast<uchar *>(&data[0]);
-  const uint fin = (data_ptr[0] & 0x80) == 0x80;
-  const uint opcode = data_ptr[0] & 0xf;
-  const uint mask = (data_ptr[1] & 0x80) == 0x80;
-
-  if (!mask)
-    return {-1, {}}; //mask must be set
-  if (opcode == 0x8)
-    return {-3, {}}; //the close opcode
-  if (opcode == 0xA)
-    return {3, {}}; //the pong opcode
-
-  int offset = 0;
-
-  ulong length = data_ptr[1] & 0x7f;
-  if (length == 126) {
-    offset = 2;
-    length = ntohs(*((u_short *)&data_ptr[2]));
-  } else if (length == 127) {
-    offset = 8;
-    length = ntohs(*((u_long *)&data_ptr[2]));
+auto basic_web_server<T>::decode_ws_frame(char *frame, size_t frame_length) -> ws_frame {
+  const auto *data = reinterpret_cast<const uchar *>(frame);
+
+  ws_frame decoded{};
+  decoded.fin = (data[0] & 0x80) == 0x80;
+  decoded.compressed = (data[0] & 0x40) == 0x40;
+  decoded.opcode = data[0] & 0xf;
+
+  size_t header_length = 2;
+  if ((data[1] & 0x7f) == 126) {
+    header_length += 2;
+  } else if ((data[1] & 0x7f) == 127) {
+    header_length += 8;
   }
 
-  const std::vector<char> masking_key{data[2 + offset], data[3 + offset], data[4 + offset], data[5 + offset]};
+  std::array<char, 4> masking_key{};
+  std::memcpy(masking_key.data(), &frame[header_length], masking_key.size());
+  header_length += masking_key.size();
 
-  for (int i = 6 + offset; i < data.size(); i++) {
-    data[i - (6 + offset)] = data_ptr[i] ^ masking_key[(i - (6 + offset)) % 4];
-  }
+  decoded.payload = frame + header_length;
+  decoded.length = frame_length - header_length;
 
-  data.resize(data.size() - (6 + offset));
+  unmask_ws_payload(decoded.payload, decoded.length, masking_key.data());
 
-  if (opcode == websocket_non_control_opcodes::ping)
-    return {2, data}; //the ping opcode
-  if (!fin)
-    return {-2, data}; //fin bit not set, so put this in a pending larger buffer of decoded data
-
-  return {1, data}; //succesfully decoded, and is the final frame
+  return decoded;
 }
 
 template <server_type T>
-std::pair<int, std::vector<std::vector<char>>> basic_web_server<T>::get_ws_frames(char *buffer, int length, int ws_client_idx) {
-  std::vector<std::vector<char>> frames;
-
-  int remaining_length = length;
+auto basic_web_server<T>::get_ws_frames(char *buffer, size_t length, int ws_client_idx, std::vector<ws_frame> &frames) -> bool {
+  auto &state = websocket_clients[ws_client_idx].parse_state;
+  size_t offset = 0;
 
-  auto &client_data = websocket_clients[ws_client_idx];
+  frames.clear();
 
-  if (client_data.receiving_data.buffer.size() > 0) { //if there is already pending data
-    auto *pending_item = &client_data.receiving_data;
-
-    if (pending_item->length == -1) { //assuming the received buffer and the pending buffer are at least 10 bytes long
-      if (pending_item->buffer.size() + length < 10) {
-        close_ws_connection_req(ws_client_idx); //doesn't deal with such small reads - just close the connection
-        return {-1, {}};
-      } else {
-        std::vector<char> temp_buffer(10); //we only need first 10 bytes for length
-        temp_buffer.insert(temp_buffer.begin(), pending_item->buffer.begin(), pending_item->buffer.end());
-        temp_buffer.insert(temp_buffer.begin(), buffer, buffer + (10 - pending_item->buffer.size()));
-        pending_item->length = get_ws_frame_length(&temp_buffer[0]);
-      }
-    }
+  if (!state.partial_frame.empty()) { //if there is already pending data, finish that frame first
+    auto &partial = state.partial_frame;
 
-    const auto required_length = pending_item->length - pending_item->buffer.size();
+    if (state.frame_length == 0) { //only take as much as could be the header, to get the length
+      const auto header_bytes = std::min(length, WS_MAX_HEADER_SIZE - std::min(partial.size(), WS_MAX_HEADER_SIZE));
+      const auto previous_size = partial.size();
+      partial.insert(partial.end(), buffer, buffer + header_bytes);
 
-    if (required_length < length) { //more than enough data
-      remaining_length = length - required_length;
-      pending_item->buffer.insert(pending_item->buffer.end(), buffer, buffer + required_length);
-      frames.push_back(std::move(pending_item->buffer));
+      state.frame_length = get_ws_frame_length(partial.data(), partial.size());
+      if (state.frame_length < 0) {
+        return false;
+      }
+      if (state.frame_length == 0) {
+        return true; //still not enough for the header, we've used up all of the data
+      }
 
-      char *remaining_data = nullptr;
-      utility::remove_first_n_elements(buffer, (int)length, remaining_data, (int)required_length);
-      buffer = remaining_data;
-      client_data.receiving_data = {};
+      const auto frame_length = static_cast<size_t>(state.frame_length);
+      offset = std::min(frame_length, partial.size()) - previous_size; //the frame may be shorter than what was taken
+      partial.resize(std::min(frame_length, partial.size()));
+    }
 
-    } else if (required_length == length) { //just enough data
-      remaining_length = 0;                 //we've used up all of the data
-      pending_item->buffer.insert(pending_item->buffer.end(), buffer, buffer + length);
-      frames.push_back(std::move(pending_item->buffer));
-      client_data.receiving_data = {};
+    const auto required_length = std::min(static_cast<size_t>(state.frame_length) - partial.size(), length - offset);
+    partial.insert(partial.end(), buffer + offset, buffer + offset + required_length);
+    offset += required_length;
 
-    } else {                //too little data
-      remaining_length = 0; //we've used up all of the data
-      pending_item->buffer.insert(pending_item->buffer.end(), buffer, buffer + length);
+    if (partial.size() < static_cast<size_t>(state.frame_length)) {
+      return true; //too little data, we've used up all of it
     }
+
+    //the frame is complete, frames from this read point into completed_frame, so that the next partial frame can go in partial_frame
+    std::swap(state.partial_frame, state.completed_frame);
+    state.partial_frame.clear();
+    state.frame_length = 0;
+    frames.push_back(decode_ws_frame(state.completed_frame.data(), state.completed_frame.size()));
   }
 
   //by this point, the data in the buffer is guaranteed to start with a new frame
-  while (remaining_length > 5) { //you only loop while greater than 5 bytes, since under 6 bytes may not have enough data to get the length
-    auto packet_length = get_ws_frame_length(buffer);
-
-    if (remaining_length >= packet_length) {
-      frames.emplace(frames.end(), buffer, buffer + packet_length);
-      char *remaining_data = nullptr;
-      utility::remove_first_n_elements(buffer, (int)remaining_length, remaining_data, (int)packet_length);
-      buffer = remaining_data;
-      remaining_length -= packet_length;
-    } else {
-      break;
+  int64_t frame_length = 0;
+  while (offset < length) {
+    frame_length = get_ws_frame_length(buffer + offset, length - offset);
+    if (frame_length < 0) {
+      return false;
     }
+    if (frame_length == 0 || static_cast<size_t>(frame_length) > length - offset) {
+      break; //split across reads
+    }
+
+    frames.push_back(decode_ws_frame(buffer + offset, frame_length));
+    offset += frame_length;
   }
 
-  //by this point only the beginnings of frames should be left, if the remaining_length is not 0
-  if (remaining_length > 0) {
-    auto *pending_item = &client_data.receiving_data;
-    pending_item->buffer = std::vector<char>(buffer, buffer + remaining_length);
-    if (remaining_length > 10) {
-      pending_item->length = get_ws_frame_length(buffer);
-    } else {
-      pending_item->length = -1;
-    }
+  //by this point only the beginning of a frame should be left, if there's anything left
+  if (offset < length) {
+    state.partial_frame.assign(buffer + offset, buffer + length);
+    state.frame_length = frame_length;
   }
 
-  return {1, frames};
+  return true;
 }
 
 template class web_server::basic_web_server<server_type::TLS>;
@@ -0,0 +1,110 @@
+#include "../header/web_server/workers.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+void append_field(std::string &output, std::string_view field) {
+  const uint64_t length = field.size();
+  output.append(reinterpret_cast<const char *>(&length), sizeof(length));
+  output.append(field);
+}
+
+auto read_field(std::string_view &input, std::string_view &field) -> bool { // false if there isn't a whole field left
+  uint64_t length{};
+  if (input.size() < sizeof(length)) {
+    return false;
+  }
+  std::memcpy(&length, input.data(), sizeof(length));
+  input.remove_prefix(sizeof(length));
+  if (input.size() < length) {
+    return false;
+  }
+  field = input.substr(0, length);
+  input.remove_prefix(length);
+  return true;
+}
+
+auto to_shared_buffer(std::string_view data) -> tcp_tls_server::shared_buffer {
+  auto copy = std::make_shared<const std::string>(data);
+  return tcp_tls_server::shared_buffer{copy, copy->data(), copy->size()};
+}
+} // namespace
+
+auto workers::send_message(int socket_fd, message_header header, std::string_view payload) -> bool {
+  header.payload_length = payload.size();
+  std::string message(reinterpret_cast<const char *>(&header), sizeof(header));
+  message.append(payload);
+
+  size_t sent = 0;
+  while (sent < message.size()) {
+    const auto result = send(socket_fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+    if (result <= 0) {
+      if (result == -1 && errno == EINTR) {
+        continue;
+      }
+      return false; // gone, or stuck for longer than the socket's send timeout
+    }
+    sent += result;
+  }
+  return true;
+}
+
+auto workers::serialise_snapshot(const web_cache::station_snapshot &snapshot) -> std::string {
+  const auto view = [](const tcp_tls_server::shared_buffer &buff) { return std::string_view(buff.buff, buff.length); };
+
+  std::string output{};
+  append_field(output, view(snapshot.station_list_response));
+  for (const auto &station : snapshot.stations) {
+    append_field(output, station.name);
+    append_field(output, std::to_string(station.id));
+    append_field(output, view(station.audio_list_response));
+    append_field(output, view(station.audio_queue_response));
+  }
+  return output;
+}
+
+auto workers::parse_snapshot(std::string_view payload) -> std::shared_ptr<const web_cache::station_snapshot> {
+  auto snapshot = std::make_shared<web_cache::station_snapshot>();
+
+  std::string_view station_list{};
+  if (!read_field(payload, station_list)) {
+    return nullptr;
+  }
+  snapshot->station_list_response = to_shared_buffer(station_list);
+
+  while (!payload.empty()) {
+    std::string_view name{}, id{}, audio_list{}, audio_queue{};
+    if (!read_field(payload, name) || !read_field(payload, id) || !read_field(payload, audio_list) || !read_field(payload, audio_queue)) {
+      return nullptr;
+    }
+    snapshot->stations.push_back({std::string(name), std::atoi(std::string(id).c_str()), to_shared_buffer(audio_list), to_shared_buffer(audio_queue), ogg_stream::response_header(name)}); // it's the same as the audio process's, so it isn't sent
+  }
+  return snapshot;
+}
+
+auto workers::spawn(int worker_idx, int segment_fd, int broadcast_efd, int socket_fd) -> pid_t {
+  // everything the child needs is made before forking, after that it can only make async signal safe calls until it's exec'd
+  auto idx = std::to_string(worker_idx);
+  char program[] = "/proc/self/exe";
+  char worker_flag[] = "--worker";
+  char *argv[] = {program, worker_flag, idx.data(), nullptr};
+
+  const pid_t pid = fork();
+  if (pid != 0) {
+    return pid;
+  }
+
+  const int fds[] = {fcntl(segment_fd, F_DUPFD, 16), fcntl(broadcast_efd, F_DUPFD, 16), fcntl(socket_fd, F_DUPFD, 16)}; // out of the way of 3 to 5 first
+  if (fds[0] == -1 || fds[1] == -1 || fds[2] == -1 || dup2(fds[0], SEGMENT_FD) == -1 || dup2(fds[1], BROADCAST_EFD) == -1 || dup2(fds[2], SOCKET_FD) == -1) {
+    _exit(127);
+  }
+  close_range(SOCKET_FD + 1, ~0U, 0); // none of the audio process's listeners, eventfds or files
+
+  execv(program, argv);
+  _exit(127);
+}
@@ -0,0 +1,242 @@
+#include "../header/web_server/web_server.h"
+#include "../vendor/json/single_include/nlohmann/json.hpp"
+
+using namespace web_server;
+using json = nlohmann::json;
+
+// Control messages on the station websocket, so that the page doesn't need a new HTTP request (and with Connection: close, a
+// new connection) for every action. The client sends JSON text frames like {"id": 1, "type": "skip"}, and gets back
+// {"id": 1, "type": "skip", "result": "..."}, the result being the same as the body of the matching HTTP endpoint's response.
+//   skip                      - votes to skip the current track
+//   request, "track"          - asks for a track to be queued
+//   queue, list               - the queue or the list of tracks
+//   subscribe, "topics"       - "queue" and/or "list", which are then pushed as {"type": "queue_update", "station": ..., "result": ...},
+//                               and "audio" and/or "metadata", whose chunks are sent as {"channel": "<station>/audio", "data": <chunk>}
+//                               with "after", the sequence number ("seq") of the last chunk it got, every chunk after that which is
+//                               still in the backlog is sent first, rather than the usual few, so a relay can resume without a gap
+//   unsubscribe, "topics"     - stops those
+// Requests are for the station the websocket connected on, unless there's a "station" in the request. Connections to /ws/mux
+// aren't for any station, they only get what they subscribe to, so one connection can be used for any number of stations.
+
+namespace {
+auto http_response_body(std::string_view response) -> std::string_view {
+  const auto header_end = response.find("\r\n\r\n");
+  return header_end == std::string_view::npos ? response : response.substr(header_end + 4);
+}
+
+auto get_string(const json &object, const char *key) -> std::string { // a string or nothing, other types aren't accepted
+  const auto item = object.find(key);
+  return item != object.end() && item->is_string() ? item->get<std::string>() : std::string{};
+}
+
+auto topic_channel_kind(const std::string &topic) -> int {
+  if (topic == "queue") {
+    return (int)channel_kind::queue_updates;
+  }
+  if (topic == "list") {
+    return (int)channel_kind::list_updates;
+  }
+  if (topic == "audio") {
+    return (int)channel_kind::audio_tagged;
+  }
+  if (topic == "metadata") {
+    return (int)channel_kind::metadata_tagged;
+  }
+  return -1;
+}
+
+void append_ws_payload(const tcp_tls_server::shared_buffer &frame, std::string &payload) { // for unmasked frames we've made, which may be fragmented
+  thread_local std::vector<tcp_tls_server::shared_buffer> fragments{};
+  split_ws_fragments(frame, fragments);
+  for (const auto &fragment : fragments) {
+    const auto length_byte = static_cast<uchar>(fragment.buff[1]) & 127;
+    const size_t header_size = length_byte == 127 ? 10 : (length_byte == 126 ? 4 : 2);
+    payload.append(fragment.buff + header_size, fragment.length - header_size);
+  }
+}
+} // namespace
+
+auto web_server::make_tagged_ws_frame(std::string_view station, std::string_view topic, const tcp_tls_server::shared_buffer &frame, bool deflate, size_t fragment_size) -> tcp_tls_server::shared_buffer {
+  // the payload is already JSON, so it's put in as it is rather than being parsed again
+  std::string tagged = "{\"channel\":";
+  tagged += json(std::string(station) + "/" + std::string(topic)).dump();
+  tagged += ",\"data\":";
+  append_ws_payload(frame, tagged);
+  tagged += "}";
+  return deflate ? make_shared_deflated_ws_frame(tagged, websocket_non_control_opcodes::text_frame, fragment_size)
+                 : make_shared_ws_frame(tagged, websocket_non_control_opcodes::text_frame, false, fragment_size);
+}
+
+auto web_server::make_burst_frames(const radio_channel &channel, const std::vector<tcp_tls_server::shared_buffer> &backlog, bool deflate, size_t fragment_size) -> std::vector<tcp_tls_server::shared_buffer> {
+  if (!is_tagged_channel(channel.kind)) {
+    return backlog;
+  }
+
+  std::vector<tcp_tls_server::shared_buffer> burst{};
+  burst.reserve(backlog.size());
+  for (const auto &frame : backlog) {
+    burst.push_back(make_tagged_ws_frame(channel.station, channel.connection_type, frame, deflate, fragment_size));
+  }
+  return burst;
+}
+
+auto web_server::make_ws_control_update(std::string_view type, std::string_view station, std::string_view result) -> tcp_tls_server::shared_buffer {
+  json update{};
+  update["type"] = std::string(type);
+  update["station"] = std::string(station);
+  update["result"] = std::string(result);
+  return make_shared_ws_frame(update.dump(), websocket_non_control_opcodes::text_frame);
+}
+
+template <server_type T>
+void basic_web_server<T>::websocket_control_cb(int ws_client_idx, std::string_view message) {
+  const auto request = json::parse(message.begin(), message.end(), nullptr, false); // no exceptions, it's discarded if it's invalid
+  if (request.is_discarded() || !request.is_object()) {
+    ws_control_reply(ws_client_idx, -1, "", "INVALID_REQUEST", true);
+    return;
+  }
+
+  const auto id_item = request.find("id");
+  const int64_t id = id_item != request.end() && id_item->is_number_integer() ? id_item->get<int64_t>() : -1;
+  const auto type = get_string(request, "type");
+
+  auto &client_data = websocket_clients[ws_client_idx];
+  auto station_name = get_string(request, "station");
+  if (station_name.empty()) {
+    station_name = client_data.station;
+  }
+
+  const auto *station = get_stations()->find(station_name);
+  if (station == nullptr) {
+    ws_control_reply(ws_client_idx, id, type, "INVALID_STATION", true);
+    return;
+  }
+
+  if (type == "queue") {
+    ws_control_reply(ws_client_idx, id, type, http_response_body({station->audio_queue_response.buff, station->audio_queue_response.length}));
+  } else if (type == "list") {
+    ws_control_reply(ws_client_idx, id, type, http_response_body({station->audio_list_response.buff, station->audio_list_response.length}));
+  } else if (type == "skip" || type == "request") {
+    const auto track = get_string(request, "track");
+    if (type == "request" && track.empty()) {
+      ws_control_reply(ws_client_idx, id, type, "FAILURE", true);
+      return;
+    }
+
+    const auto request_handle = new_ws_control_request(ws_client_idx, id, type);
+    if (request_handle == -1) {
+      ws_control_reply(ws_client_idx, id, type, "TOO_MANY_REQUESTS", true);
+      return;
+    }
+
+    // these go through the central thread just like the HTTP endpoints, the response comes back through http_write
+    if (type == "skip") {
+      post_skip_request_to_program(request_handle, station_name, client_data.ip);
+    } else {
+      post_audio_track_req_to_program(request_handle, station_name, track);
+    }
+  } else if (type == "subscribe" || type == "unsubscribe") {
+    const auto topics = request.find("topics");
+    if (topics == request.end() || !topics->is_array()) {
+      ws_control_reply(ws_client_idx, id, type, "INVALID_REQUEST", true);
+      return;
+    }
+
+    const auto after_item = request.find("after");
+    const int64_t after = after_item != request.end() && after_item->is_number_integer() ? after_item->get<int64_t>() : -1;
+
+    for (const auto &topic : *topics) {
+      const auto kind = topic.is_string() ? topic_channel_kind(topic.get<std::string>()) : -1;
+      if (kind == -1) {
+        continue;
+      }
+
+      const auto channel_id = broadcast_channel_id(station->id, static_cast<channel_kind>(kind));
+      if (type == "unsubscribe") {
+        auto &pending = client_data.pending_channels; // the central thread's answer is dropped if it's still on its way
+        pending.erase(std::remove(pending.begin(), pending.end(), channel_id), pending.end());
+        unsubscribe_client(channel_id, client_data.client_idx);
+      } else if (!is_chunk_channel(static_cast<channel_kind>(kind))) {
+        subscribe_client(channel_id, client_data.client_idx);
+      } else if (!is_subscribed(channel_id, client_data.client_idx) &&
+                 std::find(client_data.pending_channels.begin(), client_data.pending_channels.end(), channel_id) == client_data.pending_channels.end()) {
+        // the central thread sends the latest chunks first and then the subscription goes through, just like a station websocket
+        client_data.pending_channels.push_back(channel_id);
+        post_new_radio_client_to_program(station_name + "/" + topic.get<std::string>(), ws_client_idx, client_data.id, after);
+      }
+    }
+    ws_control_reply(ws_client_idx, id, type, "SUCCESS");
+  } else {
+    ws_control_reply(ws_client_idx, id, type, "UNKNOWN_TYPE", true);
+  }
+}
+
+template <server_type T>
+void basic_web_server<T>::ws_control_reply(int ws_client_idx, int64_t id, const std::string &type, std::string_view result, bool error) {
+  json reply{};
+  if (id != -1) {
+    reply["id"] = id;
+  }
+  reply["type"] = type;
+  reply[error ? "error" : "result"] = std::string(result);
+  websocket_write(ws_client_idx, make_ws_frame(reply.dump(), websocket_non_control_opcodes::text_frame), tcp_tls_server::write_priority::NEXT_MESSAGE); // ahead of any queued chunks
+}
+
+template <server_type T>
+auto basic_web_server<T>::new_ws_control_request(int ws_client_idx, int64_t id, std::string type) -> int {
+  auto &client_data = websocket_clients[ws_client_idx];
+  if (client_data.pending_control_requests >= WS_MAX_PENDING_CONTROL_REQUESTS) {
+    return -1;
+  }
+
+  int slot = -1;
+  if (!free_ws_control_slots.empty()) {
+    slot = free_ws_control_slots.back();
+    free_ws_control_slots.pop_back();
+  } else if (ws_control_requests.size() < (1 << WS_CONTROL_SLOT_BITS)) {
+    ws_control_requests.emplace_back();
+    slot = ws_control_requests.size() - 1;
+  } else {
+    return -1;
+  }
+
+  auto &request = ws_control_requests[slot];
+  request.ws_client_idx = ws_client_idx;
+  request.ws_client_id = client_data.id;
+  request.id = id;
+  request.type = std::move(type);
+  request.generation++;
+  request.active = true;
+
+  client_data.pending_control_requests++;
+  return ws_control_handle(slot, request.generation);
+}
+
+template <server_type T>
+void basic_web_server<T>::ws_control_respond(int request_handle, std::string_view http_response) {
+  const auto slot = handle_to_ws_control_slot(request_handle);
+  if (slot < 0 || size_t(slot) >= ws_control_requests.size()) {
+    return;
+  }
+
+  auto &request = ws_control_requests[slot];
+  if (!request.active || (request.generation & WS_CONTROL_GENERATION_MASK) != handle_to_ws_control_generation(request_handle)) {
+    return;
+  }
+  request.active = false;
+  free_ws_control_slots.push_back(slot);
+
+  // the websocket may have closed while the central thread was dealing with this, in which case there's nobody to respond to
+  auto &client_data = websocket_clients[request.ws_client_idx];
+  if (client_data.id != request.ws_client_id) {
+    return;
+  }
+  client_data.pending_control_requests--;
+
+  if (active_websocket_connections_client_idxs.count(client_data.client_idx) != 0U && tcp_clients[client_data.client_idx].ws_client_idx == request.ws_client_idx) {
+    ws_control_reply(request.ws_client_idx, request.id, request.type, http_response_body(http_response));
+  }
+}
+
+template class web_server::basic_web_server<server_type::TLS>;
+template class web_server::basic_web_server<server_type::NON_TLS>;
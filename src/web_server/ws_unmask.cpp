@@ -0,0 +1,89 @@
+#include "../header/web_server/ws_unmask.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+using unmask_function = void (*)(char *, size_t, const char *);
+
+// the blocks are all multiples of 4 bytes, so the key lines up with the start of whatever is left
+void unmask_tail(char *payload, size_t length, size_t offset, const char *masking_key) {
+  for (size_t i = offset; i < length; i++) {
+    payload[i] ^= masking_key[i & 3];
+  }
+}
+
+#if defined(__x86_64__)
+void unmask_sse2(char *payload, size_t length, const char *masking_key) { // SSE2 is always there on x86-64
+  int32_t key{};
+  std::memcpy(&key, masking_key, sizeof(key));
+  const __m128i key_vector = _mm_set1_epi32(key);
+
+  size_t i = 0;
+  for (; i + sizeof(__m128i) <= length; i += sizeof(__m128i)) {
+    auto *block = reinterpret_cast<__m128i *>(&payload[i]);
+    _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), key_vector));
+  }
+  unmask_tail(payload, length, i, masking_key);
+}
+
+__attribute__((target("avx2"))) void unmask_avx2(char *payload, size_t length, const char *masking_key) {
+  int32_t key{};
+  std::memcpy(&key, masking_key, sizeof(key));
+  const __m256i key_vector = _mm256_set1_epi32(key);
+
+  size_t i = 0;
+  for (; i + sizeof(__m256i) <= length; i += sizeof(__m256i)) {
+    auto *block = reinterpret_cast<__m256i *>(&payload[i]);
+    _mm256_storeu_si256(block, _mm256_xor_si256(_mm256_loadu_si256(block), key_vector));
+  }
+  if (i + sizeof(__m128i) <= length) { // a last half block
+    auto *block = reinterpret_cast<__m128i *>(&payload[i]);
+    _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), _mm256_castsi256_si128(key_vector)));
+    i += sizeof(__m128i);
+  }
+  unmask_tail(payload, length, i, masking_key);
+}
+#else
+void unmask_words(char *payload, size_t length, const char *masking_key) { // 8 bytes at a time
+  uint64_t key{};
+  std::memcpy(&key, masking_key, 4);
+  std::memcpy(reinterpret_cast<char *>(&key) + 4, masking_key, 4);
+
+  size_t i = 0;
+  for (; i + sizeof(key) <= length; i += sizeof(key)) {
+    uint64_t word{};
+    std::memcpy(&word, &payload[i], sizeof(word));
+    word ^= key;
+    std::memcpy(&payload[i], &word, sizeof(word));
+  }
+  unmask_tail(payload, length, i, masking_key);
+}
+#endif
+
+auto select_unmask() -> unmask_function {
+#if defined(__x86_64__)
+  __builtin_cpu_init(); // this runs during static initialisation, so it has to be called first
+  if (__builtin_cpu_supports("avx2")) {
+    return unmask_avx2;
+  }
+  return unmask_sse2;
+#else
+  return unmask_words;
+#endif
+}
+
+const unmask_function unmask = select_unmask();
+} // namespace
+
+void web_server::unmask_ws_payload(char *payload, size_t length, const char *masking_key) {
+  if (length < 8) { // not worth going through the function pointer for
+    unmask_tail(payload, length, 0, masking_key);
+    return;
+  }
+  unmask(payload, length, masking_key);
+}